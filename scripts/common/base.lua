@@ -567,6 +567,7 @@ function init_input(conf)
             upstream = instance.tail:stream(),
             name = conf.name,
             biss = conf.biss,
+            latency = conf.latency,
         })
         instance.tail = instance.decrypt
     elseif conf.cam == true then
@@ -601,6 +602,7 @@ function init_input(conf)
             disable_emm = conf.no_emm,
             ecm_pid = conf.ecm_pid,
             shift = conf.shift,
+            latency = conf.latency,
         })
         instance.tail = instance.decrypt
     end
@@ -1218,6 +1220,19 @@ init_input_module.t2mi = function(conf)
     end
 
     instance.clients = instance.clients + 1
+
+    -- channels sharing a decapsulator may each take a different PLP
+    if conf.addr ~= nil and #conf.addr > 0 and conf.plp ~= nil then
+        local plp = tonumber(conf.plp)
+        if plp == nil then
+            error("[" .. conf.name .. "] wrong PLP ID")
+        end
+        return transmit({
+            name = instance.name,
+            upstream = instance.t2mi:plp(plp),
+        })
+    end
+
     return instance.t2mi
 end
 
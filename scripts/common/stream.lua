@@ -344,6 +344,7 @@ init_output_module.udp = function(channel_data, output_id)
         rtp = (output_data.config.format == "rtp"),
         sync = output_data.config.sync,
         sync_opts = output_data.config.sync_opts,
+        sync_pacing = output_data.config.sync_pacing,
     })
 end
 
@@ -113,6 +113,13 @@
 #define __asc_result
 #endif /* !__GNUC__ */
 
+/* thread-local storage for per-loop core state */
+#ifdef __GNUC__
+#   define __asc_thread __thread
+#else /* __GNUC__ */
+#   define __asc_thread _Thread_local
+#endif /* !__GNUC__ */
+
 static inline
 uint32_t asc_get_be32(const void *ptr)
 {
@@ -0,0 +1,160 @@
+/*
+ * Astra Core (Packet blocks)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <astra/astra.h>
+#include <astra/core/block.h>
+
+#define MSG(_msg) "[core/block] " _msg
+
+struct asc_block_pool_t
+{
+    size_t size;
+    bool is_closed;
+
+    /* idle blocks ready for reuse */
+    asc_block_t **idle;
+    size_t idle_cnt;
+    size_t max_idle;
+
+    asc_block_stats_t stats;
+};
+
+/* block header and its buffer share a single allocation */
+#define BLOCK_HDR_SIZE \
+    ((sizeof(asc_block_t) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+asc_block_pool_t *asc_block_pool_init(size_t size, size_t max_idle)
+{
+    ASC_ASSERT(size >= TS_PACKET_SIZE, MSG("block can't fit a TS packet"));
+
+    asc_block_pool_t *const pool = ASC_ALLOC(1, asc_block_pool_t);
+
+    pool->size = size;
+    pool->max_idle = max_idle;
+    if (max_idle > 0)
+        pool->idle = ASC_ALLOC(max_idle, asc_block_t *);
+
+    return pool;
+}
+
+static
+void pool_free(asc_block_pool_t *pool)
+{
+    for (size_t i = 0; i < pool->idle_cnt; i++)
+        free(pool->idle[i]);
+
+    free(pool->idle);
+    free(pool);
+}
+
+/* NOTE: blocks still in use keep the pool alive until released */
+void asc_block_pool_destroy(asc_block_pool_t *pool)
+{
+    pool->is_closed = true;
+
+    if (pool->stats.active == 0)
+        pool_free(pool);
+}
+
+void asc_block_pool_stats(const asc_block_pool_t *pool
+                          , asc_block_stats_t *stats)
+{
+    *stats = pool->stats;
+}
+
+static
+asc_block_t *block_new(asc_block_pool_t *pool)
+{
+    asc_block_t *block;
+
+    if (pool->idle_cnt > 0)
+    {
+        block = pool->idle[--pool->idle_cnt];
+        pool->stats.reuses++;
+    }
+    else
+    {
+        block = (asc_block_t *)ASC_ALLOC(BLOCK_HDR_SIZE + pool->size
+                                         , uint8_t);
+
+        block->buffer = (uint8_t *)block + BLOCK_HDR_SIZE;
+        block->size = pool->size;
+        block->pool = pool;
+        pool->stats.allocs++;
+    }
+
+    block->data = block->buffer;
+    block->cnt = 0;
+    block->refcnt = 1;
+    pool->stats.active++;
+
+    return block;
+}
+
+/* get an empty block; its data pointer is set to the start of buffer */
+asc_block_t *asc_block_alloc(asc_block_pool_t *pool)
+{
+    ASC_ASSERT(!pool->is_closed, MSG("allocating from a closed pool"));
+
+    return block_new(pool);
+}
+
+void asc_block_release(asc_block_t *block)
+{
+    ASC_ASSERT(block->refcnt > 0, MSG("block already released"));
+
+    if (--block->refcnt > 0)
+        return;
+
+    asc_block_pool_t *const pool = block->pool;
+    pool->stats.active--;
+
+    if (!pool->is_closed && pool->idle_cnt < pool->max_idle)
+        pool->idle[pool->idle_cnt++] = block;
+    else
+        free(block);
+
+    if (pool->is_closed && pool->stats.active == 0)
+        pool_free(pool);
+}
+
+/*
+ * Copy on write: return the block itself if the caller holds the only
+ * reference, otherwise a private copy of its packets. Caller's reference
+ * to the original block is transferred to the returned one.
+ */
+asc_block_t *asc_block_writable(asc_block_t *block)
+{
+    if (block->refcnt == 1)
+        return block;
+
+    /* NOTE: pool may already be closed; our reference keeps it alive */
+    asc_block_pool_t *const pool = block->pool;
+    asc_block_t *const copy = block_new(pool);
+
+    copy->data = &copy->buffer[block->data - block->buffer];
+    copy->cnt = block->cnt;
+    memcpy(copy->data, block->data, block->cnt * TS_PACKET_SIZE);
+    pool->stats.copies++;
+
+    asc_block_release(block);
+
+    return copy;
+}
@@ -0,0 +1,88 @@
+/*
+ * Astra Core (Packet blocks)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASC_BLOCK_H_
+#define _ASC_BLOCK_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+/*
+ * Reference counted blocks of TS packets. A source fills a block once
+ * and passes it down the stream tree; consumers that need to keep the
+ * data around take a reference instead of copying the packets. Blocks
+ * are recycled through the pool they were allocated from.
+ *
+ * NOTE: reference counts are not atomic; blocks must only be used
+ *       on the main thread.
+ */
+
+typedef struct asc_block_pool_t asc_block_pool_t;
+
+typedef struct
+{
+    /* packets carried by this block; set by whoever fills it */
+    uint8_t *data;
+    size_t cnt;
+
+    /* read-only */
+    uint8_t *buffer;
+    size_t size;
+
+    unsigned int refcnt;
+    asc_block_pool_t *pool;
+} asc_block_t;
+
+typedef struct
+{
+    uint64_t allocs;
+    uint64_t reuses;
+    uint64_t copies;
+    size_t active;
+} asc_block_stats_t;
+
+asc_block_pool_t *asc_block_pool_init(size_t size, size_t max_idle) __asc_result;
+void asc_block_pool_destroy(asc_block_pool_t *pool);
+void asc_block_pool_stats(const asc_block_pool_t *pool
+                          , asc_block_stats_t *stats);
+
+asc_block_t *asc_block_alloc(asc_block_pool_t *pool) __asc_result;
+void asc_block_release(asc_block_t *block);
+asc_block_t *asc_block_writable(asc_block_t *block) __asc_result;
+
+static inline
+asc_block_t *asc_block_retain(asc_block_t *block)
+{
+    block->refcnt++;
+    return block;
+}
+
+/* number of bytes that can still be appended after the last packet */
+static inline __asc_result
+size_t asc_block_space(const asc_block_t *block)
+{
+    const size_t used = (block->data - block->buffer)
+                        + (block->cnt * TS_PACKET_SIZE);
+
+    return block->size - used;
+}
+
+#endif /* _ASC_BLOCK_H_ */
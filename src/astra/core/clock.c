@@ -51,6 +51,28 @@ uint64_t asc_utime(void)
 #endif /* !_WIN32 */
 }
 
+/* wake up time of this thread's event loop, 0 if it hasn't run yet */
+static __asc_thread uint64_t loop_time = 0;
+
+/* called by event and timer loops each time they wake up */
+uint64_t asc_loop_time_update(void)
+{
+    loop_time = asc_utime();
+    return loop_time;
+}
+
+/*
+ * return asc_utime() as of the current event loop iteration; cheaper
+ * than reading the clock for every packet delivered in that iteration
+ */
+uint64_t asc_loop_time(void)
+{
+    if (loop_time == 0)
+        return asc_utime();
+
+    return loop_time;
+}
+
 /* block calling thread for `usec' or more microseconds */
 void asc_usleep(uint64_t usec)
 {
@@ -27,6 +27,8 @@
 #endif /* !_ASTRA_H_ */
 
 uint64_t asc_utime(void) __asc_result;
+uint64_t asc_loop_time(void) __asc_result;
+uint64_t asc_loop_time_update(void);
 void asc_usleep(uint64_t usec);
 #ifndef _WIN32
 void asc_rtctime(struct timespec *ts, unsigned long offset_ms);
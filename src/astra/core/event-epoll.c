@@ -29,10 +29,25 @@
 
 #define MSG(_msg) "[event-epoll] " _msg
 
+/* pack fd and sequence number into epoll user data */
+#define EVENT_DATA(_event) \
+    (((uint64_t)(_event)->seq << 32) | (uint32_t)(_event)->fd)
+
+#define EVENT_DATA_FD(_data) ((int)((_data) & 0xFFFFFFFF))
+#define EVENT_DATA_SEQ(_data) ((uint32_t)((_data) >> 32))
+
 typedef struct
 {
-    asc_list_t *list;
-    bool is_changed;
+    /* registered events, indexed by fd */
+    asc_event_t **table;
+    size_t table_size;
+    size_t count;
+    uint32_t seq;
+
+    /* events with pending epoll_ctl() updates */
+    asc_event_t **dirty;
+    size_t dirty_cnt;
+    size_t dirty_size;
 
     int fd;
     struct epoll_event *out;
@@ -41,50 +56,143 @@ typedef struct
 
 static asc_event_mgr_t *event_mgr = NULL;
 
-void asc_event_core_init(void)
+void EVENT_EPOLL(core_init)(void)
 {
     event_mgr = ASC_ALLOC(1, asc_event_mgr_t);
-    event_mgr->list = asc_list_init();
 
+#ifdef HAVE_EPOLL_CREATE1
+    event_mgr->fd = epoll_create1(EPOLL_CLOEXEC);
+#else
     event_mgr->fd = epoll_create(256);
+#endif
     ASC_ASSERT(event_mgr->fd != -1
                , MSG("epoll_create(): %s"), strerror(errno));
 }
 
-void asc_event_core_destroy(void)
+void EVENT_EPOLL(core_destroy)(void)
 {
     if (event_mgr == NULL)
         return;
 
-    asc_event_t *event, *prev = NULL;
-    asc_list_till_empty(event_mgr->list)
+    asc_event_t *prev = NULL;
+    for (size_t i = 0; i < event_mgr->table_size; i++)
     {
-        event = (asc_event_t *)asc_list_data(event_mgr->list);
-        ASC_ASSERT(event != prev, MSG("on_error didn't close event"));
+        while (event_mgr->table[i] != NULL)
+        {
+            asc_event_t *const event = event_mgr->table[i];
+            ASC_ASSERT(event != prev, MSG("on_error didn't close event"));
 
-        if (event->on_error != NULL)
-            event->on_error(event->arg);
-        else
-            asc_event_close(event);
+            if (event->on_error != NULL)
+                event->on_error(event->arg);
+            else
+                EVENT_EPOLL(close)(event);
 
-        prev = event;
+            prev = event;
+        }
     }
 
     close(event_mgr->fd);
 
-    ASC_FREE(event_mgr->list, asc_list_destroy);
+    ASC_FREE(event_mgr->table, free);
+    ASC_FREE(event_mgr->dirty, free);
     ASC_FREE(event_mgr->out, free);
     ASC_FREE(event_mgr, free);
 }
 
-bool asc_event_core_loop(unsigned int timeout)
+static inline
+asc_event_t *find_event(uint64_t data)
+{
+    const int fd = EVENT_DATA_FD(data);
+    if (fd < 0 || (size_t)fd >= event_mgr->table_size)
+        return NULL;
+
+    asc_event_t *const event = event_mgr->table[fd];
+    if (event == NULL || event->seq != EVENT_DATA_SEQ(data))
+        return NULL; /* closed or replaced by a callback */
+
+    return event;
+}
+
+static inline
+uint32_t event_mask(const asc_event_t *event)
+{
+    uint32_t mask = (EPOLLERR | EPOLLHUP);
+
+    if (event->on_read)
+        mask |= (EPOLLIN | EPOLLRDHUP);
+    if (event->on_write)
+        mask |= EPOLLOUT;
+    if (event->on_error)
+        mask |= EPOLLPRI;
+    if (event->is_edge)
+        mask |= EPOLLET;
+
+    return mask;
+}
+
+/* apply pending subscription changes */
+static
+void flush_dirty(void)
+{
+    for (size_t i = 0; i < event_mgr->dirty_cnt; i++)
+    {
+        asc_event_t *const event = event_mgr->dirty[i];
+        event->is_dirty = false;
+
+        const uint32_t mask = event_mask(event);
+        if (mask == event->mask)
+            continue;
+
+        struct epoll_event ed = {
+            .events = mask,
+            .data = {
+                .u64 = EVENT_DATA(event),
+            },
+        };
+
+        const int ret = epoll_ctl(event_mgr->fd, EPOLL_CTL_MOD
+                                  , event->fd, &ed);
+        if (ret != 0)
+        {
+            asc_log_error(MSG("epoll_ctl(): couldn't change fd %d: %s")
+                          , event->fd, strerror(errno));
+        }
+
+        event->mask = mask;
+    }
+
+    event_mgr->dirty_cnt = 0;
+}
+
+static
+void resize_event_list(void)
+{
+    const size_t new_size = asc_list_calc_size(event_mgr->count
+                                               , event_mgr->out_size
+                                               , EVENT_LIST_MIN_SIZE);
+
+    if (event_mgr->out_size != new_size)
+    {
+        const size_t bytes = new_size * sizeof(*event_mgr->out);
+        event_mgr->out = (struct epoll_event *)realloc(event_mgr->out, bytes);
+        ASC_ASSERT(event_mgr->out != NULL, MSG("realloc() failed"));
+
+        event_mgr->out_size = new_size;
+    }
+}
+
+bool EVENT_EPOLL(core_loop)(unsigned int timeout)
 {
-    if (asc_list_count(event_mgr->list) == 0)
+    if (event_mgr->count == 0)
     {
         asc_usleep(timeout * 1000ULL); /* dry run */
         return true;
     }
 
+    /* never resized during dispatch, callbacks may open or close events */
+    resize_event_list();
+    flush_dirty();
+
     const int ret = epoll_wait(event_mgr->fd, event_mgr->out
                                , event_mgr->out_size, timeout);
 
@@ -94,91 +202,105 @@ bool asc_event_core_loop(unsigned int timeout)
         return false;
     }
 
-    event_mgr->is_changed = false;
+    /* callbacks below see this time through asc_loop_time() */
+    asc_loop_time_update();
+
     for (int i = 0; i < ret; i++)
     {
         const struct epoll_event *ed = &event_mgr->out[i];
-        const asc_event_t *event = (asc_event_t *)ed->data.ptr;
+        const uint64_t data = ed->data.u64;
 
         const bool is_rd = ed->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP);
         const bool is_wr = ed->events & EPOLLOUT;
         const bool is_er = ed->events & (EPOLLERR | EPOLLHUP | EPOLLPRI);
 
-        if (event->on_read && is_rd)
+        /* event may get closed by any of its callbacks */
+        const asc_event_t *event = find_event(data);
+
+        if (event != NULL && event->on_read && is_rd)
         {
             event->on_read(event->arg);
-            if (event_mgr->is_changed)
-                break;
+            event = find_event(data);
         }
-        if (event->on_error && is_er)
+        if (event != NULL && event->on_error && is_er)
         {
             event->on_error(event->arg);
-            if (event_mgr->is_changed)
-                break;
+            event = find_event(data);
         }
-        if (event->on_write && is_wr)
+        if (event != NULL && event->on_write && is_wr)
         {
             event->on_write(event->arg);
-            if (event_mgr->is_changed)
-                break;
         }
     }
 
     return true;
 }
 
-void asc_event_subscribe(asc_event_t *event)
+void EVENT_EPOLL(subscribe)(asc_event_t *event)
 {
-    struct epoll_event ed = {
-        .events = (EPOLLERR | EPOLLHUP),
-        .data = {
-            .ptr = event,
-        },
-    };
-
-    if (event->on_read)
-        ed.events |= (EPOLLIN | EPOLLRDHUP);
-    if (event->on_write)
-        ed.events |= EPOLLOUT;
-    if (event->on_error)
-        ed.events |= EPOLLPRI;
+    if (event->is_dirty)
+        return;
 
-    const int ret = epoll_ctl(event_mgr->fd, EPOLL_CTL_MOD, event->fd, &ed);
-    if (ret != 0)
+    if (event_mgr->dirty_cnt >= event_mgr->dirty_size)
     {
-        asc_log_error(MSG("epoll_ctl(): couldn't change fd %d: %s")
-                      , event->fd, strerror(errno));
+        const size_t new_size = asc_list_calc_size(event_mgr->dirty_cnt + 1
+                                                   , event_mgr->dirty_size
+                                                   , EVENT_LIST_MIN_SIZE);
+
+        const size_t bytes = new_size * sizeof(*event_mgr->dirty);
+        event_mgr->dirty = (asc_event_t **)realloc(event_mgr->dirty, bytes);
+        ASC_ASSERT(event_mgr->dirty != NULL, MSG("realloc() failed"));
+
+        event_mgr->dirty_size = new_size;
     }
+
+    event_mgr->dirty[event_mgr->dirty_cnt++] = event;
+    event->is_dirty = true;
 }
 
 static
-void resize_event_list(void)
+void resize_event_table(int fd)
 {
-    const size_t ev_cnt = asc_list_count(event_mgr->list);
-    const size_t new_size = asc_list_calc_size(ev_cnt, event_mgr->out_size
-                                               , EVENT_LIST_MIN_SIZE);
+    const size_t count = (size_t)fd + 1;
+    if (count <= event_mgr->table_size)
+        return;
 
-    if (event_mgr->out_size != new_size)
-    {
-        const size_t bytes = new_size * sizeof(*event_mgr->out);
-        event_mgr->out = (struct epoll_event *)realloc(event_mgr->out, bytes);
-        ASC_ASSERT(event_mgr->out != NULL, MSG("realloc() failed"));
+    size_t new_size = event_mgr->table_size;
+    if (new_size < EVENT_LIST_MIN_SIZE)
+        new_size = EVENT_LIST_MIN_SIZE;
 
-        event_mgr->out_size = new_size;
-    }
+    while (new_size < count)
+        new_size *= 2;
+
+    const size_t bytes = new_size * sizeof(*event_mgr->table);
+    event_mgr->table = (asc_event_t **)realloc(event_mgr->table, bytes);
+    ASC_ASSERT(event_mgr->table != NULL, MSG("realloc() failed"));
+
+    memset(&event_mgr->table[event_mgr->table_size], 0
+           , (new_size - event_mgr->table_size) * sizeof(*event_mgr->table));
+
+    event_mgr->table_size = new_size;
 }
 
-asc_event_t *asc_event_init(int fd, void *arg)
+asc_event_t *EVENT_EPOLL(init)(int fd, void *arg)
 {
+    ASC_ASSERT(fd >= 0, MSG("invalid fd %d"), fd);
+
+    resize_event_table(fd);
+    ASC_ASSERT(event_mgr->table[fd] == NULL
+               , MSG("fd %d is already registered"), fd);
+
     asc_event_t *const event = ASC_ALLOC(1, asc_event_t);
 
     event->fd = fd;
     event->arg = arg;
+    event->seq = ++event_mgr->seq;
+    event->mask = (EPOLLERR | EPOLLHUP);
 
     struct epoll_event ed = {
-        .events = (EPOLLERR | EPOLLHUP),
+        .events = event->mask,
         .data = {
-            .ptr = event,
+            .u64 = EVENT_DATA(event),
         },
     };
 
@@ -189,14 +311,13 @@ asc_event_t *asc_event_init(int fd, void *arg)
                       , event->fd, strerror(errno));
     }
 
-    asc_list_insert_tail(event_mgr->list, event);
-    event_mgr->is_changed = true;
-    resize_event_list();
+    event_mgr->table[fd] = event;
+    event_mgr->count++;
 
     return event;
 }
 
-void asc_event_close(asc_event_t *event)
+void EVENT_EPOLL(close)(asc_event_t *event)
 {
     /* NOTE: pre-2.6.9 kernels require non-NULL pointer to event struct */
     struct epoll_event ed = {
@@ -210,9 +331,20 @@ void asc_event_close(asc_event_t *event)
                       , event->fd, strerror(errno));
     }
 
-    asc_list_remove_item(event_mgr->list, event);
-    event_mgr->is_changed = true;
-    resize_event_list();
+    if (event->is_dirty)
+    {
+        for (size_t i = 0; i < event_mgr->dirty_cnt; i++)
+        {
+            if (event_mgr->dirty[i] == event)
+            {
+                event_mgr->dirty[i] = event_mgr->dirty[--event_mgr->dirty_cnt];
+                break;
+            }
+        }
+    }
+
+    event_mgr->table[event->fd] = NULL;
+    event_mgr->count--;
 
     free(event);
 }
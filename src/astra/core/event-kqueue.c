@@ -97,6 +97,9 @@ bool asc_event_core_loop(unsigned int timeout)
         return false;
     }
 
+    /* callbacks below see this time through asc_loop_time() */
+    asc_loop_time_update();
+
     event_mgr->is_changed = false;
     for (int i = 0; i < ret; i++)
     {
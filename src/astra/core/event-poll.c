@@ -191,6 +191,9 @@ bool asc_event_core_loop(unsigned int timeout)
         return false;
     }
 
+    /* callbacks below see this time through asc_loop_time() */
+    asc_loop_time_update();
+
     event_mgr->is_changed = false;
     for (size_t i = 0; i < event_mgr->ev_cnt && ret > 0; i++)
     {
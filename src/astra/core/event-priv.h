@@ -33,6 +33,14 @@ struct asc_event_t
     event_callback_t on_write;
     event_callback_t on_error;
     void *arg;
+    bool is_edge;
+
+#ifdef WITH_EVENT_EPOLL
+    /* registered event mask and pending update flag */
+    uint32_t seq;
+    uint32_t mask;
+    bool is_dirty;
+#endif
 
 #if defined(_WIN32) && defined(WITH_EVENT_POLL)
     /* these are for WSAPoll non-blocking connect() workaround */
@@ -43,6 +51,24 @@ struct asc_event_t
 
 void asc_event_subscribe(asc_event_t *event);
 
+#ifdef WITH_EVENT_URING
+/*
+ * io_uring backend falls back to epoll if the kernel can't do what it
+ * needs; the epoll backend is built under these names for it to call.
+ */
+#   define EVENT_EPOLL(_name) asc_event_epoll_##_name
+
+void asc_event_epoll_core_init(void);
+bool asc_event_epoll_core_loop(unsigned int timeout) __asc_result;
+void asc_event_epoll_core_destroy(void);
+
+asc_event_t *asc_event_epoll_init(int fd, void *arg) __asc_result;
+void asc_event_epoll_close(asc_event_t *event);
+void asc_event_epoll_subscribe(asc_event_t *event);
+#else
+#   define EVENT_EPOLL(_name) asc_event_##_name
+#endif /* !WITH_EVENT_URING */
+
 /* minimum size for output arrays */
 #define EVENT_LIST_MIN_SIZE 1024
 
@@ -136,6 +136,9 @@ bool asc_event_core_loop(unsigned int timeout)
         return false;
     }
 
+    /* callbacks below see this time through asc_loop_time() */
+    asc_loop_time_update();
+
     event_mgr->is_changed = false;
     for (asc_list_first(event_mgr->list)
          ; !asc_list_eol(event_mgr->list) && ret > 0
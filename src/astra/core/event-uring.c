@@ -0,0 +1,618 @@
+/*
+ * Astra Core (Event notification)
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "event-priv.h"
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define MSG(_msg) "[event-uring] " _msg
+
+/*
+ * Readiness notification through io_uring poll requests. Edge-triggered
+ * events get a multishot poll that stays armed; level-triggered ones get
+ * a single-shot poll which is rearmed on the next loop iteration, after
+ * the callbacks had a chance to consume the data. Subscription changes
+ * are queued and submitted along with the wait, so a loop iteration
+ * costs one io_uring_enter() call.
+ *
+ * Needs Linux 5.13 or later. On older kernels, or where io_uring is
+ * disabled, the epoll backend takes over.
+ */
+
+/* submission queue size; fills are submitted early */
+#define URING_SQ_ENTRIES 256
+/* completion queue size; every event may fire on a single iteration */
+#define URING_CQ_ENTRIES 4096
+
+/* feature flags we rely on; RSRC_TAGS came with multishot poll in 5.13 */
+#define URING_FEATURES (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP \
+                        | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS)
+
+/* pack fd and sequence number into request user data; 0 is never used */
+#define EVENT_DATA(_event) \
+    (((uint64_t)(_event)->seq << 32) | (uint32_t)(_event)->fd)
+
+#define EVENT_DATA_FD(_data) ((int)((_data) & 0xFFFFFFFF))
+#define EVENT_DATA_SEQ(_data) ((uint32_t)((_data) >> 32))
+
+#define ring_load(_ptr) __atomic_load_n((_ptr), __ATOMIC_ACQUIRE)
+#define ring_store(_ptr, _val) __atomic_store_n((_ptr), (_val), __ATOMIC_RELEASE)
+
+typedef struct
+{
+    /* registered events, indexed by fd */
+    asc_event_t **table;
+    size_t table_size;
+    size_t count;
+    uint32_t seq;
+
+    /* events waiting to be armed or rearmed */
+    asc_event_t **dirty;
+    size_t dirty_cnt;
+    size_t dirty_size;
+
+    int fd;
+    void *ring;
+    size_t ring_size;
+
+    /* submission queue */
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_local;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    /* completion queue */
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+} asc_event_mgr_t;
+
+static asc_event_mgr_t *event_mgr = NULL;
+static bool use_epoll = false;
+
+/*
+ * ring setup
+ */
+
+static inline
+int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline
+int uring_enter(unsigned int to_submit, unsigned int min_complete
+                , unsigned int flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, event_mgr->fd, to_submit
+                   , min_complete, flags, arg, argsz);
+}
+
+static
+bool ring_open(void)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+
+    event_mgr->fd = uring_setup(URING_SQ_ENTRIES, &p);
+    if (event_mgr->fd == -1)
+        return false;
+
+    if ((p.features & URING_FEATURES) != URING_FEATURES)
+    {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    /* single mapping holds both rings */
+    const size_t sq_size = p.sq_off.array
+                           + p.sq_entries * sizeof(unsigned int);
+    const size_t cq_size = p.cq_off.cqes
+                           + p.cq_entries * sizeof(struct io_uring_cqe);
+    event_mgr->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+
+    event_mgr->ring = mmap(NULL, event_mgr->ring_size
+                           , PROT_READ | PROT_WRITE
+                           , MAP_SHARED | MAP_POPULATE
+                           , event_mgr->fd, IORING_OFF_SQ_RING);
+    if (event_mgr->ring == MAP_FAILED)
+    {
+        event_mgr->ring = NULL;
+        return false;
+    }
+
+    event_mgr->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    event_mgr->sqes = (struct io_uring_sqe *)mmap(NULL, event_mgr->sqes_size
+                                                  , PROT_READ | PROT_WRITE
+                                                  , MAP_SHARED | MAP_POPULATE
+                                                  , event_mgr->fd
+                                                  , IORING_OFF_SQES);
+    if (event_mgr->sqes == MAP_FAILED)
+    {
+        event_mgr->sqes = NULL;
+        return false;
+    }
+
+    uint8_t *const ring = (uint8_t *)event_mgr->ring;
+
+    event_mgr->sq_head = (unsigned int *)&ring[p.sq_off.head];
+    event_mgr->sq_tail = (unsigned int *)&ring[p.sq_off.tail];
+    event_mgr->sq_mask = *(unsigned int *)&ring[p.sq_off.ring_mask];
+    event_mgr->sq_entries = p.sq_entries;
+    event_mgr->sq_local = *event_mgr->sq_tail;
+
+    /* SQE slots are used in order; map them one to one */
+    unsigned int *const array = (unsigned int *)&ring[p.sq_off.array];
+    for (unsigned int i = 0; i < p.sq_entries; i++)
+        array[i] = i;
+
+    event_mgr->cq_head = (unsigned int *)&ring[p.cq_off.head];
+    event_mgr->cq_tail = (unsigned int *)&ring[p.cq_off.tail];
+    event_mgr->cq_mask = *(unsigned int *)&ring[p.cq_off.ring_mask];
+    event_mgr->cqes = (struct io_uring_cqe *)&ring[p.cq_off.cqes];
+
+    return true;
+}
+
+static
+void ring_close(void)
+{
+    if (event_mgr->sqes != NULL)
+        munmap(event_mgr->sqes, event_mgr->sqes_size);
+
+    if (event_mgr->ring != NULL)
+        munmap(event_mgr->ring, event_mgr->ring_size);
+
+    if (event_mgr->fd != -1)
+        close(event_mgr->fd);
+}
+
+/*
+ * submission
+ */
+
+/* SQEs queued but not yet picked up by the kernel */
+static inline
+unsigned int sq_pending(void)
+{
+    return event_mgr->sq_local - ring_load(event_mgr->sq_head);
+}
+
+static
+void sq_submit(void)
+{
+    ring_store(event_mgr->sq_tail, event_mgr->sq_local);
+
+    const unsigned int pending = sq_pending();
+    if (pending > 0 && uring_enter(pending, 0, 0, NULL, 0) == -1)
+        asc_log_error(MSG("io_uring_enter(): %s"), strerror(errno));
+}
+
+static
+struct io_uring_sqe *sq_get(void)
+{
+    if (sq_pending() >= event_mgr->sq_entries)
+        sq_submit();
+
+    const unsigned int idx = event_mgr->sq_local & event_mgr->sq_mask;
+    struct io_uring_sqe *const sqe = &event_mgr->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    event_mgr->sq_local++;
+
+    return sqe;
+}
+
+static
+void poll_add(asc_event_t *event, uint32_t mask)
+{
+    struct io_uring_sqe *const sqe = sq_get();
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    /* kernel reads poll32_events as two swapped halves */
+    mask = (mask << 16) | (mask >> 16);
+#endif
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = event->fd;
+    sqe->poll32_events = mask;
+    sqe->len = (event->is_edge ? IORING_POLL_ADD_MULTI : 0);
+    sqe->user_data = EVENT_DATA(event);
+}
+
+static
+void poll_remove(uint64_t data)
+{
+    struct io_uring_sqe *const sqe = sq_get();
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->user_data = 0;
+}
+
+/*
+ * event loop
+ */
+
+void asc_event_core_init(void)
+{
+    event_mgr = ASC_ALLOC(1, asc_event_mgr_t);
+    event_mgr->fd = -1;
+
+    if (!ring_open())
+    {
+        asc_log_info(MSG("io_uring unavailable (%s), using epoll")
+                     , strerror(errno));
+
+        ring_close();
+        ASC_FREE(event_mgr, free);
+
+        use_epoll = true;
+        asc_event_epoll_core_init();
+    }
+}
+
+void asc_event_core_destroy(void)
+{
+    if (use_epoll)
+    {
+        asc_event_epoll_core_destroy();
+        use_epoll = false;
+
+        return;
+    }
+
+    if (event_mgr == NULL)
+        return;
+
+    asc_event_t *prev = NULL;
+    for (size_t i = 0; i < event_mgr->table_size; i++)
+    {
+        while (event_mgr->table[i] != NULL)
+        {
+            asc_event_t *const event = event_mgr->table[i];
+            ASC_ASSERT(event != prev, MSG("on_error didn't close event"));
+
+            if (event->on_error != NULL)
+                event->on_error(event->arg);
+            else
+                asc_event_close(event);
+
+            prev = event;
+        }
+    }
+
+    ring_close();
+
+    ASC_FREE(event_mgr->table, free);
+    ASC_FREE(event_mgr->dirty, free);
+    ASC_FREE(event_mgr, free);
+}
+
+static inline
+asc_event_t *find_event(uint64_t data)
+{
+    const int fd = EVENT_DATA_FD(data);
+    if (fd < 0 || (size_t)fd >= event_mgr->table_size)
+        return NULL;
+
+    asc_event_t *const event = event_mgr->table[fd];
+    if (event == NULL || event->seq != EVENT_DATA_SEQ(data))
+        return NULL; /* closed or rearmed with a different mask */
+
+    return event;
+}
+
+static inline
+uint32_t event_mask(const asc_event_t *event)
+{
+    uint32_t mask = (EPOLLERR | EPOLLHUP);
+
+    if (event->on_error)
+        mask |= EPOLLPRI;
+
+    if (event->on_read)
+        mask |= (EPOLLIN | EPOLLRDHUP);
+    if (event->on_write)
+        mask |= EPOLLOUT;
+    if (event->is_edge)
+        mask |= EPOLLET;
+
+    return mask;
+}
+
+static inline
+void next_seq(asc_event_t *event)
+{
+    if (++event_mgr->seq == 0)
+        ++event_mgr->seq;
+
+    event->seq = event_mgr->seq;
+}
+
+/* queue poll requests for new, changed and fired single-shot events */
+static
+void flush_dirty(void)
+{
+    for (size_t i = 0; i < event_mgr->dirty_cnt; i++)
+    {
+        asc_event_t *const event = event_mgr->dirty[i];
+        event->is_dirty = false;
+
+        const uint32_t mask = event_mask(event);
+        if (mask == event->mask)
+            continue;
+
+        if (event->mask != 0)
+            poll_remove(EVENT_DATA(event));
+
+        /* completions of the old request won't match anymore */
+        next_seq(event);
+        poll_add(event, mask);
+
+        event->mask = mask;
+    }
+
+    event_mgr->dirty_cnt = 0;
+}
+
+static
+void on_completion(uint64_t data, int res, uint32_t flags)
+{
+    if (data == 0)
+        return; /* poll removal */
+
+    asc_event_t *event = find_event(data);
+    if (event == NULL)
+        return;
+
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        /* single-shot poll fired or multishot was terminated */
+        event->mask = 0;
+
+        if (res >= 0 || res == -ECANCELED)
+            asc_event_subscribe(event);
+    }
+
+    uint32_t revents = res;
+    if (res < 0)
+    {
+        if (res == -ECANCELED)
+            return;
+
+        asc_log_error(MSG("poll failed on fd %d: %s")
+                      , event->fd, strerror(-res));
+
+        revents = EPOLLERR;
+    }
+
+    /*
+     * Poll requests may complete with the wake-up mask as is, and
+     * sockets wake their readers with EPOLLPRI set whether or not
+     * there is urgent data. Ask the file before reporting it.
+     */
+    if (revents & EPOLLPRI)
+    {
+        struct pollfd pfd = { .fd = event->fd, .events = POLLPRI };
+        if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLPRI))
+            revents &= ~EPOLLPRI;
+    }
+
+    const bool is_rd = revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP);
+    const bool is_wr = revents & EPOLLOUT;
+    const bool is_er = revents & (EPOLLERR | EPOLLHUP | EPOLLPRI);
+
+    /* event may get closed by any of its callbacks */
+    if (event->on_read && is_rd)
+    {
+        event->on_read(event->arg);
+        event = find_event(data);
+    }
+    if (event != NULL && event->on_error && is_er)
+    {
+        event->on_error(event->arg);
+        event = find_event(data);
+    }
+    if (event != NULL && event->on_write && is_wr)
+    {
+        event->on_write(event->arg);
+    }
+}
+
+bool asc_event_core_loop(unsigned int timeout)
+{
+    if (use_epoll)
+        return asc_event_epoll_core_loop(timeout);
+
+    if (event_mgr->count == 0)
+    {
+        asc_usleep(timeout * 1000ULL); /* dry run */
+        return true;
+    }
+
+    flush_dirty();
+    ring_store(event_mgr->sq_tail, event_mgr->sq_local);
+
+    struct __kernel_timespec ts = {
+        .tv_sec = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000LL,
+    };
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    /* submit pending changes and wait in one call */
+    const int ret = uring_enter(sq_pending(), 1
+                                , IORING_ENTER_GETEVENTS
+                                  | IORING_ENTER_EXT_ARG
+                                , &arg, sizeof(arg));
+
+    if (ret == -1 && errno != EINTR && errno != ETIME && errno != EBUSY)
+    {
+        asc_log_error(MSG("io_uring_enter(): %s"), strerror(errno));
+        return false;
+    }
+
+    /* callbacks below see this time through asc_loop_time() */
+    asc_loop_time_update();
+
+    /* completions posted by callbacks are left for the next iteration */
+    unsigned int head = *event_mgr->cq_head;
+    const unsigned int tail = ring_load(event_mgr->cq_tail);
+
+    while (head != tail)
+    {
+        const struct io_uring_cqe *const cqe =
+            &event_mgr->cqes[head & event_mgr->cq_mask];
+
+        const uint64_t data = cqe->user_data;
+        const int res = cqe->res;
+        const uint32_t flags = cqe->flags;
+
+        ring_store(event_mgr->cq_head, ++head);
+        on_completion(data, res, flags);
+    }
+
+    return true;
+}
+
+void asc_event_subscribe(asc_event_t *event)
+{
+    if (use_epoll)
+    {
+        asc_event_epoll_subscribe(event);
+        return;
+    }
+
+    if (event->is_dirty)
+        return;
+
+    if (event_mgr->dirty_cnt >= event_mgr->dirty_size)
+    {
+        const size_t new_size = asc_list_calc_size(event_mgr->dirty_cnt + 1
+                                                   , event_mgr->dirty_size
+                                                   , EVENT_LIST_MIN_SIZE);
+
+        const size_t bytes = new_size * sizeof(*event_mgr->dirty);
+        event_mgr->dirty = (asc_event_t **)realloc(event_mgr->dirty, bytes);
+        ASC_ASSERT(event_mgr->dirty != NULL, MSG("realloc() failed"));
+
+        event_mgr->dirty_size = new_size;
+    }
+
+    event_mgr->dirty[event_mgr->dirty_cnt++] = event;
+    event->is_dirty = true;
+}
+
+static
+void resize_event_table(int fd)
+{
+    const size_t count = (size_t)fd + 1;
+    if (count <= event_mgr->table_size)
+        return;
+
+    size_t new_size = event_mgr->table_size;
+    if (new_size < EVENT_LIST_MIN_SIZE)
+        new_size = EVENT_LIST_MIN_SIZE;
+
+    while (new_size < count)
+        new_size *= 2;
+
+    const size_t bytes = new_size * sizeof(*event_mgr->table);
+    event_mgr->table = (asc_event_t **)realloc(event_mgr->table, bytes);
+    ASC_ASSERT(event_mgr->table != NULL, MSG("realloc() failed"));
+
+    memset(&event_mgr->table[event_mgr->table_size], 0
+           , (new_size - event_mgr->table_size) * sizeof(*event_mgr->table));
+
+    event_mgr->table_size = new_size;
+}
+
+asc_event_t *asc_event_init(int fd, void *arg)
+{
+    if (use_epoll)
+        return asc_event_epoll_init(fd, arg);
+
+    ASC_ASSERT(fd >= 0, MSG("invalid fd %d"), fd);
+
+    resize_event_table(fd);
+    ASC_ASSERT(event_mgr->table[fd] == NULL
+               , MSG("fd %d is already registered"), fd);
+
+    asc_event_t *const event = ASC_ALLOC(1, asc_event_t);
+
+    event->fd = fd;
+    event->arg = arg;
+
+    event_mgr->table[fd] = event;
+    event_mgr->count++;
+
+    /* errors and hangups are always reported, as with epoll */
+    asc_event_subscribe(event);
+
+    return event;
+}
+
+void asc_event_close(asc_event_t *event)
+{
+    if (use_epoll)
+    {
+        asc_event_epoll_close(event);
+        return;
+    }
+
+    if (event->mask != 0)
+    {
+        /*
+         * The request holds a reference to the file; remove it right
+         * away so that closing the descriptor releases the socket.
+         */
+        poll_remove(EVENT_DATA(event));
+        sq_submit();
+    }
+
+    if (event->is_dirty)
+    {
+        for (size_t i = 0; i < event_mgr->dirty_cnt; i++)
+        {
+            if (event_mgr->dirty[i] == event)
+            {
+                event_mgr->dirty[i] = event_mgr->dirty[--event_mgr->dirty_cnt];
+                break;
+            }
+        }
+    }
+
+    event_mgr->table[event->fd] = NULL;
+    event_mgr->count--;
+
+    free(event);
+}
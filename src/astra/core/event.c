@@ -47,3 +47,12 @@ void asc_event_set_on_error(asc_event_t *event, event_callback_t on_error)
     event->on_error = on_error;
     asc_event_subscribe(event);
 }
+
+void asc_event_set_edge(asc_event_t *event, bool is_edge)
+{
+    if (event->is_edge == is_edge)
+        return;
+
+    event->is_edge = is_edge;
+    asc_event_subscribe(event);
+}
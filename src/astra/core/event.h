@@ -40,4 +40,12 @@ void asc_event_set_on_read(asc_event_t *event, event_callback_t on_read);
 void asc_event_set_on_write(asc_event_t *event, event_callback_t on_write);
 void asc_event_set_on_error(asc_event_t *event, event_callback_t on_error);
 
+/*
+ * Request edge-triggered notification. Callbacks must then consume all
+ * available data until EWOULDBLOCK. Backends without edge-triggered
+ * mode keep reporting events level-triggered, which is still correct
+ * for such callbacks.
+ */
+void asc_event_set_edge(asc_event_t *event, bool is_edge);
+
 #endif /* _ASC_EVENT_H_ */
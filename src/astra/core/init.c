@@ -24,6 +24,7 @@
 #include <astra/core/event.h>
 #include <astra/core/thread.h>
 #include <astra/core/timer.h>
+#include <astra/core/worker.h>
 #include <astra/core/socket.h>
 #include <astra/luaapi/state.h>
 
@@ -60,6 +61,7 @@ void asc_lib_init(void)
 
     /* call order doesn't really matter for these */
     asc_thread_core_init();
+    asc_worker_core_init();
     asc_timer_core_init();
     asc_event_core_init();
     asc_main_loop_init();
@@ -79,6 +81,9 @@ void asc_lib_destroy(void)
      */
     ASC_FREE(lua, lua_api_destroy);
 
+    /* stop worker threads before joining the rest */
+    asc_worker_core_destroy();
+
     /* join any stray threads */
     asc_thread_core_destroy();
 
@@ -92,6 +92,7 @@ bool wake_open(void)
     main_loop->wake_ev = asc_event_init(fds[PIPE_RD], NULL);
     asc_event_set_on_read(main_loop->wake_ev, on_wake_read);
     asc_event_set_on_error(main_loop->wake_ev, on_wake_error);
+    asc_event_set_edge(main_loop->wake_ev, true);
 
     return true;
 }
@@ -127,25 +128,25 @@ void on_wake_read(void *arg)
     ASC_UNUSED(arg);
 
     char buf[32];
-    const ssize_t ret = recv(main_loop->wake_fd[PIPE_RD], buf, sizeof(buf), 0);
-    switch (ret)
-    {
-        case -1:
-            /* error that may or may not be EWOULDBLOCK */
-            if (asc_socket_would_block())
-                return;
-
-            asc_log_error(MSG("wake up recv(): %s"), asc_error_msg());
-            break;
+    ssize_t ret;
 
-        case 0:
-            /* connection closed from the other side */
-            asc_log_error(MSG("wake up pipe closed unexpectedly"));
-            break;
+    /* drain pipe completely as the event is edge-triggered */
+    do {
+        ret = recv(main_loop->wake_fd[PIPE_RD], buf, sizeof(buf), 0);
+    } while (ret > 0);
 
-        default:
-            /* successful read */
+    if (ret == -1)
+    {
+        /* error that may or may not be EWOULDBLOCK */
+        if (asc_socket_would_block())
             return;
+
+        asc_log_error(MSG("wake up recv(): %s"), asc_error_msg());
+    }
+    else
+    {
+        /* connection closed from the other side */
+        asc_log_error(MSG("wake up pipe closed unexpectedly"));
     }
 
     /* this code is highly unlikely to be reached */
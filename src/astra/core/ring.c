@@ -0,0 +1,213 @@
+/*
+ * Astra Core (Packet ring)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <astra/astra.h>
+#include <astra/core/ring.h>
+
+#define MSG(_msg) "[core/ring] " _msg
+
+/* keeps producer and consumer indices on separate cache lines */
+#define RING_CACHELINE 64
+
+/* wake consumer up without waiting for producer once 1/4 full */
+#define RING_NOTIFY_SHIFT 2
+
+#define ring_load(_ptr) __atomic_load_n((_ptr), __ATOMIC_ACQUIRE)
+#define ring_store(_ptr, _val) __atomic_store_n((_ptr), (_val), __ATOMIC_RELEASE)
+
+#define stat_load(_ptr) __atomic_load_n((_ptr), __ATOMIC_RELAXED)
+#define stat_inc(_ptr) __atomic_store_n((_ptr), (*(_ptr) + 1), __ATOMIC_RELAXED)
+
+struct asc_ring_t
+{
+    /* read-only after init */
+    uint8_t *buffer;
+    size_t size;
+    size_t mask;
+
+    loop_callback_t on_data;
+    void *arg;
+
+    uint8_t pad0[RING_CACHELINE];
+
+    /* written by consumer */
+    size_t head;
+    size_t tail_cache;
+
+    uint8_t pad1[RING_CACHELINE];
+
+    /* written by producer */
+    size_t tail;
+    size_t head_cache;
+
+    uint64_t pushed;
+    uint64_t overruns;
+    uint64_t wakeups;
+
+    uint8_t pad2[RING_CACHELINE];
+
+    /* set by producer, cleared by consumer */
+    int notified;
+};
+
+asc_ring_t *asc_ring_init(size_t size, loop_callback_t on_data, void *arg)
+{
+    ASC_ASSERT(size > 0, MSG("ring size must be positive"));
+
+    size_t pow2 = 2;
+    while (pow2 < size)
+        pow2 <<= 1;
+
+    asc_ring_t *const ring = ASC_ALLOC(1, asc_ring_t);
+
+    ring->buffer = ASC_ALLOC(pow2 * TS_PACKET_SIZE, uint8_t);
+    ring->size = pow2;
+    ring->mask = pow2 - 1;
+
+    ring->on_data = on_data;
+    ring->arg = arg;
+
+    return ring;
+}
+
+/* NOTE: producer thread must be stopped before calling this */
+void asc_ring_destroy(asc_ring_t *ring)
+{
+    asc_job_prune(ring);
+
+    free(ring->buffer);
+    free(ring);
+}
+
+size_t asc_ring_size(const asc_ring_t *ring)
+{
+    return ring->size;
+}
+
+void asc_ring_stats(const asc_ring_t *ring, asc_ring_stats_t *stats)
+{
+    stats->pushed = stat_load(&ring->pushed);
+    stats->overruns = stat_load(&ring->overruns);
+    stats->wakeups = stat_load(&ring->wakeups);
+}
+
+/*
+ * producer side
+ */
+
+/* this is run on the main thread */
+static
+void on_ring_job(void *arg)
+{
+    asc_ring_t *const ring = (asc_ring_t *)arg;
+
+    /* re-arm before draining so that new data triggers another wake up */
+    ring_store(&ring->notified, 0);
+    ring->on_data(ring->arg);
+}
+
+/* wake up consumer if it has pending data and isn't notified yet */
+void asc_ring_notify(asc_ring_t *ring)
+{
+    if (ring->tail == ring_load(&ring->head))
+        return;
+
+    if (__atomic_exchange_n(&ring->notified, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        stat_inc(&ring->wakeups);
+        asc_job_queue(ring, on_ring_job, ring);
+        asc_wake();
+    }
+}
+
+/* copy packet into ring, return false and count overrun if it's full */
+bool asc_ring_push(asc_ring_t *ring, const uint8_t *ts)
+{
+    const size_t tail = ring->tail;
+
+    if (tail - ring->head_cache >= ring->size)
+    {
+        ring->head_cache = ring_load(&ring->head);
+        if (tail - ring->head_cache >= ring->size)
+        {
+            stat_inc(&ring->overruns);
+            return false;
+        }
+    }
+
+    memcpy(&ring->buffer[(tail & ring->mask) * TS_PACKET_SIZE]
+           , ts, TS_PACKET_SIZE);
+
+    ring_store(&ring->tail, tail + 1);
+    stat_inc(&ring->pushed);
+
+    /* cached head may be way behind; refresh it before waking consumer */
+    if (((tail + 1 - ring->head_cache) << RING_NOTIFY_SHIFT) >= ring->size)
+    {
+        ring->head_cache = ring_load(&ring->head);
+        if (((tail + 1 - ring->head_cache) << RING_NOTIFY_SHIFT) >= ring->size)
+            asc_ring_notify(ring);
+    }
+
+    return true;
+}
+
+/*
+ * consumer side
+ */
+
+/* get contiguous block of queued packets, return packet count */
+size_t asc_ring_peek(asc_ring_t *ring, const uint8_t **ts)
+{
+    const size_t head = ring->head;
+
+    if (head == ring->tail_cache)
+    {
+        ring->tail_cache = ring_load(&ring->tail);
+        if (head == ring->tail_cache)
+            return 0;
+    }
+
+    const size_t pos = head & ring->mask;
+    size_t cnt = ring->tail_cache - head;
+
+    if (cnt > ring->size - pos)
+        cnt = ring->size - pos;
+
+    *ts = &ring->buffer[pos * TS_PACKET_SIZE];
+
+    return cnt;
+}
+
+/* release packets returned by asc_ring_peek() */
+void asc_ring_skip(asc_ring_t *ring, size_t cnt)
+{
+    ASC_ASSERT(cnt <= ring->tail_cache - ring->head
+               , MSG("skipping past end of ring"));
+
+    ring_store(&ring->head, ring->head + cnt);
+}
+
+/* discard all queued packets */
+void asc_ring_flush(asc_ring_t *ring)
+{
+    ring->tail_cache = ring_load(&ring->tail);
+    ring_store(&ring->head, ring->tail_cache);
+}
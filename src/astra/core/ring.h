@@ -0,0 +1,62 @@
+/*
+ * Astra Core (Packet ring)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASC_RING_H_
+#define _ASC_RING_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+#include <astra/core/mainloop.h>
+
+/*
+ * Single-producer, single-consumer TS packet ring. The producer is
+ * a background thread, the consumer is the main loop. Consumer gets
+ * notified via the job queue; repeated notifications are coalesced
+ * until the consumer has run.
+ */
+
+typedef struct asc_ring_t asc_ring_t;
+
+typedef struct
+{
+    uint64_t pushed;
+    uint64_t overruns;
+    uint64_t wakeups;
+} asc_ring_stats_t;
+
+asc_ring_t *asc_ring_init(size_t size, loop_callback_t on_data
+                          , void *arg) __asc_result;
+void asc_ring_destroy(asc_ring_t *ring);
+
+size_t asc_ring_size(const asc_ring_t *ring) __asc_result;
+void asc_ring_stats(const asc_ring_t *ring, asc_ring_stats_t *stats);
+
+/* producer side */
+bool asc_ring_push(asc_ring_t *ring, const uint8_t *ts);
+void asc_ring_notify(asc_ring_t *ring);
+
+/* consumer side */
+size_t asc_ring_peek(asc_ring_t *ring, const uint8_t **ts) __asc_result;
+void asc_ring_skip(asc_ring_t *ring, size_t cnt);
+void asc_ring_flush(asc_ring_t *ring);
+
+#endif /* _ASC_RING_H_ */
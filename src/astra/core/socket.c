@@ -30,6 +30,7 @@
 #   include <arpa/inet.h>
 #   include <netinet/in.h>
 #   include <netinet/tcp.h>
+#   include <netinet/udp.h>
 #   ifdef HAVE_NETINET_SCTP_H
 #       include <netinet/sctp.h>
 #   endif
@@ -43,6 +44,9 @@
 
 #define MSG(_msg) "[socket %d] " _msg, sock->fd
 
+/* UDP GSO is limited to a single 64K datagram */
+#define GSO_MAX_SIZE 65000
+
 struct asc_socket_t
 {
     int fd;
@@ -57,6 +61,9 @@ struct asc_socket_t
 
     struct ip_mreq mreq;
 
+    /* UDP segmentation offload */
+    int gso_size;
+
     /* Callbacks */
     void *arg;
     event_callback_t on_read;      /* data read */
@@ -518,6 +525,50 @@ ssize_t asc_socket_recvfrom(asc_socket_t *sock, void *buffer, size_t size)
                     , (struct sockaddr *)&sock->sockaddr, &slen);
 }
 
+/*
+ * Read up to `cnt` datagrams into `size`-byte buffers listed in
+ * `buffers`, storing their lengths in `lens`. Returns the number of
+ * datagrams received; -1 means nothing was read (check errno).
+ */
+ssize_t asc_socket_recv_batch(asc_socket_t *sock, void *const *buffers
+                              , size_t size, size_t *lens, size_t cnt)
+{
+    if (cnt > ASC_SOCKET_BATCH_MAX)
+        cnt = ASC_SOCKET_BATCH_MAX;
+
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[ASC_SOCKET_BATCH_MAX];
+    struct iovec iov[ASC_SOCKET_BATCH_MAX];
+
+    memset(msgs, 0, cnt * sizeof(*msgs));
+    for (size_t i = 0; i < cnt; i++)
+    {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int ret = recvmmsg(sock->fd, msgs, cnt, 0, NULL);
+    for (int i = 0; i < ret; i++)
+        lens[i] = msgs[i].msg_len;
+
+    return ret;
+#else /* HAVE_RECVMMSG */
+    size_t i = 0;
+    for (; i < cnt; i++)
+    {
+        const ssize_t ret = asc_socket_recv(sock, buffers[i], size);
+        if (ret < 0)
+            break;
+
+        lens[i] = ret;
+    }
+
+    return (i > 0) ? (ssize_t)i : -1;
+#endif /* !HAVE_RECVMMSG */
+}
+
 /*
  *  oooooooo8 ooooooooooo oooo   oooo ooooooooo
  * 888         888    88   8888o  88   888    88o
@@ -538,6 +589,42 @@ ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size)
     return ret;
 }
 
+/*
+ * Send up to `cnt` buffers with a single call. Return value is the same
+ * as for asc_socket_send(). Windows only sends the first buffer.
+ */
+ssize_t asc_socket_sendv(asc_socket_t *sock, const void *const *buffers
+                         , const size_t *lens, size_t cnt)
+{
+#ifndef _WIN32
+    if (cnt > ASC_SOCKET_IOV_MAX)
+        cnt = ASC_SOCKET_IOV_MAX;
+
+    struct iovec iov[ASC_SOCKET_IOV_MAX];
+    for (size_t i = 0; i < cnt; i++)
+    {
+        iov[i].iov_base = (void *)buffers[i];
+        iov[i].iov_len = lens[i];
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = cnt;
+
+    const ssize_t ret = sendmsg(sock->fd, &msg, 0);
+    if (ret == -1 && asc_socket_would_block())
+        return 0;
+
+    return ret;
+#else /* !_WIN32 */
+    if (cnt == 0)
+        return 0;
+
+    return asc_socket_send(sock, buffers[0], lens[0]);
+#endif /* _WIN32 */
+}
+
 ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size)
 {
     const socklen_t slen = sizeof(struct sockaddr_in);
@@ -545,6 +632,85 @@ ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size)
                   , (struct sockaddr *)&sock->sockaddr, slen);
 }
 
+/*
+ * Send `len` bytes from `buffer` as datagrams of `size` bytes each (the
+ * last one may be shorter). Uses UDP GSO if it was enabled for this
+ * size, sendmmsg() otherwise. Returns the number of datagrams sent;
+ * -1 means nothing was sent (check errno).
+ */
+ssize_t asc_socket_sendto_batch(asc_socket_t *sock, const void *buffer
+                                , size_t len, size_t size)
+{
+    const uint8_t *const buf = (const uint8_t *)buffer;
+    const socklen_t slen = sizeof(struct sockaddr_in);
+
+    size_t cnt = (len + size - 1) / size;
+    if (cnt > ASC_SOCKET_BATCH_MAX)
+        cnt = ASC_SOCKET_BATCH_MAX;
+
+#ifdef UDP_SEGMENT
+    if (sock->gso_size == (int)size && cnt > 1 && len <= GSO_MAX_SIZE)
+    {
+        const ssize_t ret = sendto(sock->fd, buf, len, 0
+                                   , (struct sockaddr *)&sock->sockaddr
+                                   , slen);
+        if (ret != -1)
+            return cnt;
+
+        if (errno != EIO)
+            return -1;
+
+        /*
+         * NIC can't do checksum offload. Turn segmentation off on the
+         * socket too, or every later send fails the same way, and
+         * resend this batch with sendmmsg() below.
+         */
+        asc_log_warning(MSG("UDP GSO failed, disabling"));
+        sock->gso_size = 0;
+
+        const int off = 0;
+        if (setsockopt(sock->fd, IPPROTO_UDP, UDP_SEGMENT
+                       , &off, sizeof(off)) != 0)
+        {
+            asc_log_error(MSG("failed to disable UDP GSO: %s")
+                          , asc_error_msg());
+        }
+    }
+#endif /* UDP_SEGMENT */
+
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[ASC_SOCKET_BATCH_MAX];
+    struct iovec iov[ASC_SOCKET_BATCH_MAX];
+
+    memset(msgs, 0, cnt * sizeof(*msgs));
+    for (size_t i = 0; i < cnt; i++)
+    {
+        const size_t left = len - (i * size);
+
+        iov[i].iov_base = (void *)&buf[i * size];
+        iov[i].iov_len = (left < size) ? left : size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &sock->sockaddr;
+        msgs[i].msg_hdr.msg_namelen = slen;
+    }
+
+    return sendmmsg(sock->fd, msgs, cnt, 0);
+#else /* HAVE_SENDMMSG */
+    size_t i = 0;
+    for (; i < cnt; i++)
+    {
+        const size_t left = len - (i * size);
+        const ssize_t ret = asc_socket_sendto(sock, &buf[i * size]
+                                              , (left < size) ? left : size);
+        if (ret == -1)
+            break;
+    }
+
+    return (i > 0) ? (ssize_t)i : -1;
+#endif /* !HAVE_SENDMMSG */
+}
+
 /*
  * ooooo oooo   oooo ooooooooooo  ooooooo
  *  888   8888o  88   888    88 o888   888o
@@ -696,6 +862,25 @@ void asc_socket_set_timeout(asc_socket_t *sock, int rcvmsec, int sndmsec)
 #endif /* _WIN32 */
 }
 
+bool asc_socket_set_gso(asc_socket_t *sock, int size)
+{
+#ifdef UDP_SEGMENT
+    if (setsockopt(sock->fd, IPPROTO_UDP, UDP_SEGMENT
+                   , &size, sizeof(size)) == 0)
+    {
+        sock->gso_size = size;
+        return true;
+    }
+
+    asc_log_debug(MSG("failed to enable UDP GSO: %s"), asc_error_msg());
+#else
+    ASC_UNUSED(sock);
+    ASC_UNUSED(size);
+#endif /* UDP_SEGMENT */
+
+    return false;
+}
+
 static int sock_set_buffer(int fd, int type, int size)
 {
     int val = size;
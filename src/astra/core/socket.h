@@ -60,8 +60,23 @@ void asc_socket_connect(asc_socket_t *sock, const char *addr, int port
 ssize_t asc_socket_recv(asc_socket_t *sock, void *buffer, size_t size) __asc_result;
 ssize_t asc_socket_recvfrom(asc_socket_t *sock, void *buffer, size_t size) __asc_result;
 
+/* max. number of datagrams per asc_socket_recv_batch() call */
+#define ASC_SOCKET_BATCH_MAX 64
+
+ssize_t asc_socket_recv_batch(asc_socket_t *sock, void *const *buffers
+                              , size_t size, size_t *lens
+                              , size_t cnt) __asc_result;
+
 ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size) __asc_result;
+
+/* max. number of buffers per asc_socket_sendv() call */
+#define ASC_SOCKET_IOV_MAX 64
+
+ssize_t asc_socket_sendv(asc_socket_t *sock, const void *const *buffers
+                         , const size_t *lens, size_t cnt) __asc_result;
 ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size) __asc_result;
+ssize_t asc_socket_sendto_batch(asc_socket_t *sock, const void *buffer
+                                , size_t len, size_t size) __asc_result;
 
 int asc_socket_fd(asc_socket_t *sock) __asc_result;
 const char *asc_socket_addr(asc_socket_t *sock) __asc_result;
@@ -75,6 +90,7 @@ void asc_socket_set_keep_alive(asc_socket_t *sock, int is_on);
 void asc_socket_set_broadcast(asc_socket_t *sock, int is_on);
 void asc_socket_set_timeout(asc_socket_t *sock, int rcvmsec, int sndmsec);
 void asc_socket_set_buffer(asc_socket_t *sock, int rcvbuf, int sndbuf);
+bool asc_socket_set_gso(asc_socket_t *sock, int size) __asc_result;
 
 void asc_socket_set_multicast_if(asc_socket_t *sock, const char *addr);
 void asc_socket_set_multicast_ttl(asc_socket_t *sock, int ttl);
@@ -152,115 +152,3 @@ void asc_thread_join(asc_thread_t *thr)
 
     free(thr);
 }
-
-/*
- * thread buffer (deprecated)
- */
-
-struct asc_thread_buffer_t
-{
-    uint8_t *buffer;
-    size_t size;
-    size_t read;
-    size_t write;
-    size_t count;
-
-    asc_mutex_t mutex;
-};
-
-asc_thread_buffer_t *asc_thread_buffer_init(size_t size)
-{
-    asc_thread_buffer_t *const buffer = ASC_ALLOC(1, asc_thread_buffer_t);
-
-    buffer->size = size;
-    buffer->buffer = ASC_ALLOC(size, uint8_t);
-    asc_mutex_init(&buffer->mutex);
-
-    return buffer;
-}
-
-void asc_thread_buffer_destroy(asc_thread_buffer_t *buffer)
-{
-    free(buffer->buffer);
-    asc_mutex_destroy(&buffer->mutex);
-    free(buffer);
-}
-
-void asc_thread_buffer_flush(asc_thread_buffer_t *buffer)
-{
-    asc_mutex_lock(&buffer->mutex);
-    buffer->count = 0;
-    buffer->read = 0;
-    buffer->write = 0;
-    asc_mutex_unlock(&buffer->mutex);
-}
-
-ssize_t asc_thread_buffer_read(asc_thread_buffer_t *buffer, void *data
-                               , size_t size)
-{
-    asc_mutex_lock(&buffer->mutex);
-    if (size > buffer->count)
-        size = buffer->count;
-
-    if (!size)
-    {
-        asc_mutex_unlock(&buffer->mutex);
-        return 0;
-    }
-
-    const size_t next_read = buffer->read + size;
-    if (next_read < buffer->size)
-    {
-        memcpy(data, &buffer->buffer[buffer->read], size);
-        buffer->read += size;
-    }
-    else if (next_read > buffer->size)
-    {
-        const size_t tail = buffer->size - buffer->read;
-        memcpy(data, &buffer->buffer[buffer->read], tail);
-        buffer->read = size - tail;
-        memcpy(&((uint8_t *)data)[tail], buffer->buffer, buffer->read);
-    }
-    else
-    {
-        memcpy(data, &buffer->buffer[buffer->read], size);
-        buffer->read = 0;
-    }
-
-    buffer->count -= size;
-    asc_mutex_unlock(&buffer->mutex);
-
-    return size;
-}
-
-ssize_t asc_thread_buffer_write(asc_thread_buffer_t *buffer, const void *data
-                                , size_t size)
-{
-    if (!size)
-        return 0;
-
-    asc_mutex_lock(&buffer->mutex);
-    if (buffer->count + size > buffer->size)
-    {
-        asc_mutex_unlock(&buffer->mutex);
-        return -1; // buffer overflow
-    }
-
-    if (buffer->write + size >= buffer->size)
-    {
-        const size_t tail = buffer->size - buffer->write;
-        memcpy(&buffer->buffer[buffer->write], data, tail);
-        buffer->write = size - tail;
-        if(buffer->write > 0)
-            memcpy(buffer->buffer, &((uint8_t *)data)[tail], buffer->write);
-    }
-    else
-    {
-        memcpy(&buffer->buffer[buffer->write], data, size);
-        buffer->write += size;
-    }
-    buffer->count += size;
-    asc_mutex_unlock(&buffer->mutex);
-
-    return size;
-}
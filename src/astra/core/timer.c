@@ -21,7 +21,6 @@
 
 #include <astra/astra.h>
 #include <astra/core/timer.h>
-#include <astra/core/list.h>
 
 #ifdef _WIN32
 #   include <mmsystem.h>
@@ -30,20 +29,137 @@
 #define TIMER_DELAY_MIN 1000 /* 1ms */
 #define TIMER_DELAY_MAX 100000 /* 100ms */
 
+/* wheel resolution, usecs */
+#define TIMER_TICK 1000
+
+/* number of wheel slots, must be a power of two */
+#define TIMER_WHEEL_SIZE 256
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+typedef struct timer_link_t timer_link_t;
+
+struct timer_link_t
+{
+    timer_link_t *prev;
+    timer_link_t *next;
+};
+
 struct asc_timer_t
 {
+    timer_link_t link; /* must be first */
+
     timer_callback_t callback;
     void *arg;
 
     uint64_t interval;
     uint64_t next_shot;
+
+    asc_timer_t *next_dead;
 };
 
-static asc_list_t *timer_list = NULL;
+/*
+ * Hashed timer wheel. Each slot holds timers due within the same
+ * millisecond, modulo wheel size; timers that are more than one lap
+ * away stay in their slot until their time comes. Cancelled timers
+ * are moved to a graveyard and freed on the next loop iteration,
+ * which keeps destroy() safe to call from callbacks.
+ */
+typedef struct
+{
+    timer_link_t slots[TIMER_WHEEL_SIZE];
+    timer_link_t expired;
+    uint64_t tick;
+
+    asc_timer_t *dead;
+} asc_timer_mgr_t;
+
+static asc_timer_mgr_t *timer_mgr = NULL;
 #ifdef _WIN32
 static unsigned int timer_period = 0;
 #endif
 
+/*
+ * intrusive list helpers
+ */
+
+static inline
+void link_init(timer_link_t *head)
+{
+    head->prev = head->next = head;
+}
+
+static inline
+bool link_empty(const timer_link_t *head)
+{
+    return (head->next == head);
+}
+
+static inline
+void link_insert_tail(timer_link_t *head, timer_link_t *item)
+{
+    item->prev = head->prev;
+    item->next = head;
+    head->prev->next = item;
+    head->prev = item;
+}
+
+static inline
+void link_remove(timer_link_t *item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    item->prev = item->next = NULL;
+}
+
+/* move all items from one list to another (empty) list */
+static inline
+void link_splice(timer_link_t *from, timer_link_t *to)
+{
+    if (link_empty(from))
+        return;
+
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+
+    link_init(from);
+}
+
+static inline
+void wheel_insert(asc_timer_t *timer)
+{
+    const size_t slot = (timer->next_shot / TIMER_TICK) & TIMER_WHEEL_MASK;
+    link_insert_tail(&timer_mgr->slots[slot], &timer->link);
+}
+
+static
+void free_list(timer_link_t *head)
+{
+    while (!link_empty(head))
+    {
+        asc_timer_t *const timer = (asc_timer_t *)head->next;
+        link_remove(&timer->link);
+        free(timer);
+    }
+}
+
+static
+void free_dead(void)
+{
+    while (timer_mgr->dead != NULL)
+    {
+        asc_timer_t *const timer = timer_mgr->dead;
+        timer_mgr->dead = timer->next_dead;
+
+        free(timer);
+    }
+}
+
+/*
+ * timer core
+ */
+
 void asc_timer_core_init(void)
 {
 #ifdef _WIN32
@@ -55,20 +171,27 @@ void asc_timer_core_init(void)
     }
 #endif /* _WIN32 */
 
-    timer_list = asc_list_init();
+    timer_mgr = ASC_ALLOC(1, asc_timer_mgr_t);
+
+    for (size_t i = 0; i < TIMER_WHEEL_SIZE; i++)
+        link_init(&timer_mgr->slots[i]);
+
+    link_init(&timer_mgr->expired);
+    timer_mgr->tick = asc_utime() / TIMER_TICK;
 }
 
 void asc_timer_core_destroy(void)
 {
-    if (timer_list == NULL)
+    if (timer_mgr == NULL)
         return;
 
-    asc_list_for(timer_list)
-    {
-        free(asc_list_data(timer_list));
-    }
+    for (size_t i = 0; i < TIMER_WHEEL_SIZE; i++)
+        free_list(&timer_mgr->slots[i]);
 
-    ASC_FREE(timer_list, asc_list_destroy);
+    free_list(&timer_mgr->expired);
+    free_dead();
+
+    ASC_FREE(timer_mgr, free);
 
 #ifdef _WIN32
     if (timer_period > 0)
@@ -79,43 +202,94 @@ void asc_timer_core_destroy(void)
 #endif /* _WIN32 */
 }
 
-unsigned int asc_timer_core_loop(void)
+/* run timers that were due when this pass started */
+static
+void run_slot(timer_link_t *slot, uint64_t deadline)
 {
-    uint64_t nearest = UINT64_MAX;
-    uint64_t now = asc_utime();
+    timer_link_t *const expired = &timer_mgr->expired;
+    link_splice(slot, expired);
 
-    asc_list_first(timer_list);
-    while (!asc_list_eol(timer_list))
+    while (!link_empty(expired))
     {
-        asc_timer_t *const timer = (asc_timer_t *)asc_list_data(timer_list);
+        asc_timer_t *const timer = (asc_timer_t *)expired->next;
+        link_remove(&timer->link);
 
-        if (timer->callback != NULL && now >= timer->next_shot)
+        if (timer->next_shot > deadline)
         {
-            timer->callback(timer->arg);
+            /* not there yet, or more than one lap away */
+            link_insert_tail(slot, &timer->link);
+            continue;
+        }
 
-            /* refresh timestamp */
-            now = asc_utime();
+        timer->callback(timer->arg);
 
-            if (timer->interval > 0)
-                timer->next_shot = now + timer->interval; /* periodic timer */
-            else
-                timer->callback = NULL; /* one shot timer, so remove it */
+        if (timer->callback != NULL && timer->interval > 0)
+        {
+            /* periodic timer; refresh timestamp */
+            timer->next_shot = asc_utime() + timer->interval;
+            wheel_insert(timer);
         }
-
-        if (timer->callback == NULL)
+        else
         {
-            asc_list_remove_current(timer_list);
+            /* one shot timer or destroyed from within callback */
             free(timer);
         }
-        else
+    }
+}
+
+/* find nearest expiration time within TIMER_DELAY_MAX */
+static
+uint64_t find_nearest(uint64_t now)
+{
+    const uint64_t first = now / TIMER_TICK;
+    const uint64_t last = (now + TIMER_DELAY_MAX) / TIMER_TICK;
+
+    for (uint64_t tick = first; tick <= last; tick++)
+    {
+        const timer_link_t *const slot =
+            &timer_mgr->slots[tick & TIMER_WHEEL_MASK];
+
+        uint64_t nearest = UINT64_MAX;
+        for (const timer_link_t *item = slot->next; item != slot
+             ; item = item->next)
         {
-            if (timer->next_shot < nearest)
-                nearest = timer->next_shot;
+            const asc_timer_t *const timer = (const asc_timer_t *)item;
 
-            asc_list_next(timer_list);
+            if (timer->next_shot / TIMER_TICK <= tick
+                && timer->next_shot < nearest)
+            {
+                nearest = timer->next_shot;
+            }
         }
+
+        if (nearest != UINT64_MAX)
+            return nearest;
     }
 
+    return UINT64_MAX;
+}
+
+unsigned int asc_timer_core_loop(void)
+{
+    free_dead();
+
+    const uint64_t deadline = asc_loop_time_update();
+    const uint64_t now_tick = deadline / TIMER_TICK;
+
+    /* catch up on missed ticks, but visit each slot only once */
+    uint64_t tick = timer_mgr->tick;
+    if (now_tick - tick >= TIMER_WHEEL_SIZE)
+        tick = now_tick - TIMER_WHEEL_SIZE + 1;
+
+    for (; tick <= now_tick; tick++)
+        run_slot(&timer_mgr->slots[tick & TIMER_WHEEL_MASK], deadline);
+
+    /* current slot may still have timers due later in this tick */
+    timer_mgr->tick = now_tick;
+
+    const uint64_t now = asc_utime();
+    const uint64_t nearest = find_nearest(now);
+
     uint64_t diff;
     if (nearest < now + TIMER_DELAY_MIN)
         diff = TIMER_DELAY_MIN;
@@ -137,8 +311,7 @@ asc_timer_t *asc_timer_init(unsigned int ms, timer_callback_t callback
     timer->arg = arg;
 
     timer->next_shot = asc_utime() + timer->interval;
-
-    asc_list_insert_tail(timer_list, timer);
+    wheel_insert(timer);
 
     return timer;
 }
@@ -154,6 +327,17 @@ asc_timer_t *asc_timer_one_shot(unsigned int ms, timer_callback_t callback
 
 void asc_timer_destroy(asc_timer_t *timer)
 {
-    /* setting callback to NULL causes timer removal by loop function */
     timer->callback = NULL;
+
+    /*
+     * Unlinked timers are either running right now, in which case
+     * the loop function frees them, or already dead.
+     */
+    if (timer->link.next != NULL)
+    {
+        link_remove(&timer->link);
+
+        timer->next_dead = timer_mgr->dead;
+        timer_mgr->dead = timer;
+    }
 }
@@ -0,0 +1,296 @@
+/*
+ * Astra Core (Worker pool)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <astra/astra.h>
+#include <astra/core/worker.h>
+#include <astra/core/thread.h>
+#include <astra/core/mutex.h>
+#include <astra/core/cond.h>
+
+#define MSG(_msg) "[core/worker] " _msg
+
+/* maximum number of jobs queued per worker */
+#define WORKER_QUEUE_SIZE 1024
+
+typedef struct
+{
+    worker_callback_t proc;
+    void *arg;
+    void *owner;
+} worker_job_t;
+
+struct asc_worker_t
+{
+    unsigned int id;
+    unsigned int refcnt;
+    asc_thread_t *thread;
+
+    asc_mutex_t mutex;
+    asc_cond_t cond;
+    asc_cond_t done;
+    bool quit;
+
+    bool running;
+    void *current;
+
+    unsigned int job_head;
+    unsigned int job_cnt;
+    worker_job_t jobs[WORKER_QUEUE_SIZE];
+};
+
+typedef struct
+{
+    unsigned int count;
+    asc_worker_t *list[ASC_WORKER_MAX];
+} asc_worker_pool_t;
+
+static
+asc_worker_pool_t *worker_pool = NULL;
+
+/*
+ * worker thread
+ */
+
+static
+void worker_proc(void *arg)
+{
+    asc_worker_t *const worker = (asc_worker_t *)arg;
+
+    asc_mutex_lock(&worker->mutex);
+    while (true)
+    {
+        while (worker->job_cnt == 0 && !worker->quit)
+            asc_cond_wait(&worker->cond, &worker->mutex);
+
+        if (worker->quit)
+            break;
+
+        /* pull first job in queue */
+        const worker_job_t job = worker->jobs[worker->job_head];
+        worker->job_head = (worker->job_head + 1) % WORKER_QUEUE_SIZE;
+        worker->job_cnt--;
+
+        worker->running = true;
+        worker->current = job.owner;
+
+        /* run it with mutex unlocked */
+        asc_mutex_unlock(&worker->mutex);
+        job.proc(job.arg);
+        asc_mutex_lock(&worker->mutex);
+
+        worker->running = false;
+        worker->current = NULL;
+        asc_cond_broadcast(&worker->done);
+    }
+    asc_mutex_unlock(&worker->mutex);
+}
+
+static
+asc_worker_t *worker_init(unsigned int id)
+{
+    asc_worker_t *const worker = ASC_ALLOC(1, asc_worker_t);
+
+    worker->id = id;
+    asc_mutex_init(&worker->mutex);
+    asc_cond_init(&worker->cond);
+    asc_cond_init(&worker->done);
+
+    worker->thread = asc_thread_init(worker, worker_proc, NULL);
+
+    return worker;
+}
+
+static
+void worker_destroy(asc_worker_t *worker)
+{
+    if (worker->refcnt > 0)
+    {
+        asc_log_error(MSG("BUG: worker %u still has %u users")
+                      , worker->id, worker->refcnt);
+    }
+
+    asc_mutex_lock(&worker->mutex);
+    worker->quit = true;
+    asc_cond_signal(&worker->cond);
+    asc_mutex_unlock(&worker->mutex);
+
+    asc_thread_join(worker->thread);
+
+    if (worker->job_cnt > 0)
+    {
+        asc_log_debug(MSG("worker %u: discarding %u pending jobs")
+                      , worker->id, worker->job_cnt);
+    }
+
+    asc_cond_destroy(&worker->done);
+    asc_cond_destroy(&worker->cond);
+    asc_mutex_destroy(&worker->mutex);
+
+    free(worker);
+}
+
+/*
+ * pool management
+ */
+
+void asc_worker_core_init(void)
+{
+    worker_pool = ASC_ALLOC(1, asc_worker_pool_t);
+}
+
+void asc_worker_core_destroy(void)
+{
+    if (worker_pool == NULL)
+        return;
+
+    for (unsigned int i = 0; i < worker_pool->count; i++)
+        worker_destroy(worker_pool->list[i]);
+
+    ASC_FREE(worker_pool, free);
+}
+
+/* resize pool; fails if any of the workers are in use */
+bool asc_worker_set_count(unsigned int count)
+{
+    if (count > ASC_WORKER_MAX)
+        return false;
+
+    if (count == worker_pool->count)
+        return true;
+
+    for (unsigned int i = 0; i < worker_pool->count; i++)
+    {
+        if (worker_pool->list[i]->refcnt > 0)
+            return false;
+    }
+
+    for (unsigned int i = 0; i < worker_pool->count; i++)
+        worker_destroy(worker_pool->list[i]);
+
+    for (unsigned int i = 0; i < count; i++)
+        worker_pool->list[i] = worker_init(i);
+
+    worker_pool->count = count;
+    asc_log_debug(MSG("pool size set to %u"), count);
+
+    return true;
+}
+
+unsigned int asc_worker_get_count(void)
+{
+    return worker_pool->count;
+}
+
+/*
+ * Pick the least busy worker and bind caller to it. Returns NULL
+ * if the pool is disabled, in which case the caller is expected to
+ * do its processing on the main thread.
+ */
+asc_worker_t *asc_worker_acquire(void)
+{
+    asc_worker_t *worker = NULL;
+
+    for (unsigned int i = 0; i < worker_pool->count; i++)
+    {
+        asc_worker_t *const item = worker_pool->list[i];
+
+        if (worker == NULL || item->refcnt < worker->refcnt)
+            worker = item;
+    }
+
+    if (worker != NULL)
+        worker->refcnt++;
+
+    return worker;
+}
+
+void asc_worker_release(asc_worker_t *worker)
+{
+    ASC_ASSERT(worker->refcnt > 0, MSG("worker %u already released")
+               , worker->id);
+
+    worker->refcnt--;
+}
+
+unsigned int asc_worker_id(const asc_worker_t *worker)
+{
+    return worker->id;
+}
+
+/*
+ * job queue
+ */
+
+/* add a procedure to worker's job list; jobs are run in FIFO order */
+bool asc_worker_queue(asc_worker_t *worker, void *owner
+                      , worker_callback_t proc, void *arg)
+{
+    bool ret = false;
+
+    asc_mutex_lock(&worker->mutex);
+    if (worker->job_cnt < WORKER_QUEUE_SIZE)
+    {
+        const unsigned int pos = (worker->job_head + worker->job_cnt)
+                                 % WORKER_QUEUE_SIZE;
+        worker_job_t *const job = &worker->jobs[pos];
+
+        job->proc = proc;
+        job->arg = arg;
+        job->owner = owner;
+
+        if (worker->job_cnt++ == 0)
+            asc_cond_signal(&worker->cond);
+
+        ret = true;
+    }
+    asc_mutex_unlock(&worker->mutex);
+
+    return ret;
+}
+
+/*
+ * Remove pending jobs belonging to `owner' and wait for its currently
+ * running job, if any, to complete. Must not be called from a worker.
+ */
+void asc_worker_prune(asc_worker_t *worker, void *owner)
+{
+    asc_mutex_lock(&worker->mutex);
+
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < worker->job_cnt; i++)
+    {
+        const unsigned int src = (worker->job_head + i) % WORKER_QUEUE_SIZE;
+        const unsigned int dst = (worker->job_head + kept) % WORKER_QUEUE_SIZE;
+
+        if (worker->jobs[src].owner != owner)
+        {
+            if (src != dst)
+                worker->jobs[dst] = worker->jobs[src];
+
+            kept++;
+        }
+    }
+    worker->job_cnt = kept;
+
+    while (worker->running && worker->current == owner)
+        asc_cond_wait(&worker->done, &worker->mutex);
+
+    asc_mutex_unlock(&worker->mutex);
+}
@@ -0,0 +1,49 @@
+/*
+ * Astra Core (Worker pool)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASC_WORKER_H_
+#define _ASC_WORKER_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+/* maximum number of worker threads */
+#define ASC_WORKER_MAX 64
+
+typedef struct asc_worker_t asc_worker_t;
+typedef void (*worker_callback_t)(void *);
+
+void asc_worker_core_init(void);
+void asc_worker_core_destroy(void);
+
+bool asc_worker_set_count(unsigned int count) __asc_result;
+unsigned int asc_worker_get_count(void) __asc_result;
+
+asc_worker_t *asc_worker_acquire(void) __asc_result;
+void asc_worker_release(asc_worker_t *worker);
+
+bool asc_worker_queue(asc_worker_t *worker, void *owner
+                      , worker_callback_t proc, void *arg) __asc_result;
+void asc_worker_prune(asc_worker_t *worker, void *owner);
+
+unsigned int asc_worker_id(const asc_worker_t *worker) __asc_result;
+
+#endif /* _ASC_WORKER_H_ */
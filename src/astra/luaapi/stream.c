@@ -34,8 +34,20 @@ struct module_stream_t
     module_stream_t *parent;
 
     stream_callback_t on_ts;
+    stream_batch_callback_t on_ts_batch;
+    stream_block_callback_t on_ts_block;
     asc_list_t *children;
 
+    /* children that get every packet */
+    asc_list_t *flood;
+    /* per-pid lists of routed children, allocated on first join */
+    asc_list_t **routes;
+    /* only receive packets for joined pids */
+    bool is_routed;
+    /* route lists are being walked; removals leave NULL slots */
+    unsigned int route_depth;
+    bool route_dirty;
+
     demux_callback_t join_pid;
     demux_callback_t leave_pid;
     uint8_t pid_list[TS_MAX_PIDS];
@@ -87,6 +99,7 @@ void module_stream_init(lua_State *L, module_data_t *mod
     st->self = mod;
     st->on_ts = on_ts;
     st->children = asc_list_init();
+    st->flood = asc_list_init();
 
     /* demux default: forward downstream pid requests to parent */
     st->join_pid = module_demux_join;
@@ -134,10 +147,45 @@ void module_stream_destroy(module_data_t *mod)
         i->parent = NULL;
     }
 
+    if (mod->stream->routes != NULL)
+    {
+        for (unsigned int i = 0; i < TS_MAX_PIDS; i++)
+            ASC_FREE(mod->stream->routes[i], asc_list_destroy);
+
+        ASC_FREE(mod->stream->routes, free);
+    }
+
+    ASC_FREE(mod->stream->flood, asc_list_destroy);
     ASC_FREE(mod->stream->children, asc_list_destroy);
     ASC_FREE(mod->stream, free);
 }
 
+void module_stream_set_batch(module_data_t *mod
+                             , stream_batch_callback_t on_ts_batch)
+{
+    ASC_ASSERT(mod->stream != NULL, MSG("module not initialized"));
+    ASC_ASSERT(mod->stream->on_ts != NULL
+               , MSG("batch callback requires on_ts"));
+
+    mod->stream->on_ts_batch = on_ts_batch;
+}
+
+/*
+ * Block callback receives packets along with their storage. A child
+ * that wants to keep the data after returning from the callback takes
+ * a reference with asc_block_retain() instead of copying packets, and
+ * must use asc_block_writable() before modifying them.
+ */
+void module_stream_set_block(module_data_t *mod
+                             , stream_block_callback_t on_ts_block)
+{
+    ASC_ASSERT(mod->stream != NULL, MSG("module not initialized"));
+    ASC_ASSERT(mod->stream->on_ts != NULL
+               , MSG("block callback requires on_ts"));
+
+    mod->stream->on_ts_block = on_ts_block;
+}
+
 /*
  * streaming module tree
  */
@@ -187,6 +235,9 @@ void module_stream_attach(module_data_t *mod, module_data_t *child)
     if (cs->parent != NULL)
     {
         asc_list_remove_item(cs->parent->children, cs);
+        if (!cs->is_routed)
+            asc_list_remove_item(cs->parent->flood, cs);
+
         cs->parent = NULL;
     }
 
@@ -198,6 +249,8 @@ void module_stream_attach(module_data_t *mod, module_data_t *child)
 
         cs->parent = ps;
         asc_list_insert_tail(ps->children, cs);
+        if (!cs->is_routed)
+            asc_list_insert_tail(ps->flood, cs);
     }
 
     /* re-request pids from new parent */
@@ -208,23 +261,209 @@ void module_stream_attach(module_data_t *mod, module_data_t *child)
     }
 }
 
+module_data_t *module_stream_parent(const module_data_t *mod)
+{
+    const module_stream_t *const st = mod->stream;
+    ASC_ASSERT(st != NULL, MSG("module not initialized"));
+
+    return (st->parent != NULL ? st->parent->self : NULL);
+}
+
+/*
+ * NOTE: routed children are walked from tail to head. A child that
+ *       leaves and rejoins a pid from inside its own on_ts (e.g. channel
+ *       reloading on PAT change) ends up at the tail of the list, so
+ *       this way it is neither skipped nor fed the same packet twice.
+ *       Children leaving during the walk are unlinked afterwards by
+ *       route_end(); until then their slots are set to NULL.
+ */
+static inline
+void route_send(asc_list_t *list, const uint8_t *ts)
+{
+    size_t i = asc_list_count(list);
+    while (i > 0)
+    {
+        module_stream_t *const st = (module_stream_t *)list->items[--i];
+        if (st != NULL)
+            st->on_ts(st->self, ts);
+    }
+}
+
+static inline
+void route_begin(module_stream_t *st)
+{
+    st->route_depth++;
+}
+
+static
+void route_purge(module_stream_t *st)
+{
+    for (unsigned int pid = 0; pid < TS_MAX_PIDS; pid++)
+    {
+        asc_list_t *const list = st->routes[pid];
+        if (list == NULL)
+            continue;
+
+        for (size_t i = asc_list_count(list); i > 0; i--)
+        {
+            if (list->items[i - 1] == NULL)
+                asc_list_remove_index(list, i - 1);
+        }
+    }
+
+    st->route_dirty = false;
+}
+
+static inline
+void route_end(module_stream_t *st)
+{
+    if (--st->route_depth == 0 && st->route_dirty)
+        route_purge(st);
+}
+
 void module_stream_send(void *arg, const uint8_t *ts)
 {
     module_data_t *const mod = (module_data_t *)arg;
+    module_stream_t *const st = mod->stream;
 
-    asc_list_for(mod->stream->children)
+    asc_list_for(st->flood)
     {
         module_stream_t *const i =
-            (module_stream_t *)asc_list_data(mod->stream->children);
+            (module_stream_t *)asc_list_data(st->flood);
 
         i->on_ts(i->self, ts);
     }
+
+    if (st->routes != NULL)
+    {
+        asc_list_t *const list = st->routes[TS_GET_PID(ts)];
+        if (list != NULL)
+        {
+            route_begin(st);
+            route_send(list, ts);
+            route_end(st);
+        }
+    }
+}
+
+static inline
+void flood_send_batch(module_stream_t *st, const uint8_t *ts, size_t cnt)
+{
+    if (st->on_ts_batch != NULL)
+    {
+        st->on_ts_batch(st->self, ts, cnt);
+    }
+    else
+    {
+        /* child doesn't do batches; unroll into single packets */
+        const uint8_t *const end = &ts[cnt * TS_PACKET_SIZE];
+        for (const uint8_t *p = ts; p < end; p += TS_PACKET_SIZE)
+            st->on_ts(st->self, p);
+    }
+}
+
+static inline
+void route_send_batch(module_stream_t *st, const uint8_t *ts, size_t cnt)
+{
+    route_begin(st);
+
+    const uint8_t *const end = &ts[cnt * TS_PACKET_SIZE];
+    for (const uint8_t *p = ts; p < end; p += TS_PACKET_SIZE)
+    {
+        asc_list_t *const list = st->routes[TS_GET_PID(p)];
+        if (list != NULL)
+            route_send(list, p);
+    }
+
+    route_end(st);
+}
+
+void module_stream_send_batch(void *arg, const uint8_t *ts, size_t cnt)
+{
+    module_data_t *const mod = (module_data_t *)arg;
+
+    module_stream_t *const st = mod->stream;
+
+    if (cnt == 0)
+        return;
+
+    asc_list_for(st->flood)
+    {
+        module_stream_t *const i =
+            (module_stream_t *)asc_list_data(st->flood);
+
+        flood_send_batch(i, ts, cnt);
+    }
+
+    if (st->routes != NULL)
+        route_send_batch(st, ts, cnt);
+}
+
+/* NOTE: caller keeps its reference to the block */
+void module_stream_send_block(void *arg, asc_block_t *block)
+{
+    module_data_t *const mod = (module_data_t *)arg;
+
+    module_stream_t *const st = mod->stream;
+
+    if (block->cnt == 0)
+        return;
+
+    asc_list_for(st->flood)
+    {
+        module_stream_t *const i =
+            (module_stream_t *)asc_list_data(st->flood);
+
+        if (i->on_ts_block != NULL)
+            i->on_ts_block(i->self, block);
+        else
+            flood_send_batch(i, block->data, block->cnt);
+    }
+
+    if (st->routes != NULL)
+        route_send_batch(st, block->data, block->cnt);
 }
 
 /*
  * pid membership
  */
 
+static
+void route_add(module_stream_t *ps, module_stream_t *cs, uint16_t pid)
+{
+    if (ps->routes == NULL)
+        ps->routes = ASC_ALLOC(TS_MAX_PIDS, asc_list_t *);
+
+    /* NOTE: lists are kept until parent is destroyed */
+    if (ps->routes[pid] == NULL)
+        ps->routes[pid] = asc_list_init();
+
+    asc_list_insert_tail(ps->routes[pid], cs);
+}
+
+static
+void route_del(module_stream_t *ps, module_stream_t *cs, uint16_t pid)
+{
+    asc_list_t *const list = ps->routes[pid];
+
+    if (ps->route_depth == 0)
+    {
+        asc_list_remove_item(list, cs);
+        return;
+    }
+
+    /* list is being walked; don't shift the remaining children */
+    for (size_t i = 0; i < asc_list_count(list); i++)
+    {
+        if (list->items[i] == cs)
+        {
+            list->items[i] = NULL;
+            ps->route_dirty = true;
+            return;
+        }
+    }
+}
+
 void module_demux_set(module_data_t *mod, demux_callback_t join_pid
                       , demux_callback_t leave_pid)
 {
@@ -232,16 +471,36 @@ void module_demux_set(module_data_t *mod, demux_callback_t join_pid
     mod->stream->leave_pid = leave_pid;
 }
 
+void module_demux_route(module_data_t *mod, bool enable)
+{
+    module_stream_t *const st = mod->stream;
+    ASC_ASSERT(st != NULL, MSG("module not initialized"));
+
+    if (st->is_routed == enable)
+        return;
+
+    /* reattach to move pid memberships into parent's routing table */
+    module_data_t *const parent =
+        (st->parent != NULL ? st->parent->self : NULL);
+
+    module_stream_attach(NULL, mod);
+    st->is_routed = enable;
+    module_stream_attach(parent, mod);
+}
+
 void module_demux_join(module_data_t *mod, uint16_t pid)
 {
     ASC_ASSERT(ts_pid_valid(pid), MSG("join: pid %hu out of range"), pid);
     module_stream_t *const st = mod->stream;
 
     ++st->pid_list[pid];
-    if (st->pid_list[pid] == 1 && st->parent != NULL
-        && st->parent->join_pid != NULL)
+    if (st->pid_list[pid] == 1 && st->parent != NULL)
     {
-        st->parent->join_pid(st->parent->self, pid);
+        if (st->is_routed)
+            route_add(st->parent, st, pid);
+
+        if (st->parent->join_pid != NULL)
+            st->parent->join_pid(st->parent->self, pid);
     }
 }
 
@@ -253,10 +512,13 @@ void module_demux_leave(module_data_t *mod, uint16_t pid)
     if (st->pid_list[pid] > 0)
     {
         --st->pid_list[pid];
-        if (st->pid_list[pid] == 0 && st->parent != NULL
-            && st->parent->leave_pid != NULL)
+        if (st->pid_list[pid] == 0 && st->parent != NULL)
         {
-            st->parent->leave_pid(st->parent->self, pid);
+            if (st->is_routed)
+                route_del(st->parent, st, pid);
+
+            if (st->parent->leave_pid != NULL)
+                st->parent->leave_pid(st->parent->self, pid);
         }
     }
     else
@@ -27,19 +27,31 @@
 #endif /* !_ASTRA_H_ */
 
 #include <astra/luaapi/module.h>
+#include <astra/core/block.h>
 
 typedef void (*stream_callback_t)(module_data_t *, const uint8_t *);
+typedef void (*stream_batch_callback_t)(module_data_t *, const uint8_t *
+                                        , size_t);
+typedef void (*stream_block_callback_t)(module_data_t *, asc_block_t *);
 typedef void (*demux_callback_t)(module_data_t *, uint16_t);
 
 void module_stream_init(lua_State *L, module_data_t *mod
                         , stream_callback_t on_ts);
 void module_stream_destroy(module_data_t *mod);
+void module_stream_set_batch(module_data_t *mod
+                             , stream_batch_callback_t on_ts_batch);
+void module_stream_set_block(module_data_t *mod
+                             , stream_block_callback_t on_ts_block);
 
 void module_stream_attach(module_data_t *mod, module_data_t *child);
+module_data_t *module_stream_parent(const module_data_t *mod) __asc_result;
 void module_stream_send(void *arg, const uint8_t *ts);
+void module_stream_send_batch(void *arg, const uint8_t *ts, size_t cnt);
+void module_stream_send_block(void *arg, asc_block_t *block);
 
 void module_demux_set(module_data_t *mod, demux_callback_t join_pid
                       , demux_callback_t leave_pid);
+void module_demux_route(module_data_t *mod, bool enable);
 void module_demux_join(module_data_t *mod, uint16_t pid);
 void module_demux_leave(module_data_t *mod, uint16_t pid);
 bool module_demux_check(const module_data_t *mod, uint16_t pid) __asc_result;
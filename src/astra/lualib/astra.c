@@ -39,11 +39,18 @@
  *                  - restart without terminating the process
  *      astra.shutdown()
  *                  - schedule graceful shutdown
+ *      astra.workers([count])
+ *                  - set number of worker threads, return current count
+ *      astra.sync_stats()
+ *                  - return table with shared sync scheduler counters and
+ *                    fill level and underruns of every scheduled buffer
  */
 
 #include <astra/astra.h>
 #include <astra/core/mainloop.h>
+#include <astra/core/worker.h>
 #include <astra/luaapi/module.h>
+#include <astra/mpegts/sync.h>
 
 static int method_exit(lua_State *L)
 {
@@ -73,6 +80,69 @@ static int method_shutdown(lua_State *L)
     return 0;
 }
 
+static int method_workers(lua_State *L)
+{
+    if (lua_gettop(L) > 0)
+    {
+        const lua_Integer count = luaL_checkinteger(L, 1);
+        if (count < 0 || count > ASC_WORKER_MAX)
+        {
+            luaL_error(L, "worker count must be between 0 and %d"
+                       , ASC_WORKER_MAX);
+        }
+
+        if (!asc_worker_set_count(count))
+            luaL_error(L, "can't resize worker pool while it is in use");
+    }
+
+    lua_pushinteger(L, asc_worker_get_count());
+    return 1;
+}
+
+static void push_sync_buffer(void *arg, const char *name
+                             , const ts_sync_stat_t *st)
+{
+    lua_State *const L = (lua_State *)arg;
+
+    lua_newtable(L);
+    lua_pushstring(L, name);
+    lua_setfield(L, -2, "name");
+    lua_pushinteger(L, st->bitrate / 1000);
+    lua_setfield(L, -2, "bitrate");
+    lua_pushinteger(L, (st->filled * 100) / st->size);
+    lua_setfield(L, -2, "fill");
+    lua_pushinteger(L, st->filled);
+    lua_setfield(L, -2, "filled");
+    lua_pushinteger(L, st->size);
+    lua_setfield(L, -2, "size");
+    lua_pushinteger(L, st->num_blocks);
+    lua_setfield(L, -2, "blocks");
+    lua_pushnumber(L, st->underruns);
+    lua_setfield(L, -2, "underruns");
+
+    lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+}
+
+static int method_sync_stats(lua_State *L)
+{
+    ts_sync_sched_stat_t st;
+    ts_sync_sched_query(&st);
+
+    lua_newtable(L);
+    lua_pushinteger(L, st.buffers);
+    lua_setfield(L, -2, "buffers");
+    lua_pushnumber(L, st.ticks);
+    lua_setfield(L, -2, "ticks");
+    lua_pushnumber(L, st.steps);
+    lua_setfield(L, -2, "steps");
+
+    lua_newtable(L);
+    ts_sync_sched_foreach(push_sync_buffer, L);
+    lua_setfield(L, -2, "list");
+
+    return 1;
+}
+
 static void module_load(lua_State *L)
 {
     static const luaL_Reg api[] =
@@ -81,6 +151,8 @@ static void module_load(lua_State *L)
         { "abort", method_abort },
         { "reload", method_reload },
         { "shutdown", method_shutdown },
+        { "workers", method_workers },
+        { "sync_stats", method_sync_stats },
         { NULL, NULL },
     };
 
@@ -19,6 +19,9 @@
  */
 
 #include <astra/astra.h>
+#include <astra/core/thread.h>
+#include <astra/core/mutex.h>
+#include <astra/core/timer.h>
 #include <astra/mpegts/sync.h>
 #include <astra/mpegts/pcr.h>
 
@@ -49,6 +52,9 @@
 /* interval for reducing buffer allocation size */
 #define COMPACT_INTERVAL (10 * 1000 * 1000) /* 10s */
 
+/* longest time a scheduled buffer can go without service */
+#define MAX_SCHED_DELAY (50 * 1000) /* 50ms */
+
 /* marker for unknown PCR PID */
 #define PCR_PID_NONE ((unsigned int)-1)
 
@@ -94,12 +100,49 @@ struct ts_sync_t
     uint64_t last_compact;
 
     bool buffered;
+    uint64_t underruns;
+
+    /* shared scheduler heap position, see ts_sync_schedule() */
+    struct
+    {
+        bool on;
+        size_t idx;
+        uint64_t deadline;
+    } sched;
+
+    /* dedicated output thread, see ts_sync_set_pacing() */
+    struct
+    {
+        asc_thread_t *thread;
+        asc_mutex_t mutex;
+        unsigned int interval;
+        bool quit;
+
+        uint64_t wakeups;
+        uint64_t jitter_total;
+        uint64_t jitter_max;
+    } pacer;
 };
 
 /*
  * worker functions
  */
 
+/* buffer is only shared with another thread when pacing is on */
+static inline
+void sync_lock(const ts_sync_t *sx)
+{
+    if (sx->pacer.thread != NULL)
+        asc_mutex_lock((asc_mutex_t *)&sx->pacer.mutex);
+}
+
+static inline
+void sync_unlock(const ts_sync_t *sx)
+{
+    if (sx->pacer.thread != NULL)
+        asc_mutex_unlock((asc_mutex_t *)&sx->pacer.mutex);
+}
+
 /* return number of packets in the buffer */
 static inline
 size_t buffer_filled(const ts_sync_t *sx)
@@ -369,12 +412,10 @@ unsigned int update_last_run(ts_sync_t *sx, uint64_t time_now)
     return elapsed;
 }
 
-void ts_sync_loop(void *arg)
+static
+void sync_step(ts_sync_t *sx, uint64_t time_now)
 {
-    ts_sync_t *const sx = (ts_sync_t *)arg;
-
     /* timekeeping */
-    const uint64_t time_now = asc_utime();
     const unsigned int elapsed = update_last_run(sx, time_now);
 
     /* request more packets if needed (pull mode) */
@@ -399,6 +440,7 @@ void ts_sync_loop(void *arg)
         {
             /* set error state */
             sx->last_error = time_now;
+            sx->underruns++;
         }
         else if (downtime >= MAX_IDLE_TIME)
         {
@@ -474,10 +516,9 @@ void ts_sync_loop(void *arg)
     }
 }
 
-bool ts_sync_push(ts_sync_t *sx, const void *buf, size_t count)
+static
+bool sync_push(ts_sync_t *sx, const ts_packet_t *ts, size_t count)
 {
-    const ts_packet_t *const ts = (const ts_packet_t *)buf;
-
     while (buffer_space(sx) < count)
     {
         const bool ok = buffer_resize(sx, 0);
@@ -526,6 +567,337 @@ bool ts_sync_push(ts_sync_t *sx, const void *buf, size_t count)
     return true;
 }
 
+static
+void sched_wakeup(ts_sync_t *sx);
+
+bool ts_sync_push(ts_sync_t *sx, const void *buf, size_t count)
+{
+    const ts_packet_t *const ts = (const ts_packet_t *)buf;
+
+    sync_lock(sx);
+    const bool was_buffered = sx->buffered;
+    const bool ret = sync_push(sx, ts, count);
+    sync_unlock(sx);
+
+    /* initial buffering is done, start output on next tick */
+    if (sx->sched.on && !was_buffered && sx->buffered)
+        sched_wakeup(sx);
+
+    return ret;
+}
+
+void ts_sync_loop(void *arg)
+{
+    ts_sync_t *const sx = (ts_sync_t *)arg;
+
+    sync_step(sx, asc_utime());
+}
+
+/*
+ * pacing thread
+ */
+
+/* return number of microseconds until next packet is due */
+static
+unsigned int next_delay(const ts_sync_t *sx, unsigned int min
+                        , unsigned int max)
+{
+    if (!sx->buffered || sx->last_error > 0 || sx->quantum <= 0.0)
+        return min;
+
+    double usec = 0.0;
+    if (sx->quantum > sx->pending)
+        usec = (sx->quantum - sx->pending) / (TS_PCR_FREQ / 1000000);
+
+    if (usec < min)
+        return min;
+    else if (usec > max)
+        return max;
+
+    return usec;
+}
+
+/* sleep until asc_utime() reaches `deadline' */
+static
+void pacer_sleep(uint64_t deadline)
+{
+#if defined(HAVE_CLOCK_NANOSLEEP) && defined(HAVE_CLOCK_GETTIME)
+    const struct timespec ts =
+    {
+        .tv_sec = deadline / 1000000ULL,
+        .tv_nsec = (deadline % 1000000ULL) * 1000ULL,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ; /* nothing */
+#else
+    const uint64_t now = asc_utime();
+    if (deadline > now)
+        asc_usleep(deadline - now);
+#endif /* HAVE_CLOCK_NANOSLEEP && HAVE_CLOCK_GETTIME */
+}
+
+static
+void pacer_proc(void *arg)
+{
+    ts_sync_t *const sx = (ts_sync_t *)arg;
+    uint64_t deadline = 0;
+
+    asc_mutex_lock(&sx->pacer.mutex);
+
+    while (!sx->pacer.quit)
+    {
+        const uint64_t now = asc_utime();
+
+        /* only count wakeups that were meant to release packets */
+        if (deadline > 0 && sx->buffered && sx->last_error == 0)
+        {
+            const uint64_t late = (now > deadline) ? (now - deadline) : 0;
+
+            sx->pacer.wakeups++;
+            sx->pacer.jitter_total += late;
+            if (late > sx->pacer.jitter_max)
+                sx->pacer.jitter_max = late;
+        }
+
+        sync_step(sx, now);
+        unsigned int delay = SYNC_PACING_MAX_USEC;
+        if (sx->buffered && sx->last_error == 0)
+        {
+            delay = next_delay(sx, sx->pacer.interval
+                               , SYNC_PACING_MAX_USEC);
+        }
+
+        deadline = now + delay;
+
+        asc_mutex_unlock(&sx->pacer.mutex);
+        pacer_sleep(deadline);
+        asc_mutex_lock(&sx->pacer.mutex);
+    }
+
+    asc_mutex_unlock(&sx->pacer.mutex);
+}
+
+bool ts_sync_set_pacing(ts_sync_t *sx, unsigned int interval)
+{
+    ASC_ASSERT(sx->on_ready == NULL, MSG("pacing doesn't support pull mode"));
+    ASC_ASSERT(!sx->sched.on, MSG("scheduled buffer can't be paced"));
+
+    if (sx->pacer.thread != NULL)
+    {
+        asc_log_error(MSG("pacing thread is already running"));
+        return false;
+    }
+
+    if (!(interval >= SYNC_PACING_MIN_USEC && interval <= SYNC_PACING_MAX_USEC))
+    {
+        asc_log_error(MSG("pacing interval out of range"));
+        return false;
+    }
+
+    asc_log_debug(MSG("starting pacing thread, interval %uus"), interval);
+
+    sx->pacer.interval = interval;
+    asc_mutex_init(&sx->pacer.mutex);
+    sx->pacer.thread = asc_thread_init(sx, pacer_proc, NULL);
+
+    return true;
+}
+
+/*
+ * shared scheduler
+ */
+
+/* single main loop timer servicing all scheduled buffers */
+static struct
+{
+    asc_timer_t *timer;
+
+    /* binary min-heap ordered by deadline */
+    ts_sync_t **heap;
+    size_t cnt;
+    size_t size;
+
+    uint64_t ticks;
+    uint64_t steps;
+} sched;
+
+/* slack for timer wakeups that come a bit early */
+#define SCHED_TICK_USEC (SYNC_INTERVAL_MSEC * 1000)
+#define SCHED_SLACK_USEC (SCHED_TICK_USEC / 2)
+
+static inline
+void sched_set(size_t idx, ts_sync_t *sx)
+{
+    sched.heap[idx] = sx;
+    sx->sched.idx = idx;
+}
+
+static
+void sched_sift_up(size_t idx)
+{
+    ts_sync_t *const sx = sched.heap[idx];
+
+    while (idx > 0)
+    {
+        const size_t parent = (idx - 1) / 2;
+        if (sched.heap[parent]->sched.deadline <= sx->sched.deadline)
+            break;
+
+        sched_set(idx, sched.heap[parent]);
+        idx = parent;
+    }
+
+    sched_set(idx, sx);
+}
+
+static
+void sched_sift_down(size_t idx)
+{
+    ts_sync_t *const sx = sched.heap[idx];
+
+    while (true)
+    {
+        size_t child = idx * 2 + 1;
+        if (child >= sched.cnt)
+            break;
+
+        if (child + 1 < sched.cnt
+            && sched.heap[child + 1]->sched.deadline
+               < sched.heap[child]->sched.deadline)
+        {
+            child++;
+        }
+
+        if (sx->sched.deadline <= sched.heap[child]->sched.deadline)
+            break;
+
+        sched_set(idx, sched.heap[child]);
+        idx = child;
+    }
+
+    sched_set(idx, sx);
+}
+
+/* move buffer to its new place in the heap after deadline change */
+static
+void sched_update(ts_sync_t *sx, uint64_t deadline)
+{
+    const uint64_t old = sx->sched.deadline;
+    sx->sched.deadline = deadline;
+
+    if (deadline < old)
+        sched_sift_up(sx->sched.idx);
+    else
+        sched_sift_down(sx->sched.idx);
+}
+
+/* service buffer on next tick */
+static
+void sched_wakeup(ts_sync_t *sx)
+{
+    if (sx->sched.deadline > 0)
+        sched_update(sx, 0);
+}
+
+static
+void on_sched_tick(void *arg)
+{
+    ASC_UNUSED(arg);
+
+    const uint64_t now = asc_utime();
+    sched.ticks++;
+
+    /* new deadlines are at least a tick away, so this loop terminates */
+    while (sched.cnt > 0)
+    {
+        ts_sync_t *const sx = sched.heap[0];
+        if (sx->sched.deadline > now + SCHED_SLACK_USEC)
+            break;
+
+        sync_step(sx, now);
+        sched.steps++;
+
+        /* idle buffers are woken up by push or set_on_ready */
+        unsigned int delay = MAX_SCHED_DELAY;
+        if (sx->buffered || sx->on_ready != NULL)
+            delay = next_delay(sx, SCHED_TICK_USEC, MAX_SCHED_DELAY);
+
+        sched_update(sx, now + delay);
+    }
+}
+
+static
+void sched_remove(ts_sync_t *sx)
+{
+    const size_t idx = sx->sched.idx;
+    ts_sync_t *const last = sched.heap[--sched.cnt];
+
+    if (last != sx)
+    {
+        sched_set(idx, last);
+        sched_sift_up(idx);
+        sched_sift_down(last->sched.idx);
+    }
+
+    sx->sched.on = false;
+
+    if (sched.cnt == 0)
+    {
+        ASC_FREE(sched.timer, asc_timer_destroy);
+        ASC_FREE(sched.heap, free);
+        sched.size = 0;
+    }
+}
+
+void ts_sync_schedule(ts_sync_t *sx)
+{
+    ASC_ASSERT(sx->pacer.thread == NULL
+               , MSG("paced buffer can't be scheduled"));
+
+    if (sx->sched.on)
+        return;
+
+    if (sched.cnt >= sched.size)
+    {
+        sched.size = (sched.size > 0) ? sched.size * 2 : 64;
+        sched.heap = (ts_sync_t **)realloc(sched.heap
+                                           , sched.size * sizeof(*sched.heap));
+        ASC_ASSERT(sched.heap != NULL, MSG("realloc() failed"));
+    }
+
+    if (sched.timer == NULL)
+    {
+        asc_log_debug("[sync] starting shared scheduler");
+        sched.timer = asc_timer_init(SYNC_INTERVAL_MSEC, on_sched_tick, NULL);
+    }
+
+    /* service on next tick */
+    sx->sched.on = true;
+    sx->sched.deadline = 0;
+    sched_set(sched.cnt++, sx);
+    sched_sift_up(sx->sched.idx);
+}
+
+void ts_sync_sched_query(ts_sync_sched_stat_t *out)
+{
+    out->buffers = sched.cnt;
+    out->ticks = sched.ticks;
+    out->steps = sched.steps;
+}
+
+void ts_sync_sched_foreach(sync_iter_t callback, void *arg)
+{
+    for (size_t i = 0; i < sched.cnt; i++)
+    {
+        const ts_sync_t *const sx = sched.heap[i];
+
+        ts_sync_stat_t st;
+        ts_sync_query(sx, &st);
+        callback(arg, sx->name, &st);
+    }
+}
+
 /*
  * create and destroy
  */
@@ -556,13 +928,33 @@ ts_sync_t *ts_sync_init(ts_callback_t on_ts, void *arg)
 
 void ts_sync_destroy(ts_sync_t *sx)
 {
+    if (sx->sched.on)
+        sched_remove(sx);
+
+    if (sx->pacer.thread != NULL)
+    {
+        asc_mutex_lock(&sx->pacer.mutex);
+        sx->pacer.quit = true;
+        asc_mutex_unlock(&sx->pacer.mutex);
+
+        ASC_FREE(sx->pacer.thread, asc_thread_join);
+        asc_mutex_destroy(&sx->pacer.mutex);
+    }
+
     free(sx->buf);
     free(sx);
 }
 
 void ts_sync_set_on_ready(ts_sync_t *sx, sync_callback_t on_ready)
 {
+    ASC_ASSERT(sx->pacer.thread == NULL || on_ready == NULL
+               , MSG("pacing doesn't support pull mode"));
+
     sx->on_ready = on_ready;
+
+    /* producer is waiting; don't let it sleep until a far deadline */
+    if (on_ready != NULL && sx->sched.on)
+        sched_wakeup(sx);
 }
 
 void ts_sync_set_fname(ts_sync_t *sx, const char *format, ...)
@@ -670,6 +1062,8 @@ void ts_sync_query(const ts_sync_t *sx, ts_sync_stat_t *out)
 {
     memset(out, 0, sizeof(*out));
 
+    sync_lock(sx);
+
     out->size = sx->size;
     out->filled = buffer_filled(sx);
     out->num_blocks = sx->num_blocks;
@@ -693,9 +1087,20 @@ void ts_sync_query(const ts_sync_t *sx, ts_sync_stat_t *out)
     {
         out->want = 0;
     }
+
+    out->underruns = sx->underruns;
+
+    out->wakeups = sx->pacer.wakeups;
+    out->jitter_max = sx->pacer.jitter_max;
+    if (sx->pacer.wakeups > 0)
+        out->jitter_avg = sx->pacer.jitter_total / sx->pacer.wakeups;
+
+    sync_unlock(sx);
 }
 
 void ts_sync_reset(ts_sync_t *sx)
 {
+    sync_lock(sx);
     buffer_reset(sx, SYNC_RESET_ALL);
+    sync_unlock(sx);
 }
@@ -28,6 +28,10 @@
 /* default timer interval, milliseconds */
 #define SYNC_INTERVAL_MSEC 5 /* 5ms */
 
+/* allowed range for pacing thread wakeup interval, microseconds */
+#define SYNC_PACING_MIN_USEC 50
+#define SYNC_PACING_MAX_USEC (SYNC_INTERVAL_MSEC * 1000)
+
 typedef struct ts_sync_t ts_sync_t;
 typedef void (*sync_callback_t)(void *);
 
@@ -44,6 +48,12 @@ typedef struct
     size_t filled;
     size_t want;
     unsigned int num_blocks;
+    uint64_t underruns;
+
+    /* pacing thread wakeup lateness, microseconds */
+    uint64_t wakeups;
+    unsigned int jitter_avg;
+    unsigned int jitter_max;
 } ts_sync_stat_t;
 
 ts_sync_t *ts_sync_init(ts_callback_t on_ts, void *arg) __asc_result;
@@ -70,6 +80,41 @@ bool ts_sync_set_opts(ts_sync_t *sx, const char *opts);
 bool ts_sync_set_max_size(ts_sync_t *sx, unsigned int mbytes);
 bool ts_sync_set_blocks(ts_sync_t *sx, unsigned int enough, unsigned int low);
 
+/*
+ * Release packets from a dedicated thread instead of a main loop timer.
+ * The thread sleeps until the next packet is due according to the PCR
+ * derived bitrate, but no less than `interval' microseconds, so output
+ * is spread evenly instead of going out in timer sized bursts.
+ *
+ * NOTE: the output callback is then called on the pacing thread, with
+ *       the buffer locked. Pull mode (on_ready) is not available, and
+ *       ts_sync_loop() must not be called on a paced buffer.
+ */
+bool ts_sync_set_pacing(ts_sync_t *sx, unsigned int interval);
+
+/*
+ * Hand the buffer over to the shared scheduler. A single main loop timer
+ * services all scheduled buffers, earliest deadline first. Buffers that
+ * have nothing due are skipped until their next packet is, so there's no
+ * need for a ts_sync_loop() timer per instance.
+ *
+ * NOTE: buffer stays scheduled until it is destroyed. Paced buffers
+ *       can't be scheduled and vice versa.
+ */
+void ts_sync_schedule(ts_sync_t *sx);
+
+typedef struct
+{
+    size_t buffers;
+    uint64_t ticks;
+    uint64_t steps;
+} ts_sync_sched_stat_t;
+
+typedef void (*sync_iter_t)(void *, const char *, const ts_sync_stat_t *);
+
+void ts_sync_sched_query(ts_sync_sched_stat_t *out);
+void ts_sync_sched_foreach(sync_iter_t callback, void *arg);
+
 void ts_sync_query(const ts_sync_t *sx, ts_sync_stat_t *out);
 void ts_sync_reset(ts_sync_t *sx);
 
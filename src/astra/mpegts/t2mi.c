@@ -26,7 +26,7 @@
 #define MSG(_msg) "[t2mi %s] " _msg, mi->name
 
 /* sizes and lengths */
-#define PLP_LIST_SIZE 0x100
+#define PLP_LIST_SIZE T2MI_PLP_COUNT
 #define T2MI_BUFFER_SIZE 0x3000
 
 #define T2MI_HEADER_SIZE 6
@@ -152,6 +152,10 @@ struct t2_plp_t
     uint32_t plp_start;
     unsigned num_blocks;
 
+    /* multi-PLP mode: data PLPs sharing this Common PLP */
+    unsigned members[PLP_LIST_SIZE];
+    size_t member_cnt;
+
     size_t frag_skip;
     uint8_t frag[T2MI_BUFFER_SIZE];
 };
@@ -243,6 +247,13 @@ typedef struct
     bb_frame_t bb;
 } t2mi_packet_t;
 
+/* per-PLP output */
+typedef struct
+{
+    ts_callback_t on_ts;
+    void *arg;
+} t2mi_output_t;
+
 /* decapsulator context */
 struct ts_t2mi_t
 {
@@ -273,6 +284,13 @@ struct ts_t2mi_t
     ts_callback_t on_ts;
     void *arg;
 
+    /* multi-PLP mode; on_ts keeps getting the selected PLP */
+    t2mi_output_t outputs[PLP_LIST_SIZE];
+    unsigned out_cnt;
+    unsigned selected_plp;
+
+    ts_t2mi_plp_stats_t stats[PLP_LIST_SIZE];
+
     bool warned;
     bool seen_pkts;
     bool error;
@@ -410,6 +428,7 @@ ts_t2mi_t *ts_t2mi_init(void)
     mi->pmt = ts_psi_init(TS_TYPE_PMT, 0);
 
     mi->prefer_plp = T2MI_PLP_AUTO;
+    mi->selected_plp = T2MI_PLP_AUTO;
 
     return mi;
 }
@@ -460,6 +479,45 @@ void ts_t2mi_set_plp(ts_t2mi_t *mi, unsigned plp_id)
     mi->l1_current.cksum = 0;
 }
 
+/*
+ * Route packets of a single PLP to its own callback. Once any PLP has
+ * a callback, the decapsulator switches to multi-PLP mode: every PLP
+ * with a callback is extracted, and Common PLP packets are delivered
+ * to all outputs in the same group. The callback set with
+ * ts_t2mi_set_callback() still gets the PLP picked by ts_t2mi_set_plp().
+ */
+void ts_t2mi_set_plp_callback(ts_t2mi_t *mi, unsigned plp_id
+                              , ts_callback_t cb, void *arg)
+{
+    ASC_ASSERT(plp_id < PLP_LIST_SIZE, MSG("PLP ID %u out of range")
+               , plp_id);
+
+    t2mi_output_t *const out = &mi->outputs[plp_id];
+
+    if (out->on_ts != NULL)
+        mi->out_cnt--;
+
+    out->on_ts = cb;
+    out->arg = arg;
+
+    if (out->on_ts != NULL)
+        mi->out_cnt++;
+
+    /* re-evaluate PLP list on next L1-current */
+    mi->l1_current.cksum = 0;
+}
+
+bool ts_t2mi_get_plp_stats(const ts_t2mi_t *mi, unsigned plp_id
+                           , ts_t2mi_plp_stats_t *stats)
+{
+    if (plp_id >= PLP_LIST_SIZE)
+        return false;
+
+    *stats = mi->stats[plp_id];
+
+    return true;
+}
+
 void ts_t2mi_set_demux(ts_t2mi_t *mi, module_data_t *mod
                        , demux_callback_t join_pid
                        , demux_callback_t leave_pid)
@@ -539,6 +597,7 @@ bool bb_reassemble_up(ts_t2mi_t *mi, t2mi_packet_t *pkt)
         asc_log_debug(MSG("dropping UP fragment due to discontinuity "
                           "(%zu bytes)"), frag_skip);
 
+        mi->stats[plp->id].dropped++;
         return false;
     }
 
@@ -559,6 +618,8 @@ bool bb_reassemble_up(ts_t2mi_t *mi, t2mi_packet_t *pkt)
         {
             asc_log_debug(MSG("reassembled UP has wrong size (expected %zu, "
                               "got %zu)"), bb->up_size, len);
+
+            mi->stats[plp->id].dropped++;
         }
 
         return false;
@@ -568,11 +629,51 @@ bool bb_reassemble_up(ts_t2mi_t *mi, t2mi_packet_t *pkt)
     return true;
 }
 
+/* deliver packet to output(s) of the PLP it was extracted from */
 static inline
-void bb_reinsert_null(ts_t2mi_t *mi, size_t dnp)
+void plp_send(ts_t2mi_t *mi, const t2_plp_t *plp, const uint8_t *ts)
+{
+    if (mi->out_cnt == 0)
+    {
+        if (mi->on_ts != NULL)
+            mi->on_ts(mi->arg, ts);
+
+        return;
+    }
+
+    if (plp->type != PLP_TYPE_COMMON)
+    {
+        const t2mi_output_t *const out = &mi->outputs[plp->id];
+        if (out->on_ts != NULL)
+            out->on_ts(out->arg, ts);
+
+        if (plp->id == mi->selected_plp && mi->on_ts != NULL)
+            mi->on_ts(mi->arg, ts);
+
+        return;
+    }
+
+    /* Common PLP is shared by all data PLPs in its group */
+    for (size_t i = 0; i < plp->member_cnt; i++)
+    {
+        const unsigned member = plp->members[i];
+
+        const t2mi_output_t *const out = &mi->outputs[member];
+        if (out->on_ts != NULL)
+            out->on_ts(out->arg, ts);
+
+        if (member == mi->selected_plp && mi->on_ts != NULL)
+            mi->on_ts(mi->arg, ts);
+    }
+}
+
+static inline
+void bb_reinsert_null(ts_t2mi_t *mi, const t2_plp_t *plp, size_t dnp)
 {
     for (size_t i = 0; i < dnp; i++)
-        mi->on_ts(mi->arg, ts_null_pkt);
+        plp_send(mi, plp, ts_null_pkt);
+
+    mi->stats[plp->id].nulls += dnp;
 }
 
 static
@@ -598,12 +699,16 @@ bool on_bbframe_ts(ts_t2mi_t *mi, t2mi_packet_t *pkt)
         /* additional byte for null packet counter */
         bb->up_size++;
 
+    ts_t2mi_plp_stats_t *const stats = &mi->stats[plp->id];
+
     /* fragmented TS reassembly */
-    if (bb_reassemble_up(mi, pkt) && mi->on_ts)
+    if (bb_reassemble_up(mi, pkt))
     {
-        mi->on_ts(mi->arg, plp->frag);
+        plp_send(mi, plp, plp->frag);
+        stats->packets++;
+
         if (bb->npd)
-            bb_reinsert_null(mi, plp->frag[TS_PACKET_SIZE]);
+            bb_reinsert_null(mi, plp, plp->frag[TS_PACKET_SIZE]);
     }
 
     /* zero-copy path */
@@ -613,13 +718,12 @@ bool on_bbframe_ts(ts_t2mi_t *mi, t2mi_packet_t *pkt)
         uint8_t *const ts = ptr - 1;
         ts[0] = bb->sync;
 
-        if (mi->on_ts)
-        {
-            mi->on_ts(mi->arg, ts);
-            if (bb->npd)
-                // TODO: insert Common PLP packets instead of null ones
-                bb_reinsert_null(mi, ptr[bb->up_size - 1]);
-        }
+        plp_send(mi, plp, ts);
+        stats->packets++;
+
+        if (bb->npd)
+            // TODO: insert Common PLP packets instead of null ones
+            bb_reinsert_null(mi, plp, ptr[bb->up_size - 1]);
 
         ptr += bb->up_size;
     }
@@ -669,10 +773,13 @@ bool on_bbframe(ts_t2mi_t *mi, t2mi_packet_t *pkt)
     bb->crc8 = au_crc8(ptr, BBFRAME_HEADER_SIZE - 1);
     bb->mode = ptr[9] ^ bb->crc8;
 
+    mi->stats[bb->plp->id].bbframes++;
+
     if (bb->mode & ~0x1)
     {
         /* unknown mode; assume corrupt frame */
         asc_log_debug(MSG("CRC-8 error, dropping BBframe"));
+        mi->stats[bb->plp->id].errors++;
         return false;
     }
 
@@ -683,6 +790,7 @@ bool on_bbframe(ts_t2mi_t *mi, t2mi_packet_t *pkt)
     if (bb->end > pkt->end)
     {
         asc_log_debug(MSG("BBframe data field length out of bounds"));
+        mi->stats[bb->plp->id].errors++;
         return false;
     }
 
@@ -699,6 +807,7 @@ bool on_bbframe(ts_t2mi_t *mi, t2mi_packet_t *pkt)
         if (bb->up_offset > bb->df_size)
         {
             asc_log_debug(MSG("BBframe syncd value out of bounds"));
+            mi->stats[bb->plp->id].errors++;
             return false;
         }
     }
@@ -813,6 +922,8 @@ bool on_l1_current(ts_t2mi_t *mi, const t2mi_packet_t *pkt)
 
     t2_plp_t *selected = NULL;
     const bool auto_plp = (mi->prefer_plp == T2MI_PLP_AUTO);
+    const bool multi_plp = (mi->out_cnt > 0);
+    unsigned selected_cnt = 0;
 
     for (size_t i = 0; i < l1->num_plp; i++)
     {
@@ -845,8 +956,17 @@ bool on_l1_current(ts_t2mi_t *mi, const t2mi_packet_t *pkt)
         BIT_FIELD(plp->in_band_a, 1);
         BIT_SKIP(16);
 
-        if (selected == NULL
-            && (plp->type == PLP_TYPE_DATA_1 || plp->type == PLP_TYPE_DATA_2)
+        const bool is_data = (plp->type == PLP_TYPE_DATA_1
+                              || plp->type == PLP_TYPE_DATA_2);
+
+        /* extract every data PLP that has an output */
+        if (multi_plp && is_data && mi->outputs[plp->id].on_ts != NULL)
+        {
+            plp->active = true;
+            selected_cnt++;
+        }
+
+        if (selected == NULL && is_data
             && (auto_plp || mi->prefer_plp == plp->id))
         {
             plp->active = true;
@@ -854,6 +974,8 @@ bool on_l1_current(ts_t2mi_t *mi, const t2mi_packet_t *pkt)
         }
     }
 
+    mi->selected_plp = (selected != NULL ? selected->id : T2MI_PLP_AUTO);
+
     for (size_t i = 0; i < PLP_LIST_SIZE; i++)
     {
         const t2_plp_t *const plp = mi->plps[i];
@@ -871,9 +993,26 @@ bool on_l1_current(ts_t2mi_t *mi, const t2mi_packet_t *pkt)
             continue;
 
         /* look for Common Type PLP(s) in the same group */
-        if (selected != NULL
-            && plp->type == PLP_TYPE_COMMON
-            && plp->group_id == selected->group_id)
+        if (multi_plp && plp->type == PLP_TYPE_COMMON)
+        {
+            plp->member_cnt = 0;
+            for (size_t j = 0; j < PLP_LIST_SIZE; j++)
+            {
+                const t2_plp_t *const data = mi->plps[j];
+
+                if (data != NULL && data->active
+                    && data->type != PLP_TYPE_COMMON
+                    && data->group_id == plp->group_id)
+                {
+                    plp->members[plp->member_cnt++] = data->id;
+                }
+            }
+
+            plp->active = (plp->member_cnt > 0);
+        }
+        else if (selected != NULL
+                 && plp->type == PLP_TYPE_COMMON
+                 && plp->group_id == selected->group_id)
         {
             plp->active = true;
         }
@@ -892,6 +1031,30 @@ bool on_l1_current(ts_t2mi_t *mi, const t2mi_packet_t *pkt)
                      , plp->active ? " (*)" : "");
     }
 
+    /* update statistics */
+    for (size_t i = 0; i < PLP_LIST_SIZE; i++)
+    {
+        ts_t2mi_plp_stats_t *const stats = &mi->stats[i];
+        const t2_plp_t *const plp = mi->plps[i];
+
+        stats->present = (plp != NULL);
+        stats->active = (plp != NULL && plp->active);
+
+        if (plp != NULL)
+        {
+            stats->type = plp->type;
+            stats->group_id = plp->group_id;
+        }
+    }
+
+    if (multi_plp)
+    {
+        if (selected_cnt > 0)
+            asc_log_info(MSG("extracting %u data PLP's"), selected_cnt);
+        else
+            asc_log_error(MSG("none of the requested data PLP's found"));
+    }
+
     if (selected != NULL)
     {
         asc_log_info(MSG("selected data PLP %u%s")
@@ -28,9 +28,24 @@
 #include <astra/luaapi/stream.h>
 
 #define T2MI_PLP_AUTO 0x100
+#define T2MI_PLP_COUNT 0x100
 
 typedef struct ts_t2mi_t ts_t2mi_t;
 
+typedef struct
+{
+    bool present;
+    bool active;
+    unsigned type;
+    unsigned group_id;
+
+    uint64_t bbframes;
+    uint64_t packets;
+    uint64_t nulls;
+    uint64_t errors;
+    uint64_t dropped;
+} ts_t2mi_plp_stats_t;
+
 ts_t2mi_t *ts_t2mi_init(void) __asc_result;
 void ts_t2mi_destroy(ts_t2mi_t *mi);
 
@@ -38,6 +53,10 @@ void ts_t2mi_set_fname(ts_t2mi_t *mi, const char *format
                        , ...) __asc_printf(2, 3);
 void ts_t2mi_set_callback(ts_t2mi_t *mi, ts_callback_t cb, void *arg);
 void ts_t2mi_set_plp(ts_t2mi_t *mi, unsigned plp_id);
+void ts_t2mi_set_plp_callback(ts_t2mi_t *mi, unsigned plp_id
+                              , ts_callback_t cb, void *arg);
+bool ts_t2mi_get_plp_stats(const ts_t2mi_t *mi, unsigned plp_id
+                           , ts_t2mi_plp_stats_t *stats);
 void ts_t2mi_set_payload(ts_t2mi_t *mi, uint16_t pnr, uint16_t pid);
 void ts_t2mi_set_demux(ts_t2mi_t *mi, module_data_t *mod
                        , demux_callback_t join_pid
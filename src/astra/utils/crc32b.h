@@ -30,4 +30,12 @@
 
 uint32_t au_crc32b(const void *data, size_t len) __asc_result;
 
+/* specific implementations, for testing and benchmarking */
+uint32_t au_crc32b_sb8(const void *data, size_t len) __asc_result;
+
+#ifdef HAVE_PCLMUL
+bool au_crc32b_clmul_supported(void) __asc_result;
+uint32_t au_crc32b_clmul(const void *data, size_t len) __asc_result;
+#endif /* HAVE_PCLMUL */
+
 #endif /* _AU_CRC32B_H_ */
@@ -0,0 +1,584 @@
+/*
+ * Astra Utils (DVB Common Scrambling Algorithm)
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Batch kernel template. csa.c includes this file once per engine with
+ * the following macros defined:
+ *
+ *   BS_NAME(x) - appends the engine suffix to an identifier
+ *   BS_WORD    - integer or vector type holding one bit per packet
+ *   BS_BITS    - width of BS_WORD in bits, a multiple of 64
+ *   BS_TARGET  - function attributes selecting the instruction set
+ *
+ * The stream cipher is bitsliced: bit i of every BS_WORD belongs to
+ * packet i. The block cipher is byte-sliced: each of its eight state
+ * bytes is kept as an array of BS_BITS bytes, one per packet.
+ */
+
+#define BS_LANES (BS_BITS / 64)
+#define BS_INLINE CSA_INLINE BS_TARGET
+#define BS_LANE(_w, _c) (((uint64_t *)&(_w))[_c])
+
+typedef struct
+{
+    BS_WORD a[10][4];
+    BS_WORD b[10][4];
+    BS_WORD x[4], y[4], z[4];
+    BS_WORD d[4], e[4], f[4];
+    BS_WORD p, q, r;
+} BS_NAME(bs_stream_t);
+
+BS_INLINE
+BS_WORD BS_NAME(bs_mux)(BS_WORD s, BS_WORD a1, BS_WORD a0)
+{
+    return a0 ^ ((a0 ^ a1) & s);
+}
+
+/*
+ * Evaluate a 5-input boolean function given by its truth table. The
+ * table is a compile-time constant, so the leaves fold into plain
+ * operations on x0.
+ */
+BS_INLINE
+BS_WORD BS_NAME(bs_lut1)(uint32_t tt, BS_WORD x0)
+{
+    const BS_WORD zero = { 0 };
+
+    switch (tt & 3)
+    {
+        case 0: return zero;
+        case 1: return ~x0;
+        case 2: return x0;
+        default: return ~zero;
+    }
+}
+
+BS_INLINE
+BS_WORD BS_NAME(bs_lut2)(uint32_t tt, BS_WORD x1, BS_WORD x0)
+{
+    return BS_NAME(bs_mux)(x1, BS_NAME(bs_lut1)(tt >> 2, x0)
+                           , BS_NAME(bs_lut1)(tt, x0));
+}
+
+BS_INLINE
+BS_WORD BS_NAME(bs_lut3)(uint32_t tt, BS_WORD x2, BS_WORD x1, BS_WORD x0)
+{
+    return BS_NAME(bs_mux)(x2, BS_NAME(bs_lut2)(tt >> 4, x1, x0)
+                           , BS_NAME(bs_lut2)(tt, x1, x0));
+}
+
+BS_INLINE
+BS_WORD BS_NAME(bs_lut4)(uint32_t tt, BS_WORD x3, BS_WORD x2
+                         , BS_WORD x1, BS_WORD x0)
+{
+    return BS_NAME(bs_mux)(x3, BS_NAME(bs_lut3)(tt >> 8, x2, x1, x0)
+                           , BS_NAME(bs_lut3)(tt, x2, x1, x0));
+}
+
+BS_INLINE
+BS_WORD BS_NAME(bs_lut5)(uint32_t tt, BS_WORD x4, BS_WORD x3
+                         , BS_WORD x2, BS_WORD x1, BS_WORD x0)
+{
+    return BS_NAME(bs_mux)(x4, BS_NAME(bs_lut4)(tt >> 16, x3, x2, x1, x0)
+                           , BS_NAME(bs_lut4)(tt, x3, x2, x1, x0));
+}
+
+#define BS_SBOX(_n, _out, _x4, _x3, _x2, _x1, _x0) \
+    do { \
+        _out[0] = BS_NAME(bs_lut5)(stream_sbox_tt[_n][0] \
+                                   , _x4, _x3, _x2, _x1, _x0); \
+        _out[1] = BS_NAME(bs_lut5)(stream_sbox_tt[_n][1] \
+                                   , _x4, _x3, _x2, _x1, _x0); \
+    } while (0)
+
+/*
+ * One clock of the stream cipher; mirrors stream_byte() in csa.c.
+ * During initialization ia and ib carry the input nibbles; out gets
+ * the two output bits, most significant first.
+ */
+BS_INLINE
+void BS_NAME(bs_stream_step)(BS_NAME(bs_stream_t) *st
+                             , const BS_WORD *ia, const BS_WORD *ib
+                             , BS_WORD *out)
+{
+    BS_WORD (*const a)[4] = st->a;
+    BS_WORD (*const b)[4] = st->b;
+    BS_WORD s1[2], s2[2], s3[2], s4[2], s5[2], s6[2], s7[2];
+
+    BS_SBOX(0, s1, a[3][0], a[0][2], a[5][1], a[6][3], a[8][0]);
+    BS_SBOX(1, s2, a[1][1], a[2][2], a[5][3], a[6][0], a[8][1]);
+    BS_SBOX(2, s3, a[0][3], a[1][0], a[4][1], a[4][3], a[5][2]);
+    BS_SBOX(3, s4, a[2][3], a[0][1], a[1][3], a[3][2], a[7][0]);
+    BS_SBOX(4, s5, a[4][2], a[3][3], a[5][0], a[7][1], a[8][2]);
+    BS_SBOX(5, s6, a[2][1], a[3][1], a[4][0], a[6][2], a[8][3]);
+    BS_SBOX(6, s7, a[1][2], a[2][0], a[6][1], a[7][2], a[7][3]);
+
+    BS_WORD extra[4];
+    extra[3] = b[2][0] ^ b[5][1] ^ b[6][2] ^ b[8][3];
+    extra[2] = b[5][0] ^ b[7][1] ^ b[2][3] ^ b[3][2];
+    extra[1] = b[4][3] ^ b[7][2] ^ b[3][0] ^ b[4][1];
+    extra[0] = b[8][2] ^ b[5][3] ^ b[2][1] ^ b[7][0];
+
+    BS_WORD na[4], nb[4], carry = st->r;
+    for (unsigned int n = 0; n < 4; n++)
+    {
+        na[n] = a[9][n] ^ st->x[n];
+        nb[n] = b[6][n] ^ b[9][n] ^ st->y[n];
+
+        if (ia != NULL)
+        {
+            na[n] ^= st->d[n] ^ ia[n];
+            nb[n] ^= ib[n];
+        }
+
+        st->d[n] = st->e[n] ^ st->z[n] ^ extra[n];
+
+        /* F = Z + E + r when q is set, F = E otherwise */
+        const BS_WORD z = st->z[n];
+        const BS_WORD e = st->e[n];
+        const BS_WORD sum = z ^ e ^ carry;
+
+        carry = (z & e) | (carry & (z ^ e));
+        st->e[n] = st->f[n];
+        st->f[n] = BS_NAME(bs_mux)(st->q, sum, e);
+    }
+    st->r = BS_NAME(bs_mux)(st->q, carry, st->r);
+
+    /* rotate the new B1 left by one bit when p is set */
+    const BS_WORD nb3 = nb[3];
+    nb[3] = BS_NAME(bs_mux)(st->p, nb[2], nb[3]);
+    nb[2] = BS_NAME(bs_mux)(st->p, nb[1], nb[2]);
+    nb[1] = BS_NAME(bs_mux)(st->p, nb[0], nb[1]);
+    nb[0] = BS_NAME(bs_mux)(st->p, nb3, nb[0]);
+
+    memmove(&a[1], &a[0], 9 * sizeof(a[0]));
+    memmove(&b[1], &b[0], 9 * sizeof(b[0]));
+    memcpy(a[0], na, sizeof(na));
+    memcpy(b[0], nb, sizeof(nb));
+
+    st->x[3] = s4[0]; st->x[2] = s3[0]; st->x[1] = s2[1]; st->x[0] = s1[1];
+    st->y[3] = s6[0]; st->y[2] = s5[0]; st->y[1] = s4[1]; st->y[0] = s3[1];
+    st->z[3] = s2[0]; st->z[2] = s1[0]; st->z[1] = s7[1]; st->z[0] = s6[1];
+    st->p = s7[1];
+    st->q = s7[0];
+
+    if (out != NULL)
+    {
+        out[0] = st->d[3] ^ st->d[2];
+        out[1] = st->d[1] ^ st->d[0];
+    }
+}
+
+#undef BS_SBOX
+
+/*
+ * Convert between per-packet 64-bit blocks and bitsliced words.
+ * Word 8 * k + 7 - n holds bit n of byte k of every block.
+ */
+static BS_TARGET
+void BS_NAME(bs_slice)(BS_WORD w[64], const uint64_t *blk)
+{
+    for (unsigned int c = 0; c < BS_LANES; c++)
+    {
+        uint64_t m[64];
+        memcpy(m, &blk[c * 64], sizeof(m));
+        csa_transpose64(m);
+
+        for (unsigned int i = 0; i < 64; i++)
+            BS_LANE(w[i], c) = m[i];
+    }
+}
+
+static BS_TARGET
+void BS_NAME(bs_unslice)(uint64_t *blk, const BS_WORD w[64])
+{
+    for (unsigned int c = 0; c < BS_LANES; c++)
+    {
+        uint64_t m[64];
+        for (unsigned int i = 0; i < 64; i++)
+            m[i] = BS_LANE(w[i], c);
+
+        csa_transpose64(m);
+        memcpy(&blk[c * 64], m, sizeof(m));
+    }
+}
+
+static BS_TARGET
+void BS_NAME(bs_stream_init)(BS_NAME(bs_stream_t) *st, const csa_key_t *key
+                             , const uint64_t *blk)
+{
+    const BS_WORD zero = { 0 };
+    BS_WORD iv[64];
+
+    BS_NAME(bs_slice)(iv, blk);
+    memset(st, 0, sizeof(*st));
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        const uint8_t ka = key->cw[i];
+        const uint8_t kb = key->cw[4 + i];
+
+        for (unsigned int n = 0; n < 4; n++)
+        {
+            st->a[i * 2][n] = ((ka >> (n + 4)) & 1) ? ~zero : zero;
+            st->a[i * 2 + 1][n] = ((ka >> n) & 1) ? ~zero : zero;
+            st->b[i * 2][n] = ((kb >> (n + 4)) & 1) ? ~zero : zero;
+            st->b[i * 2 + 1][n] = ((kb >> n) & 1) ? ~zero : zero;
+        }
+    }
+
+    for (unsigned int k = 0; k < CSA_BLOCK_SIZE; k++)
+    {
+        BS_WORD hi[4], lo[4];
+        for (unsigned int n = 0; n < 4; n++)
+        {
+            hi[n] = iv[k * 8 + 3 - n];
+            lo[n] = iv[k * 8 + 7 - n];
+        }
+
+        BS_NAME(bs_stream_step)(st, hi, lo, NULL);
+        BS_NAME(bs_stream_step)(st, lo, hi, NULL);
+        BS_NAME(bs_stream_step)(st, hi, lo, NULL);
+        BS_NAME(bs_stream_step)(st, lo, hi, NULL);
+    }
+}
+
+/* next 8 bytes of keystream for every packet */
+static BS_TARGET
+void BS_NAME(bs_stream_block)(BS_NAME(bs_stream_t) *st, uint64_t *blk)
+{
+    BS_WORD ks[64];
+
+    for (unsigned int i = 0; i < 64; i += 2)
+        BS_NAME(bs_stream_step)(st, NULL, NULL, &ks[i]);
+
+    BS_NAME(bs_unslice)(blk, ks);
+}
+
+/* byte-sliced block cipher state: 8 rows of BS_BITS bytes */
+typedef BS_WORD BS_NAME(bs_row_t)[8];
+
+/*
+ * Engines that can look up a byte vector in a 256-entry table define
+ * BS_SBOX_VEC(x, s, t) to set s and t from block_sbox and block_sbox_perm.
+ * Others look up eight packets at a time on 64-bit words.
+ */
+#ifdef BS_SBOX_VEC
+typedef BS_WORD BS_NAME(bs_cell_t);
+#   define BS_CELLS 8
+#   define BS_SBOX_LOOKUP(_x, _s, _t) BS_SBOX_VEC(_x, _s, _t)
+#else /* BS_SBOX_VEC */
+typedef uint64_t BS_NAME(bs_cell_t);
+#   define BS_CELLS (BS_BITS / 8)
+#   define BS_SBOX_LOOKUP(_x, _s, _t) \
+    do { \
+        _s = 0; \
+        _t = 0; \
+        for (unsigned int _b = 0; _b < 64; _b += 8) \
+        { \
+            const uint8_t _v = (uint8_t)((_x) >> _b); \
+            _s |= (uint64_t)block_sbox[_v] << _b; \
+            _t |= (uint64_t)block_sbox_perm[_v] << _b; \
+        } \
+    } while (0)
+#endif /* !BS_SBOX_VEC */
+
+static BS_TARGET
+void BS_NAME(bs_block_decrypt)(const csa_key_t *key
+                               , BS_NAME(bs_row_t) *w)
+{
+    const BS_NAME(bs_cell_t) zero = { 0 };
+    BS_NAME(bs_cell_t) *r[8];
+
+    for (unsigned int i = 0; i < 8; i++)
+        r[i] = (BS_NAME(bs_cell_t) *)w[i];
+
+    for (int i = CSA_SCHEDULE_SIZE - 1; i >= 0; i--)
+    {
+        const BS_NAME(bs_cell_t) k =
+            zero ^ (key->sch[i] * 0x0101010101010101ULL);
+
+        for (unsigned int c = 0; c < BS_CELLS; c++)
+        {
+            BS_NAME(bs_cell_t) s, t;
+            BS_SBOX_LOOKUP(r[6][c] ^ k, s, t);
+
+            const BS_NAME(bs_cell_t) l = r[7][c] ^ s;
+            r[7][c] = l;
+            r[5][c] ^= t;
+            r[3][c] ^= l;
+            r[2][c] ^= l;
+            r[1][c] ^= l;
+        }
+
+        BS_NAME(bs_cell_t) *const l = r[7];
+        memmove(&r[1], &r[0], 7 * sizeof(r[0]));
+        r[0] = l;
+    }
+}
+
+static BS_TARGET
+void BS_NAME(bs_block_encrypt)(const csa_key_t *key
+                               , BS_NAME(bs_row_t) *w)
+{
+    const BS_NAME(bs_cell_t) zero = { 0 };
+    BS_NAME(bs_cell_t) *r[8];
+
+    for (unsigned int i = 0; i < 8; i++)
+        r[i] = (BS_NAME(bs_cell_t) *)w[i];
+
+    for (unsigned int i = 0; i < CSA_SCHEDULE_SIZE; i++)
+    {
+        const BS_NAME(bs_cell_t) k =
+            zero ^ (key->sch[i] * 0x0101010101010101ULL);
+
+        for (unsigned int c = 0; c < BS_CELLS; c++)
+        {
+            BS_NAME(bs_cell_t) s, t;
+            BS_SBOX_LOOKUP(r[7][c] ^ k, s, t);
+
+            const BS_NAME(bs_cell_t) l = r[0][c];
+            r[2][c] ^= l;
+            r[3][c] ^= l;
+            r[4][c] ^= l;
+            r[6][c] ^= t;
+            r[0][c] = l ^ s;
+        }
+
+        BS_NAME(bs_cell_t) *const l = r[0];
+        memmove(&r[0], &r[1], 7 * sizeof(r[0]));
+        r[7] = l;
+    }
+}
+
+#undef BS_CELLS
+#undef BS_SBOX_LOOKUP
+
+/* collect packets of a batch; returns packet count */
+static
+size_t BS_NAME(bs_batch)(const csa_batch_t *batch, unsigned int maxlen
+                         , uint8_t **data, unsigned int *len
+                         , unsigned int *maxblk)
+{
+    size_t cnt = 0;
+
+    *maxblk = 0;
+    for (; cnt < BS_BITS && batch[cnt].data != NULL; cnt++)
+    {
+        unsigned int plen = batch[cnt].len;
+        if (plen > maxlen)
+            plen = maxlen;
+
+        /* packets shorter than one block are left as is */
+        if (plen < CSA_BLOCK_SIZE)
+            plen = 0;
+
+        data[cnt] = batch[cnt].data;
+        len[cnt] = plen;
+
+        if (*maxblk < plen / CSA_BLOCK_SIZE)
+            *maxblk = plen / CSA_BLOCK_SIZE;
+    }
+
+    return cnt;
+}
+
+static BS_TARGET
+void BS_NAME(csa_decrypt)(const csa_key_t *key, const csa_batch_t *batch
+                          , unsigned int maxlen)
+{
+    uint8_t *data[BS_BITS];
+    unsigned int len[BS_BITS];
+    unsigned int maxblk;
+
+    const size_t cnt = BS_NAME(bs_batch)(batch, maxlen, data, len, &maxblk);
+    if (maxblk == 0)
+        return;
+
+    BS_NAME(bs_stream_t) st;
+    BS_NAME(bs_row_t) rows[2][8];
+    BS_NAME(bs_row_t) *cur = rows[0];
+    BS_NAME(bs_row_t) *next = rows[1];
+    uint64_t blk[BS_BITS];
+
+    memset(blk, 0, sizeof(blk));
+    memset(rows, 0, sizeof(rows));
+
+    /* first ciphertext block is both the IV and the first block input */
+    for (size_t p = 0; p < cnt; p++)
+    {
+        if (len[p] == 0)
+            continue;
+
+        blk[p] = csa_load_be64(data[p]);
+        for (unsigned int b = 0; b < CSA_BLOCK_SIZE; b++)
+            ((uint8_t *)cur[b])[p] = data[p][b];
+    }
+
+    BS_NAME(bs_stream_init)(&st, key, blk);
+
+    for (unsigned int k = 1; k <= maxblk; k++)
+    {
+        const unsigned int pos = k * CSA_BLOCK_SIZE;
+
+        bool need_ks = false;
+        for (size_t p = 0; p < cnt && !need_ks; p++)
+            need_ks = (len[p] > pos);
+
+        if (need_ks)
+            BS_NAME(bs_stream_block)(&st, blk);
+
+        for (size_t p = 0; p < cnt; p++)
+        {
+            const unsigned int plen = len[p];
+            if (plen < pos)
+                continue;
+
+            uint8_t *const ptr = &data[p][pos];
+            const unsigned int rest = plen - pos;
+
+            if (rest >= CSA_BLOCK_SIZE)
+            {
+                const uint64_t x = csa_load_be64(ptr) ^ blk[p];
+                for (unsigned int b = 0; b < CSA_BLOCK_SIZE; b++)
+                    ((uint8_t *)next[b])[p] = (uint8_t)(x >> (56 - b * 8));
+            }
+            else
+            {
+                /* last full block chains into zeros; residue is stream only */
+                for (unsigned int b = 0; b < rest; b++)
+                    ptr[b] ^= (uint8_t)(blk[p] >> (56 - b * 8));
+
+                for (unsigned int b = 0; b < CSA_BLOCK_SIZE; b++)
+                    ((uint8_t *)next[b])[p] = 0;
+            }
+        }
+
+        BS_NAME(bs_block_decrypt)(key, cur);
+
+        for (size_t p = 0; p < cnt; p++)
+        {
+            if (len[p] < pos)
+                continue;
+
+            uint8_t *const ptr = &data[p][pos - CSA_BLOCK_SIZE];
+            for (unsigned int b = 0; b < CSA_BLOCK_SIZE; b++)
+                ptr[b] = ((uint8_t *)cur[b])[p] ^ ((uint8_t *)next[b])[p];
+        }
+
+        BS_NAME(bs_row_t) *const tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+}
+
+static BS_TARGET
+void BS_NAME(csa_encrypt)(const csa_key_t *key, const csa_batch_t *batch
+                          , unsigned int maxlen)
+{
+    uint8_t *data[BS_BITS];
+    unsigned int len[BS_BITS];
+    unsigned int maxblk;
+
+    const size_t cnt = BS_NAME(bs_batch)(batch, maxlen, data, len, &maxblk);
+    if (maxblk == 0)
+        return;
+
+    BS_NAME(bs_stream_t) st;
+    BS_NAME(bs_row_t) w[8];
+    uint64_t blk[BS_BITS];
+
+    memset(blk, 0, sizeof(blk));
+    memset(w, 0, sizeof(w));
+
+    /* block layer runs backwards, chaining each block into the previous */
+    for (unsigned int k = maxblk; k > 0; k--)
+    {
+        const unsigned int pos = (k - 1) * CSA_BLOCK_SIZE;
+
+        for (size_t p = 0; p < cnt; p++)
+        {
+            const unsigned int nblk = len[p] / CSA_BLOCK_SIZE;
+            if (nblk < k)
+                continue;
+
+            const uint8_t *const ptr = &data[p][pos];
+            for (unsigned int b = 0; b < CSA_BLOCK_SIZE; b++)
+            {
+                uint8_t *const v = &((uint8_t *)w[b])[p];
+                *v = (nblk == k ? ptr[b] : *v ^ ptr[b]);
+            }
+        }
+
+        BS_NAME(bs_block_encrypt)(key, w);
+
+        for (size_t p = 0; p < cnt; p++)
+        {
+            if (len[p] / CSA_BLOCK_SIZE < k)
+                continue;
+
+            uint8_t *const ptr = &data[p][pos];
+            for (unsigned int b = 0; b < CSA_BLOCK_SIZE; b++)
+                ptr[b] = ((uint8_t *)w[b])[p];
+        }
+    }
+
+    /* stream layer runs forwards, keyed by the first output block */
+    for (size_t p = 0; p < cnt; p++)
+    {
+        if (len[p] > 0)
+            blk[p] = csa_load_be64(data[p]);
+    }
+
+    BS_NAME(bs_stream_init)(&st, key, blk);
+
+    for (unsigned int pos = CSA_BLOCK_SIZE; ; pos += CSA_BLOCK_SIZE)
+    {
+        bool need_ks = false;
+        for (size_t p = 0; p < cnt && !need_ks; p++)
+            need_ks = (len[p] > pos);
+
+        if (!need_ks)
+            break;
+
+        BS_NAME(bs_stream_block)(&st, blk);
+
+        for (size_t p = 0; p < cnt; p++)
+        {
+            if (len[p] <= pos)
+                continue;
+
+            unsigned int rest = len[p] - pos;
+            if (rest > CSA_BLOCK_SIZE)
+                rest = CSA_BLOCK_SIZE;
+
+            uint8_t *const ptr = &data[p][pos];
+            for (unsigned int b = 0; b < rest; b++)
+                ptr[b] ^= (uint8_t)(blk[p] >> (56 - b * 8));
+        }
+    }
+}
+
+#undef BS_LANES
+#undef BS_INLINE
+#undef BS_LANE
+#undef BS_NAME
+#undef BS_WORD
+#undef BS_BITS
+#undef BS_TARGET
+#undef BS_SBOX_VEC
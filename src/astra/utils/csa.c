@@ -0,0 +1,712 @@
+/*
+ * Astra Utils (DVB Common Scrambling Algorithm)
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * DVB-CSA descrambling and scrambling, as specified in ETSI ETR 289
+ * and described in:
+ *
+ * E. Tews, J. Waelde, M. Weiner, "Breaking DVB-CSA", WEWoRC 2011
+ *
+ * au_csa_encrypt() and au_csa_decrypt() are a straightforward one
+ * packet at a time reference. Batch engines process up to 64, 128,
+ * 256 or 512 packets at once, depending on vector width; the widest
+ * one the CPU supports is picked at run time. When built with
+ * libdvbcsa, au_csa_engine() returns that library instead.
+ */
+
+#include <astra/astra.h>
+#include <astra/utils/csa.h>
+
+#ifdef HAVE_DVBCSA
+#   include <dvbcsa/dvbcsa.h>
+#endif /* HAVE_DVBCSA */
+
+#ifdef HAVE_SIMD_TARGETS
+#   include <immintrin.h>
+#endif /* HAVE_SIMD_TARGETS */
+
+#ifdef __GNUC__
+#   define CSA_INLINE static inline __attribute__((__always_inline__))
+#else /* __GNUC__ */
+#   define CSA_INLINE static inline
+#endif /* !__GNUC__ */
+
+/*
+ * tables
+ */
+
+static
+const uint8_t block_sbox[256] =
+{
+    0x3a, 0xea, 0x68, 0xfe, 0x33, 0xe9, 0x88, 0x1a, 0x83, 0xcf, 0xe1, 0x7f,
+    0xba, 0xe2, 0x38, 0x12, 0xe8, 0x27, 0x61, 0x95, 0x0c, 0x36, 0xe5, 0x70,
+    0xa2, 0x06, 0x82, 0x7c, 0x17, 0xa3, 0x26, 0x49, 0xbe, 0x7a, 0x6d, 0x47,
+    0xc1, 0x51, 0x8f, 0xf3, 0xcc, 0x5b, 0x67, 0xbd, 0xcd, 0x18, 0x08, 0xc9,
+    0xff, 0x69, 0xef, 0x03, 0x4e, 0x48, 0x4a, 0x84, 0x3f, 0xb4, 0x10, 0x04,
+    0xdc, 0xf5, 0x5c, 0xc6, 0x16, 0xab, 0xac, 0x4c, 0xf1, 0x6a, 0x2f, 0x3c,
+    0x3b, 0xd4, 0xd5, 0x94, 0xd0, 0xc4, 0x63, 0x62, 0x71, 0xa1, 0xf9, 0x4f,
+    0x2e, 0xaa, 0xc5, 0x56, 0xe3, 0x39, 0x93, 0xce, 0x65, 0x64, 0xe4, 0x58,
+    0x6c, 0x19, 0x42, 0x79, 0xdd, 0xee, 0x96, 0xf6, 0x8a, 0xec, 0x1e, 0x85,
+    0x53, 0x45, 0xde, 0xbb, 0x7e, 0x0a, 0x9a, 0x13, 0x2a, 0x9d, 0xc2, 0x5e,
+    0x5a, 0x1f, 0x32, 0x35, 0x9c, 0xa8, 0x73, 0x30, 0x29, 0x3d, 0xe7, 0x92,
+    0x87, 0x1b, 0x2b, 0x4b, 0xa5, 0x57, 0x97, 0x40, 0x15, 0xe6, 0xbc, 0x0e,
+    0xeb, 0xc3, 0x34, 0x2d, 0xb8, 0x44, 0x25, 0xa4, 0x1c, 0xc7, 0x23, 0xed,
+    0x90, 0x6e, 0x50, 0x00, 0x99, 0x9e, 0x4d, 0xd9, 0xda, 0x8d, 0x6f, 0x5f,
+    0x3e, 0xd7, 0x21, 0x74, 0x86, 0xdf, 0x6b, 0x05, 0x8e, 0x5d, 0x37, 0x11,
+    0xd2, 0x28, 0x75, 0xd6, 0xa7, 0x77, 0x24, 0xbf, 0xf0, 0xb0, 0x02, 0xb7,
+    0xf8, 0xfc, 0x81, 0x09, 0xb1, 0x01, 0x76, 0x91, 0x7d, 0x0f, 0xc8, 0xa0,
+    0xf2, 0xcb, 0x78, 0x60, 0xd1, 0xf7, 0xe0, 0xb5, 0x98, 0x22, 0xb3, 0x20,
+    0x1d, 0xa6, 0xdb, 0x7b, 0x59, 0x9f, 0xae, 0x31, 0xfb, 0xd3, 0xb6, 0xca,
+    0x43, 0x72, 0x07, 0xf4, 0xd8, 0x41, 0x14, 0x55, 0x0d, 0x54, 0x8b, 0xb9,
+    0xad, 0x46, 0x0b, 0xaf, 0x80, 0x52, 0x2c, 0xfa, 0x8c, 0x89, 0x66, 0xfd,
+    0xb2, 0xa9, 0x9b, 0xc0,
+};
+
+/* bit permutation applied to the block cipher S-box output */
+static
+const uint8_t block_perm[256] =
+{
+    0x00, 0x02, 0x80, 0x82, 0x20, 0x22, 0xa0, 0xa2, 0x10, 0x12, 0x90, 0x92,
+    0x30, 0x32, 0xb0, 0xb2, 0x04, 0x06, 0x84, 0x86, 0x24, 0x26, 0xa4, 0xa6,
+    0x14, 0x16, 0x94, 0x96, 0x34, 0x36, 0xb4, 0xb6, 0x40, 0x42, 0xc0, 0xc2,
+    0x60, 0x62, 0xe0, 0xe2, 0x50, 0x52, 0xd0, 0xd2, 0x70, 0x72, 0xf0, 0xf2,
+    0x44, 0x46, 0xc4, 0xc6, 0x64, 0x66, 0xe4, 0xe6, 0x54, 0x56, 0xd4, 0xd6,
+    0x74, 0x76, 0xf4, 0xf6, 0x01, 0x03, 0x81, 0x83, 0x21, 0x23, 0xa1, 0xa3,
+    0x11, 0x13, 0x91, 0x93, 0x31, 0x33, 0xb1, 0xb3, 0x05, 0x07, 0x85, 0x87,
+    0x25, 0x27, 0xa5, 0xa7, 0x15, 0x17, 0x95, 0x97, 0x35, 0x37, 0xb5, 0xb7,
+    0x41, 0x43, 0xc1, 0xc3, 0x61, 0x63, 0xe1, 0xe3, 0x51, 0x53, 0xd1, 0xd3,
+    0x71, 0x73, 0xf1, 0xf3, 0x45, 0x47, 0xc5, 0xc7, 0x65, 0x67, 0xe5, 0xe7,
+    0x55, 0x57, 0xd5, 0xd7, 0x75, 0x77, 0xf5, 0xf7, 0x08, 0x0a, 0x88, 0x8a,
+    0x28, 0x2a, 0xa8, 0xaa, 0x18, 0x1a, 0x98, 0x9a, 0x38, 0x3a, 0xb8, 0xba,
+    0x0c, 0x0e, 0x8c, 0x8e, 0x2c, 0x2e, 0xac, 0xae, 0x1c, 0x1e, 0x9c, 0x9e,
+    0x3c, 0x3e, 0xbc, 0xbe, 0x48, 0x4a, 0xc8, 0xca, 0x68, 0x6a, 0xe8, 0xea,
+    0x58, 0x5a, 0xd8, 0xda, 0x78, 0x7a, 0xf8, 0xfa, 0x4c, 0x4e, 0xcc, 0xce,
+    0x6c, 0x6e, 0xec, 0xee, 0x5c, 0x5e, 0xdc, 0xde, 0x7c, 0x7e, 0xfc, 0xfe,
+    0x09, 0x0b, 0x89, 0x8b, 0x29, 0x2b, 0xa9, 0xab, 0x19, 0x1b, 0x99, 0x9b,
+    0x39, 0x3b, 0xb9, 0xbb, 0x0d, 0x0f, 0x8d, 0x8f, 0x2d, 0x2f, 0xad, 0xaf,
+    0x1d, 0x1f, 0x9d, 0x9f, 0x3d, 0x3f, 0xbd, 0xbf, 0x49, 0x4b, 0xc9, 0xcb,
+    0x69, 0x6b, 0xe9, 0xeb, 0x59, 0x5b, 0xd9, 0xdb, 0x79, 0x7b, 0xf9, 0xfb,
+    0x4d, 0x4f, 0xcd, 0xcf, 0x6d, 0x6f, 0xed, 0xef, 0x5d, 0x5f, 0xdd, 0xdf,
+    0x7d, 0x7f, 0xfd, 0xff,
+};
+
+/* block_perm[block_sbox[x]], saves a dependent lookup */
+static
+const uint8_t block_sbox_perm[256] =
+{
+    0xd4, 0xd9, 0x51, 0xfd, 0xc6, 0x5b, 0x18, 0x94, 0x8a, 0xbb, 0x4b, 0xf7,
+    0xdc, 0xc9, 0x54, 0x84, 0x59, 0xe2, 0x43, 0x2e, 0x30, 0xe4, 0x6b, 0x45,
+    0xc8, 0xa0, 0x88, 0x75, 0xa6, 0xca, 0xe0, 0x13, 0xfc, 0xd5, 0x73, 0xa3,
+    0x0b, 0x07, 0xba, 0xcf, 0x39, 0x97, 0xe3, 0x7e, 0x3b, 0x14, 0x10, 0x1b,
+    0xff, 0x53, 0xfb, 0x82, 0xb1, 0x11, 0x91, 0x28, 0xf6, 0x6c, 0x04, 0x20,
+    0x3d, 0x6f, 0x35, 0xa9, 0xa4, 0xda, 0x78, 0x31, 0x4f, 0xd1, 0xf2, 0x74,
+    0xd6, 0x2d, 0x2f, 0x2c, 0x0d, 0x29, 0xc3, 0xc1, 0x47, 0x4a, 0x5f, 0xb3,
+    0xf0, 0xd8, 0x2b, 0xa5, 0xcb, 0x56, 0x8e, 0xb9, 0x63, 0x61, 0x69, 0x15,
+    0x71, 0x16, 0x81, 0x57, 0x3f, 0xf9, 0xac, 0xed, 0x98, 0x79, 0xb4, 0x2a,
+    0x87, 0x23, 0xbd, 0xde, 0xf5, 0x90, 0x9c, 0x86, 0xd0, 0x3e, 0x89, 0xb5,
+    0x95, 0xb6, 0xc4, 0x66, 0x3c, 0x58, 0xc7, 0x44, 0x52, 0x76, 0xeb, 0x8c,
+    0xaa, 0x96, 0xd2, 0x93, 0x6a, 0xa7, 0xae, 0x01, 0x26, 0xe9, 0x7c, 0xb0,
+    0xdb, 0x8b, 0x64, 0x72, 0x5c, 0x21, 0x62, 0x68, 0x34, 0xab, 0xc2, 0x7b,
+    0x0c, 0xf1, 0x05, 0x00, 0x1e, 0xbc, 0x33, 0x1f, 0x9d, 0x3a, 0xf3, 0xb7,
+    0xf4, 0xaf, 0x42, 0x65, 0xa8, 0xbf, 0xd3, 0x22, 0xb8, 0x37, 0xe6, 0x06,
+    0x8d, 0x50, 0x67, 0xad, 0xea, 0xe7, 0x60, 0xfe, 0x4d, 0x4c, 0x80, 0xee,
+    0x5d, 0x7d, 0x0a, 0x12, 0x4e, 0x02, 0xe5, 0x0e, 0x77, 0xb2, 0x19, 0x48,
+    0xcd, 0x9b, 0x55, 0x41, 0x0f, 0xef, 0x49, 0x6e, 0x1c, 0xc0, 0xce, 0x40,
+    0x36, 0xe8, 0x9f, 0xd7, 0x17, 0xbe, 0xf8, 0x46, 0xdf, 0x8f, 0xec, 0x99,
+    0x83, 0xc5, 0xa2, 0x6d, 0x1d, 0x03, 0x24, 0x27, 0x32, 0x25, 0x9a, 0x5e,
+    0x7a, 0xa1, 0x92, 0xfa, 0x08, 0x85, 0x70, 0xdd, 0x38, 0x1a, 0xe1, 0x7f,
+    0xcc, 0x5a, 0x9e, 0x09,
+};
+
+/* key schedule bit permutation, 1-based, MSB of the first byte is bit 1 */
+static
+const uint8_t key_perm[64] =
+{
+    0x12, 0x24, 0x09, 0x07, 0x2a, 0x31, 0x1d, 0x15,
+    0x1c, 0x36, 0x3e, 0x32, 0x13, 0x21, 0x3b, 0x40,
+    0x18, 0x14, 0x25, 0x27, 0x02, 0x35, 0x1b, 0x01,
+    0x22, 0x04, 0x0d, 0x0e, 0x39, 0x28, 0x1a, 0x29,
+    0x33, 0x23, 0x34, 0x0c, 0x16, 0x30, 0x1e, 0x3a,
+    0x2d, 0x1f, 0x08, 0x19, 0x17, 0x2f, 0x3d, 0x11,
+    0x3c, 0x05, 0x38, 0x2b, 0x0b, 0x06, 0x0a, 0x2c,
+    0x20, 0x3f, 0x2e, 0x0f, 0x03, 0x26, 0x10, 0x37,
+};
+
+/* stream cipher S-boxes, 5 input bits to 2 output bits */
+static
+const uint8_t stream_sbox[7][32] =
+{
+    {
+        2, 0, 1, 1, 2, 3, 3, 0, 3, 2, 2, 0, 1, 1, 0, 3,
+        0, 3, 3, 0, 2, 2, 1, 1, 2, 2, 0, 3, 1, 1, 3, 0,
+    },
+    {
+        3, 1, 0, 2, 2, 3, 3, 0, 1, 3, 2, 1, 0, 0, 1, 2,
+        3, 1, 0, 3, 3, 2, 0, 2, 0, 0, 1, 2, 2, 1, 3, 1,
+    },
+    {
+        2, 0, 1, 2, 2, 3, 3, 1, 1, 1, 0, 3, 3, 0, 2, 0,
+        1, 3, 0, 1, 3, 0, 2, 2, 2, 0, 1, 2, 0, 3, 3, 1,
+    },
+    {
+        3, 1, 2, 3, 0, 2, 1, 2, 1, 2, 0, 1, 3, 0, 0, 3,
+        1, 0, 3, 1, 2, 3, 0, 3, 0, 3, 2, 0, 1, 2, 2, 1,
+    },
+    {
+        2, 0, 0, 1, 3, 2, 3, 2, 0, 1, 3, 3, 1, 0, 2, 1,
+        2, 3, 2, 0, 0, 3, 1, 1, 1, 0, 3, 2, 3, 1, 0, 2,
+    },
+    {
+        0, 1, 2, 3, 1, 2, 2, 0, 0, 1, 3, 0, 2, 3, 1, 3,
+        2, 3, 0, 2, 3, 0, 1, 1, 2, 1, 1, 2, 0, 3, 3, 0,
+    },
+    {
+        0, 3, 2, 2, 3, 0, 0, 1, 3, 0, 1, 3, 1, 2, 2, 1,
+        1, 0, 3, 3, 0, 1, 1, 2, 2, 3, 1, 0, 2, 3, 0, 2,
+    },
+};
+
+/*
+ * Same S-boxes as truth tables for the bitsliced code: bit i of
+ * stream_sbox_tt[n][k] is bit k of stream_sbox[n][i].
+ */
+static
+const uint32_t stream_sbox_tt[7][2] =
+{
+    { 0x78c6b16c, 0x4b368771 },
+    { 0xe41b4b63, 0x58b98679 },
+    { 0xe41b1be4, 0x69d25879 },
+    { 0x92ad994b, 0x66b492ad },
+    { 0x35e29e58, 0x9c274cf1 },
+    { 0x66d2e61a, 0x691bb46c },
+    { 0x266d9d92, 0xb38c691e },
+};
+
+static inline
+uint64_t csa_load_be64(const uint8_t *p)
+{
+    return ((uint64_t)asc_get_be32(p) << 32) | asc_get_be32(&p[4]);
+}
+
+/*
+ * key schedule
+ */
+
+static
+uint64_t key_permute(uint64_t k)
+{
+    uint64_t out = 0;
+
+    for (unsigned int i = 0; i < 64; i++)
+    {
+        if ((k >> (63 - i)) & 1)
+            out |= (uint64_t)1 << (64 - key_perm[i]);
+    }
+
+    return out;
+}
+
+csa_key_t *au_csa_key_init(void)
+{
+    csa_key_t *const key = ASC_ALLOC(1, csa_key_t);
+
+#ifdef HAVE_DVBCSA
+    key->bs = dvbcsa_bs_key_alloc();
+    ASC_ASSERT(key->bs != NULL, "[csa] dvbcsa_bs_key_alloc() failed");
+#endif /* HAVE_DVBCSA */
+
+    return key;
+}
+
+void au_csa_key_destroy(csa_key_t *key)
+{
+#ifdef HAVE_DVBCSA
+    dvbcsa_bs_key_free(key->bs);
+#endif /* HAVE_DVBCSA */
+
+    free(key);
+}
+
+void au_csa_key_set(csa_key_t *key, const uint8_t *cw)
+{
+    memcpy(key->cw, cw, CSA_CW_SIZE);
+
+#ifdef HAVE_DVBCSA
+    dvbcsa_bs_key_set(cw, key->bs);
+#endif /* HAVE_DVBCSA */
+
+    /* last 8 schedule bytes come from the CW, earlier ones are permuted */
+    uint64_t k = csa_load_be64(cw);
+    for (unsigned int i = CSA_SCHEDULE_SIZE / 8; i-- > 0;)
+    {
+        for (unsigned int j = 0; j < 8; j++)
+            key->sch[i * 8 + j] = (uint8_t)(k >> (56 - j * 8)) ^ i;
+
+        k = key_permute(k);
+    }
+}
+
+/*
+ * reference implementation
+ */
+
+typedef struct
+{
+    uint8_t a[10]; /* A1..A10 */
+    uint8_t b[10]; /* B1..B10 */
+    uint8_t x, y, z;
+    uint8_t d, e, f;
+    uint8_t p, q, r;
+} csa_stream_t;
+
+#define BIT(_v, _n) (((_v) >> (_n)) & 1)
+
+/*
+ * Clock the stream cipher four times, two output bits per clock.
+ * While initializing, the IV byte is fed into both registers and
+ * the output is discarded.
+ */
+static
+uint8_t stream_byte(csa_stream_t *st, bool init, uint8_t in)
+{
+    const uint8_t in1 = in >> 4;
+    const uint8_t in2 = in & 0x0f;
+    const uint8_t *const a = st->a;
+    const uint8_t *const b = st->b;
+    uint8_t out = 0;
+
+    for (unsigned int j = 0; j < 4; j++)
+    {
+        const uint8_t s1 = stream_sbox[0][BIT(a[3], 0) << 4 | BIT(a[0], 2) << 3
+                                          | BIT(a[5], 1) << 2 | BIT(a[6], 3) << 1
+                                          | BIT(a[8], 0)];
+        const uint8_t s2 = stream_sbox[1][BIT(a[1], 1) << 4 | BIT(a[2], 2) << 3
+                                          | BIT(a[5], 3) << 2 | BIT(a[6], 0) << 1
+                                          | BIT(a[8], 1)];
+        const uint8_t s3 = stream_sbox[2][BIT(a[0], 3) << 4 | BIT(a[1], 0) << 3
+                                          | BIT(a[4], 1) << 2 | BIT(a[4], 3) << 1
+                                          | BIT(a[5], 2)];
+        const uint8_t s4 = stream_sbox[3][BIT(a[2], 3) << 4 | BIT(a[0], 1) << 3
+                                          | BIT(a[1], 3) << 2 | BIT(a[3], 2) << 1
+                                          | BIT(a[7], 0)];
+        const uint8_t s5 = stream_sbox[4][BIT(a[4], 2) << 4 | BIT(a[3], 3) << 3
+                                          | BIT(a[5], 0) << 2 | BIT(a[7], 1) << 1
+                                          | BIT(a[8], 2)];
+        const uint8_t s6 = stream_sbox[5][BIT(a[2], 1) << 4 | BIT(a[3], 1) << 3
+                                          | BIT(a[4], 0) << 2 | BIT(a[6], 2) << 1
+                                          | BIT(a[8], 3)];
+        const uint8_t s7 = stream_sbox[6][BIT(a[1], 2) << 4 | BIT(a[2], 0) << 3
+                                          | BIT(a[6], 1) << 2 | BIT(a[7], 2) << 1
+                                          | BIT(a[7], 3)];
+
+        const uint8_t extra =
+            (BIT(b[2], 0) ^ BIT(b[5], 1) ^ BIT(b[6], 2) ^ BIT(b[8], 3)) << 3
+            | (BIT(b[5], 0) ^ BIT(b[7], 1) ^ BIT(b[2], 3) ^ BIT(b[3], 2)) << 2
+            | (BIT(b[4], 3) ^ BIT(b[7], 2) ^ BIT(b[3], 0) ^ BIT(b[4], 1)) << 1
+            | (BIT(b[8], 2) ^ BIT(b[5], 3) ^ BIT(b[2], 1) ^ BIT(b[7], 0));
+
+        uint8_t next_a = a[9] ^ st->x;
+        uint8_t next_b = b[6] ^ b[9] ^ st->y;
+        if (init)
+        {
+            next_a ^= st->d ^ ((j & 1) ? in2 : in1);
+            next_b ^= ((j & 1) ? in1 : in2);
+        }
+
+        if (st->p)
+            next_b = ((next_b << 1) | (next_b >> 3)) & 0x0f;
+
+        st->d = st->e ^ st->z ^ extra;
+
+        const uint8_t next_e = st->f;
+        if (st->q)
+        {
+            st->f = st->z + st->e + st->r;
+            st->r = (st->f >> 4) & 1;
+            st->f &= 0x0f;
+        }
+        else
+        {
+            st->f = st->e;
+        }
+        st->e = next_e;
+
+        memmove(&st->a[1], &st->a[0], 9);
+        memmove(&st->b[1], &st->b[0], 9);
+        st->a[0] = next_a;
+        st->b[0] = next_b;
+
+        st->x = BIT(s4, 0) << 3 | BIT(s3, 0) << 2 | BIT(s2, 1) << 1 | BIT(s1, 1);
+        st->y = BIT(s6, 0) << 3 | BIT(s5, 0) << 2 | BIT(s4, 1) << 1 | BIT(s3, 1);
+        st->z = BIT(s2, 0) << 3 | BIT(s1, 0) << 2 | BIT(s7, 1) << 1 | BIT(s6, 1);
+        st->p = BIT(s7, 1);
+        st->q = BIT(s7, 0);
+
+        out = (out << 2) | (BIT(st->d, 3) ^ BIT(st->d, 2)) << 1
+              | (BIT(st->d, 1) ^ BIT(st->d, 0));
+    }
+
+    return out;
+}
+
+#undef BIT
+
+static
+void stream_init(csa_stream_t *st, const csa_key_t *key, const uint8_t *iv)
+{
+    memset(st, 0, sizeof(*st));
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        st->a[i * 2] = key->cw[i] >> 4;
+        st->a[i * 2 + 1] = key->cw[i] & 0x0f;
+        st->b[i * 2] = key->cw[4 + i] >> 4;
+        st->b[i * 2 + 1] = key->cw[4 + i] & 0x0f;
+    }
+
+    for (unsigned int i = 0; i < CSA_BLOCK_SIZE; i++)
+        stream_byte(st, true, iv[i]);
+}
+
+static
+void stream_xor(csa_stream_t *st, uint8_t *data, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i++)
+        data[i] ^= stream_byte(st, false, 0);
+}
+
+static
+void block_decrypt(const csa_key_t *key, const uint8_t *in, uint8_t *out)
+{
+    uint8_t w[8];
+    memcpy(w, in, sizeof(w));
+
+    for (int i = CSA_SCHEDULE_SIZE - 1; i >= 0; i--)
+    {
+        const uint8_t s = block_sbox[key->sch[i] ^ w[6]];
+        const uint8_t l = w[7] ^ s;
+
+        w[7] = w[6];
+        w[6] = w[5] ^ block_perm[s];
+        w[5] = w[4];
+        w[4] = w[3] ^ l;
+        w[3] = w[2] ^ l;
+        w[2] = w[1] ^ l;
+        w[1] = w[0];
+        w[0] = l;
+    }
+
+    memcpy(out, w, sizeof(w));
+}
+
+static
+void block_encrypt(const csa_key_t *key, const uint8_t *in, uint8_t *out)
+{
+    uint8_t w[8];
+    memcpy(w, in, sizeof(w));
+
+    for (unsigned int i = 0; i < CSA_SCHEDULE_SIZE; i++)
+    {
+        const uint8_t s = block_sbox[key->sch[i] ^ w[7]];
+        const uint8_t l = w[0];
+
+        w[0] = w[1];
+        w[1] = w[2] ^ l;
+        w[2] = w[3] ^ l;
+        w[3] = w[4] ^ l;
+        w[4] = w[5];
+        w[5] = w[6] ^ block_perm[s];
+        w[6] = w[7];
+        w[7] = l ^ s;
+    }
+
+    memcpy(out, w, sizeof(w));
+}
+
+void au_csa_decrypt(const csa_key_t *key, uint8_t *data, unsigned int len)
+{
+    const unsigned int nblk = len / CSA_BLOCK_SIZE;
+    if (nblk == 0)
+        return;
+
+    csa_stream_t st;
+    uint8_t ib[CSA_BLOCK_SIZE];
+    uint8_t next[CSA_BLOCK_SIZE];
+
+    memcpy(ib, data, sizeof(ib));
+    stream_init(&st, key, ib);
+
+    for (unsigned int i = 1; i <= nblk; i++)
+    {
+        uint8_t *const prev = &data[(i - 1) * CSA_BLOCK_SIZE];
+        uint8_t *const ptr = &data[i * CSA_BLOCK_SIZE];
+
+        if (i < nblk)
+        {
+            memcpy(next, ptr, sizeof(next));
+            stream_xor(&st, next, sizeof(next));
+        }
+        else
+        {
+            /* residue is scrambled by the stream cipher alone */
+            stream_xor(&st, ptr, len - i * CSA_BLOCK_SIZE);
+            memset(next, 0, sizeof(next));
+        }
+
+        block_decrypt(key, ib, prev);
+        for (unsigned int j = 0; j < CSA_BLOCK_SIZE; j++)
+            prev[j] ^= next[j];
+
+        memcpy(ib, next, sizeof(ib));
+    }
+}
+
+void au_csa_encrypt(const csa_key_t *key, uint8_t *data, unsigned int len)
+{
+    const unsigned int nblk = len / CSA_BLOCK_SIZE;
+    if (nblk == 0)
+        return;
+
+    uint8_t ib[CSA_BLOCK_SIZE] = { 0 };
+
+    for (unsigned int i = nblk; i > 0; i--)
+    {
+        uint8_t *const ptr = &data[(i - 1) * CSA_BLOCK_SIZE];
+
+        for (unsigned int j = 0; j < CSA_BLOCK_SIZE; j++)
+            ib[j] ^= ptr[j];
+
+        block_encrypt(key, ib, ib);
+        memcpy(ptr, ib, sizeof(ib));
+    }
+
+    csa_stream_t st;
+    stream_init(&st, key, data);
+    stream_xor(&st, &data[CSA_BLOCK_SIZE], len - CSA_BLOCK_SIZE);
+}
+
+/*
+ * batch engines
+ */
+
+/*
+ * Transpose a 64x64 bit matrix: bit 63 - j of m[i] is swapped with
+ * bit 63 - i of m[j].
+ */
+static inline
+void csa_transpose64(uint64_t *m)
+{
+    uint64_t mask = 0x00000000ffffffffULL;
+
+    for (unsigned int j = 32; j != 0; j >>= 1, mask ^= (mask << j))
+    {
+        for (unsigned int k = 0; k < 64; k = ((k | j) + 1) & ~j)
+        {
+            const uint64_t t = (m[k] ^ (m[k | j] >> j)) & mask;
+
+            m[k] ^= t;
+            m[k | j] ^= t << j;
+        }
+    }
+}
+
+#define BS_NAME(_x) _x##_generic
+#define BS_WORD uint64_t
+#define BS_BITS 64
+#define BS_TARGET
+#include "csa-bs.h"
+
+#ifdef HAVE_SIMD_TARGETS
+typedef uint64_t csa_v128_t __attribute__((__vector_size__(16)));
+typedef uint64_t csa_v256_t __attribute__((__vector_size__(32)));
+typedef uint64_t csa_v512_t __attribute__((__vector_size__(64)));
+
+#define AVX2_TARGET __attribute__((__target__("avx2")))
+#define AVX512_TARGET __attribute__((__target__("avx512f,avx512bw,avx512vbmi")))
+
+/*
+ * AVX2 walks the 256-byte table 16 entries at a time with PSHUFB,
+ * taking 16 off the index on every step. Saturating add sets bit 7
+ * for indices outside the current slice, which makes PSHUFB return 0.
+ */
+static inline AVX2_TARGET
+void csa_sbox_avx2(csa_v256_t x, csa_v256_t *s, csa_v256_t *t)
+{
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(0x10);
+    __m256i idx = (__m256i)x;
+    __m256i rs = _mm256_setzero_si256();
+    __m256i rt = _mm256_setzero_si256();
+
+    for (unsigned int i = 0; i < 256; i += 16)
+    {
+        const __m256i ts = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)&block_sbox[i]));
+        const __m256i tt = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)&block_sbox_perm[i]));
+        const __m256i sel = _mm256_adds_epu8(idx, bias);
+
+        rs = _mm256_or_si256(rs, _mm256_shuffle_epi8(ts, sel));
+        rt = _mm256_or_si256(rt, _mm256_shuffle_epi8(tt, sel));
+        idx = _mm256_sub_epi8(idx, step);
+    }
+
+    *s = (csa_v256_t)rs;
+    *t = (csa_v256_t)rt;
+}
+
+/* VPERMI2B covers 128 entries; bit 7 of the index picks the half */
+static inline AVX512_TARGET
+__m512i csa_lut_avx512(__m512i idx, __mmask64 hi, const uint8_t *tab)
+{
+    const __m512i lo_half =
+        _mm512_permutex2var_epi8(_mm512_loadu_si512(&tab[0]), idx
+                                 , _mm512_loadu_si512(&tab[64]));
+    const __m512i hi_half =
+        _mm512_permutex2var_epi8(_mm512_loadu_si512(&tab[128]), idx
+                                 , _mm512_loadu_si512(&tab[192]));
+
+    return _mm512_mask_blend_epi8(hi, lo_half, hi_half);
+}
+
+static inline AVX512_TARGET
+void csa_sbox_avx512(csa_v512_t x, csa_v512_t *s, csa_v512_t *t)
+{
+    const __m512i idx = (__m512i)x;
+    const __mmask64 hi = _mm512_movepi8_mask(idx);
+
+    *s = (csa_v512_t)csa_lut_avx512(idx, hi, block_sbox);
+    *t = (csa_v512_t)csa_lut_avx512(idx, hi, block_sbox_perm);
+}
+
+#define BS_NAME(_x) _x##_sse2
+#define BS_WORD csa_v128_t
+#define BS_BITS 128
+#define BS_TARGET __attribute__((__target__("sse2")))
+#include "csa-bs.h"
+
+#define BS_NAME(_x) _x##_avx2
+#define BS_WORD csa_v256_t
+#define BS_BITS 256
+#define BS_TARGET AVX2_TARGET
+#define BS_SBOX_VEC(_x, _s, _t) csa_sbox_avx2(_x, &_s, &_t)
+#include "csa-bs.h"
+
+#define BS_NAME(_x) _x##_avx512
+#define BS_WORD csa_v512_t
+#define BS_BITS 512
+#define BS_TARGET AVX512_TARGET
+#define BS_SBOX_VEC(_x, _s, _t) csa_sbox_avx512(_x, &_s, &_t)
+#include "csa-bs.h"
+#endif /* HAVE_SIMD_TARGETS */
+
+/* widest first; each engine's CPU requirement implies the next one's */
+static
+const csa_engine_t csa_engines[] =
+{
+#ifdef HAVE_SIMD_TARGETS
+    { "avx512", 512, csa_encrypt_avx512, csa_decrypt_avx512 },
+    { "avx2", 256, csa_encrypt_avx2, csa_decrypt_avx2 },
+    { "sse2", 128, csa_encrypt_sse2, csa_decrypt_sse2 },
+#endif /* HAVE_SIMD_TARGETS */
+    { "generic", 64, csa_encrypt_generic, csa_decrypt_generic },
+};
+
+static
+size_t csa_engine_first(void)
+{
+    size_t first = 0;
+
+#ifdef HAVE_SIMD_TARGETS
+    __builtin_cpu_init();
+
+    if (!__builtin_cpu_supports("avx512bw")
+        || !__builtin_cpu_supports("avx512vbmi"))
+    {
+        first++;
+        if (!__builtin_cpu_supports("avx2"))
+        {
+            first++;
+            if (!__builtin_cpu_supports("sse2"))
+                first++;
+        }
+    }
+#endif /* HAVE_SIMD_TARGETS */
+
+    return first;
+}
+
+const csa_engine_t *au_csa_engine_list(size_t *cnt)
+{
+    static const csa_engine_t *list = NULL;
+    static size_t list_cnt = 0;
+
+    if (list == NULL)
+    {
+        const size_t first = csa_engine_first();
+
+        list_cnt = ASC_ARRAY_SIZE(csa_engines) - first;
+        list = &csa_engines[first];
+    }
+
+    *cnt = list_cnt;
+    return list;
+}
+
+#ifdef HAVE_DVBCSA
+/* csa_batch_t is laid out like struct dvbcsa_bs_batch_s */
+ASC_STATIC_ASSERT(sizeof(csa_batch_t) == sizeof(struct dvbcsa_bs_batch_s));
+ASC_STATIC_ASSERT(offsetof(csa_batch_t, len)
+                  == offsetof(struct dvbcsa_bs_batch_s, len));
+
+static
+void csa_encrypt_dvbcsa(const csa_key_t *key, const csa_batch_t *batch
+                        , unsigned int maxlen)
+{
+    dvbcsa_bs_encrypt(key->bs, (const struct dvbcsa_bs_batch_s *)batch
+                      , maxlen);
+}
+
+static
+void csa_decrypt_dvbcsa(const csa_key_t *key, const csa_batch_t *batch
+                        , unsigned int maxlen)
+{
+    dvbcsa_bs_decrypt(key->bs, (const struct dvbcsa_bs_batch_s *)batch
+                      , maxlen);
+}
+#endif /* HAVE_DVBCSA */
+
+const csa_engine_t *au_csa_engine(void)
+{
+#ifdef HAVE_DVBCSA
+    /* stays the default until built-in engines see more field use */
+    static csa_engine_t engine =
+    {
+        "libdvbcsa", 0, csa_encrypt_dvbcsa, csa_decrypt_dvbcsa
+    };
+
+    if (engine.batch_size == 0)
+        engine.batch_size = dvbcsa_bs_batch_size();
+
+    return &engine;
+#else /* HAVE_DVBCSA */
+    size_t cnt;
+
+    return au_csa_engine_list(&cnt);
+#endif /* !HAVE_DVBCSA */
+}
@@ -0,0 +1,77 @@
+/*
+ * Astra Utils (DVB Common Scrambling Algorithm)
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AU_CSA_H_
+#define _AU_CSA_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+#define CSA_CW_SIZE 8
+#define CSA_BLOCK_SIZE 8
+#define CSA_SCHEDULE_SIZE 56
+
+struct dvbcsa_bs_key_s;
+
+typedef struct
+{
+    uint8_t cw[CSA_CW_SIZE];
+    uint8_t sch[CSA_SCHEDULE_SIZE];
+#ifdef HAVE_DVBCSA
+    struct dvbcsa_bs_key_s *bs; /* same key for the libdvbcsa engine */
+#endif /* HAVE_DVBCSA */
+} csa_key_t;
+
+/* list of packet payloads, terminated by an entry with data set to NULL */
+typedef struct
+{
+    uint8_t *data;
+    unsigned int len;
+} csa_batch_t;
+
+typedef void (*csa_batch_func_t)(const csa_key_t *key
+                                 , const csa_batch_t *batch
+                                 , unsigned int maxlen);
+
+typedef struct
+{
+    const char *name;
+    unsigned int batch_size;
+    csa_batch_func_t encrypt;
+    csa_batch_func_t decrypt;
+} csa_engine_t;
+
+csa_key_t *au_csa_key_init(void) __asc_result;
+void au_csa_key_destroy(csa_key_t *key);
+void au_csa_key_set(csa_key_t *key, const uint8_t *cw);
+
+/* single packet, reference implementation */
+void au_csa_encrypt(const csa_key_t *key, uint8_t *data, unsigned int len);
+void au_csa_decrypt(const csa_key_t *key, uint8_t *data, unsigned int len);
+
+/*
+ * default engine: libdvbcsa when built with it, otherwise the built-in
+ * bitslice engine with the widest vectors supported by this CPU
+ */
+const csa_engine_t *au_csa_engine(void) __asc_result;
+
+/* built-in engines usable on this CPU, for testing and benchmarking */
+const csa_engine_t *au_csa_engine_list(size_t *cnt) __asc_result;
+
+#endif /* _AU_CSA_H_ */
@@ -28,6 +28,7 @@
 
 #include "dvb.h"
 #include <astra/core/mainloop.h>
+#include <astra/core/ring.h>
 #include <astra/core/thread.h>
 
 #define MSG(_msg) "[ddci %d:%d] " _msg, mod->adapter, mod->frontend
@@ -55,7 +56,8 @@ struct module_data_t
     int dec_sec_fd;
 
     asc_thread_t *sec_thread;
-    asc_thread_buffer_t *sec_thread_output;
+    asc_ring_t *sec_ring;
+    uint64_t sec_overruns;
 
     bool is_ca_thread_started;
     asc_thread_t *ca_thread;
@@ -88,25 +90,29 @@ static void on_thread_close(void *arg)
         asc_wake_close();
     }
 
-    if(mod->sec_thread_output)
-    {
-        asc_job_prune(mod->sec_thread_output);
-        ASC_FREE(mod->sec_thread_output, asc_thread_buffer_destroy);
-    }
+    ASC_FREE(mod->sec_ring, asc_ring_destroy);
 }
 
-static void on_thread_read(void *arg)
+static void on_ring_data(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    uint8_t ts[TS_PACKET_SIZE];
-    while (true)
+    const uint8_t *ts;
+    size_t cnt;
+
+    while((cnt = asc_ring_peek(mod->sec_ring, &ts)) > 0)
     {
-        const ssize_t r = asc_thread_buffer_read(mod->sec_thread_output, ts, sizeof(ts));
-        if (r != sizeof(ts))
-            return;
+        module_stream_send_batch(mod, ts, cnt);
+        asc_ring_skip(mod->sec_ring, cnt);
+    }
 
-        module_stream_send(mod, ts);
+    asc_ring_stats_t st;
+    asc_ring_stats(mod->sec_ring, &st);
+    if(st.overruns > mod->sec_overruns)
+    {
+        asc_log_error(MSG("sec buffer overrun, dropped %" PRIu64 " packets")
+                      , st.overruns - mod->sec_overruns);
+        mod->sec_overruns = st.overruns;
     }
 }
 
@@ -126,22 +132,16 @@ static void thread_loop(void *arg)
 
         if(len == sizeof(ts) && ts[0] == 0x47)
         {
-            const ssize_t r = asc_thread_buffer_write(mod->sec_thread_output, ts, sizeof(ts));
-            if(r != TS_PACKET_SIZE)
-            {
-                // overflow
-            }
-            else
+            /*
+             * TODO: add proper buffering with sync byte alignment checks
+             */
+            if(asc_ring_push(mod->sec_ring, ts))
             {
-                /*
-                 * TODO: add proper buffering with sync byte alignment checks
-                 */
                 system_time = asc_utime();
                 if (system_time > system_time_buffer + 5000)
                 {
                     system_time_buffer = system_time;
-                    asc_job_queue(mod->sec_thread_output, on_thread_read, mod);
-                    asc_wake();
+                    asc_ring_notify(mod->sec_ring);
                 }
             }
         }
@@ -159,7 +159,8 @@ static void sec_open(module_data_t *mod)
 
     asc_wake_open();
 
-    mod->sec_thread_output = asc_thread_buffer_init(BUFFER_SIZE);
+    mod->sec_ring = asc_ring_init(BUFFER_SIZE / TS_PACKET_SIZE
+                                  , on_ring_data, mod);
     mod->sec_thread = asc_thread_init(mod, thread_loop, on_thread_close);
 }
 
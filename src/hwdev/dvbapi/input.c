@@ -184,16 +184,17 @@ static void dvr_on_read(void *arg)
     }
     mod->dvr_read += len;
 
-    for(int i = 0; i < len; i += TS_PACKET_SIZE)
+    const size_t cnt = len / TS_PACKET_SIZE;
+    module_stream_send_batch(mod, mod->dvr_buffer, cnt);
+    mod->packets += cnt;
+
+    for(size_t i = 0; i < cnt; i++)
     {
-        const uint8_t *ts = &mod->dvr_buffer[i];
+        const uint8_t *ts = &mod->dvr_buffer[i * TS_PACKET_SIZE];
 
         if(mod->ca->ca_fd > 0)
             ca_on_ts(mod->ca, ts);
 
-        module_stream_send(mod, ts);
-        mod->packets++;
-
         if(TS_IS_SYNC(ts) && TS_GET_PID(ts) == 0)
             ts_psi_mux(mod->pat, ts, on_pat, mod);
     }
@@ -29,22 +29,47 @@
  *      upstream    - object, stream instance returned by module_instance:stream()
  *      name        - string, analyzer name
  *      rate_stat   - boolean, dump bitrate with 10ms interval
+ *      rate_window - number, keep per-millisecond packet counts for
+ *                    the given number of milliseconds, see rate()
  *      join_pid    - boolean, request all SI tables on the upstream module
+ *      tr101290    - boolean, run TR 101 290 priority 1, 2 and 3 checks
  *      callback    - function(data), events callback:
  *                    data.error    - string,
  *                    data.psi      - table, psi information (PAT, PMT, CAT, SDT)
  *                    data.analyze  - table, per pid information: errors, bitrate
  *                    data.on_air   - boolean, comes with data.analyze, stream status
  *                    data.rate     - table, rate_stat array
+ *                    data.tr101290 - table, comes with data.analyze,
+ *                                    error counters for the last second,
+ *                                    grouped by priority: p1, p2, p3
+ *
+ * Module Methods:
+ *      rate()      - return packet arrival histogram (rate_window option):
+ *                    window - number, histogram length in milliseconds
+ *                    total  - table, packets per millisecond, oldest first;
+ *                             the last entry is the current millisecond
+ *                    pids   - table, same as total for each PID;
+ *                             PIDs not listed in PSI are counted as 0x1FFF
+ *
+ * Packet arrival time is taken once per batch received from upstream.
  */
 
 #include <astra/astra.h>
+#include <astra/core/clock.h>
 #include <astra/core/timer.h>
 #include <astra/luaapi/stream.h>
 #include <astra/mpegts/descriptors.h>
 #include <astra/mpegts/pes.h>
 #include <astra/mpegts/psi.h>
 
+#include "tr101290.h"
+
+typedef struct
+{
+    uint32_t *bins; /* packets per millisecond, ring buffer */
+    uint64_t last;  /* time of the most recent bin, ms */
+} rate_hist_t;
+
 typedef struct
 {
     ts_type_t type;
@@ -57,6 +82,8 @@ typedef struct
     uint32_t cc_error;  // Continuity Counter
     uint32_t sc_error;  // Scrambled
     uint32_t pes_error; // PES header
+
+    rate_hist_t rate;
 } analyze_item_t;
 
 typedef struct
@@ -71,9 +98,11 @@ struct module_data_t
 
     const char *name;
     bool rate_stat;
+    int rate_window;
     int cc_limit;
     int bitrate_limit;
     bool join_pid;
+    bool tr101290;
 
     bool cc_check; // to skip initial cc errors
     bool video_check; // increase bitrate_limit for channel with video stream
@@ -102,6 +131,12 @@ struct module_data_t
     uint32_t ts_count;
     int rate_count;
     int rate[10];
+
+    // rate_window
+    rate_hist_t rate_total;
+
+    // tr101290
+    tr101290_t *tr;
 };
 
 #define MSG(_msg) "[analyze %s] " _msg, mod->name
@@ -165,6 +200,13 @@ static void on_pat(void *arg, ts_psi_t *psi)
     psi->crc32 = crc32;
     mod->tsid = PAT_GET_TSID(psi);
 
+    if(mod->tr)
+    {
+        // PMTs are parsed again below; CAT has to be done explicitly
+        tr101290_unref(mod->tr);
+        mod->cat->crc32 = 0;
+    }
+
     lua_pushstring(L, "pat");
     lua_setfield(L, -2, __psi);
 
@@ -199,6 +241,9 @@ static void on_pat(void *arg, ts_psi_t *psi)
         if(!mod->stream[pid])
             mod->stream[pid] = ASC_ALLOC(1, analyze_item_t);
 
+        if(mod->tr)
+            tr101290_ref_pid(mod->tr, pid, (pnr != 0) ? TR_REF_PMT : 0);
+
         if(pnr != 0)
         {
             mod->stream[pid]->type = TS_TYPE_PMT;
@@ -274,6 +319,9 @@ static void on_cat(void *arg, ts_psi_t *psi)
         ts_desc_to_lua(L, desc_pointer);
         lua_settable(L, -3); // append to the "descriptors" table
 
+        if(mod->tr && desc_pointer[0] == 0x09)
+            tr101290_ref_pid(mod->tr, DESC_CA_PID(desc_pointer), 0);
+
         CAT_DESC_NEXT(psi, desc_pointer);
     }
     lua_setfield(L, -2, __descriptors);
@@ -311,6 +359,11 @@ static void on_pmt(void *arg, ts_psi_t *psi)
         lua_pushstring(L, "PMT checksum error");
         lua_setfield(L, -2, __err);
         callback(L, mod);
+
+        // PMT sections are not reassembled by the TR 101 290 engine
+        if(mod->tr)
+            tr101290_error(mod->tr, TR_CRC);
+
         return;
     }
 
@@ -366,6 +419,9 @@ static void on_pmt(void *arg, ts_psi_t *psi)
         ts_desc_to_lua(L, desc_pointer);
         lua_settable(L, -3); // append to the "descriptors" table
 
+        if(mod->tr && desc_pointer[0] == 0x09)
+            tr101290_ref_pid(mod->tr, DESC_CA_PID(desc_pointer), 0);
+
         PMT_DESC_NEXT(psi, desc_pointer);
     }
     lua_setfield(L, -2, __descriptors);
@@ -373,6 +429,9 @@ static void on_pmt(void *arg, ts_psi_t *psi)
     lua_pushinteger(L, PMT_GET_PCR(psi));
     lua_setfield(L, -2, "pcr");
 
+    if(mod->tr)
+        tr101290_ref_pid(mod->tr, PMT_GET_PCR(psi), TR_REF_PCR);
+
     int streams_count = 1;
     lua_newtable(L);
     const uint8_t *pointer;
@@ -406,9 +465,23 @@ static void on_pmt(void *arg, ts_psi_t *psi)
 
             if(type == 0x06 && mod->stream[pid]->type == TS_TYPE_DATA)
                 mod->stream[pid]->type = ts_priv_type(desc_pointer[0]);
+
+            if(mod->tr && desc_pointer[0] == 0x09)
+                tr101290_ref_pid(mod->tr, DESC_CA_PID(desc_pointer), 0);
         }
         lua_setfield(L, -2, __descriptors);
 
+        if(mod->tr)
+        {
+            unsigned int flags = TR_REF_ES;
+            if(mod->stream[pid]->type == TS_TYPE_VIDEO
+               || mod->stream[pid]->type == TS_TYPE_AUDIO)
+            {
+                flags |= TR_REF_PTS;
+            }
+            tr101290_ref_pid(mod->tr, pid, flags);
+        }
+
         lua_pushstring(L, ts_type_name(mod->stream[pid]->type));
         lua_setfield(L, -2, "type_name");
 
@@ -567,36 +640,83 @@ static void append_rate(module_data_t *mod, int rate)
     }
 }
 
-static void on_ts(module_data_t *mod, const uint8_t *ts)
+static void rate_stat_update(module_data_t *mod, uint64_t now, size_t cnt)
 {
-    if(mod->rate_stat)
+    mod->ts_count += cnt;
+
+    uint64_t diff_interval = 0;
+    const uint64_t cur = now / 10;
+
+    if(cur != mod->last_ts)
     {
-        ++mod->ts_count;
+        if(mod->last_ts != 0 && cur > mod->last_ts)
+            diff_interval = cur - mod->last_ts;
 
-        uint64_t diff_interval = 0;
-        const uint64_t cur = asc_utime() / 10000;
+        mod->last_ts = cur;
+    }
 
-        if(cur != mod->last_ts)
+    if(diff_interval > 0)
+    {
+        if(diff_interval > 1)
         {
-            if(mod->last_ts != 0 && cur > mod->last_ts)
-                diff_interval = cur - mod->last_ts;
-
-            mod->last_ts = cur;
+            for(; diff_interval > 0; --diff_interval)
+                append_rate(mod, 0);
         }
 
-        if(diff_interval > 0)
-        {
-            if(diff_interval > 1)
-            {
-                for(; diff_interval > 0; --diff_interval)
-                    append_rate(mod, 0);
-            }
+        append_rate(mod, mod->ts_count);
+        mod->ts_count = 0;
+    }
+}
 
-            append_rate(mod, mod->ts_count);
-            mod->ts_count = 0;
+static void rate_hist_add(rate_hist_t *hist, size_t window, uint64_t now
+                          , size_t cnt)
+{
+    if(!hist->bins)
+        hist->bins = ASC_ALLOC(window, uint32_t);
+
+    if(now > hist->last)
+    {
+        // clear bins skipped since the last update
+        if(now - hist->last >= window)
+        {
+            memset(hist->bins, 0, window * sizeof(*hist->bins));
+        }
+        else
+        {
+            for(uint64_t t = hist->last + 1; t <= now; ++t)
+                hist->bins[t % window] = 0;
         }
+
+        hist->last = now;
     }
 
+    hist->bins[hist->last % window] += cnt;
+}
+
+static void rate_hist_push(lua_State *L, const rate_hist_t *hist
+                           , size_t window, uint64_t now)
+{
+    lua_createtable(L, window, 0);
+
+    const uint64_t first = now - window + 1;
+    for(size_t i = 0; i < window; ++i)
+    {
+        const uint64_t t = first + i;
+        uint32_t value = 0;
+
+        if(hist->bins && t <= hist->last && hist->last - t < window)
+            value = hist->bins[t % window];
+
+        lua_pushinteger(L, value);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+static void analyze_ts(module_data_t *mod, const uint8_t *ts, uint64_t now)
+{
+    if(mod->tr)
+        tr101290_packet(mod->tr, ts, now);
+
     const uint16_t pid = TS_GET_PID(ts);
     analyze_item_t *item = NULL;
     if(TS_IS_SYNC(ts))
@@ -606,6 +726,9 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
 
     ++item->packets;
 
+    if(mod->rate_window > 0)
+        rate_hist_add(&item->rate, mod->rate_window, now, 1);
+
     if(item->type == TS_TYPE_NULL)
         return;
 
@@ -658,6 +781,34 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     }
 }
 
+static void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t cnt)
+{
+    /*
+     * packets in a batch are treated as having arrived at the same time;
+     * so are single packets delivered in one event loop iteration
+     */
+    uint64_t now = 0;
+    if(mod->rate_stat || mod->rate_window > 0 || mod->tr)
+    {
+        now = asc_loop_time() / 1000;
+
+        if(mod->rate_stat)
+            rate_stat_update(mod, now, cnt);
+
+        if(mod->rate_window > 0)
+            rate_hist_add(&mod->rate_total, mod->rate_window, now, cnt);
+    }
+
+    const uint8_t *const end = &ts[cnt * TS_PACKET_SIZE];
+    for(; ts < end; ts += TS_PACKET_SIZE)
+        analyze_ts(mod, ts, now);
+}
+
+static void on_ts(module_data_t *mod, const uint8_t *ts)
+{
+    on_ts_batch(mod, ts, 1);
+}
+
 /*
  *  oooooooo8 ooooooooooo   o   ooooooooooo
  * 888        88  888  88  888  88  888  88
@@ -667,6 +818,32 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
  *
  */
 
+static void push_tr101290(lua_State *L, module_data_t *mod)
+{
+    static const char *const priorities[] = { "p1", "p2", "p3" };
+
+    uint32_t errors[TR_ERROR_COUNT];
+    tr101290_check(mod->tr, asc_utime() / 1000);
+    tr101290_query(mod->tr, errors);
+
+    lua_newtable(L);
+    for(unsigned int p = 1; p <= 3; ++p)
+    {
+        lua_newtable(L);
+        for(unsigned int i = 0; i < TR_ERROR_COUNT; ++i)
+        {
+            const tr101290_error_t err = (tr101290_error_t)i;
+            if(tr101290_priority(err) != p)
+                continue;
+
+            lua_pushinteger(L, errors[i]);
+            lua_setfield(L, -2, tr101290_name(err));
+        }
+        lua_setfield(L, -2, priorities[p - 1]);
+    }
+    lua_setfield(L, -2, "tr101290");
+}
+
 static void on_check_stat(void *arg)
 {
     module_data_t *const mod = (module_data_t *)arg;
@@ -753,6 +930,9 @@ static void on_check_stat(void *arg)
     }
     lua_setfield(L, -2, "total");
 
+    if(mod->tr)
+        push_tr101290(L, mod);
+
     if(!mod->cc_check)
         mod->cc_check = true;
 
@@ -769,6 +949,37 @@ static void on_check_stat(void *arg)
     callback(L, mod);
 }
 
+static int method_rate(lua_State *L, module_data_t *mod)
+{
+    if(mod->rate_window <= 0)
+        luaL_error(L, MSG("option 'rate_window' is not set"));
+
+    const size_t window = mod->rate_window;
+    const uint64_t now = asc_utime() / 1000;
+
+    lua_newtable(L);
+
+    lua_pushinteger(L, window);
+    lua_setfield(L, -2, "window");
+
+    rate_hist_push(L, &mod->rate_total, window, now);
+    lua_setfield(L, -2, "total");
+
+    lua_newtable(L);
+    for(int i = 0; i < TS_MAX_PIDS; ++i)
+    {
+        const analyze_item_t *const item = mod->stream[i];
+        if(!item || !item->rate.bins)
+            continue;
+
+        rate_hist_push(L, &item->rate, window, now);
+        lua_rawseti(L, -2, i);
+    }
+    lua_setfield(L, -2, "pids");
+
+    return 1;
+}
+
 /*
  * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
  *  8888o   888 o888   888o 888    88o 888    88   888         888    88
@@ -791,11 +1002,16 @@ static void module_init(lua_State *L, module_data_t *mod)
     mod->idx_callback = luaL_ref(L, LUA_REGISTRYINDEX);
 
     module_option_boolean(L, "rate_stat", &mod->rate_stat);
+    module_option_integer(L, "rate_window", &mod->rate_window);
+    if(mod->rate_window < 0 || mod->rate_window > 60000)
+        luaL_error(L, MSG("option 'rate_window' is out of range"));
     module_option_integer(L, "cc_limit", &mod->cc_limit);
     module_option_integer(L, "bitrate_limit", &mod->bitrate_limit);
     module_option_boolean(L, "join_pid", &mod->join_pid);
+    module_option_boolean(L, "tr101290", &mod->tr101290);
 
     module_stream_init(L, mod, on_ts);
+    module_stream_set_batch(mod, on_ts_batch);
     module_demux_set(mod, NULL, NULL);
     if(mod->join_pid)
     {
@@ -803,8 +1019,18 @@ static void module_init(lua_State *L, module_data_t *mod)
         module_demux_join(mod, 0x01);
         module_demux_join(mod, 0x11);
         module_demux_join(mod, 0x12);
+
+        if(mod->tr101290)
+        {
+            module_demux_join(mod, 0x10);
+            module_demux_join(mod, 0x13);
+            module_demux_join(mod, 0x14);
+        }
     }
 
+    if(mod->tr101290)
+        mod->tr = tr101290_init();
+
     // PAT
     mod->stream[0x00] = ASC_ALLOC(1, analyze_item_t);
     mod->stream[0x00]->type = TS_TYPE_PAT;
@@ -842,9 +1068,16 @@ static void module_destroy(module_data_t *mod)
     for(int i = 0; i < TS_MAX_PIDS; ++i)
     {
         if(mod->stream[i])
+        {
+            free(mod->stream[i]->rate.bins);
             free(mod->stream[i]);
+        }
     }
 
+    free(mod->rate_total.bins);
+
+    ASC_FREE(mod->tr, tr101290_destroy);
+
     ts_psi_destroy(mod->pat);
     ts_psi_destroy(mod->cat);
     ts_psi_destroy(mod->sdt);
@@ -856,8 +1089,15 @@ static void module_destroy(module_data_t *mod)
     free(mod->sdt_checksum_list);
 }
 
+static const module_method_t module_methods[] =
+{
+    { "rate", method_rate },
+    { NULL, NULL },
+};
+
 STREAM_MODULE_REGISTER(analyze)
 {
     .init = module_init,
     .destroy = module_destroy,
+    .methods = module_methods,
 };
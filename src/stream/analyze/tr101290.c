@@ -0,0 +1,778 @@
+/*
+ * Astra Module: MPEG-TS (TR 101 290 measurements)
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Priority 1, 2 and 3 checks of ETSI TR 101 290, except for
+ * buffer_error (3.3) and the data broadcast checks (3.9, 3.10).
+ *
+ * All state is allocated at init; the packet path only updates fixed
+ * per-PID records and a few section reassembly buffers for PSI/SI PIDs.
+ *
+ * Timing checks use the arrival time passed by the caller and are only
+ * meaningful for real-time input. PCR accuracy is measured against the
+ * packet position in the multiplex, which assumes constant bitrate.
+ *
+ * Conditions that persist (missing tables, absent PIDs) are counted
+ * once per call to tr101290_check().
+ */
+
+#include <astra/astra.h>
+#include <astra/mpegts/pcr.h>
+#include <astra/mpegts/pes.h>
+#include <astra/mpegts/psi.h>
+
+#include "tr101290.h"
+
+/* maximum repetition intervals, ms */
+#define PAT_INTERVAL 500
+#define PMT_INTERVAL 500
+#define PID_INTERVAL 5000
+#define PTS_INTERVAL 700
+#define NIT_INTERVAL 10000
+#define SDT_INTERVAL 2000
+#define EIT_INTERVAL 2000
+#define TDT_INTERVAL 30000
+#define PCR_INTERVAL 40
+
+/* minimum interval between sections with the same number, ms */
+#define SI_MIN_INTERVAL 25
+
+/* time a PID may stay unreferenced before it is reported, ms */
+#define UNREF_INTERVAL 500
+
+/* PCR limits, 27 MHz ticks */
+#define PCR_REPETITION ((uint64_t)TS_PCR_FREQ * PCR_INTERVAL / 1000)
+#define PCR_DISCONT ((uint64_t)TS_PCR_FREQ * 100 / 1000)
+#define PCR_ACCURACY 13 /* 500 ns */
+#define PCR_SPAN_MIN ((uint64_t)TS_PCR_FREQ)
+#define PCR_SPAN_MAX ((uint64_t)TS_PCR_FREQ * 60)
+
+#define PCR_SLOTS 64
+
+/* sync bytes needed to lose and to acquire sync */
+#define SYNC_LOSS 2
+#define SYNC_ACQUIRE 5
+
+/* PSI/SI PIDs reassembled by the engine: 0x00, 0x01, 0x10..0x14 */
+#define PSI_SLOTS 7
+
+/* per-PID flags; the low bits are TR_REF_* */
+enum
+{
+    PID_REF  = 0x0010,  /* referenced in PSI */
+    PID_SEEN = 0x0020,  /* packets have been received */
+    PID_CC   = 0x0040,  /* cc holds a valid value */
+    PID_DUP  = 0x0080,  /* last packet was a duplicate */
+    PID_LATE = 0x0100,  /* missing PMT or PTS already counted */
+    PID_SC   = 0x0200,  /* last payload was scrambled */
+};
+
+typedef struct
+{
+    uint32_t seen;      /* last arrival, ms */
+    uint32_t event;     /* last PMT or PTS; time unreferenced since */
+    uint16_t flags;
+    uint8_t cc;
+    uint8_t pcr;        /* PCR slot index + 1 */
+} tr_pid_t;
+
+typedef struct
+{
+    bool valid;
+    bool based;
+    bool mid_valid;
+    bool late;          /* current gap already counted */
+
+    uint32_t last;      /* arrival of the last PCR, ms */
+    uint64_t pcr;       /* last PCR value and its packet position */
+    uint64_t pos;
+
+    /* reference point for the long term rate estimate */
+    uint64_t base_pcr;
+    uint64_t base_pos;
+
+    /* next reference point, taken halfway through the span */
+    uint64_t mid_pcr;
+    uint64_t mid_pos;
+} tr_pcr_t;
+
+typedef struct
+{
+    uint32_t last;
+    bool late;
+} tr_table_t;
+
+struct tr101290_t
+{
+    bool started;
+    uint64_t start;
+    uint32_t now;       /* ms since start, plus 1 */
+    uint64_t pos;       /* packets received */
+
+    bool sync;
+    unsigned int sync_bad;
+    unsigned int sync_good;
+
+    bool cat_seen;
+    bool cat_late;
+
+    ts_psi_t *psi[PSI_SLOTS];
+
+    tr_table_t pat;
+    tr_table_t nit;
+    tr_table_t sdt;
+    tr_table_t eit;
+    tr_table_t tdt;
+
+    uint32_t nit_sec[256];
+    uint32_t sdt_sec[256];
+    uint32_t eit_sec[2];
+    uint32_t tdt_sec;
+    uint32_t rst_sec;
+
+    tr_pcr_t pcr[PCR_SLOTS];
+    unsigned int pcr_cnt;
+
+    uint32_t errors[TR_ERROR_COUNT];
+
+    tr_pid_t pids[TS_MAX_PIDS];
+};
+
+static const struct
+{
+    const char *name;
+    unsigned int priority;
+} tr_errors[TR_ERROR_COUNT] =
+{
+    [TR_TS_SYNC_LOSS]       = { "ts_sync_loss", 1 },
+    [TR_SYNC_BYTE]          = { "sync_byte_error", 1 },
+    [TR_PAT]                = { "pat_error", 1 },
+    [TR_CC]                 = { "cc_error", 1 },
+    [TR_PMT]                = { "pmt_error", 1 },
+    [TR_PID]                = { "pid_error", 1 },
+    [TR_TRANSPORT]          = { "transport_error", 2 },
+    [TR_CRC]                = { "crc_error", 2 },
+    [TR_PCR_REPETITION]     = { "pcr_repetition_error", 2 },
+    [TR_PCR_DISCONTINUITY]  = { "pcr_discontinuity_error", 2 },
+    [TR_PCR_ACCURACY]       = { "pcr_accuracy_error", 2 },
+    [TR_PTS]                = { "pts_error", 2 },
+    [TR_CAT]                = { "cat_error", 2 },
+    [TR_NIT]                = { "nit_error", 3 },
+    [TR_SI_REPETITION]      = { "si_repetition_error", 3 },
+    [TR_UNREFERENCED_PID]   = { "unreferenced_pid", 3 },
+    [TR_SDT]                = { "sdt_error", 3 },
+    [TR_EIT]                = { "eit_error", 3 },
+    [TR_RST]                = { "rst_error", 3 },
+    [TR_TDT]                = { "tdt_error", 3 },
+};
+
+static inline
+int psi_slot(uint16_t pid)
+{
+    if (pid <= 0x01)
+        return pid;
+    else if (pid >= 0x10 && pid <= 0x14)
+        return 2 + (pid - 0x10);
+    else
+        return -1;
+}
+
+/*
+ * table timing
+ */
+
+static inline
+void timing_error(tr101290_t *tr, tr101290_error_t err)
+{
+    tr->errors[err]++;
+
+    /* SI timing violations are also summarized in 3.2 */
+    if (tr_errors[err].priority == 3)
+        tr->errors[TR_SI_REPETITION]++;
+}
+
+static
+void table_arrival(tr101290_t *tr, tr_table_t *table, uint32_t limit
+                   , tr101290_error_t err)
+{
+    if (!table->late && tr->now - table->last > limit)
+        timing_error(tr, err);
+
+    table->last = tr->now;
+    table->late = false;
+}
+
+static
+void table_check(tr101290_t *tr, tr_table_t *table, uint32_t limit
+                 , tr101290_error_t err)
+{
+    if (tr->now - table->last > limit)
+    {
+        timing_error(tr, err);
+        table->late = true;
+    }
+}
+
+static
+void section_arrival(tr101290_t *tr, uint32_t *last, tr101290_error_t err)
+{
+    if (*last != 0 && tr->now - *last < SI_MIN_INTERVAL)
+        timing_error(tr, err);
+
+    *last = tr->now;
+}
+
+static
+void on_section(void *arg, ts_psi_t *psi)
+{
+    tr101290_t *const tr = (tr101290_t *)arg;
+    const uint8_t table_id = psi->buffer[0];
+
+    /* 2.2: all long sections and TOT carry CRC */
+    if ((psi->buffer[1] & 0x80) || table_id == 0x73)
+    {
+        const uint32_t crc32 = PSI_GET_CRC32(psi);
+        if (crc32 != PSI_CALC_CRC32(psi))
+        {
+            tr->errors[TR_CRC]++;
+            return;
+        }
+    }
+
+    switch (psi->pid)
+    {
+        case 0x00:
+            if (table_id == 0x00)
+                table_arrival(tr, &tr->pat, PAT_INTERVAL, TR_PAT);
+            else
+                tr->errors[TR_PAT]++;
+            break;
+
+        case 0x01:
+            if (table_id == 0x01)
+                tr->cat_seen = true;
+            else
+                tr->errors[TR_CAT]++;
+            break;
+
+        case 0x10:
+            if (table_id == 0x40)
+            {
+                table_arrival(tr, &tr->nit, NIT_INTERVAL, TR_NIT);
+                section_arrival(tr, &tr->nit_sec[psi->buffer[6]], TR_NIT);
+            }
+            else if (table_id != 0x41 && table_id != 0x72)
+            {
+                tr->errors[TR_NIT]++;
+            }
+            break;
+
+        case 0x11:
+            if (table_id == 0x42)
+            {
+                table_arrival(tr, &tr->sdt, SDT_INTERVAL, TR_SDT);
+                section_arrival(tr, &tr->sdt_sec[psi->buffer[6]], TR_SDT);
+            }
+            else if (table_id != 0x46 && table_id != 0x4A && table_id != 0x72)
+            {
+                tr->errors[TR_SDT]++;
+            }
+            break;
+
+        case 0x12:
+            if (table_id == 0x4E)
+            {
+                /* present/following sections only */
+                const uint8_t section = psi->buffer[6];
+
+                table_arrival(tr, &tr->eit, EIT_INTERVAL, TR_EIT);
+                if (section < 2)
+                    section_arrival(tr, &tr->eit_sec[section], TR_EIT);
+            }
+            else if ((table_id < 0x4F || table_id > 0x6F) && table_id != 0x72)
+            {
+                tr->errors[TR_EIT]++;
+            }
+            break;
+
+        case 0x13:
+            if (table_id == 0x71)
+                section_arrival(tr, &tr->rst_sec, TR_RST);
+            else if (table_id != 0x72)
+                tr->errors[TR_RST]++;
+            break;
+
+        case 0x14:
+            if (table_id == 0x70)
+            {
+                table_arrival(tr, &tr->tdt, TDT_INTERVAL, TR_TDT);
+                section_arrival(tr, &tr->tdt_sec, TR_TDT);
+            }
+            else if (table_id != 0x73 && table_id != 0x72)
+            {
+                tr->errors[TR_TDT]++;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * per-PID checks
+ */
+
+static
+bool cc_check(tr101290_t *tr, tr_pid_t *p, const uint8_t *ts)
+{
+    const uint8_t cc = TS_GET_CC(ts);
+    bool ok = true;
+
+    if (!(p->flags & PID_CC) || TS_IS_DISCONT(ts))
+    {
+        p->flags = (p->flags | PID_CC) & ~PID_DUP;
+    }
+    else if (TS_IS_PAYLOAD(ts))
+    {
+        if (cc == p->cc)
+        {
+            /* a single duplicate packet is allowed */
+            if (p->flags & PID_DUP)
+                ok = false;
+
+            p->flags |= PID_DUP;
+        }
+        else
+        {
+            if (cc != ((p->cc + 1) & 0x0F))
+                ok = false;
+
+            p->flags &= ~PID_DUP;
+        }
+    }
+    else if (cc != p->cc)
+    {
+        /* counter must not advance without payload */
+        ok = false;
+    }
+
+    p->cc = cc;
+
+    if (!ok)
+        tr->errors[TR_CC]++;
+
+    return ok;
+}
+
+static
+void event_arrival(tr101290_t *tr, tr_pid_t *p, uint32_t limit
+                   , tr101290_error_t err)
+{
+    if (p->event != 0 && !(p->flags & PID_LATE)
+        && tr->now - p->event > limit)
+    {
+        tr->errors[err]++;
+    }
+
+    p->event = tr->now;
+    p->flags &= ~PID_LATE;
+}
+
+static
+void pmt_check(tr101290_t *tr, tr_pid_t *p, const uint8_t *ts)
+{
+    const uint8_t *const payload = TS_GET_PAYLOAD(ts);
+    const unsigned int len = ts_payload_len(ts, payload);
+
+    if (len == 0)
+        return;
+
+    /* table_id of the first section starting in this packet */
+    const unsigned int ptr = 1 + payload[0];
+    if (ptr < len && payload[ptr] == 0x02)
+        event_arrival(tr, p, PMT_INTERVAL, TR_PMT);
+}
+
+static
+void pts_check(tr101290_t *tr, tr_pid_t *p, const uint8_t *ts)
+{
+    const uint8_t *const payload = TS_GET_PAYLOAD(ts);
+    const unsigned int len = ts_payload_len(ts, payload);
+
+    if (len < PES_HEADER_SIZE || PES_BUFFER_GET_HEADER(payload) != 0x000001)
+        return;
+
+    if (payload[7] & 0x80)
+        event_arrival(tr, p, PTS_INTERVAL, TR_PTS);
+}
+
+static
+void pcr_accuracy(tr101290_t *tr, tr_pcr_t *s, uint64_t pcr, uint64_t delta)
+{
+    const uint64_t span = TS_PCR_DELTA(s->base_pcr, pcr);
+    const uint64_t span_pos = tr->pos - s->base_pos;
+
+    if (span >= PCR_SPAN_MIN && span_pos > 0)
+    {
+        /* PCR increment expected from the long term multiplex rate */
+        const uint64_t expect = (tr->pos - s->pos) * span / span_pos;
+        const int64_t diff = (int64_t)delta - (int64_t)expect;
+
+        if (diff > PCR_ACCURACY || diff < -PCR_ACCURACY)
+            tr->errors[TR_PCR_ACCURACY]++;
+    }
+
+    if (span >= PCR_SPAN_MAX / 2 && !s->mid_valid)
+    {
+        s->mid_pcr = pcr;
+        s->mid_pos = tr->pos;
+        s->mid_valid = true;
+    }
+    else if (span >= PCR_SPAN_MAX && s->mid_valid)
+    {
+        s->base_pcr = s->mid_pcr;
+        s->base_pos = s->mid_pos;
+        s->mid_valid = false;
+    }
+}
+
+static
+void pcr_check(tr101290_t *tr, tr_pcr_t *s, const uint8_t *ts)
+{
+    const uint64_t pcr = TS_GET_PCR(ts);
+
+    if (TS_IS_DISCONT(ts))
+    {
+        s->based = false;
+    }
+    else if (s->valid)
+    {
+        /* backward steps wrap around to large values */
+        const uint64_t delta = TS_PCR_DELTA(s->pcr, pcr);
+
+        if (delta > PCR_DISCONT)
+        {
+            tr->errors[TR_PCR_DISCONTINUITY]++;
+            s->based = false;
+        }
+        else
+        {
+            if (delta > PCR_REPETITION && !s->late)
+                tr->errors[TR_PCR_REPETITION]++;
+
+            if (s->based)
+                pcr_accuracy(tr, s, pcr, delta);
+        }
+    }
+
+    if (!s->based)
+    {
+        s->base_pcr = pcr;
+        s->base_pos = tr->pos;
+        s->mid_valid = false;
+        s->based = true;
+    }
+
+    s->valid = true;
+    s->late = false;
+    s->last = tr->now;
+    s->pcr = pcr;
+    s->pos = tr->pos;
+}
+
+void tr101290_packet(tr101290_t *tr, const uint8_t *ts, uint64_t now)
+{
+    if (!tr->started)
+    {
+        tr->start = now;
+        tr->started = true;
+    }
+
+    tr->now = (uint32_t)(now - tr->start) + 1;
+    tr->pos++;
+
+    /* 1.1, 1.2 */
+    if (!TS_IS_SYNC(ts))
+    {
+        tr->errors[TR_SYNC_BYTE]++;
+        tr->sync_good = 0;
+
+        if (tr->sync && ++tr->sync_bad >= SYNC_LOSS)
+        {
+            tr->errors[TR_TS_SYNC_LOSS]++;
+            tr->sync = false;
+        }
+
+        return;
+    }
+
+    tr->sync_bad = 0;
+    if (!tr->sync && ++tr->sync_good >= SYNC_ACQUIRE)
+        tr->sync = true;
+
+    /* 2.1: header can't be trusted */
+    if (TS_IS_ERROR(ts))
+    {
+        tr->errors[TR_TRANSPORT]++;
+        return;
+    }
+
+    const uint16_t pid = TS_GET_PID(ts);
+    tr_pid_t *const p = &tr->pids[pid];
+
+    if (!(p->flags & PID_SEEN))
+    {
+        p->flags |= PID_SEEN;
+        if (!(p->flags & PID_REF))
+            p->event = tr->now;
+    }
+
+    p->seen = tr->now;
+
+    if (pid == TS_NULL_PID)
+        return;
+
+    /* 1.4 */
+    if (!cc_check(tr, p, ts) && p->pcr != 0)
+        tr->pcr[p->pcr - 1].based = false;
+
+    /* 2.6 */
+    const bool scrambled = (TS_GET_SC(ts) != TS_SC_NONE);
+    if (scrambled)
+    {
+        p->flags |= PID_SC;
+        if (!tr->cat_seen && !tr->cat_late)
+        {
+            tr->errors[TR_CAT]++;
+            tr->cat_late = true;
+        }
+    }
+    else if (TS_IS_PAYLOAD(ts))
+    {
+        p->flags &= ~PID_SC;
+    }
+
+    /* 2.3 */
+    if (p->pcr != 0 && TS_IS_PCR(ts))
+        pcr_check(tr, &tr->pcr[p->pcr - 1], ts);
+
+    if (pid < 0x20)
+    {
+        const int slot = psi_slot(pid);
+
+        /* 1.3 */
+        if (pid == 0x00 && scrambled)
+            tr->errors[TR_PAT]++;
+        else if (slot >= 0 && !scrambled)
+            ts_psi_mux(tr->psi[slot], ts, on_section, tr);
+    }
+
+    if (p->flags & TR_REF_PMT)
+    {
+        /* 1.5 */
+        if (scrambled)
+            tr->errors[TR_PMT]++;
+        else if (TS_IS_PUSI(ts))
+            pmt_check(tr, p, ts);
+    }
+    else if ((p->flags & TR_REF_PTS) && TS_IS_PUSI(ts) && !scrambled)
+    {
+        /* 2.5 */
+        pts_check(tr, p, ts);
+    }
+}
+
+/*
+ * periodic checks
+ */
+
+void tr101290_check(tr101290_t *tr, uint64_t now)
+{
+    if (!tr->started)
+        return;
+
+    tr->now = (uint32_t)(now - tr->start) + 1;
+
+    table_check(tr, &tr->pat, PAT_INTERVAL, TR_PAT);
+    table_check(tr, &tr->nit, NIT_INTERVAL, TR_NIT);
+    table_check(tr, &tr->sdt, SDT_INTERVAL, TR_SDT);
+    table_check(tr, &tr->eit, EIT_INTERVAL, TR_EIT);
+    table_check(tr, &tr->tdt, TDT_INTERVAL, TR_TDT);
+
+    for (unsigned int pid = 0; pid < TS_MAX_PIDS; pid++)
+    {
+        tr_pid_t *const p = &tr->pids[pid];
+
+        if (p->flags & TR_REF_PMT)
+        {
+            if (tr->now - p->event > PMT_INTERVAL)
+            {
+                tr->errors[TR_PMT]++;
+                p->flags |= PID_LATE;
+            }
+        }
+
+        if (p->flags & TR_REF_ES)
+        {
+            /* 1.6 */
+            if (tr->now - p->seen > PID_INTERVAL)
+                tr->errors[TR_PID]++;
+
+            /* 2.5: stream is present, but carries no PTS */
+            if ((p->flags & TR_REF_PTS) && !(p->flags & PID_SC)
+                && p->event != 0 && tr->now - p->seen <= 1000
+                && tr->now - p->event > PTS_INTERVAL)
+            {
+                tr->errors[TR_PTS]++;
+                p->flags |= PID_LATE;
+            }
+        }
+        else if (!(p->flags & PID_REF) && (p->flags & PID_SEEN)
+                 && pid >= 0x20 && pid != TS_NULL_PID)
+        {
+            /* 3.4: present now, unreferenced for a while */
+            if (tr->now - p->seen <= 1000
+                && tr->now - p->event > UNREF_INTERVAL)
+            {
+                tr->errors[TR_UNREFERENCED_PID]++;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < tr->pcr_cnt; i++)
+    {
+        tr_pcr_t *const s = &tr->pcr[i];
+
+        /* one error per gap, whether seen here or on the next PCR */
+        if (s->valid && !s->late && tr->now - s->last > PCR_INTERVAL)
+        {
+            tr->errors[TR_PCR_REPETITION]++;
+            s->late = true;
+        }
+    }
+}
+
+/*
+ * PSI references
+ */
+
+void tr101290_ref_pid(tr101290_t *tr, uint16_t pid, unsigned int flags)
+{
+    if (pid >= TS_NULL_PID)
+        return;
+
+    tr_pid_t *const p = &tr->pids[pid];
+    const unsigned int added = flags & ~p->flags;
+
+    if (added & TR_REF_PMT)
+        p->event = tr->now;
+    else if (!(p->flags & PID_REF))
+        p->event = 0;
+
+    /* absence is counted from the moment of reference */
+    if (!(p->flags & (PID_REF | PID_SEEN)))
+        p->seen = tr->now;
+
+    p->flags |= flags | PID_REF;
+
+    if ((flags & TR_REF_PCR) && p->pcr == 0 && tr->pcr_cnt < PCR_SLOTS)
+    {
+        memset(&tr->pcr[tr->pcr_cnt], 0, sizeof(tr->pcr[0]));
+        p->pcr = ++tr->pcr_cnt;
+    }
+}
+
+void tr101290_unref(tr101290_t *tr)
+{
+    for (unsigned int pid = 0; pid < TS_MAX_PIDS; pid++)
+    {
+        tr_pid_t *const p = &tr->pids[pid];
+
+        if (!(p->flags & PID_REF))
+            continue;
+
+        p->flags &= ~(PID_REF | PID_LATE
+                      | TR_REF_PMT | TR_REF_ES | TR_REF_PTS | TR_REF_PCR);
+        p->event = tr->now;
+        p->pcr = 0;
+    }
+
+    tr->pcr_cnt = 0;
+}
+
+/*
+ * counters
+ */
+
+void tr101290_error(tr101290_t *tr, tr101290_error_t err)
+{
+    tr->errors[err]++;
+}
+
+void tr101290_query(tr101290_t *tr, uint32_t out[TR_ERROR_COUNT])
+{
+    memcpy(out, tr->errors, sizeof(tr->errors));
+    memset(tr->errors, 0, sizeof(tr->errors));
+
+    tr->cat_late = false;
+}
+
+const char *tr101290_name(tr101290_error_t err)
+{
+    return tr_errors[err].name;
+}
+
+unsigned int tr101290_priority(tr101290_error_t err)
+{
+    return tr_errors[err].priority;
+}
+
+/*
+ * init/destroy
+ */
+
+tr101290_t *tr101290_init(void)
+{
+    static const uint16_t psi_pids[PSI_SLOTS] =
+    {
+        0x00, 0x01, 0x10, 0x11, 0x12, 0x13, 0x14,
+    };
+
+    static const ts_type_t psi_types[PSI_SLOTS] =
+    {
+        TS_TYPE_PAT, TS_TYPE_CAT, TS_TYPE_NIT, TS_TYPE_SDT,
+        TS_TYPE_EIT, TS_TYPE_SI /* RST */, TS_TYPE_TDT,
+    };
+
+    tr101290_t *const tr = ASC_ALLOC(1, tr101290_t);
+
+    for (unsigned int i = 0; i < PSI_SLOTS; i++)
+        tr->psi[i] = ts_psi_init(psi_types[i], psi_pids[i]);
+
+    return tr;
+}
+
+void tr101290_destroy(tr101290_t *tr)
+{
+    for (unsigned int i = 0; i < PSI_SLOTS; i++)
+        ts_psi_destroy(tr->psi[i]);
+
+    free(tr);
+}
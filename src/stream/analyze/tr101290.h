@@ -0,0 +1,102 @@
+/*
+ * Astra Module: MPEG-TS (TR 101 290 measurements)
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ANALYZE_TR101290_H_
+#define _ANALYZE_TR101290_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+#include <astra/mpegts/mpegts.h>
+
+typedef enum
+{
+    /* priority 1 */
+    TR_TS_SYNC_LOSS = 0,
+    TR_SYNC_BYTE,
+    TR_PAT,
+    TR_CC,
+    TR_PMT,
+    TR_PID,
+
+    /* priority 2 */
+    TR_TRANSPORT,
+    TR_CRC,
+    TR_PCR_REPETITION,
+    TR_PCR_DISCONTINUITY,
+    TR_PCR_ACCURACY,
+    TR_PTS,
+    TR_CAT,
+
+    /* priority 3 */
+    TR_NIT,
+    TR_SI_REPETITION,
+    TR_UNREFERENCED_PID,
+    TR_SDT,
+    TR_EIT,
+    TR_RST,
+    TR_TDT,
+
+    TR_ERROR_COUNT,
+} tr101290_error_t;
+
+/* PID reference flags, see tr101290_ref_pid() */
+enum
+{
+    TR_REF_PMT = 0x01,  /* program map PID, checked for repetition */
+    TR_REF_ES  = 0x02,  /* elementary stream, checked for presence */
+    TR_REF_PTS = 0x04,  /* audio or video, checked for PTS repetition */
+    TR_REF_PCR = 0x08,  /* carries PCR for a program */
+};
+
+typedef struct tr101290_t tr101290_t;
+
+tr101290_t *tr101290_init(void) __asc_result;
+void tr101290_destroy(tr101290_t *tr);
+
+/*
+ * Packets are fed in the order of arrival. Time is in milliseconds
+ * and must not go backwards; a single timestamp may be used for
+ * a whole batch of packets.
+ */
+void tr101290_packet(tr101290_t *tr, const uint8_t *ts, uint64_t now);
+
+/*
+ * The engine does not parse PAT, CAT and PMT contents; the caller
+ * reports referenced PIDs instead. Passing 0 as flags only marks the
+ * PID as referenced (NIT, ECM, EMM). tr101290_unref() drops all
+ * references, e.g. on PAT change.
+ */
+void tr101290_ref_pid(tr101290_t *tr, uint16_t pid, unsigned int flags);
+void tr101290_unref(tr101290_t *tr);
+
+/* count an error detected by the caller, e.g. PMT CRC mismatch */
+void tr101290_error(tr101290_t *tr, tr101290_error_t err);
+
+/* absence checks, to be called periodically */
+void tr101290_check(tr101290_t *tr, uint64_t now);
+
+/* copy error counters and reset them */
+void tr101290_query(tr101290_t *tr, uint32_t out[TR_ERROR_COUNT]);
+
+const char *tr101290_name(tr101290_error_t err) __asc_result;
+unsigned int tr101290_priority(tr101290_error_t err) __asc_result;
+
+#endif /* _ANALYZE_TR101290_H_ */
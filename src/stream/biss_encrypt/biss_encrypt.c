@@ -24,14 +24,38 @@
  *
  * Module Role:
  *      Output stage, no demux
+ *
+ * Module Options:
+ *      upstream    - object, stream instance returned by module_instance:stream()
+ *      key         - string, BISS key, 16 chars length
+ *      latency     - number, maximum time in ms a packet is held for
+ *                    batching before a partial batch is sent
+ *                    (default: 100, 0 to disable)
+ *
+ * Module Methods:
+ *      stats()     - return table with packets, encrypted (scrambled
+ *                    packets), batches, flushes (partial batches sent on
+ *                    the latency deadline) and bitrate (kbit/s)
+ *
+ * Packets are collected into a pooled block, encrypted in place once the
+ * block holds a full CSA batch, and the block itself is passed on to the
+ * children; those that take blocks keep a reference instead of copying.
  */
 
 #include <astra/astra.h>
+#include <astra/core/block.h>
+#include <astra/core/timer.h>
+#include <astra/utils/csa.h>
 #include <astra/utils/strhex.h>
 #include <astra/luaapi/stream.h>
 #include <astra/mpegts/psi.h>
 
-#include <dvbcsa/dvbcsa.h>
+#define MSG(_msg) "[biss_encrypt] " _msg
+
+#define LATENCY_DEFAULT 100
+
+/* spare blocks kept for reuse */
+#define POOL_IDLE 4
 
 struct module_data_t
 {
@@ -42,21 +66,68 @@ struct module_data_t
     ts_psi_t *pat;
     ts_psi_t *pmt;
 
-    struct dvbcsa_bs_key_s *key;
+    const csa_engine_t *csa;
+    csa_key_t *key;
+
+    /* block being filled; encrypted in place when full */
+    asc_block_pool_t *pool;
+    asc_block_t *block;
+    size_t batch_size;
 
-    size_t storage_size;
-    size_t storage_skip;
+    size_t batch_skip;
+    csa_batch_t *batch;
 
-    int batch_skip;
-    uint8_t *batch_storage_recv;
-    uint8_t *batch_storage_send;
-    struct dvbcsa_bs_batch_s *batch;
+    uint64_t latency;
+    uint64_t block_time;
+    asc_timer_t *deadline;
+
+    struct
+    {
+        uint64_t packets;
+        uint64_t encrypted;
+        uint64_t batches;
+        uint64_t flushes;
+
+        uint64_t rate_time;
+        uint64_t rate_packets;
+        unsigned int bitrate;
+    } stats;
 };
 
+static void send_block(module_data_t *mod)
+{
+    asc_block_t *const block = mod->block;
+    mod->block = NULL;
+
+    if(mod->batch_skip > 0)
+    {
+        mod->batch[mod->batch_skip].data = NULL;
+        mod->csa->encrypt(mod->key, mod->batch, TS_BODY_SIZE);
+
+        mod->stats.encrypted += mod->batch_skip;
+        mod->batch_skip = 0;
+    }
+
+    ++mod->stats.batches;
+    mod->stats.packets += block->cnt;
+
+    module_stream_send_block(mod, block);
+    asc_block_release(block);
+}
+
 static void process_ts(module_data_t *mod, const uint8_t *ts, uint8_t hdr_size)
 {
-    uint8_t *dst = &mod->batch_storage_recv[mod->storage_skip];
+    if(!mod->block)
+    {
+        mod->block = asc_block_alloc(mod->pool);
+        if(mod->latency)
+            mod->block_time = asc_utime();
+    }
+
+    asc_block_t *const block = mod->block;
+    uint8_t *dst = &block->data[block->cnt * TS_PACKET_SIZE];
     memcpy(dst, ts, TS_PACKET_SIZE);
+    ++block->cnt;
 
     if(hdr_size)
     {
@@ -66,22 +137,30 @@ static void process_ts(module_data_t *mod, const uint8_t *ts, uint8_t hdr_size)
         ++mod->batch_skip;
     }
 
-    if(mod->batch_storage_send)
-        module_stream_send(mod, &mod->batch_storage_send[mod->storage_skip]);
+    if(block->cnt >= mod->batch_size)
+        send_block(mod);
+}
+
+static void on_deadline(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
 
-    mod->storage_skip += TS_PACKET_SIZE;
+    const uint64_t now = asc_utime();
 
-    if(mod->storage_skip >= mod->storage_size)
+    if(mod->latency && mod->block && now - mod->block_time >= mod->latency)
     {
-        mod->batch[mod->batch_skip].data = NULL;
-        dvbcsa_bs_encrypt(mod->key, mod->batch, 184);
-        uint8_t *storage_tmp = mod->batch_storage_send;
-        mod->batch_storage_send = mod->batch_storage_recv;
-        if(!storage_tmp)
-            storage_tmp = ASC_ALLOC(mod->storage_size, uint8_t);
-        mod->batch_storage_recv = storage_tmp;
-        mod->batch_skip = 0;
-        mod->storage_skip = 0;
+        ++mod->stats.flushes;
+        send_block(mod);
+    }
+
+    /* update bitrate about once a second */
+    const uint64_t elapsed = now - mod->stats.rate_time;
+    if(elapsed >= 1000000)
+    {
+        const uint64_t packets = mod->stats.packets - mod->stats.rate_packets;
+        mod->stats.bitrate = (packets * TS_PACKET_SIZE * 8 * 1000) / elapsed;
+        mod->stats.rate_packets = mod->stats.packets;
+        mod->stats.rate_time = now;
     }
 }
 
@@ -184,33 +263,76 @@ static void module_init(lua_State *L, module_data_t *mod)
     key[3] = (key[0] + key[1] + key[2]) & 0xFF;
     key[7] = (key[4] + key[5] + key[6]) & 0xFF;
 
-    const int batch_size = dvbcsa_bs_batch_size();
-    mod->batch = ASC_ALLOC(batch_size + 1, struct dvbcsa_bs_batch_s);
-    mod->storage_size = batch_size * TS_PACKET_SIZE;
-    mod->batch_storage_recv = ASC_ALLOC(mod->storage_size, uint8_t);
+    int latency = LATENCY_DEFAULT;
+    module_option_integer(L, "latency", &latency);
+    if(latency < 0)
+        luaL_error(L, MSG("latency must not be negative"));
+
+    mod->csa = au_csa_engine();
+    mod->batch_size = mod->csa->batch_size;
+    mod->batch = ASC_ALLOC(mod->batch_size + 1, csa_batch_t);
+    mod->pool = asc_block_pool_init(mod->batch_size * TS_PACKET_SIZE, POOL_IDLE);
 
-    mod->key = dvbcsa_bs_key_alloc();
-    dvbcsa_bs_key_set(key, mod->key);
+    mod->key = au_csa_key_init();
+    au_csa_key_set(mod->key, key);
 
     mod->stream[0x00] = TS_TYPE_PAT;
     mod->pat = ts_psi_init(TS_TYPE_PAT, 0);
     mod->pmt = ts_psi_init(TS_TYPE_PMT, 0);
+
+    /* deadline timer also keeps bitrate up to date */
+    unsigned int interval = 250;
+    if(latency > 0)
+    {
+        mod->latency = latency * 1000ULL;
+        interval = (latency + 3) / 4;
+    }
+
+    mod->stats.rate_time = asc_utime();
+    mod->deadline = asc_timer_init(interval, on_deadline, mod);
 }
 
 static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
 
+    ASC_FREE(mod->deadline, asc_timer_destroy);
+    ASC_FREE(mod->block, asc_block_release);
+    ASC_FREE(mod->pool, asc_block_pool_destroy);
     ASC_FREE(mod->batch, free);
-    ASC_FREE(mod->batch_storage_recv, free);
-    ASC_FREE(mod->key, dvbcsa_bs_key_free);
+    ASC_FREE(mod->key, au_csa_key_destroy);
 
     ASC_FREE(mod->pat, ts_psi_destroy);
     ASC_FREE(mod->pmt, ts_psi_destroy);
 }
 
+static int method_stats(lua_State *L, module_data_t *mod)
+{
+    lua_newtable(L);
+
+    lua_pushnumber(L, mod->stats.packets);
+    lua_setfield(L, -2, "packets");
+    lua_pushnumber(L, mod->stats.encrypted);
+    lua_setfield(L, -2, "encrypted");
+    lua_pushnumber(L, mod->stats.batches);
+    lua_setfield(L, -2, "batches");
+    lua_pushnumber(L, mod->stats.flushes);
+    lua_setfield(L, -2, "flushes");
+    lua_pushinteger(L, mod->stats.bitrate);
+    lua_setfield(L, -2, "bitrate");
+
+    return 1;
+}
+
+static const module_method_t module_methods[] =
+{
+    { "stats", method_stats },
+    { NULL, NULL },
+};
+
 STREAM_MODULE_REGISTER(biss_encrypt)
 {
     .init = module_init,
     .destroy = module_destroy,
+    .methods = module_methods,
 };
@@ -23,6 +23,7 @@
  *
  * Module Role:
  *      Input or output stage, forwards pid requests
+ *      Source, ignores pid requests (multi-program mode)
  *
  * Module Options:
  *      upstream    - object, stream module instance
@@ -34,6 +35,26 @@
  *                      can be negative, disabled by default
  *      buffer_size - number, buffer size in milliseconds at target bitrate
  *                      default is 150 ms (e.g. ~187 KiB if rate is 10 Mbit)
+ *
+ * Multi-program mode options:
+ *      programs    - table, list of programs to multiplex; enables
+ *                      statistical multiplexing of several upstreams
+ *                      into a single stream at the target bitrate:
+ *          upstream    - object, stream module instance
+ *          pnr         - number, output program number
+ *          input_pnr   - number, program to take from upstream
+ *                          default is the first one listed in PAT
+ *          service     - string, service name for SDT
+ *                          copied from input SDT if not set
+ *          provider    - string, provider name for SDT
+ *      delay       - number, time in milliseconds every packet is held
+ *                      before output to absorb input jitter and bursts
+ *                      default is 40 ms, must be less than buffer_size
+ *      tsid        - number, output transport stream id, default is 1
+ *      onid        - number, output original network id, default is 1
+ *
+ * Module Methods:
+ *      stats()     - return multiplexer statistics (multi-program mode)
  */
 
 #include <astra/astra.h>
@@ -42,6 +63,8 @@
 #include <astra/mpegts/pcr.h>
 #include <astra/mpegts/psi.h>
 
+#include "mux.h"
+
 #define MSG(_msg) "[cbr %s] " _msg, mod->name
 
 /* default PCR insertion interval, milliseconds */
@@ -50,6 +73,9 @@
 /* default buffer size, milliseconds */
 #define DEFAULT_BUFFER_SIZE 150
 
+/* default multiplexing delay, milliseconds */
+#define DEFAULT_MUX_DELAY 40
+
 /* maximum allowed PCR delta on receive */
 #define MAX_PCR_DELTA ((TS_PCR_FREQ / 1000) * 100) /* 100ms */
 
@@ -115,6 +141,8 @@ struct module_data_t
     unsigned int master_pcr_pid;
     unsigned int pending;
     int feedback;
+
+    cbr_mux_t *mux;
 };
 
 /*
@@ -629,6 +657,193 @@ void on_ts(module_data_t *mod, const uint8_t *ts)
     }
 }
 
+/*
+ * multi-program mode
+ */
+
+static
+void mux_init(lua_State *L, module_data_t *mod
+              , unsigned int pcr_interval, unsigned int buffer_size)
+{
+    lua_getfield(L, MODULE_OPTIONS_IDX, "upstream");
+    if (!lua_isnil(L, -1))
+        luaL_error(L, MSG("option 'upstream' cannot be used with 'programs'"));
+
+    lua_pop(L, 1);
+
+    cbr_mux_config_t cfg =
+    {
+        .name = mod->name,
+        .bitrate = mod->bitrate,
+        .delay = DEFAULT_MUX_DELAY,
+        .buffer = buffer_size,
+        .pcr_interval = pcr_interval,
+        .tsid = 1,
+        .onid = 1,
+    };
+
+    /* multiplexing delay, ms */
+    int opt = cfg.delay;
+    module_option_integer(L, "delay", &opt);
+    if (!(opt >= 10 && opt < (int)buffer_size))
+        luaL_error(L, MSG("delay must be at least 10 ms and less than buffer size"));
+
+    cfg.delay = opt;
+
+    /* output stream identifiers */
+    opt = cfg.tsid;
+    module_option_integer(L, "tsid", &opt);
+    if (!(opt >= 0 && opt <= 0xFFFF))
+        luaL_error(L, MSG("tsid must be between 0 and 65535"));
+
+    cfg.tsid = opt;
+
+    opt = cfg.onid;
+    module_option_integer(L, "onid", &opt);
+    if (!(opt >= 0 && opt <= 0xFFFF))
+        luaL_error(L, MSG("onid must be between 0 and 65535"));
+
+    cfg.onid = opt;
+
+    /* program list */
+    cbr_mux_prog_config_t prog[CBR_MUX_MAX_PROGRAMS];
+    memset(prog, 0, sizeof(prog));
+
+    lua_getfield(L, MODULE_OPTIONS_IDX, "programs");
+    if (!lua_istable(L, -1))
+        luaL_error(L, MSG("option 'programs' must be a table"));
+
+    const int cnt = luaL_len(L, -1);
+    if (!(cnt >= 1 && cnt <= CBR_MUX_MAX_PROGRAMS))
+    {
+        luaL_error(L, MSG("number of programs must be between 1 and %d")
+                   , CBR_MUX_MAX_PROGRAMS);
+    }
+
+    for (int i = 0; i < cnt; i++)
+    {
+        cbr_mux_prog_config_t *const pc = &prog[i];
+
+        lua_rawgeti(L, -1, i + 1);
+        if (!lua_istable(L, -1))
+            luaL_error(L, MSG("program #%d: expected a table"), i + 1);
+
+        lua_getfield(L, -1, "upstream");
+        if (!lua_islightuserdata(L, -1))
+            luaL_error(L, MSG("program #%d: option 'upstream' is required"), i + 1);
+
+        pc->upstream = (module_data_t *)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "pnr");
+        if (!lua_isnumber(L, -1))
+            luaL_error(L, MSG("program #%d: option 'pnr' is required"), i + 1);
+
+        const lua_Integer pnr = lua_tointeger(L, -1);
+        if (!ts_pnr_valid(pnr))
+            luaL_error(L, MSG("program #%d: invalid program number"), i + 1);
+
+        for (int j = 0; j < i; j++)
+        {
+            if (prog[j].pnr == pnr)
+                luaL_error(L, MSG("program #%d: duplicate program number %d")
+                           , i + 1, (int)pnr);
+        }
+
+        pc->pnr = pnr;
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "input_pnr");
+        if (!lua_isnil(L, -1))
+        {
+            const lua_Integer in_pnr = lua_tointeger(L, -1);
+            if (!ts_pnr_valid(in_pnr))
+                luaL_error(L, MSG("program #%d: invalid input program number"), i + 1);
+
+            pc->in_pnr = in_pnr;
+        }
+        lua_pop(L, 1);
+
+        /* strings stay referenced by the options table */
+        lua_getfield(L, -1, "service");
+        if (lua_isstring(L, -1))
+            pc->service = lua_tostring(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "provider");
+        if (lua_isstring(L, -1))
+            pc->provider = lua_tostring(L, -1);
+        lua_pop(L, 1);
+
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 1);
+
+    module_stream_init(L, mod, NULL);
+    module_demux_set(mod, NULL, NULL);
+
+    mod->mux = cbr_mux_init(&cfg, module_stream_send, mod);
+    for (int i = 0; i < cnt; i++)
+        cbr_mux_add(mod->mux, &prog[i]);
+
+    asc_log_debug(MSG("multiplexing %d programs at %zu bps")
+                  , cnt, mod->bitrate);
+}
+
+static
+int method_stats(lua_State *L, module_data_t *mod)
+{
+    if (mod->mux == NULL)
+        luaL_error(L, MSG("statistics are only available in multi-program mode"));
+
+    cbr_mux_stat_t stat;
+    cbr_mux_query(mod->mux, &stat);
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, stat.packets);
+    lua_setfield(L, -2, "packets");
+    lua_pushnumber(L, stat.nulls);
+    lua_setfield(L, -2, "nulls");
+    lua_pushnumber(L, stat.pcr_inserts);
+    lua_setfield(L, -2, "pcr_inserts");
+    lua_pushinteger(L, stat.null_share);
+    lua_setfield(L, -2, "null_share");
+
+    lua_newtable(L);
+    for (size_t i = 0; i < stat.programs; i++)
+    {
+        cbr_mux_prog_stat_t ps;
+        if (!cbr_mux_query_prog(mod->mux, i, &ps))
+            break;
+
+        lua_newtable(L);
+
+        lua_pushinteger(L, ps.pnr);
+        lua_setfield(L, -2, "pnr");
+        lua_pushboolean(L, ps.ready);
+        lua_setfield(L, -2, "ready");
+        lua_pushinteger(L, ps.bitrate / 1000);
+        lua_setfield(L, -2, "bitrate");
+        lua_pushinteger(L, ps.share);
+        lua_setfield(L, -2, "share");
+        lua_pushinteger(L, ps.queue);
+        lua_setfield(L, -2, "queue");
+        lua_pushinteger(L, ps.delay_max);
+        lua_setfield(L, -2, "delay_max");
+        lua_pushnumber(L, ps.dropped);
+        lua_setfield(L, -2, "dropped");
+        lua_pushnumber(L, ps.clock_resets);
+        lua_setfield(L, -2, "clock_resets");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "programs");
+
+    return 1;
+}
+
 /*
  * module init/destroy
  */
@@ -667,6 +882,7 @@ void module_init(lua_State *L, module_data_t *mod)
     if (!(opt >= 10 && opt <= 100))
         luaL_error(L, MSG("PCR interval must be between 10 and 100 ms"));
 
+    const unsigned int pcr_interval = opt;
     mod->pcr_interval = TS_PCR_PACKETS(opt, mod->bitrate);
     if (mod->pcr_interval <= 1)
         luaL_error(L, MSG("PCR interval is too small for configured bitrate"));
@@ -687,6 +903,16 @@ void module_init(lua_State *L, module_data_t *mod)
     if (!(opt >= 100 && opt <= 1000))
         luaL_error(L, MSG("buffer size must be between 100 and 1000 ms"));
 
+    lua_getfield(L, MODULE_OPTIONS_IDX, "programs");
+    const bool is_mux = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+
+    if (is_mux)
+    {
+        mux_init(L, mod, pcr_interval, opt);
+        return;
+    }
+
     mod->buf_size = TS_PCR_PACKETS(opt, mod->bitrate);
     ASC_ASSERT(mod->buf_size > 0, MSG("invalid buffer size"));
 
@@ -710,6 +936,8 @@ void module_init(lua_State *L, module_data_t *mod)
 static
 void module_destroy(module_data_t *mod)
 {
+    ASC_FREE(mod->mux, cbr_mux_destroy);
+
     for (size_t i = 0; i < TS_MAX_PIDS; i++)
     {
         ASC_FREE(mod->psi[i], ts_psi_destroy);
@@ -724,8 +952,15 @@ void module_destroy(module_data_t *mod)
     module_stream_destroy(mod);
 }
 
+static const module_method_t module_methods[] =
+{
+    { "stats", method_stats },
+    { NULL, NULL },
+};
+
 STREAM_MODULE_REGISTER(ts_cbr)
 {
     .init = module_init,
     .destroy = module_destroy,
+    .methods = module_methods,
 };
@@ -0,0 +1,1126 @@
+/*
+ * Astra Module: Constant bitrate muxer (multi-program mode)
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Each program is received from its own upstream by an internal stream
+ * module, which selects a single service, remaps its PIDs into a private
+ * range and queues packets along with their arrival time.
+ *
+ * The output runs off the system clock at a fixed packet rate. Every
+ * packet slot goes to the program whose oldest queued packet has been
+ * waiting the longest, provided that it has been held for at least the
+ * configured multiplexing delay. This way bandwidth is shared according
+ * to instantaneous demand. PCR-only packets are inserted before a
+ * program would exceed its PCR interval, and unused slots are filled with
+ * null padding.
+ *
+ * Program clocks are recovered from arrival times of PCR packets, so that
+ * restamped PCRs reflect position of each packet in the output schedule.
+ */
+
+#include <astra/astra.h>
+#include <astra/core/timer.h>
+#include <astra/mpegts/pcr.h>
+#include <astra/mpegts/psi.h>
+
+#include "mux.h"
+
+#define MSG(_msg) "[cbr %s] " _msg, mux->name
+
+/* output timer interval, milliseconds */
+#define MUX_TICK_MSEC 2
+
+/* PAT and PMT repetition interval */
+#define PSI_INTERVAL (TS_PCR_FREQ / 10) /* 100ms */
+
+/* SDT repetition interval */
+#define SDT_INTERVAL TS_PCR_FREQ /* 1s */
+
+/* statistics update interval */
+#define STAT_INTERVAL TS_PCR_FREQ /* 1s */
+
+/* skip ahead if output falls behind by this much */
+#define MAX_LAG (TS_PCR_FREQ / 2) /* 500ms */
+
+/* maximum allowed input clock jitter before resetting time base */
+#define MAX_CLOCK_DRIFT ((TS_PCR_FREQ / 1000) * 100) /* 100ms */
+
+/* maximum PCR adjustment increment */
+#define MAX_PCR_ADJ 12 /* 444ns */
+
+/* look for least delayed PCR arrival over this number of PCRs */
+#define DRIFT_WINDOW 32
+
+/* output PID range for each program */
+#define PID_BASE 0x100
+#define PID_STEP 0x20
+
+/* maximum size of table packets queued for output */
+#define PSI_QUEUE_SIZE 256
+
+/* initial per-program queue size, packets */
+#define QUEUE_INIT_SIZE 256
+
+/* service entry size limit for output SDT */
+#define SDT_ITEM_SIZE 256
+
+/* maximum SDT section size */
+#define SDT_MAX_SIZE 1024
+
+typedef struct
+{
+    uint64_t time;
+    uint64_t offset;
+    ts_packet_t ts;
+} mux_pkt_t;
+
+/* per-program receiver */
+struct module_data_t
+{
+    STREAM_MODULE_DATA();
+
+    cbr_mux_t *mux;
+
+    unsigned int pnr;
+    unsigned int in_pnr;
+    unsigned int src_pnr;
+    unsigned int pid_base;
+
+    ts_psi_t *pat;
+    ts_psi_t *pmt;
+    ts_psi_t *sdt;
+    ts_psi_t *out_pmt;
+    unsigned int pmt_version;
+    bool ready;
+
+    uint16_t pid_map[TS_MAX_PIDS];
+    unsigned int in_pcr_pid;
+    unsigned int pcr_pid;
+
+    uint8_t sdt_item[SDT_ITEM_SIZE];
+    size_t sdt_item_size;
+    bool sdt_fixed;
+
+    mux_pkt_t *queue;
+    size_t q_size;
+    size_t q_head;
+    size_t q_cnt;
+
+    struct
+    {
+        bool on;
+        bool disc;
+        uint64_t offset;
+        int64_t low;
+        int64_t target;
+        unsigned int cnt;
+    } clock;
+
+    struct
+    {
+        uint64_t last;
+        uint64_t offset;
+        unsigned int cc;
+    } out;
+
+    struct
+    {
+        uint64_t sent;
+        uint64_t wait_max;
+        uint64_t dropped;
+    } period;
+
+    cbr_mux_prog_stat_t stat;
+};
+
+struct cbr_mux_t
+{
+    const char *name;
+    size_t bitrate;
+    uint64_t delay;
+    uint64_t pcr_interval;
+    uint64_t slot_time;
+    size_t q_max;
+    unsigned int tsid;
+    unsigned int onid;
+
+    ts_callback_t on_ts;
+    void *arg;
+
+    module_data_t *prog[CBR_MUX_MAX_PROGRAMS];
+    size_t prog_cnt;
+
+    asc_timer_t *timer;
+    uint64_t start;
+    uint64_t clock;
+    uint64_t clock_rem;
+
+    ts_psi_t *pat;
+    unsigned int pat_version;
+    ts_psi_t *sdt;
+    unsigned int sdt_version;
+    bool sdt_dirty;
+
+    uint64_t psi_next;
+    uint64_t sdt_next;
+    ts_packet_t psi_queue[PSI_QUEUE_SIZE];
+    size_t psi_head;
+    size_t psi_cnt;
+
+    uint64_t stat_next;
+    uint64_t period_slots;
+    uint64_t period_nulls;
+    cbr_mux_stat_t stat;
+};
+
+static inline
+uint64_t mux_now(const cbr_mux_t *mux)
+{
+    return (asc_utime() - mux->start) * (TS_PCR_FREQ / 1000000);
+}
+
+/*
+ * input clock recovery
+ */
+
+static
+void clock_reset(module_data_t *prog, uint64_t offset)
+{
+    prog->clock.on = true;
+    prog->clock.offset = offset;
+    prog->clock.low = INT64_MAX;
+    prog->clock.target = 0;
+    prog->clock.cnt = 0;
+}
+
+static
+void clock_update(module_data_t *prog, uint64_t now, uint64_t pcr)
+{
+    cbr_mux_t *const mux = prog->mux;
+
+    /* arrival time of this PCR relative to program clock */
+    const uint64_t offset =
+        ((now % TS_PCR_MAX) + TS_PCR_MAX - pcr) % TS_PCR_MAX;
+
+    if (!prog->clock.on)
+    {
+        clock_reset(prog, offset);
+        return;
+    }
+
+    int64_t diff = (int64_t)offset - (int64_t)prog->clock.offset;
+
+    if (diff >= TS_PCR_MAX / 2)
+        diff -= TS_PCR_MAX;
+    else if (diff <= -(TS_PCR_MAX / 2))
+        diff += TS_PCR_MAX;
+
+    if (diff < -MAX_CLOCK_DRIFT || diff > MAX_CLOCK_DRIFT)
+    {
+        const long long ms = diff / (TS_PCR_FREQ / 1000);
+        asc_log_error(MSG("program %u: reset time base (drift %lld ms)")
+                      , prog->pnr, ms);
+
+        clock_reset(prog, offset);
+        prog->clock.disc = true;
+        prog->stat.clock_resets++;
+
+        return;
+    }
+
+    /*
+     * Network jitter only ever delays packets, so the PCR that arrived
+     * earliest within the window is the best estimate of the time base.
+     * Apply corrections gradually to avoid injecting PCR jitter.
+     */
+    if (diff < prog->clock.low)
+        prog->clock.low = diff;
+
+    if (++prog->clock.cnt >= DRIFT_WINDOW)
+    {
+        prog->clock.target = prog->clock.low;
+        prog->clock.low = INT64_MAX;
+        prog->clock.cnt = 0;
+    }
+
+    int64_t adj = prog->clock.target;
+    if (adj > MAX_PCR_ADJ)
+        adj = MAX_PCR_ADJ;
+    else if (adj < -MAX_PCR_ADJ)
+        adj = -MAX_PCR_ADJ;
+
+    prog->clock.offset = (TS_PCR_MAX + prog->clock.offset + adj) % TS_PCR_MAX;
+    prog->clock.target -= adj;
+}
+
+static inline
+uint64_t clock_pcr(const cbr_mux_t *mux, uint64_t slot, uint64_t offset)
+{
+    return ((slot % TS_PCR_MAX) + (TS_PCR_MAX * 2)
+            - offset - mux->delay) % TS_PCR_MAX;
+}
+
+/*
+ * per-program queue
+ */
+
+static
+void queue_push(module_data_t *prog, const uint8_t *ts, unsigned int pid
+                , uint64_t now)
+{
+    cbr_mux_t *const mux = prog->mux;
+
+    if (prog->q_cnt >= prog->q_size)
+    {
+        if (prog->q_size >= mux->q_max)
+        {
+            prog->period.dropped++;
+            prog->stat.dropped++;
+            return;
+        }
+
+        size_t size = prog->q_size * 2;
+        if (size > mux->q_max)
+            size = mux->q_max;
+
+        mux_pkt_t *const queue = ASC_ALLOC(size, mux_pkt_t);
+        for (size_t i = 0; i < prog->q_cnt; i++)
+        {
+            const size_t pos = (prog->q_head + i) % prog->q_size;
+            memcpy(&queue[i], &prog->queue[pos], sizeof(*queue));
+        }
+
+        free(prog->queue);
+        prog->queue = queue;
+        prog->q_size = size;
+        prog->q_head = 0;
+    }
+
+    const size_t pos = (prog->q_head + prog->q_cnt) % prog->q_size;
+    mux_pkt_t *const pkt = &prog->queue[pos];
+    prog->q_cnt++;
+
+    memcpy(pkt->ts, ts, TS_PACKET_SIZE);
+    TS_SET_PID(pkt->ts, pid);
+
+    pkt->time = now;
+    pkt->offset = prog->clock.offset;
+
+    if (prog->clock.disc && TS_IS_PCR(pkt->ts))
+    {
+        TS_SET_DISCONT(pkt->ts, true);
+        prog->clock.disc = false;
+    }
+}
+
+static
+void queue_flush(module_data_t *prog)
+{
+    prog->q_head = prog->q_cnt = 0;
+}
+
+/*
+ * input tables
+ */
+
+static
+void prog_reset(module_data_t *prog)
+{
+    for (size_t i = 0; i < TS_MAX_PIDS; i++)
+    {
+        if (prog->pid_map[i] != 0)
+        {
+            module_demux_leave(prog, i);
+            prog->pid_map[i] = 0;
+        }
+    }
+
+    if (prog->pmt->pid < TS_MAX_PIDS)
+        module_demux_leave(prog, prog->pmt->pid);
+
+    prog->pmt->pid = TS_MAX_PIDS;
+    prog->pmt->crc32 = 0;
+
+    prog->in_pcr_pid = TS_NULL_PID;
+    prog->clock.on = false;
+
+    queue_flush(prog);
+}
+
+static
+void on_pat(void *arg, ts_psi_t *psi)
+{
+    module_data_t *const prog = (module_data_t *)arg;
+    cbr_mux_t *const mux = prog->mux;
+
+    if (psi->buffer[0] != 0x00)
+        return;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if (crc32 == psi->crc32)
+        return;
+
+    if (crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("program %u: PAT checksum error"), prog->pnr);
+        return;
+    }
+
+    psi->crc32 = crc32;
+
+    unsigned int pnr = 0;
+    unsigned int pmt_pid = TS_NULL_PID;
+    const uint8_t *ptr = NULL;
+
+    PAT_ITEMS_FOREACH(psi, ptr)
+    {
+        const unsigned int item_pnr = PAT_ITEM_GET_PNR(psi, ptr);
+        const unsigned int item_pid = PAT_ITEM_GET_PID(psi, ptr);
+
+        if (!ts_pnr_valid(item_pnr) || !(item_pid >= 32 && item_pid < TS_NULL_PID))
+            continue; /* NIT or illegal PMT PID */
+
+        if (prog->in_pnr == 0 || prog->in_pnr == item_pnr)
+        {
+            pnr = item_pnr;
+            pmt_pid = item_pid;
+            break;
+        }
+    }
+
+    if (pmt_pid == TS_NULL_PID)
+    {
+        asc_log_error(MSG("program %u: input program %u not found in PAT")
+                      , prog->pnr, prog->in_pnr);
+
+        prog_reset(prog);
+        return;
+    }
+
+    if (pmt_pid != prog->pmt->pid || pnr != prog->src_pnr)
+    {
+        prog_reset(prog);
+
+        prog->src_pnr = pnr;
+        prog->pmt->pid = pmt_pid;
+        module_demux_join(prog, pmt_pid);
+
+        asc_log_debug(MSG("program %u: using input program %u, PMT PID %u")
+                      , prog->pnr, pnr, pmt_pid);
+    }
+}
+
+static
+size_t copy_desc(uint8_t *dst, const uint8_t *desc, size_t size)
+{
+    size_t skip = 0;
+
+    for (size_t i = 0; i + 2 <= size; i += 2 + desc[i + 1])
+    {
+        const size_t len = 2 + desc[i + 1];
+        if (i + len > size)
+            break;
+
+        if (desc[i] == 0x09)
+            continue; /* scrambling info is not carried over */
+
+        memcpy(&dst[skip], &desc[i], len);
+        skip += len;
+    }
+
+    return skip;
+}
+
+static
+void on_pmt(void *arg, ts_psi_t *psi)
+{
+    module_data_t *const prog = (module_data_t *)arg;
+    cbr_mux_t *const mux = prog->mux;
+
+    if (psi->buffer[0] != 0x02 || (unsigned int)PMT_GET_PNR(psi) != prog->src_pnr)
+        return;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if (crc32 == psi->crc32)
+        return;
+
+    if (crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("program %u: PMT checksum error"), prog->pnr);
+        return;
+    }
+
+    psi->crc32 = crc32;
+
+    /* drop previous PID mapping */
+    for (size_t i = 0; i < TS_MAX_PIDS; i++)
+    {
+        if (prog->pid_map[i] != 0)
+        {
+            module_demux_leave(prog, i);
+            prog->pid_map[i] = 0;
+        }
+    }
+
+    ts_psi_t *const out = prog->out_pmt;
+    uint8_t *const buf = out->buffer;
+
+    memcpy(buf, psi->buffer, 12);
+    PMT_SET_PNR(out, prog->pnr);
+    PMT_SET_VERSION(out, prog->pmt_version);
+    prog->pmt_version = (prog->pmt_version + 1) & 0x1F;
+
+    /* program info */
+    size_t skip = 12;
+    size_t size = copy_desc(&buf[skip], PMT_DESC_FIRST(psi)
+                            , __PMT_DESC_SIZE(psi));
+
+    buf[10] = 0xF0 | ((size >> 8) & 0x0F);
+    buf[11] = size & 0xFF;
+    skip += size;
+
+    /* elementary streams */
+    const unsigned int in_pcr_pid = PMT_GET_PCR(psi);
+    unsigned int pcr_pid = TS_NULL_PID;
+    unsigned int next_pid = prog->pid_base + 1;
+    unsigned int es_cnt = 0;
+    const uint8_t *ptr = NULL;
+
+    PMT_ITEMS_FOREACH(psi, ptr)
+    {
+        const unsigned int pid = PMT_ITEM_GET_PID(psi, ptr);
+
+        if (!(pid >= 32 && pid < TS_NULL_PID)
+            || pid == psi->pid || prog->pid_map[pid] != 0)
+        {
+            continue; /* illegal or duplicate PID */
+        }
+
+        if (next_pid >= prog->pid_base + PID_STEP - 1)
+        {
+            asc_log_warning(MSG("program %u: too many streams, "
+                                "dropping PID %u"), prog->pnr, pid);
+            continue;
+        }
+
+        uint8_t *const item = &buf[skip];
+        memcpy(item, ptr, 5);
+        PMT_ITEM_SET_PID(out, item, next_pid);
+
+        size = copy_desc(&item[5], PMT_ITEM_DESC_FIRST(ptr)
+                         , __PMT_ITEM_DESC_SIZE(ptr));
+
+        item[3] = 0xF0 | ((size >> 8) & 0x0F);
+        item[4] = size & 0xFF;
+        skip += 5 + size;
+
+        if (pid == in_pcr_pid)
+            pcr_pid = next_pid;
+
+        prog->pid_map[pid] = next_pid++;
+        module_demux_join(prog, pid);
+        es_cnt++;
+    }
+
+    if (pcr_pid == TS_NULL_PID
+        && in_pcr_pid >= 32 && in_pcr_pid < TS_NULL_PID
+        && in_pcr_pid != psi->pid)
+    {
+        /* PCR is carried on a separate PID */
+        pcr_pid = prog->pid_base + PID_STEP - 1;
+        prog->pid_map[in_pcr_pid] = pcr_pid;
+        module_demux_join(prog, in_pcr_pid);
+    }
+
+    PMT_SET_PCR(out, pcr_pid);
+    out->buffer_size = skip + CRC32_SIZE;
+    PSI_SET_SIZE(out);
+    PSI_SET_CRC32(out);
+
+    if (prog->in_pcr_pid != in_pcr_pid || prog->pcr_pid != pcr_pid)
+    {
+        prog->in_pcr_pid = in_pcr_pid;
+        prog->pcr_pid = pcr_pid;
+        prog->clock.on = false;
+        prog->out.last = TS_TIME_NONE;
+    }
+
+    prog->ready = true;
+
+    asc_log_debug(MSG("program %u: PMT updated, %u streams, PCR PID %u")
+                  , prog->pnr, es_cnt, pcr_pid);
+
+    /* send new PMT right away */
+    mux->psi_next = 0;
+}
+
+static
+void on_sdt(void *arg, ts_psi_t *psi)
+{
+    module_data_t *const prog = (module_data_t *)arg;
+    cbr_mux_t *const mux = prog->mux;
+
+    if (psi->buffer[0] != 0x42)
+        return;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if (crc32 == psi->crc32)
+        return;
+
+    if (crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("program %u: SDT checksum error"), prog->pnr);
+        return;
+    }
+
+    psi->crc32 = crc32;
+
+    const uint8_t *ptr = NULL;
+    SDT_ITEMS_FOREACH(psi, ptr)
+    {
+        if ((unsigned int)SDT_ITEM_GET_SID(psi, ptr) == prog->src_pnr)
+            break;
+    }
+
+    if (SDT_ITEMS_EOL(psi, ptr))
+        return; /* might be in another section */
+
+    uint8_t item[SDT_ITEM_SIZE];
+    item[0] = prog->pnr >> 8;
+    item[1] = prog->pnr & 0xFF;
+    item[2] = 0xFC; /* no EIT */
+
+    size_t size = 0;
+    const uint8_t *desc = SDT_ITEM_DESC_FIRST(ptr);
+    const uint8_t *const desc_end = desc + __SDT_ITEM_DESC_SIZE(ptr);
+
+    while (desc + 2 <= desc_end)
+    {
+        const size_t len = 2 + desc[1];
+        if (desc + len > desc_end || 5 + size + len > sizeof(item))
+            break;
+
+        memcpy(&item[5 + size], desc, len);
+        size += len;
+        desc += len;
+    }
+
+    item[3] = (ptr[3] & 0xF0) | ((size >> 8) & 0x0F);
+    item[4] = size & 0xFF;
+    size += 5;
+
+    if (size != prog->sdt_item_size || memcmp(item, prog->sdt_item, size))
+    {
+        memcpy(prog->sdt_item, item, size);
+        prog->sdt_item_size = size;
+        mux->sdt_dirty = true;
+    }
+}
+
+static
+void on_prog_ts(module_data_t *prog, const uint8_t *ts)
+{
+    const unsigned int pid = TS_GET_PID(ts);
+
+    if (pid == prog->pmt->pid)
+    {
+        ts_psi_mux(prog->pmt, ts, on_pmt, prog);
+        return;
+    }
+    else if (pid == 0x00)
+    {
+        ts_psi_mux(prog->pat, ts, on_pat, prog);
+        return;
+    }
+    else if (pid == 0x11)
+    {
+        if (!prog->sdt_fixed)
+            ts_psi_mux(prog->sdt, ts, on_sdt, prog);
+
+        return;
+    }
+
+    const unsigned int out_pid = prog->pid_map[pid];
+    if (out_pid == 0)
+        return;
+
+    const uint64_t now = mux_now(prog->mux);
+
+    if (pid == prog->in_pcr_pid && TS_IS_PCR(ts))
+        clock_update(prog, now, TS_GET_PCR(ts));
+
+    queue_push(prog, ts, out_pid, now);
+}
+
+/*
+ * output tables
+ */
+
+static
+void rebuild_pat(cbr_mux_t *mux)
+{
+    ts_psi_t *const psi = mux->pat;
+
+    PAT_INIT(psi, mux->tsid, mux->pat_version);
+    mux->pat_version = (mux->pat_version + 1) & 0x1F;
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        const module_data_t *const prog = mux->prog[i];
+        PAT_ITEMS_APPEND(psi, prog->pnr, prog->pid_base);
+    }
+
+    PSI_SET_CRC32(psi);
+}
+
+static
+void rebuild_sdt(cbr_mux_t *mux)
+{
+    ts_psi_t *const psi = mux->sdt;
+    uint8_t *const buf = psi->buffer;
+
+    buf[0] = 0x42;
+    buf[1] = 0x80 | 0x70;
+    SDT_SET_TSID(psi, mux->tsid);
+    buf[5] = 0x01;
+    PAT_SET_VERSION(psi, mux->sdt_version);
+    buf[6] = 0x00;
+    buf[7] = 0x00;
+    buf[8] = mux->onid >> 8;
+    buf[9] = mux->onid & 0xFF;
+    buf[10] = 0xFF;
+
+    mux->sdt_version = (mux->sdt_version + 1) & 0x1F;
+
+    size_t skip = 11;
+    size_t cnt = 0;
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        const module_data_t *const prog = mux->prog[i];
+        const size_t size = prog->sdt_item_size;
+
+        if (size == 0)
+            continue;
+
+        if (skip + size + CRC32_SIZE > SDT_MAX_SIZE)
+        {
+            asc_log_warning(MSG("SDT is full, skipping program %u")
+                            , prog->pnr);
+            continue;
+        }
+
+        memcpy(&buf[skip], prog->sdt_item, size);
+        skip += size;
+        cnt++;
+    }
+
+    if (cnt > 0)
+    {
+        psi->buffer_size = skip + CRC32_SIZE;
+        PSI_SET_SIZE(psi);
+        PSI_SET_CRC32(psi);
+    }
+    else
+    {
+        psi->buffer_size = 0;
+    }
+
+    mux->sdt_dirty = false;
+}
+
+static
+void on_psi_ts(void *arg, const uint8_t *ts)
+{
+    cbr_mux_t *const mux = (cbr_mux_t *)arg;
+
+    if (mux->psi_cnt >= PSI_QUEUE_SIZE)
+    {
+        asc_log_error(MSG("table queue overflow"));
+        return;
+    }
+
+    const size_t pos = (mux->psi_head + mux->psi_cnt) % PSI_QUEUE_SIZE;
+    memcpy(mux->psi_queue[pos], ts, TS_PACKET_SIZE);
+    mux->psi_cnt++;
+}
+
+static
+void queue_tables(cbr_mux_t *mux, uint64_t slot)
+{
+    ts_psi_demux(mux->pat, on_psi_ts, mux);
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        module_data_t *const prog = mux->prog[i];
+
+        if (prog->ready)
+            ts_psi_demux(prog->out_pmt, on_psi_ts, mux);
+    }
+
+    if (mux->sdt_dirty || slot >= mux->sdt_next)
+    {
+        if (mux->sdt_dirty)
+            rebuild_sdt(mux);
+
+        ts_psi_demux(mux->sdt, on_psi_ts, mux);
+        mux->sdt_next = slot + SDT_INTERVAL;
+    }
+
+    mux->psi_next = slot + PSI_INTERVAL;
+}
+
+/*
+ * packet scheduling
+ */
+
+static
+void send_pcr(cbr_mux_t *mux, module_data_t *prog, uint64_t slot)
+{
+    uint8_t ts[TS_PACKET_SIZE];
+
+    TS_INIT(ts);
+    TS_SET_PID(ts, prog->pcr_pid);
+    TS_SET_CC(ts, prog->out.cc);
+    TS_SET_AF(ts, TS_BODY_SIZE - 1);
+    TS_SET_PCR(ts, clock_pcr(mux, slot, prog->out.offset));
+
+    prog->out.last = slot;
+    mux->on_ts(mux->arg, ts);
+}
+
+static
+void send_queued(cbr_mux_t *mux, module_data_t *prog, uint64_t slot)
+{
+    mux_pkt_t *const pkt = &prog->queue[prog->q_head];
+    uint8_t *const ts = pkt->ts;
+
+    const uint64_t wait = slot - pkt->time;
+    if (wait > prog->period.wait_max)
+        prog->period.wait_max = wait;
+
+    if (TS_GET_PID(ts) == prog->pcr_pid)
+    {
+        prog->out.cc = TS_GET_CC(ts);
+
+        if (TS_IS_PCR(ts))
+        {
+            TS_SET_PCR(ts, clock_pcr(mux, slot, pkt->offset));
+            prog->out.last = slot;
+            prog->out.offset = pkt->offset;
+        }
+    }
+
+    prog->period.sent++;
+    mux->on_ts(mux->arg, ts);
+
+    prog->q_head = (prog->q_head + 1) % prog->q_size;
+    prog->q_cnt--;
+}
+
+static
+void send_slot(cbr_mux_t *mux, uint64_t slot)
+{
+    mux->stat.packets++;
+    mux->period_slots++;
+
+    /*
+     * Keep PCR interval even if the link is saturated. Insert early
+     * enough that every program due at the same time gets its slot
+     * before the interval runs out.
+     */
+    const uint64_t ahead = mux->slot_time * mux->prog_cnt;
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        module_data_t *const prog = mux->prog[i];
+
+        if (prog->out.last != TS_TIME_NONE
+            && slot + ahead - prog->out.last > mux->pcr_interval)
+        {
+            mux->stat.pcr_inserts++;
+            send_pcr(mux, prog, slot);
+            return;
+        }
+    }
+
+    /* then tables */
+    if (mux->psi_cnt > 0)
+    {
+        mux->on_ts(mux->arg, mux->psi_queue[mux->psi_head]);
+        mux->psi_head = (mux->psi_head + 1) % PSI_QUEUE_SIZE;
+        mux->psi_cnt--;
+
+        return;
+    }
+
+    /* earliest arrival first */
+    module_data_t *next = NULL;
+    uint64_t next_time = UINT64_MAX;
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        module_data_t *const prog = mux->prog[i];
+
+        if (prog->q_cnt > 0 && prog->queue[prog->q_head].time < next_time)
+        {
+            next = prog;
+            next_time = prog->queue[prog->q_head].time;
+        }
+    }
+
+    if (next != NULL && next_time + mux->delay <= slot)
+    {
+        send_queued(mux, next, slot);
+        return;
+    }
+
+    /* spare slot */
+    mux->stat.nulls++;
+    mux->period_nulls++;
+    mux->on_ts(mux->arg, ts_null_pkt);
+}
+
+static
+void update_stats(cbr_mux_t *mux)
+{
+    const uint64_t slots = mux->period_slots;
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        module_data_t *const prog = mux->prog[i];
+        cbr_mux_prog_stat_t *const stat = &prog->stat;
+
+        stat->bitrate = prog->period.sent * TS_PACKET_BITS;
+        stat->share = (slots > 0) ? (prog->period.sent * 100) / slots : 0;
+        stat->delay_max = prog->period.wait_max / (TS_PCR_FREQ / 1000);
+
+        if (prog->period.dropped > 0)
+        {
+            asc_log_warning(MSG("program %u: queue overflow, "
+                                "dropped %" PRIu64 " packets")
+                            , prog->pnr, prog->period.dropped);
+        }
+
+        memset(&prog->period, 0, sizeof(prog->period));
+    }
+
+    mux->stat.null_share =
+        (slots > 0) ? (mux->period_nulls * 100) / slots : 0;
+
+    mux->period_slots = mux->period_nulls = 0;
+}
+
+static
+void on_tick(void *arg)
+{
+    cbr_mux_t *const mux = (cbr_mux_t *)arg;
+    const uint64_t now = mux_now(mux);
+
+    if (now > mux->clock + MAX_LAG)
+    {
+        const unsigned long long ms =
+            (now - mux->clock) / (TS_PCR_FREQ / 1000);
+
+        asc_log_error(MSG("output is %llu ms late, skipping ahead"), ms);
+
+        mux->clock = now;
+        mux->clock_rem = 0;
+        mux->psi_next = mux->stat_next = now;
+    }
+
+    while (mux->clock <= now)
+    {
+        const uint64_t slot = mux->clock;
+
+        if (slot >= mux->psi_next)
+            queue_tables(mux, slot);
+
+        if (slot >= mux->stat_next)
+        {
+            update_stats(mux);
+            mux->stat_next = slot + STAT_INTERVAL;
+        }
+
+        send_slot(mux, slot);
+
+        /* advance by exactly one packet time at configured bitrate */
+        mux->clock_rem += TS_PACKET_BITS * TS_PCR_FREQ;
+        mux->clock += mux->clock_rem / mux->bitrate;
+        mux->clock_rem %= mux->bitrate;
+    }
+}
+
+/*
+ * public API
+ */
+
+cbr_mux_t *cbr_mux_init(const cbr_mux_config_t *cfg
+                        , ts_callback_t on_ts, void *arg)
+{
+    cbr_mux_t *const mux = ASC_ALLOC(1, cbr_mux_t);
+
+    mux->name = cfg->name;
+    mux->bitrate = cfg->bitrate;
+    mux->delay = cfg->delay * (TS_PCR_FREQ / 1000);
+    mux->pcr_interval = cfg->pcr_interval * (TS_PCR_FREQ / 1000);
+    mux->slot_time = (TS_PACKET_BITS * TS_PCR_FREQ + cfg->bitrate - 1)
+                     / cfg->bitrate;
+    mux->q_max = TS_PCR_PACKETS(cfg->buffer, cfg->bitrate);
+    mux->tsid = cfg->tsid;
+    mux->onid = cfg->onid;
+
+    ASC_ASSERT(mux->q_max >= QUEUE_INIT_SIZE, MSG("buffer is too small"));
+
+    mux->on_ts = on_ts;
+    mux->arg = arg;
+
+    mux->pat = ts_psi_init(TS_TYPE_PAT, 0x00);
+    mux->sdt = ts_psi_init(TS_TYPE_SDT, 0x11);
+    rebuild_pat(mux);
+
+    mux->start = asc_utime();
+    mux->stat_next = STAT_INTERVAL;
+    mux->timer = asc_timer_init(MUX_TICK_MSEC, on_tick, mux);
+
+    return mux;
+}
+
+void cbr_mux_destroy(cbr_mux_t *mux)
+{
+    ASC_FREE(mux->timer, asc_timer_destroy);
+
+    for (size_t i = 0; i < mux->prog_cnt; i++)
+    {
+        module_data_t *const prog = mux->prog[i];
+
+        module_stream_destroy(prog);
+
+        ASC_FREE(prog->pat, ts_psi_destroy);
+        ASC_FREE(prog->pmt, ts_psi_destroy);
+        ASC_FREE(prog->sdt, ts_psi_destroy);
+        ASC_FREE(prog->out_pmt, ts_psi_destroy);
+        ASC_FREE(prog->queue, free);
+
+        free(prog);
+    }
+
+    ASC_FREE(mux->pat, ts_psi_destroy);
+    ASC_FREE(mux->sdt, ts_psi_destroy);
+
+    free(mux);
+}
+
+static
+void set_service(module_data_t *prog, const char *service
+                 , const char *provider)
+{
+    uint8_t *const item = prog->sdt_item;
+    size_t skip = 5;
+
+    const size_t s_len = strnlen(service, 96);
+    const size_t p_len = (provider != NULL) ? strnlen(provider, 96) : 0;
+
+    /* service descriptor: digital television */
+    item[skip++] = 0x48;
+    item[skip++] = 3 + p_len + s_len;
+    item[skip++] = 0x01;
+    item[skip++] = p_len;
+    if (p_len > 0)
+    {
+        memcpy(&item[skip], provider, p_len);
+        skip += p_len;
+    }
+    item[skip++] = s_len;
+    memcpy(&item[skip], service, s_len);
+    skip += s_len;
+
+    const size_t size = skip - 5;
+    item[0] = prog->pnr >> 8;
+    item[1] = prog->pnr & 0xFF;
+    item[2] = 0xFC; /* no EIT */
+    item[3] = 0x80 | ((size >> 8) & 0x0F); /* running */
+    item[4] = size & 0xFF;
+
+    prog->sdt_item_size = skip;
+    prog->sdt_fixed = true;
+}
+
+void cbr_mux_add(cbr_mux_t *mux, const cbr_mux_prog_config_t *cfg)
+{
+    ASC_ASSERT(mux->prog_cnt < CBR_MUX_MAX_PROGRAMS
+               , MSG("too many programs"));
+
+    module_data_t *const prog = ASC_ALLOC(1, module_data_t);
+
+    prog->mux = mux;
+    prog->pnr = cfg->pnr;
+    prog->in_pnr = cfg->in_pnr;
+    prog->pid_base = PID_BASE + (mux->prog_cnt * PID_STEP);
+
+    prog->pat = ts_psi_init(TS_TYPE_PAT, 0x00);
+    prog->pmt = ts_psi_init(TS_TYPE_PMT, TS_MAX_PIDS);
+    prog->sdt = ts_psi_init(TS_TYPE_SDT, 0x11);
+    prog->out_pmt = ts_psi_init(TS_TYPE_PMT, prog->pid_base);
+
+    prog->in_pcr_pid = prog->pcr_pid = TS_NULL_PID;
+    prog->out.last = TS_TIME_NONE;
+
+    prog->q_size = QUEUE_INIT_SIZE;
+    prog->queue = ASC_ALLOC(prog->q_size, mux_pkt_t);
+
+    prog->stat.pnr = prog->pnr;
+
+    if (cfg->service != NULL)
+        set_service(prog, cfg->service, cfg->provider);
+
+    mux->prog[mux->prog_cnt++] = prog;
+    rebuild_pat(mux);
+    mux->sdt_dirty = true;
+
+    module_stream_init(NULL, prog, on_prog_ts);
+    module_demux_set(prog, NULL, NULL);
+    module_demux_route(prog, true);
+    module_stream_attach(cfg->upstream, prog);
+
+    module_demux_join(prog, 0x00);
+    if (!prog->sdt_fixed)
+        module_demux_join(prog, 0x11);
+}
+
+void cbr_mux_query(const cbr_mux_t *mux, cbr_mux_stat_t *out)
+{
+    memcpy(out, &mux->stat, sizeof(*out));
+    out->programs = mux->prog_cnt;
+}
+
+bool cbr_mux_query_prog(const cbr_mux_t *mux, size_t idx
+                        , cbr_mux_prog_stat_t *out)
+{
+    if (idx >= mux->prog_cnt)
+        return false;
+
+    const module_data_t *const prog = mux->prog[idx];
+
+    memcpy(out, &prog->stat, sizeof(*out));
+    out->ready = prog->ready;
+    out->queue = prog->q_cnt;
+
+    return true;
+}
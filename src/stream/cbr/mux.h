@@ -0,0 +1,85 @@
+/*
+ * Astra Module: Constant bitrate muxer (multi-program mode)
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CBR_MUX_H_
+#define _CBR_MUX_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+#include <astra/luaapi/stream.h>
+
+/* maximum number of programs in a multiplex */
+#define CBR_MUX_MAX_PROGRAMS 64
+
+typedef struct cbr_mux_t cbr_mux_t;
+
+typedef struct
+{
+    const char *name;       /* instance name for logging */
+    size_t bitrate;         /* total output bitrate, bps */
+    unsigned int delay;     /* fixed multiplexing delay, ms */
+    unsigned int buffer;    /* per-program queue size, ms */
+    unsigned int pcr_interval; /* maximum PCR interval, ms */
+    unsigned int tsid;      /* output transport stream id */
+    unsigned int onid;      /* output original network id */
+} cbr_mux_config_t;
+
+typedef struct
+{
+    module_data_t *upstream;
+    unsigned int pnr;       /* output program number */
+    unsigned int in_pnr;    /* input program number, 0 selects first one */
+    const char *service;    /* service name; copied from input SDT if NULL */
+    const char *provider;   /* provider name, used with service name */
+} cbr_mux_prog_config_t;
+
+typedef struct
+{
+    unsigned int pnr;
+    bool ready;             /* PMT received */
+    size_t bitrate;         /* over the last second, bps */
+    unsigned int share;     /* percentage of total bitrate */
+    size_t queue;           /* packets waiting for output */
+    unsigned int delay_max; /* worst queueing delay over last second, ms */
+    uint64_t dropped;       /* packets discarded due to queue overflow */
+    uint64_t clock_resets;  /* input timebase discontinuities */
+} cbr_mux_prog_stat_t;
+
+typedef struct
+{
+    size_t programs;
+    uint64_t packets;       /* total packets sent */
+    uint64_t nulls;         /* null padding packets sent */
+    uint64_t pcr_inserts;   /* PCR-only packets sent */
+    unsigned int null_share; /* padding percentage over last second */
+} cbr_mux_stat_t;
+
+cbr_mux_t *cbr_mux_init(const cbr_mux_config_t *cfg
+                        , ts_callback_t on_ts, void *arg) __asc_result;
+void cbr_mux_destroy(cbr_mux_t *mux);
+
+void cbr_mux_add(cbr_mux_t *mux, const cbr_mux_prog_config_t *cfg);
+
+void cbr_mux_query(const cbr_mux_t *mux, cbr_mux_stat_t *out);
+bool cbr_mux_query_prog(const cbr_mux_t *mux, size_t idx
+                        , cbr_mux_prog_stat_t *out);
+
+#endif /* _CBR_MUX_H_ */
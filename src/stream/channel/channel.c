@@ -32,6 +32,8 @@
  *      pid         - list, join PID in list
  *      no_sdt      - boolean, do not join SDT table
  *      no_eit      - boolean, do not join EIT table
+ *      eit_interval - number, minimum repetition interval for unchanged
+ *                    EIT sections, in milliseconds (default: as received)
  *      cas         - boolean, join CAT, ECM, EMM tables
  *      set_pnr     - number, replace original PNR
  *      map         - list, map PID by stream type, item format: "type=pid"
@@ -41,11 +43,14 @@
  */
 
 #include <astra/astra.h>
+#include <astra/core/clock.h>
 #include <astra/core/list.h>
 #include <astra/core/timer.h>
 #include <astra/luaapi/stream.h>
 #include <astra/mpegts/psi.h>
 
+#include "si_cache.h"
+
 typedef struct
 {
     char type[6];
@@ -54,6 +59,17 @@ typedef struct
     bool is_set;
 } map_item_t;
 
+/* EIT actual: present/following and 16 schedule tables */
+#define EIT_CACHE_SIZE (17 * 256)
+
+typedef struct
+{
+    uint32_t crc32; /* input section checksum */
+    uint64_t sent;  /* last transmission time */
+    uint16_t size;
+    uint8_t buffer[]; /* rewritten section, with set_pnr only */
+} eit_section_t;
+
 struct module_data_t
 {
     STREAM_MODULE_DATA();
@@ -68,6 +84,7 @@ struct module_data_t
         bool no_eit;
         bool no_reload;
         bool cas;
+        int eit_interval;
 
         bool pass_sdt;
         bool pass_eit;
@@ -81,7 +98,6 @@ struct module_data_t
     ts_psi_t *pat;
     ts_psi_t *cat;
     ts_psi_t *pmt;
-    ts_psi_t *sdt;
     ts_psi_t *eit;
 
     ts_type_t stream[TS_MAX_PIDS];
@@ -92,12 +108,12 @@ struct module_data_t
     ts_psi_t *custom_pmt;
     ts_psi_t *custom_sdt;
 
-    /* */
-    uint8_t sdt_original_section_id;
-    uint8_t sdt_max_section_id;
-    uint32_t *sdt_checksum_list;
+    /* SDT and EIT are demultiplexed by a cache shared with other channels */
+    si_cache_sub_t *si_sub;
+    uint32_t sdt_crc32;
 
     uint8_t eit_cc;
+    eit_section_t **eit_cache;
 
     uint8_t pat_version;
     asc_timer_t *si_timer;
@@ -105,6 +121,12 @@ struct module_data_t
 
 #define MSG(_msg) "[channel %s] " _msg, mod->config.name
 
+static void eit_cache_flush(module_data_t *mod)
+{
+    for(size_t i = 0; i < EIT_CACHE_SIZE; i++)
+        ASC_FREE(mod->eit_cache[i], free);
+}
+
 static void stream_reload(module_data_t *mod)
 {
     memset(mod->stream, 0, sizeof(mod->stream));
@@ -130,19 +152,24 @@ static void stream_reload(module_data_t *mod)
 
     if(mod->config.no_sdt == false)
     {
-        mod->stream[0x11] = TS_TYPE_SDT;
-        module_demux_join(mod, 0x11);
-        if(mod->sdt_checksum_list)
+        mod->sdt_crc32 = 0;
+        if(mod->config.pass_sdt)
         {
-            free(mod->sdt_checksum_list);
-            mod->sdt_checksum_list = NULL;
+            mod->stream[0x11] = TS_TYPE_SDT;
+            module_demux_join(mod, 0x11);
         }
     }
 
     if(mod->config.no_eit == false)
     {
-        mod->stream[0x12] = TS_TYPE_EIT;
-        module_demux_join(mod, 0x12);
+        if(mod->config.pass_eit)
+        {
+            mod->stream[0x12] = TS_TYPE_EIT;
+            module_demux_join(mod, 0x12);
+        }
+
+        if(mod->eit_cache)
+            eit_cache_flush(mod);
 
         mod->stream[0x14] = TS_TYPE_TDT;
         module_demux_join(mod, 0x14);
@@ -184,6 +211,8 @@ static void on_si_timer(void *arg)
  *
  */
 
+static void si_subscribe(module_data_t *mod);
+
 static void on_pat(void *arg, ts_psi_t *psi)
 {
     module_data_t *mod = (module_data_t *)arg;
@@ -195,6 +224,9 @@ static void on_pat(void *arg, ts_psi_t *psi)
     const uint32_t crc32 = PSI_GET_CRC32(psi);
     if(crc32 == psi->crc32)
     {
+        // follow upstream changes
+        si_subscribe(mod);
+
         ts_psi_demux(mod->custom_pat, module_stream_send, mod);
         return;
     }
@@ -246,6 +278,9 @@ static void on_pat(void *arg, ts_psi_t *psi)
         return;
     }
 
+    // pnr is known at this point, even if it was taken from the PAT
+    si_subscribe(mod);
+
     const uint8_t pat_version = PAT_GET_VERSION(mod->custom_pat) + 1;
     PAT_INIT(mod->custom_pat, mod->tsid, pat_version);
     memcpy(PAT_ITEMS_FIRST(mod->custom_pat), pointer, 4);
@@ -614,85 +649,41 @@ static void on_sdt(void *arg, ts_psi_t *psi)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    if(psi->buffer[0] != 0x42)
+    if(si_cache_upstream(mod->si_sub) != module_stream_parent(mod))
         return;
 
     if(mod->tsid != SDT_GET_TSID(psi))
         return;
 
-    const uint32_t crc32 = PSI_GET_CRC32(psi);
-
-    // check crc
-    if(crc32 != PSI_CALC_CRC32(psi))
-    {
-        asc_log_error(MSG("SDT checksum error"));
+    if(mod->config.no_reload && mod->custom_sdt->buffer_size != 0)
         return;
-    }
 
     // check changes
-    if(!mod->sdt_checksum_list)
-    {
-        const uint8_t max_section_id = SDT_GET_LAST_SECTION_NUMBER(psi);
-        mod->sdt_max_section_id = max_section_id;
-        mod->sdt_checksum_list = ASC_ALLOC(max_section_id + 1, uint32_t);
-    }
-    const uint8_t section_id = SDT_GET_SECTION_NUMBER(psi);
-    if(section_id > mod->sdt_max_section_id)
-    {
-        asc_log_warning(MSG("SDT: section_number is greater then section_last_number"));
-        return;
-    }
-    if(mod->sdt_checksum_list[section_id] == crc32)
-    {
-        if(mod->sdt_original_section_id == section_id)
-            ts_psi_demux(mod->custom_sdt, module_stream_send, mod);
-
-        return;
-    }
-
-    if(mod->sdt_checksum_list[section_id] != 0)
-    {
-        asc_log_warning(MSG("SDT changed. Reload stream info"));
-        stream_reload(mod);
-        return;
-    }
-
-    mod->sdt_checksum_list[section_id] = crc32;
-
-    const uint8_t *pointer;
-    SDT_ITEMS_FOREACH(psi, pointer)
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if(crc32 != mod->sdt_crc32)
     {
-        if(SDT_ITEM_GET_SID(psi, pointer) == mod->config.pnr)
-            break;
-    }
-
-    if(SDT_ITEMS_EOL(psi, pointer))
-        return;
-
-    mod->sdt_original_section_id = section_id;
+        if(mod->sdt_crc32 != 0)
+        {
+            asc_log_warning(MSG("SDT changed. Reload stream info"));
+            stream_reload(mod);
+            return;
+        }
 
-    memcpy(mod->custom_sdt->buffer, psi->buffer, 11); // copy SDT header
-    SDT_SET_SECTION_NUMBER(mod->custom_sdt, 0);
-    SDT_SET_LAST_SECTION_NUMBER(mod->custom_sdt, 0);
+        mod->sdt_crc32 = crc32;
 
-    const uint16_t item_length = __SDT_ITEM_DESC_SIZE(pointer) + 5;
-    memcpy(&mod->custom_sdt->buffer[11], pointer, item_length);
-    const uint16_t section_length = item_length + 8 + CRC32_SIZE;
-    mod->custom_sdt->buffer_size = 3 + section_length;
+        // cache sends sections with the requested service only
+        memcpy(mod->custom_sdt->buffer, psi->buffer, psi->buffer_size);
+        mod->custom_sdt->buffer_size = psi->buffer_size;
 
-    if(mod->config.set_pnr)
-    {
-        uint8_t *custom_pointer = SDT_ITEMS_FIRST(mod->custom_sdt);
-        SDT_ITEM_SET_SID(mod->custom_sdt, custom_pointer, mod->config.set_pnr);
+        if(mod->config.set_pnr)
+        {
+            uint8_t *custom_pointer = SDT_ITEMS_FIRST(mod->custom_sdt);
+            SDT_ITEM_SET_SID(mod->custom_sdt, custom_pointer, mod->config.set_pnr);
+            PSI_SET_CRC32(mod->custom_sdt);
+        }
     }
 
-    PSI_SET_SIZE(mod->custom_sdt);
-    PSI_SET_CRC32(mod->custom_sdt);
-
     ts_psi_demux(mod->custom_sdt, module_stream_send, mod);
-
-    if(mod->config.no_reload)
-        mod->stream[psi->pid] = TS_TYPE_UNKNOWN;
 }
 
 /*
@@ -708,30 +699,108 @@ static void on_eit(void *arg, ts_psi_t *psi)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    const uint8_t table_id = psi->buffer[0];
-    const bool is_actual_eit = (table_id == 0x4E || (table_id >= 0x50 && table_id <= 0x5F));
-    if(!is_actual_eit)
+    if(si_cache_upstream(mod->si_sub) != module_stream_parent(mod))
         return;
 
     if(mod->tsid != EIT_GET_TSID(psi))
         return;
 
-    if(mod->config.pnr != EIT_GET_PNR(psi))
+    if(!mod->eit_cache)
+    {
+        psi->cc = mod->eit_cc;
+        ts_psi_demux(psi, module_stream_send, mod);
+        mod->eit_cc = psi->cc;
         return;
+    }
 
-    psi->cc = mod->eit_cc;
+    // cache sends p/f (0x4E) and schedule (0x50..0x5F) sections only
+    const uint8_t table_id = psi->buffer[0];
+    const size_t table = (table_id == 0x4E) ? 0 : (1 + table_id - 0x50);
+    eit_section_t **const slot = &mod->eit_cache[(table * 256) + psi->buffer[6]];
+
+    eit_section_t *item = *slot;
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    const uint64_t now = asc_utime();
+    bool rewritten = false;
+
+    if(item != NULL && item->crc32 == crc32)
+    {
+        // unchanged section, skip if repeated too often
+        if(now - item->sent < (uint64_t)mod->config.eit_interval * 1000)
+            return;
+    }
+    else
+    {
+        // new section or new version
+        const size_t size = (mod->config.set_pnr ? psi->buffer_size : 0);
+        if(item == NULL || item->size < size)
+        {
+            item = (eit_section_t *)realloc(item, sizeof(*item) + size);
+            ASC_ASSERT(item != NULL, MSG("realloc() failed"));
+            *slot = item;
+        }
+
+        item->crc32 = crc32;
+        item->size = size;
+
+        /* section is shared with other channels, rewrite a copy */
+        if(mod->config.set_pnr)
+        {
+            memcpy(mod->eit->buffer, psi->buffer, psi->buffer_size);
+            mod->eit->buffer_size = psi->buffer_size;
+
+            EIT_SET_PNR(mod->eit, mod->config.set_pnr);
+            PSI_SET_CRC32(mod->eit);
+
+            memcpy(item->buffer, mod->eit->buffer, size);
+            rewritten = true;
+        }
+    }
+
+    item->sent = now;
 
     if(mod->config.set_pnr)
     {
-        EIT_SET_PNR(psi, mod->config.set_pnr);
-        PSI_SET_CRC32(psi);
+        // repeated section, send the stored copy
+        if(!rewritten)
+        {
+            memcpy(mod->eit->buffer, item->buffer, item->size);
+            mod->eit->buffer_size = item->size;
+        }
+
+        psi = mod->eit;
     }
 
+    psi->cc = mod->eit_cc;
     ts_psi_demux(psi, module_stream_send, mod);
-
     mod->eit_cc = psi->cc;
 }
 
+static void si_subscribe(module_data_t *mod)
+{
+    const bool need_sdt = (mod->custom_sdt != NULL && !mod->config.pass_sdt);
+    const bool need_eit = (mod->eit != NULL && !mod->config.pass_eit);
+    if(!need_sdt && !need_eit)
+        return;
+
+    module_data_t *const upstream = module_stream_parent(mod);
+    if(mod->si_sub != NULL)
+    {
+        if(si_cache_upstream(mod->si_sub) == upstream)
+            return;
+
+        ASC_FREE(mod->si_sub, si_cache_unsubscribe);
+    }
+
+    if(upstream == NULL || !mod->config.pnr)
+        return;
+
+    mod->si_sub = si_cache_subscribe(upstream, mod->config.pnr
+                                     , need_sdt ? on_sdt : NULL
+                                     , need_eit ? on_eit : NULL
+                                     , mod);
+}
+
 /*
  * ooooooooooo  oooooooo8
  * 88  888  88 888
@@ -743,10 +812,8 @@ static void on_eit(void *arg, ts_psi_t *psi)
 
 static void on_ts(module_data_t *mod, const uint8_t *ts)
 {
+    /* parent only routes joined pids to this module */
     const uint16_t pid = TS_GET_PID(ts);
-    if(!module_demux_check(mod, pid))
-        return;
-
     if(pid == TS_NULL_PID)
         return;
 
@@ -763,16 +830,6 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         case TS_TYPE_PMT:
             ts_psi_mux(mod->pmt, ts, on_pmt, mod);
             return;
-        case TS_TYPE_SDT:
-            if(mod->config.pass_sdt)
-                break;
-            ts_psi_mux(mod->sdt, ts, on_sdt, mod);
-            return;
-        case TS_TYPE_EIT:
-            if(mod->config.pass_eit)
-                break;
-            ts_psi_mux(mod->eit, ts, on_eit, mod);
-            return;
         case TS_TYPE_UNKNOWN:
             return;
         default:
@@ -810,6 +867,7 @@ static void module_init(lua_State *L, module_data_t *mod)
 {
     module_stream_init(L, mod, on_ts);
     module_demux_set(mod, NULL, NULL);
+    module_demux_route(mod, true);
 
     module_option_string(L, "name", &mod->config.name, NULL);
     if(mod->config.name == NULL)
@@ -838,25 +896,40 @@ static void module_init(lua_State *L, module_data_t *mod)
         module_option_boolean(L, "no_sdt", &mod->config.no_sdt);
         if(mod->config.no_sdt == false)
         {
-            mod->sdt = ts_psi_init(TS_TYPE_SDT, 0x11);
             mod->custom_sdt = ts_psi_init(TS_TYPE_SDT, 0x11);
-            mod->stream[0x11] = TS_TYPE_SDT;
-            module_demux_join(mod, 0x11);
 
             module_option_boolean(L, "pass_sdt", &mod->config.pass_sdt);
+            if(mod->config.pass_sdt)
+            {
+                mod->stream[0x11] = TS_TYPE_SDT;
+                module_demux_join(mod, 0x11);
+            }
         }
 
         module_option_boolean(L, "no_eit", &mod->config.no_eit);
         if(mod->config.no_eit == false)
         {
             mod->eit = ts_psi_init(TS_TYPE_EIT, 0x12);
-            mod->stream[0x12] = TS_TYPE_EIT;
-            module_demux_join(mod, 0x12);
 
             mod->stream[0x14] = TS_TYPE_TDT;
             module_demux_join(mod, 0x14);
 
             module_option_boolean(L, "pass_eit", &mod->config.pass_eit);
+            if(mod->config.pass_eit)
+            {
+                mod->stream[0x12] = TS_TYPE_EIT;
+                module_demux_join(mod, 0x12);
+            }
+
+            module_option_integer(L, "eit_interval", &mod->config.eit_interval);
+            if(mod->config.eit_interval < 0)
+                luaL_error(L, MSG("option 'eit_interval': value is out of range"));
+
+            if(!mod->config.pass_eit
+               && (mod->config.set_pnr || mod->config.eit_interval > 0))
+            {
+                mod->eit_cache = ASC_ALLOC(EIT_CACHE_SIZE, eit_section_t *);
+            }
         }
 
         module_option_boolean(L, "no_reload", &mod->config.no_reload);
@@ -949,6 +1022,7 @@ static void module_init(lua_State *L, module_data_t *mod)
 
 static void module_destroy(module_data_t *mod)
 {
+    ASC_FREE(mod->si_sub, si_cache_unsubscribe);
     module_stream_destroy(mod);
 
     ts_psi_destroy(mod->pat);
@@ -961,17 +1035,18 @@ static void module_destroy(module_data_t *mod)
     ts_psi_destroy(mod->custom_pat);
     ts_psi_destroy(mod->custom_pmt);
 
-    if(mod->sdt)
-    {
-        ts_psi_destroy(mod->sdt);
+    if(mod->custom_sdt)
         ts_psi_destroy(mod->custom_sdt);
 
-        free(mod->sdt_checksum_list);
-    }
-
     if(mod->eit)
         ts_psi_destroy(mod->eit);
 
+    if(mod->eit_cache)
+    {
+        eit_cache_flush(mod);
+        free(mod->eit_cache);
+    }
+
     if(mod->map)
     {
         asc_list_for(mod->map)
@@ -0,0 +1,392 @@
+/*
+ * Astra Module: MPEG-TS (Shared SI table cache)
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Channels demultiplexing services from the same upstream share a single
+ * instance of this cache. It attaches to the upstream as an internal
+ * stream module, reassembles SDT and EIT once for all of them and only
+ * hands out sections belonging to subscribed services.
+ *
+ * CRC is verified once per section version: a section whose CRC field
+ * matches the last verified one for the same table and section number
+ * is passed without recalculation.
+ */
+
+#include <astra/astra.h>
+#include <astra/core/list.h>
+
+#include "si_cache.h"
+
+#define MSG(_msg) "[si_cache] " _msg
+
+/* EIT actual: present/following and 16 schedule tables */
+#define EIT_TABLES 17
+#define EIT_SECTIONS 256
+
+typedef struct si_cache_t si_cache_t;
+
+typedef struct
+{
+    unsigned int pnr;
+    unsigned int refcnt;
+
+    /* SDT section with this service only */
+    ts_psi_t *sdt;
+
+    /* last verified EIT checksums, by table and section number */
+    uint32_t *eit_crc;
+} si_service_t;
+
+struct si_cache_sub_t
+{
+    si_cache_t *cache;
+    si_service_t *svc;
+
+    si_cache_callback_t on_sdt;
+    si_cache_callback_t on_eit;
+    void *arg;
+};
+
+struct si_cache_t
+{
+    STREAM_MODULE_DATA();
+
+    module_data_t *upstream;
+
+    ts_psi_t *sdt;
+    ts_psi_t *eit;
+    uint32_t sdt_crc[256];
+
+    asc_list_t *services;
+    asc_list_t *subs;
+
+    unsigned int sdt_cnt;
+    unsigned int eit_cnt;
+};
+
+static asc_list_t *cache_list = NULL;
+
+static
+si_service_t *service_find(si_cache_t *cache, unsigned int pnr)
+{
+    asc_list_for(cache->services)
+    {
+        si_service_t *const svc =
+            (si_service_t *)asc_list_data(cache->services);
+
+        if (svc->pnr == pnr)
+            return svc;
+    }
+
+    return NULL;
+}
+
+/*
+ * SDT
+ */
+
+static
+void split_sdt(si_service_t *svc, const ts_psi_t *psi, const uint8_t *item)
+{
+    ts_psi_t *const out = svc->sdt;
+    uint8_t *const buf = out->buffer;
+
+    const size_t item_size = 5 + __SDT_ITEM_DESC_SIZE(item);
+    const size_t size = 11 + item_size + CRC32_SIZE;
+
+    if (out->buffer_size == size
+        && !memcmp(&buf[3], &psi->buffer[3], 3) /* tsid, version */
+        && !memcmp(&buf[8], &psi->buffer[8], 3) /* onid */
+        && !memcmp(&buf[11], item, item_size))
+    {
+        return; /* unchanged */
+    }
+
+    memcpy(buf, psi->buffer, 11);
+    SDT_SET_SECTION_NUMBER(out, 0);
+    SDT_SET_LAST_SECTION_NUMBER(out, 0);
+
+    memcpy(&buf[11], item, item_size);
+    out->buffer_size = size;
+
+    PSI_SET_SIZE(out);
+    PSI_SET_CRC32(out);
+}
+
+static
+void on_sdt(void *arg, ts_psi_t *psi)
+{
+    si_cache_t *const cache = (si_cache_t *)arg;
+
+    if (psi->buffer[0] != 0x42)
+        return;
+
+    const unsigned int section = SDT_GET_SECTION_NUMBER(psi);
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+
+    if (crc32 != cache->sdt_crc[section])
+    {
+        if (crc32 != PSI_CALC_CRC32(psi))
+        {
+            asc_log_error(MSG("SDT checksum error"));
+            return;
+        }
+
+        cache->sdt_crc[section] = crc32;
+    }
+
+    const uint8_t *ptr = NULL;
+    SDT_ITEMS_FOREACH(psi, ptr)
+    {
+        si_service_t *const svc =
+            service_find(cache, SDT_ITEM_GET_SID(psi, ptr));
+
+        if (svc == NULL)
+            continue;
+
+        split_sdt(svc, psi, ptr);
+
+        asc_list_for(cache->subs)
+        {
+            si_cache_sub_t *const sub =
+                (si_cache_sub_t *)asc_list_data(cache->subs);
+
+            if (sub->svc == svc && sub->on_sdt != NULL)
+                sub->on_sdt(sub->arg, svc->sdt);
+        }
+    }
+}
+
+/*
+ * EIT
+ */
+
+static
+void on_eit(void *arg, ts_psi_t *psi)
+{
+    si_cache_t *const cache = (si_cache_t *)arg;
+
+    const unsigned int table_id = psi->buffer[0];
+    unsigned int table = 0;
+
+    if (table_id == 0x4E)
+        table = 0;
+    else if (table_id >= 0x50 && table_id <= 0x5F)
+        table = 1 + (table_id - 0x50);
+    else
+        return; /* other TS */
+
+    si_service_t *const svc = service_find(cache, EIT_GET_PNR(psi));
+    if (svc == NULL || svc->eit_crc == NULL)
+        return;
+
+    uint32_t *const crc_last = &svc->eit_crc[(table * EIT_SECTIONS)
+                                             + psi->buffer[6]];
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if (crc32 != *crc_last)
+    {
+        if (crc32 != PSI_CALC_CRC32(psi))
+        {
+            asc_log_debug(MSG("EIT checksum error (pnr %u, table 0x%02X)")
+                          , svc->pnr, table_id);
+            return;
+        }
+
+        *crc_last = crc32;
+    }
+
+    asc_list_for(cache->subs)
+    {
+        si_cache_sub_t *const sub =
+            (si_cache_sub_t *)asc_list_data(cache->subs);
+
+        if (sub->svc == svc && sub->on_eit != NULL)
+            sub->on_eit(sub->arg, psi);
+    }
+}
+
+static
+void on_ts(si_cache_t *cache, const uint8_t *ts)
+{
+    switch (TS_GET_PID(ts))
+    {
+        case 0x11:
+            ts_psi_mux(cache->sdt, ts, on_sdt, cache);
+            break;
+
+        case 0x12:
+            ts_psi_mux(cache->eit, ts, on_eit, cache);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * subscription
+ */
+
+static
+si_cache_t *cache_find(module_data_t *upstream)
+{
+    if (cache_list == NULL)
+        return NULL;
+
+    asc_list_for(cache_list)
+    {
+        si_cache_t *const cache = (si_cache_t *)asc_list_data(cache_list);
+        module_data_t *const mod = (module_data_t *)cache;
+
+        /*
+         * Caches are left detached when their upstream goes away;
+         * make sure not to pick one up for a new module that happens
+         * to have the same address.
+         */
+        if (cache->upstream == upstream
+            && module_stream_parent(mod) == upstream)
+        {
+            return cache;
+        }
+    }
+
+    return NULL;
+}
+
+static
+si_cache_t *cache_init(module_data_t *upstream)
+{
+    si_cache_t *const cache = ASC_ALLOC(1, si_cache_t);
+    module_data_t *const mod = (module_data_t *)cache;
+
+    cache->upstream = upstream;
+    cache->sdt = ts_psi_init(TS_TYPE_SDT, 0x11);
+    cache->eit = ts_psi_init(TS_TYPE_EIT, 0x12);
+    cache->services = asc_list_init();
+    cache->subs = asc_list_init();
+
+    module_stream_init(NULL, mod, (stream_callback_t)on_ts);
+    module_demux_set(mod, NULL, NULL);
+    module_demux_route(mod, true);
+    module_stream_attach(upstream, mod);
+
+    if (cache_list == NULL)
+        cache_list = asc_list_init();
+
+    asc_list_insert_tail(cache_list, cache);
+
+    return cache;
+}
+
+static
+void cache_destroy(si_cache_t *cache)
+{
+    module_stream_destroy((module_data_t *)cache);
+
+    ASC_FREE(cache->sdt, ts_psi_destroy);
+    ASC_FREE(cache->eit, ts_psi_destroy);
+    ASC_FREE(cache->services, asc_list_destroy);
+    ASC_FREE(cache->subs, asc_list_destroy);
+
+    asc_list_remove_item(cache_list, cache);
+    if (asc_list_count(cache_list) == 0)
+        ASC_FREE(cache_list, asc_list_destroy);
+
+    free(cache);
+}
+
+si_cache_sub_t *si_cache_subscribe(module_data_t *upstream, unsigned int pnr
+                                   , si_cache_callback_t sdt_cb
+                                   , si_cache_callback_t eit_cb
+                                   , void *arg)
+{
+    si_cache_t *cache = cache_find(upstream);
+    if (cache == NULL)
+        cache = cache_init(upstream);
+
+    module_data_t *const mod = (module_data_t *)cache;
+
+    si_service_t *svc = service_find(cache, pnr);
+    if (svc == NULL)
+    {
+        svc = ASC_ALLOC(1, si_service_t);
+        svc->pnr = pnr;
+        svc->sdt = ts_psi_init(TS_TYPE_SDT, 0x11);
+
+        asc_list_insert_tail(cache->services, svc);
+    }
+
+    if (eit_cb != NULL && svc->eit_crc == NULL)
+        svc->eit_crc = ASC_ALLOC(EIT_TABLES * EIT_SECTIONS, uint32_t);
+
+    svc->refcnt++;
+
+    si_cache_sub_t *const sub = ASC_ALLOC(1, si_cache_sub_t);
+    sub->cache = cache;
+    sub->svc = svc;
+    sub->on_sdt = sdt_cb;
+    sub->on_eit = eit_cb;
+    sub->arg = arg;
+
+    asc_list_insert_tail(cache->subs, sub);
+
+    if (sdt_cb != NULL && cache->sdt_cnt++ == 0)
+        module_demux_join(mod, 0x11);
+
+    if (eit_cb != NULL && cache->eit_cnt++ == 0)
+        module_demux_join(mod, 0x12);
+
+    return sub;
+}
+
+void si_cache_unsubscribe(si_cache_sub_t *sub)
+{
+    si_cache_t *const cache = sub->cache;
+    si_service_t *const svc = sub->svc;
+    module_data_t *const mod = (module_data_t *)cache;
+
+    asc_list_remove_item(cache->subs, sub);
+
+    if (sub->on_sdt != NULL && --cache->sdt_cnt == 0)
+        module_demux_leave(mod, 0x11);
+
+    if (sub->on_eit != NULL && --cache->eit_cnt == 0)
+        module_demux_leave(mod, 0x12);
+
+    if (--svc->refcnt == 0)
+    {
+        asc_list_remove_item(cache->services, svc);
+
+        ts_psi_destroy(svc->sdt);
+        free(svc->eit_crc);
+        free(svc);
+    }
+
+    free(sub);
+
+    if (asc_list_count(cache->subs) == 0)
+        cache_destroy(cache);
+}
+
+module_data_t *si_cache_upstream(const si_cache_sub_t *sub)
+{
+    /* NULL if the upstream module has been destroyed */
+    return module_stream_parent((const module_data_t *)sub->cache);
+}
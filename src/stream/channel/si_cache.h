@@ -0,0 +1,52 @@
+/*
+ * Astra Module: MPEG-TS (Shared SI table cache)
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CHANNEL_SI_CACHE_H_
+#define _CHANNEL_SI_CACHE_H_ 1
+
+#ifndef _ASTRA_H_
+#   error "Please include <astra/astra.h> first"
+#endif /* !_ASTRA_H_ */
+
+#include <astra/luaapi/stream.h>
+#include <astra/mpegts/psi.h>
+
+typedef struct si_cache_sub_t si_cache_sub_t;
+
+/*
+ * Sections passed to callbacks are shared between all subscribers and
+ * have already passed CRC check. Callbacks may send them downstream
+ * using ts_psi_demux() after setting the CC, but must not modify them
+ * or unsubscribe.
+ *
+ * on_sdt receives SDT actual sections containing only the subscribed
+ * service; on_eit receives EIT actual (p/f and schedule) sections for
+ * the subscribed service.
+ */
+typedef void (*si_cache_callback_t)(void *, ts_psi_t *);
+
+si_cache_sub_t *si_cache_subscribe(module_data_t *upstream, unsigned int pnr
+                                   , si_cache_callback_t sdt_cb
+                                   , si_cache_callback_t eit_cb
+                                   , void *arg) __asc_result;
+void si_cache_unsubscribe(si_cache_sub_t *sub);
+
+module_data_t *si_cache_upstream(const si_cache_sub_t *sub) __asc_result;
+
+#endif /* _CHANNEL_SI_CACHE_H_ */
@@ -34,6 +34,7 @@
 
 #include <astra/astra.h>
 #include <astra/core/mainloop.h>
+#include <astra/core/ring.h>
 #include <astra/core/thread.h>
 #include <astra/core/timer.h>
 #include <astra/luaapi/stream.h>
@@ -42,6 +43,7 @@
 #define MSG(_msg) "[file_input %s] " _msg, mod->filename
 
 #define INPUT_BUFFER_SIZE 2
+#define INPUT_BATCH_SIZE 64
 #define TS_PACKET_SIZE_BDAV 192
 
 struct module_data_t
@@ -66,10 +68,10 @@ struct module_data_t
     asc_timer_t *timer_skip;
 
     asc_thread_t *thread;
-    asc_thread_buffer_t *thread_output;
+    asc_ring_t *ring;
     bool thread_run;
 
-    uint32_t overflow;
+    uint64_t overruns;
     uint8_t *buffer;
     uint32_t buffer_size;
     uint32_t buffer_skip;
@@ -192,7 +194,6 @@ static bool open_file(module_data_t *mod)
     return true;
 }
 
-static void on_thread_read(void *arg);
 
 static void thread_loop(void *arg)
 {
@@ -276,12 +277,7 @@ static void thread_loop(void *arg)
         {
             // send
             mod->buffer_skip += mod->m2ts_header;
-            if(TS_PACKET_SIZE != asc_thread_buffer_write(  mod->thread_output
-                                                         , &mod->buffer[mod->buffer_skip]
-                                                         , TS_PACKET_SIZE))
-            {
-                ;
-            }
+            asc_ring_push(mod->ring, &mod->buffer[mod->buffer_skip]);
             mod->buffer_skip += TS_PACKET_SIZE;
 
             system_time = asc_utime();
@@ -303,8 +299,7 @@ static void thread_loop(void *arg)
             if (system_time > system_time_buffer + 5000)
             {
                 system_time_buffer = system_time;
-                asc_job_queue(mod->thread_output, on_thread_read, mod);
-                asc_wake();
+                asc_ring_notify(mod->ring);
             }
 
             system_time_check = system_time;
@@ -345,11 +340,7 @@ static void on_thread_close(void *arg)
         asc_wake_close();
     }
 
-    if(mod->thread_output)
-    {
-        asc_job_prune(mod->thread_output);
-        ASC_FREE(mod->thread_output, asc_thread_buffer_destroy);
-    }
+    ASC_FREE(mod->ring, asc_ring_destroy);
 
     if(mod->is_eof && mod->idx_callback)
     {
@@ -361,19 +352,29 @@ static void on_thread_close(void *arg)
     }
 }
 
-static void on_thread_read(void *arg)
+static void on_ring_data(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    uint8_t ts[TS_PACKET_SIZE];
-    while (true)
+    const uint8_t *ts;
+    size_t cnt;
+
+    while((cnt = asc_ring_peek(mod->ring, &ts)) > 0)
     {
-        const ssize_t r = asc_thread_buffer_read(mod->thread_output, ts
-                                                 , TS_PACKET_SIZE);
-        if (r != TS_PACKET_SIZE)
-            return;
+        if(cnt > INPUT_BATCH_SIZE)
+            cnt = INPUT_BATCH_SIZE;
+
+        module_stream_send_batch(mod, ts, cnt);
+        asc_ring_skip(mod->ring, cnt);
+    }
 
-        module_stream_send(mod, ts);
+    asc_ring_stats_t st;
+    asc_ring_stats(mod->ring, &st);
+    if(st.overruns > mod->overruns)
+    {
+        asc_log_error(MSG("buffer overrun, dropped %" PRIu64 " packets")
+                      , st.overruns - mod->overruns);
+        mod->overruns = st.overruns;
     }
 }
 
@@ -459,7 +460,8 @@ static void module_init(lua_State *L, module_data_t *mod)
     asc_wake_open();
 
     mod->thread_run = true;
-    mod->thread_output = asc_thread_buffer_init(mod->buffer_size);
+    mod->ring = asc_ring_init(mod->buffer_size / TS_PACKET_SIZE
+                              , on_ring_data, mod);
 
     mod->thread = asc_thread_init(mod, thread_loop, on_thread_close);
 }
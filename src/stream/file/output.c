@@ -30,6 +30,9 @@
  *      m2ts        - boolean, use m2ts file format [default : false]
  *      buffer_size - number, output buffer size. in kilobytes [default : 32]
  *      aio         - boolean, use aio [default : false]
+ *      uring       - boolean, use io_uring with registered buffers,
+ *                    falls back to write() if the kernel lacks support
+ *                    [default : false]
  *      directio    - boolean, try to avoid all caching operations [default : false]
  *
  * Module Methods:
@@ -47,6 +50,10 @@
 #   endif
 #endif
 
+#ifdef HAVE_LIBURING
+#   include <liburing.h>
+#endif
+
 #define FILE_BUFFER_SIZE 32
 #define TS_PACKET_SIZE_BDAV 192
 
@@ -55,6 +62,18 @@
 
 #define MSG(_msg) "[file_output %s] " _msg, mod->config.filename
 
+#ifdef HAVE_LIBURING
+/* number of registered buffers, i.e. maximum writes in flight */
+#define URING_BUFFERS 2
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    bool busy;
+} uring_buffer_t;
+#endif
+
 struct module_data_t
 {
     STREAM_MODULE_DATA();
@@ -73,6 +92,10 @@ struct module_data_t
 #ifdef HAVE_LIBAIO
         bool aio_kernel;
 #endif
+
+#ifdef HAVE_LIBURING
+        bool uring;
+#endif
     } config;
 
     int fd;
@@ -88,6 +111,16 @@ struct module_data_t
     struct iocb *io[1];
 #endif
 
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+    bool ring_ready;
+
+    uring_buffer_t uring_buf[URING_BUFFERS];
+    unsigned int uring_cur;
+    unsigned int uring_inflight;
+    size_t uring_offset;
+#endif
+
     size_t file_size;
 
     uint8_t packet_size;
@@ -96,12 +129,225 @@ struct module_data_t
     uint8_t *buffer; // write buffer
 };
 
+/* io_uring */
+
+#ifdef HAVE_LIBURING
+static bool uring_complete(module_data_t *mod, struct io_uring_cqe *cqe)
+{
+    uring_buffer_t *const buf = (uring_buffer_t *)io_uring_cqe_get_data(cqe);
+    const int res = cqe->res;
+
+    io_uring_cqe_seen(&mod->ring, cqe);
+    buf->busy = false;
+    mod->uring_inflight--;
+
+    if(res < 0)
+    {
+        asc_log_error(MSG("io_uring write error: %s"), strerror(-res));
+        return false;
+    }
+    else if((size_t)res != buf->size)
+    {
+        asc_log_error(MSG("io_uring short write: %d of %zu bytes")
+                      , res, buf->size);
+        return false;
+    }
+
+    return true;
+}
+
+/* reap finished writes; optionally block until all of them are done */
+static bool uring_reap(module_data_t *mod, bool wait)
+{
+    bool ok = true;
+
+    while(mod->uring_inflight > 0)
+    {
+        struct io_uring_cqe *cqe = NULL;
+        const int ret = wait ? io_uring_wait_cqe(&mod->ring, &cqe)
+                             : io_uring_peek_cqe(&mod->ring, &cqe);
+
+        if(ret == -EAGAIN || ret == -EINTR)
+        {
+            if(!wait)
+                break;
+
+            continue;
+        }
+        else if(ret < 0 || cqe == NULL)
+        {
+            asc_log_error(MSG("failed to get io_uring completion: %s")
+                          , strerror(-ret));
+            return false;
+        }
+
+        if(!uring_complete(mod, cqe))
+            ok = false;
+    }
+
+    return ok;
+}
+
+/*
+ * Packets are collected straight into a registered buffer. On flush
+ * that buffer is queued for writing and the next one takes its place;
+ * only the unaligned tail left over by directio is copied across.
+ */
+static int uring_flush(module_data_t *mod)
+{
+    if(!uring_reap(mod, false))
+        return -1;
+
+#ifdef O_DIRECT
+    const size_t size = mod->config.directio ? align(mod->buffer_skip) : mod->buffer_skip;
+#else
+    const size_t size = mod->buffer_skip;
+#endif
+
+    if(size == 0)
+        return 1;
+
+    uring_buffer_t *const buf = &mod->uring_buf[mod->uring_cur];
+    const unsigned int next_idx = (mod->uring_cur + 1) % URING_BUFFERS;
+    uring_buffer_t *const next = &mod->uring_buf[next_idx];
+
+    if(next->busy)
+    {
+        if(!mod->error)
+        {
+            asc_log_error(MSG("io_uring write in progress. "
+                              "Try to increase buffer size"));
+            mod->error = true;
+        }
+        return 0;
+    }
+
+    struct io_uring_sqe *const sqe = io_uring_get_sqe(&mod->ring);
+    if(!sqe)
+        return 0;
+
+    buf->size = size;
+    buf->busy = true;
+
+    io_uring_prep_write_fixed(sqe, mod->fd, buf->data, size
+                              , mod->uring_offset, mod->uring_cur);
+    io_uring_sqe_set_data(sqe, buf);
+
+    if(io_uring_submit(&mod->ring) != 1)
+    {
+        asc_log_error(MSG("error at io_uring_submit"));
+        buf->busy = false;
+        return -1;
+    }
+
+    mod->uring_inflight++;
+    mod->uring_offset += size;
+    mod->file_size += size;
+
+    mod->buffer_skip -= size;
+    if(mod->buffer_skip)
+        memcpy(next->data, &buf->data[size], mod->buffer_skip);
+
+    mod->uring_cur = next_idx;
+    mod->buffer = next->data;
+
+    return 1;
+}
+
+static bool uring_init(module_data_t *mod)
+{
+    int ret = io_uring_queue_init(URING_BUFFERS * 2, &mod->ring, 0);
+    if(ret < 0)
+    {
+        asc_log_warning(MSG("io_uring is not available (%s), "
+                            "falling back to write()"), strerror(-ret));
+        return false;
+    }
+
+    struct iovec iov[URING_BUFFERS];
+    for(size_t i = 0; i < URING_BUFFERS; i++)
+    {
+        uring_buffer_t *const buf = &mod->uring_buf[i];
+
+#ifdef HAVE_POSIX_MEMALIGN
+        if(posix_memalign((void **)&buf->data, ALIGN, mod->buffer_size))
+            buf->data = NULL;
+#else
+        buf->data = ASC_ALLOC(mod->buffer_size, uint8_t);
+#endif
+
+        iov[i].iov_base = buf->data;
+        iov[i].iov_len = mod->buffer_size;
+
+        if(!buf->data)
+            ret = -ENOMEM;
+    }
+
+    if(ret == 0)
+        ret = io_uring_register_buffers(&mod->ring, iov, URING_BUFFERS);
+
+    if(ret < 0)
+    {
+        asc_log_warning(MSG("failed to register io_uring buffers (%s), "
+                            "falling back to write()"), strerror(-ret));
+
+        io_uring_queue_exit(&mod->ring);
+        for(size_t i = 0; i < URING_BUFFERS; i++)
+            ASC_FREE(mod->uring_buf[i].data, free);
+
+        return false;
+    }
+
+    mod->ring_ready = true;
+    mod->uring_cur = 0;
+    mod->buffer = mod->uring_buf[0].data;
+
+    return true;
+}
+
+static void uring_destroy(module_data_t *mod)
+{
+    if(!mod->ring_ready)
+        return;
+
+    uring_reap(mod, true);
+    io_uring_queue_exit(&mod->ring);
+    mod->ring_ready = false;
+
+    /* write buffer is one of the registered ones */
+    mod->buffer = NULL;
+
+    for(size_t i = 0; i < URING_BUFFERS; i++)
+        ASC_FREE(mod->uring_buf[i].data, free);
+}
+#endif /* HAVE_LIBURING */
+
 /* stream_ts callbacks */
 
 static void module_destroy(module_data_t *mod);
 
 static void on_ts(module_data_t *mod, const uint8_t *ts)
 {
+#ifdef HAVE_LIBURING
+    if(mod->config.uring)
+    {
+        if(mod->buffer_skip + mod->packet_size > mod->buffer_size || !ts)
+        {
+            const int ret = uring_flush(mod);
+            if(ret < 0)
+            {
+                mod->error = true;
+                module_destroy(mod);
+                return;
+            }
+            else if(ret == 0 || !ts)
+            {
+                return;
+            }
+        }
+    }
+    else
+#endif /* HAVE_LIBURING */
     if(mod->buffer_skip + mod->packet_size > mod->buffer_size || !ts)
     {
         ssize_t size;
@@ -257,6 +503,14 @@ static void module_init(lua_State *L, module_data_t *mod)
     module_option_boolean(L, "aio", &mod->config.aio);
 #endif
 
+#ifdef HAVE_LIBURING
+    module_option_boolean(L, "uring", &mod->config.uring);
+#ifdef HAVE_AIO
+    if(mod->config.uring && mod->config.aio)
+        luaL_error(L, MSG("options 'aio' and 'uring' are mutually exclusive"));
+#endif
+#endif
+
 #ifdef HAVE_LIBAIO
     mod->config.aio_kernel = mod->config.aio && mod->config.directio;
 #endif
@@ -265,6 +519,17 @@ static void module_init(lua_State *L, module_data_t *mod)
     module_option_integer(L, "buffer_size", &buffer_size);
     mod->buffer_size = buffer_size * 1024;
 
+#ifdef HAVE_LIBURING
+    if(mod->config.uring)
+        mod->config.uring = uring_init(mod);
+
+    if(mod->config.uring)
+    {
+        /* packets go straight into registered buffers */
+    }
+    else
+#endif
+
 #if defined(HAVE_POSIX_MEMALIGN) && defined(O_DIRECT)
 #ifdef HAVE_AIO
     if(mod->config.directio && !mod->config.aio)
@@ -284,6 +549,12 @@ static void module_init(lua_State *L, module_data_t *mod)
     int flags = O_CREAT | O_APPEND | O_WRONLY;
     const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
 
+#ifdef HAVE_LIBURING
+    /* writes go to explicit offsets; O_APPEND would reorder them */
+    if(mod->config.uring)
+        flags &= ~O_APPEND;
+#endif
+
 #ifdef HAVE_AIO
     flags |= O_NONBLOCK;
 #endif
@@ -301,6 +572,10 @@ static void module_init(lua_State *L, module_data_t *mod)
     fstat(mod->fd, &st);
     mod->file_size = st.st_size;
 
+#ifdef HAVE_LIBURING
+    mod->uring_offset = mod->file_size;
+#endif
+
 #ifdef HAVE_AIO
     if(mod->config.aio)
     {
@@ -340,6 +615,17 @@ static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
 
+#ifdef HAVE_LIBURING
+    if(mod->config.uring)
+    {
+        if(!mod->error && mod->ring_ready && uring_reap(mod, true))
+            on_ts(mod, NULL); /* Flush buffer */
+
+        uring_destroy(mod);
+    }
+    else
+#endif
+    {
 #ifdef HAVE_AIO
     if(mod->config.aio)
     {
@@ -362,6 +648,7 @@ static void module_destroy(module_data_t *mod)
     else if(!mod->error)
         on_ts(mod, NULL); /* Flush buffer */
 #endif
+    }
 
     if(mod->fd > 0)
     {
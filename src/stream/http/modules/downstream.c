@@ -78,22 +78,18 @@ static void on_downstream_read(void *arg)
         }
     }
 
-    while(skip < size)
-    {
-        const uint8_t *ts = (const uint8_t *)&client->buffer[skip];
+    if(skip >= size)
+        return;
 
-        const size_t remain = size - skip;
-        if(remain < TS_PACKET_SIZE)
-        {
-            memcpy(client->response->buffer, ts, remain);
-            client->response->buffer_skip = remain;
-            break;
-        }
-        else
-        {
-            module_stream_send(client->response, ts);
-            skip += TS_PACKET_SIZE;
-        }
+    const uint8_t *ts = (const uint8_t *)&client->buffer[skip];
+    const size_t cnt = (size - skip) / TS_PACKET_SIZE;
+    module_stream_send_batch(client->response, ts, cnt);
+
+    const size_t remain = (size - skip) % TS_PACKET_SIZE;
+    if(remain > 0)
+    {
+        memcpy(client->response->buffer, &ts[cnt * TS_PACKET_SIZE], remain);
+        client->response->buffer_skip = remain;
     }
 }
 
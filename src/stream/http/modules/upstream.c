@@ -19,6 +19,7 @@
  */
 
 #include <astra/astra.h>
+#include <astra/core/block.h>
 #include <astra/luaapi/stream.h>
 
 #include "../http.h"
@@ -26,6 +27,10 @@
 #define DEFAULT_BUFFER_SIZE (1024 * 1024)
 #define DEFAULT_BUFFER_FILL (128 * 1024)
 
+/* single packets are packed into blocks of this size */
+#define UPSTREAM_BLOCK_SIZE (TS_PACKET_SIZE * 64)
+#define UPSTREAM_POOL_IDLE 8
+
 struct module_data_t
 {
     MODULE_DATA();
@@ -33,6 +38,11 @@ struct module_data_t
     int idx_callback;
 };
 
+/*
+ * Outgoing data is kept as a queue of packet blocks. Blocks coming from
+ * upstream are referenced rather than copied, so clients watching the
+ * same channel share a single copy of the stream.
+ */
 struct http_response_t
 {
     STREAM_MODULE_DATA();
@@ -40,11 +50,17 @@ struct http_response_t
     module_data_t *mod;
     http_client_t *client;
 
-    uint8_t *buffer;
-    size_t buffer_count;
-    size_t buffer_read;
-    size_t buffer_write;
+    asc_block_pool_t *pool;
+    asc_block_t **queue;
+    size_t queue_size;
+    size_t queue_head;
+    size_t queue_cnt;
+    size_t queue_skip; /* bytes of the first block already sent */
 
+    /* last queued block, if it's ours and can take more packets */
+    asc_block_t *tail;
+
+    size_t buffer_count;
     size_t buffer_size;
     size_t buffer_fill;
 
@@ -56,6 +72,36 @@ struct http_response_t
  * client->response->mod - http_upstream module
  */
 
+static void queue_pop(http_response_t *response)
+{
+    asc_block_t *const block = response->queue[response->queue_head];
+
+    if(block == response->tail)
+        response->tail = NULL;
+
+    asc_block_release(block);
+    response->queue_head = (response->queue_head + 1) % response->queue_size;
+    response->queue_cnt--;
+    response->queue_skip = 0;
+}
+
+static void queue_push(http_response_t *response, asc_block_t *block)
+{
+    const size_t pos = (response->queue_head + response->queue_cnt)
+                       % response->queue_size;
+
+    response->queue[pos] = block;
+    response->queue_cnt++;
+}
+
+static void queue_flush(http_response_t *response)
+{
+    while(response->queue_cnt > 0)
+        queue_pop(response);
+
+    response->buffer_count = 0;
+}
+
 static void on_upstream_ready(void *arg)
 {
     http_client_t *const client = (http_client_t *)arg;
@@ -63,23 +109,42 @@ static void on_upstream_ready(void *arg)
 
     if(response->buffer_count > 0)
     {
-        size_t block_size = (response->buffer_write > response->buffer_read)
-                          ? (response->buffer_write - response->buffer_read)
-                          : (response->buffer_size - response->buffer_read);
+        const void *bufs[ASC_SOCKET_IOV_MAX];
+        size_t lens[ASC_SOCKET_IOV_MAX];
+        size_t cnt = 0, block_size = 0;
+
+        for(; cnt < response->queue_cnt && cnt < ASC_SOCKET_IOV_MAX; cnt++)
+        {
+            const size_t pos = (response->queue_head + cnt) % response->queue_size;
+            const asc_block_t *const block = response->queue[pos];
+            const size_t skip = (cnt == 0) ? response->queue_skip : 0;
 
-        if(block_size > response->buffer_count)
-            block_size = response->buffer_count;
+            bufs[cnt] = &block->data[skip];
+            lens[cnt] = block->cnt * TS_PACKET_SIZE - skip;
+            block_size += lens[cnt];
+        }
 
-        const ssize_t send_size = asc_socket_send(  client->sock
-                                                  , &response->buffer[response->buffer_read]
-                                                  , block_size);
+        const ssize_t send_size = asc_socket_sendv(client->sock, bufs, lens, cnt);
 
         if(send_size > 0)
         {
+            size_t left = send_size;
             response->buffer_count -= send_size;
-            response->buffer_read += send_size;
-            if(response->buffer_read >= response->buffer_size)
-                response->buffer_read = 0;
+
+            while(left > 0)
+            {
+                const asc_block_t *const block = response->queue[response->queue_head];
+                const size_t size = block->cnt * TS_PACKET_SIZE - response->queue_skip;
+
+                if(left < size)
+                {
+                    response->queue_skip += left;
+                    break;
+                }
+
+                left -= size;
+                queue_pop(response);
+            }
         }
         else if(send_size == -1)
         {
@@ -97,53 +162,69 @@ static void on_upstream_ready(void *arg)
     }
 }
 
-static void on_ts(void *arg, const uint8_t *ts)
+/* drop queued data if there's no room for `size' more bytes */
+static bool check_overflow(http_response_t *response, size_t size)
 {
-    http_response_t *const response = (http_response_t *)arg;
-    http_client_t *const client = response->client;
+    if(response->buffer_count + size < response->buffer_size)
+        return false;
 
-    if(response->buffer_count + TS_PACKET_SIZE >= response->buffer_size)
+    queue_flush(response);
+    if(response->is_socket_busy)
     {
-        // overflow
-        response->buffer_count = 0;
-        response->buffer_read = 0;
-        response->buffer_write = 0;
-        if(response->is_socket_busy)
-        {
-            asc_socket_set_on_ready(client->sock, NULL);
-            response->is_socket_busy = false;
-        }
-        return;
+        asc_socket_set_on_ready(response->client->sock, NULL);
+        response->is_socket_busy = false;
     }
 
-    const size_t buffer_write = response->buffer_write + TS_PACKET_SIZE;
-    if(buffer_write < response->buffer_size)
-    {
-        memcpy(&response->buffer[response->buffer_write], ts, TS_PACKET_SIZE);
-        response->buffer_write = buffer_write;
-    }
-    else if(buffer_write > response->buffer_size)
-    {
-        const size_t ts_head = response->buffer_size - response->buffer_write;
-        memcpy(&response->buffer[response->buffer_write], ts, ts_head);
-        response->buffer_write = TS_PACKET_SIZE - ts_head;
-        memcpy(response->buffer, &ts[ts_head], response->buffer_write);
-    }
-    else
-    {
-        memcpy(&response->buffer[response->buffer_write], ts, TS_PACKET_SIZE);
-        response->buffer_write = 0;
-    }
-    response->buffer_count += TS_PACKET_SIZE;
+    return true;
+}
 
+static void check_fill(http_response_t *response)
+{
     if(   response->is_socket_busy == false
        && response->buffer_count >= response->buffer_fill)
     {
-        asc_socket_set_on_ready(client->sock, on_upstream_ready);
+        asc_socket_set_on_ready(response->client->sock, on_upstream_ready);
         response->is_socket_busy = true;
     }
 }
 
+static void on_ts(void *arg, const uint8_t *ts)
+{
+    http_response_t *const response = (http_response_t *)arg;
+
+    if(check_overflow(response, TS_PACKET_SIZE))
+        return;
+
+    asc_block_t *block = response->tail;
+    if(!block || asc_block_space(block) < TS_PACKET_SIZE)
+    {
+        block = asc_block_alloc(response->pool);
+        queue_push(response, block);
+        response->tail = block;
+    }
+
+    memcpy(&block->data[block->cnt * TS_PACKET_SIZE], ts, TS_PACKET_SIZE);
+    block->cnt++;
+    response->buffer_count += TS_PACKET_SIZE;
+
+    check_fill(response);
+}
+
+static void on_ts_block(void *arg, asc_block_t *block)
+{
+    http_response_t *const response = (http_response_t *)arg;
+    const size_t size = block->cnt * TS_PACKET_SIZE;
+
+    if(check_overflow(response, size))
+        return;
+
+    queue_push(response, asc_block_retain(block));
+    response->tail = NULL;
+    response->buffer_count += size;
+
+    check_fill(response);
+}
+
 static void on_upstream_read(void *arg)
 {
     http_client_t *const client = (http_client_t *)arg;
@@ -206,10 +287,15 @@ static void on_upstream_send(void *arg)
         return;
     }
 
-    client->response->buffer = ASC_ALLOC(client->response->buffer_size, uint8_t);
+    /* every queued block holds at least one packet */
+    http_response_t *const response = client->response;
+    response->queue_size = response->buffer_size / TS_PACKET_SIZE + 1;
+    response->queue = ASC_ALLOC(response->queue_size, asc_block_t *);
+    response->pool = asc_block_pool_init(UPSTREAM_BLOCK_SIZE, UPSTREAM_POOL_IDLE);
 
-    module_data_t *const mod = (module_data_t *)client->response;
+    module_data_t *const mod = (module_data_t *)response;
     module_stream_init(NULL, mod, (stream_callback_t)on_ts);
+    module_stream_set_block(mod, (stream_block_callback_t)on_ts_block);
     module_demux_set(mod, NULL, NULL);
     module_stream_attach(upstream, mod);
 
@@ -243,10 +329,17 @@ static int module_call(lua_State *L, module_data_t *mod)
             if (lua_tr_call(L, 3, 0) != 0)
                 lua_err_log(L);
 
-            module_stream_destroy((module_data_t *)client->response);
+            http_response_t *const response = client->response;
+            module_stream_destroy((module_data_t *)response);
+
+            if(response->queue)
+            {
+                queue_flush(response);
+                free(response->queue);
+            }
 
-            free(client->response->buffer);
-            free(client->response);
+            ASC_FREE(response->pool, asc_block_pool_destroy);
+            free(response);
             client->response = NULL;
         }
         return 0;
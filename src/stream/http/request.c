@@ -132,7 +132,6 @@ struct module_data_t
         size_t buf_fill;
 
         ts_sync_t *sync;
-        asc_timer_t *sync_loop;
         size_t sync_ration_size;
         ssize_t sync_feed;
     } ts;
@@ -273,7 +272,6 @@ static void on_close(void *arg)
     }
 
     ASC_FREE(mod->ts.buf, free);
-    ASC_FREE(mod->ts.sync_loop, asc_timer_destroy);
     ASC_FREE(mod->ts.sync, ts_sync_destroy);
 
     if(mod->idx_response)
@@ -629,9 +627,7 @@ static void on_read(void *arg)
                 mod->ts.sync_ration_size = HTTP_BUFFER_SIZE / TS_PACKET_SIZE;
                 mod->ts.sync_feed = mod->ts.sync_ration_size;
 
-                mod->ts.sync_loop = asc_timer_init(SYNC_INTERVAL_MSEC
-                                                   , ts_sync_loop
-                                                   , mod->ts.sync);
+                ts_sync_schedule(mod->ts.sync);
             }
 
             mod->buffer_skip = 0;
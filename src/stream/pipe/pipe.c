@@ -56,7 +56,6 @@ struct module_data_t
     int idx_callback;
 
     ts_sync_t *sync;
-    asc_timer_t *sync_loop;
     ssize_t sync_feed;
 
     bool bypass;
@@ -287,11 +286,7 @@ void on_child_ts_sync(void *arg, const void *buf, size_t packets)
 static
 void on_child_ts(void *arg, const void *buf, size_t packets)
 {
-    module_data_t *const mod = (module_data_t *)arg;
-    const uint8_t *const ts = (uint8_t *)buf;
-
-    for (size_t i = 0; i < packets; i++)
-        module_stream_send(mod, &ts[i * TS_PACKET_SIZE]);
+    module_stream_send_batch(arg, (const uint8_t *)buf, packets);
 }
 
 static
@@ -484,8 +479,7 @@ void module_init(lua_State *L, module_data_t *mod)
         ts_sync_query(mod->sync, &data);
         mod->sync_feed = data.want;
 
-        mod->sync_loop = asc_timer_init(SYNC_INTERVAL_MSEC, ts_sync_loop
-                                        , mod->sync);
+        ts_sync_schedule(mod->sync);
 
         mod->config.sout.on_flush = on_child_ts_sync;
     }
@@ -518,7 +512,6 @@ void module_destroy(module_data_t *mod)
 
     ASC_FREE(mod->restart, asc_timer_destroy);
     ASC_FREE(mod->child, asc_child_destroy);
-    ASC_FREE(mod->sync_loop, asc_timer_destroy);
     ASC_FREE(mod->sync, ts_sync_destroy);
 }
 
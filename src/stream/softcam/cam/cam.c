@@ -19,6 +19,38 @@
  */
 
 #include "../module_cam.h"
+#include <astra/utils/crc32b.h>
+
+/* maximum number of cached ECMs per CAM */
+#define ECM_CACHE_SIZE 64
+
+/* control word response: table id, length and two keys */
+#define ECM_RESPONSE_SIZE (3 + 16)
+
+typedef struct
+{
+    module_decrypt_t *decrypt;
+    void *arg;
+} ecm_waiter_t;
+
+/*
+ * An ECM is sent to the server once; decrypt instances that submit the
+ * same ECM while it's in flight are added as waiters and get the same
+ * response. First waiter is the one the request was sent for.
+ */
+typedef struct
+{
+    uint32_t hash;
+    uint8_t *ecm;
+    uint16_t size;
+
+    bool is_pending;
+    bool is_orphan;
+    uint64_t time;
+    uint8_t response[ECM_RESPONSE_SIZE];
+
+    asc_list_t *waiters;
+} ecm_entry_t;
 
 em_packet_t * module_cam_queue_pop(module_cam_t *cam)
 {
@@ -46,6 +78,341 @@ void module_cam_queue_flush(module_cam_t *cam, module_decrypt_t *decrypt)
     }
 }
 
+/*
+ * ooooooooooo  oooooooo8 oooo     oooo
+ *  888    88 o888     88  8888o   888
+ *  888ooo8   888          88 888o8 88
+ *  888    oo 888o     oo  88  888  88
+ * o888ooo8888 888oooo88  o88o  8  o88o
+ *
+ */
+
+static void ecm_entry_destroy(ecm_entry_t *entry)
+{
+    asc_list_clear(entry->waiters)
+    {
+        free(asc_list_data(entry->waiters));
+    }
+
+    asc_list_destroy(entry->waiters);
+    free(entry->ecm);
+    free(entry);
+}
+
+static bool ecm_entry_is_expired(const module_cam_t *cam
+                                 , const ecm_entry_t *entry, uint64_t now)
+{
+    /* pending requests expire if the CAM silently dropped them */
+    const uint64_t ttl = cam->ecm_cache_ttl * 1000ULL;
+    return (now - entry->time) >= ttl;
+}
+
+static ecm_entry_t *ecm_cache_find(module_cam_t *cam, const uint8_t *buffer
+                                   , uint16_t size, uint64_t now)
+{
+    const uint32_t hash = au_crc32b(buffer, size);
+
+    asc_list_first(cam->ecm_cache);
+    while(!asc_list_eol(cam->ecm_cache))
+    {
+        ecm_entry_t *const entry = (ecm_entry_t *)asc_list_data(cam->ecm_cache);
+
+        if(ecm_entry_is_expired(cam, entry, now))
+        {
+            ecm_entry_destroy(entry);
+            asc_list_remove_current(cam->ecm_cache);
+            continue;
+        }
+
+        if(   entry->hash == hash
+           && entry->size == size
+           && !memcmp(entry->ecm, buffer, size))
+        {
+            return entry;
+        }
+
+        asc_list_next(cam->ecm_cache);
+    }
+
+    return NULL;
+}
+
+static void ecm_cache_remove(module_cam_t *cam, ecm_entry_t *entry)
+{
+    asc_list_remove_item(cam->ecm_cache, entry);
+    ecm_entry_destroy(entry);
+}
+
+static void ecm_waiter_add(ecm_entry_t *entry
+                           , module_decrypt_t *decrypt, void *arg)
+{
+    asc_list_for(entry->waiters)
+    {
+        const ecm_waiter_t *const w = (ecm_waiter_t *)asc_list_data(entry->waiters);
+        if(w->decrypt == decrypt && w->arg == arg)
+            return;
+    }
+
+    ecm_waiter_t *const w = ASC_ALLOC(1, ecm_waiter_t);
+    w->decrypt = decrypt;
+    w->arg = arg;
+    asc_list_insert_tail(entry->waiters, w);
+}
+
+void module_cam_cache_clear(module_cam_t *cam)
+{
+    asc_list_clear(cam->ecm_cache)
+    {
+        ecm_entry_destroy((ecm_entry_t *)asc_list_data(cam->ecm_cache));
+    }
+}
+
+void module_cam_send_em(  module_cam_t *cam
+                        , module_decrypt_t *decrypt, void *arg
+                        , const uint8_t *buffer, uint16_t size)
+{
+    const bool is_ecm = (buffer[0] == 0x80 || buffer[0] == 0x81);
+    if(!is_ecm || cam->ecm_cache_ttl == 0)
+    {
+        cam->send_em(cam->self, decrypt, arg, buffer, size);
+        return;
+    }
+
+    const uint64_t now = asc_utime();
+    ecm_entry_t *entry = ecm_cache_find(cam, buffer, size, now);
+
+    if(entry != NULL && !entry->is_pending)
+    {
+        ++cam->ecm_stats.hits;
+        on_cam_response(decrypt->self, arg, entry->response);
+        return;
+    }
+
+    if(entry != NULL)
+    {
+        ++cam->ecm_stats.coalesced;
+        ecm_waiter_add(entry, decrypt, arg);
+        return;
+    }
+
+    ++cam->ecm_stats.misses;
+
+    if(asc_list_count(cam->ecm_cache) >= ECM_CACHE_SIZE)
+    {
+        /* evict oldest entry */
+        asc_list_first(cam->ecm_cache);
+        ecm_entry_destroy((ecm_entry_t *)asc_list_data(cam->ecm_cache));
+        asc_list_remove_current(cam->ecm_cache);
+    }
+
+    entry = ASC_ALLOC(1, ecm_entry_t);
+    entry->hash = au_crc32b(buffer, size);
+    entry->ecm = ASC_ALLOC(size, uint8_t);
+    memcpy(entry->ecm, buffer, size);
+    entry->size = size;
+    entry->is_pending = true;
+    entry->time = now;
+    entry->waiters = asc_list_init();
+    ecm_waiter_add(entry, decrypt, arg);
+    asc_list_insert_tail(cam->ecm_cache, entry);
+
+    cam->send_em(cam->self, decrypt, arg, buffer, size);
+}
+
+/* called by CAM modules when a response to `packet' is received */
+void module_cam_response(  module_cam_t *cam
+                         , const em_packet_t *packet, const uint8_t *data)
+{
+    ecm_entry_t *entry = NULL;
+
+    if(cam->ecm_cache_ttl > 0)
+    {
+        entry = ecm_cache_find(cam, packet->buffer, packet->buffer_size
+                               , asc_utime());
+    }
+
+    if(entry == NULL || !entry->is_pending)
+    {
+        on_cam_response(packet->decrypt->self, packet->arg, data);
+        return;
+    }
+
+    const bool is_keys = (data[2] == 16);
+    if(is_keys)
+    {
+        memcpy(entry->response, data, ECM_RESPONSE_SIZE);
+        entry->is_pending = false;
+        entry->time = asc_utime();
+    }
+    else
+    {
+        memcpy(entry->response, data, 3);
+    }
+
+    /* NOTE: decrypt validates `arg' against its own list of streams */
+    asc_list_for(entry->waiters)
+    {
+        const ecm_waiter_t *const w = (ecm_waiter_t *)asc_list_data(entry->waiters);
+        on_cam_response(w->decrypt->self, w->arg, entry->response);
+    }
+
+    if(!is_keys)
+    {
+        /* don't cache failures */
+        ecm_cache_remove(cam, entry);
+    }
+    else
+    {
+        asc_list_clear(entry->waiters)
+        {
+            free(asc_list_data(entry->waiters));
+        }
+    }
+}
+
+/*
+ * Called by CAM modules when a request to `packet' got no answer in time.
+ * Waiters of the cached ECM get a failure response and the entry is
+ * dropped, so that the next copy of this ECM is sent to the server again.
+ */
+void module_cam_timeout(module_cam_t *cam, const em_packet_t *packet)
+{
+    if(cam->ecm_cache_ttl == 0)
+        return;
+
+    ecm_entry_t *const entry = ecm_cache_find(cam, packet->buffer
+                                              , packet->buffer_size
+                                              , asc_utime());
+    if(entry == NULL || !entry->is_pending)
+        return;
+
+    /* table id with zero length: no keys */
+    uint8_t response[ECM_RESPONSE_SIZE] = { 0 };
+    response[0] = entry->ecm[0];
+
+    /* entry is off the list before waiters can resend the ECM */
+    asc_list_remove_item(cam->ecm_cache, entry);
+
+    asc_list_for(entry->waiters)
+    {
+        const ecm_waiter_t *const w = (ecm_waiter_t *)asc_list_data(entry->waiters);
+        on_cam_response(w->decrypt->self, w->arg, response);
+    }
+
+    ecm_entry_destroy(entry);
+}
+
+/* sender of a pending request is gone; ask again for the next waiter */
+static void ecm_entry_resend(module_cam_t *cam, ecm_entry_t *entry)
+{
+    asc_list_first(entry->waiters);
+    const ecm_waiter_t *const w = (ecm_waiter_t *)asc_list_data(entry->waiters);
+    cam->send_em(cam->self, w->decrypt, w->arg, entry->ecm, entry->size);
+}
+
+/*
+ * Called by CAM modules when `packet' is discarded without being answered,
+ * e.g. replaced in the queue by a newer ECM from the same stream. If the
+ * request was sent on behalf of this waiter, it's resent for the next one;
+ * the entry is dropped when nobody else is waiting for it.
+ */
+void module_cam_drop(module_cam_t *cam, const em_packet_t *packet)
+{
+    if(cam->ecm_cache_ttl == 0)
+        return;
+
+    ecm_entry_t *const entry = ecm_cache_find(cam, packet->buffer
+                                              , packet->buffer_size
+                                              , asc_utime());
+    if(entry == NULL || !entry->is_pending)
+        return;
+
+    asc_list_first(entry->waiters);
+    if(asc_list_eol(entry->waiters))
+        return;
+
+    ecm_waiter_t *const w = (ecm_waiter_t *)asc_list_data(entry->waiters);
+    if(w->decrypt != packet->decrypt || w->arg != packet->arg)
+        return; /* request in flight belongs to someone else */
+
+    free(w);
+    asc_list_remove_current(entry->waiters);
+
+    if(asc_list_count(entry->waiters) == 0)
+        ecm_cache_remove(cam, entry);
+    else
+        ecm_entry_resend(cam, entry);
+}
+
+/*
+ * Drop waiters belonging to a detached decrypt. If the request was sent
+ * on its behalf, the CAM will discard the response; resend it for the
+ * next waiter instead.
+ */
+static void ecm_cache_detach(module_cam_t *cam, module_decrypt_t *decrypt)
+{
+    asc_list_first(cam->ecm_cache);
+    while(!asc_list_eol(cam->ecm_cache))
+    {
+        ecm_entry_t *const entry = (ecm_entry_t *)asc_list_data(cam->ecm_cache);
+        bool is_sender = false;
+
+        asc_list_first(entry->waiters);
+        for(size_t i = 0; !asc_list_eol(entry->waiters); ++i)
+        {
+            ecm_waiter_t *const w = (ecm_waiter_t *)asc_list_data(entry->waiters);
+            if(w->decrypt == decrypt)
+            {
+                if(i == 0)
+                    is_sender = true;
+
+                free(w);
+                asc_list_remove_current(entry->waiters);
+            }
+            else
+                asc_list_next(entry->waiters);
+        }
+
+        if(entry->is_pending && is_sender)
+        {
+            if(asc_list_count(entry->waiters) == 0)
+            {
+                ecm_entry_destroy(entry);
+                asc_list_remove_current(cam->ecm_cache);
+                continue;
+            }
+
+            entry->is_orphan = true;
+        }
+
+        asc_list_next(cam->ecm_cache);
+    }
+
+    /*
+     * Resend after the walk: send_em() may drop older requests from the
+     * queue, which in turn changes the cache.
+     */
+    while(true)
+    {
+        ecm_entry_t *entry = NULL;
+        asc_list_for(cam->ecm_cache)
+        {
+            ecm_entry_t *const i = (ecm_entry_t *)asc_list_data(cam->ecm_cache);
+            if(i->is_orphan)
+            {
+                entry = i;
+                break;
+            }
+        }
+
+        if(entry == NULL)
+            break;
+
+        entry->is_orphan = false;
+        ecm_entry_resend(cam, entry);
+    }
+}
+
 void module_cam_ready(module_cam_t *cam)
 {
     cam->is_ready = true;
@@ -70,6 +437,7 @@ void module_cam_reset(module_cam_t *cam)
     asc_list_purge(cam->prov_list);
 
     module_cam_queue_flush(cam, NULL);
+    module_cam_cache_clear(cam);
 }
 
 void module_cam_attach_decrypt(module_cam_t *cam, module_decrypt_t *decrypt)
@@ -83,6 +451,7 @@ void module_cam_attach_decrypt(module_cam_t *cam, module_decrypt_t *decrypt)
 void module_cam_detach_decrypt(module_cam_t *cam, module_decrypt_t *decrypt)
 {
     module_cam_queue_flush(cam, decrypt);
+    ecm_cache_detach(cam, decrypt);
     asc_list_remove_item(cam->decrypt_list, decrypt);
     if(asc_list_count(cam->decrypt_list) == 0)
         cam->disconnect(cam->self);
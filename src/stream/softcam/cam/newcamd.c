@@ -30,6 +30,11 @@
 #define MAX_PROV_COUNT 16
 #define KEY_SIZE 14
 
+/* requests in flight, upper limit for the 'pipeline' option */
+#define NEWCAMD_PIPELINE_MAX 32
+/* resolution of per-request timeouts, ms */
+#define NEWCAMD_TIMER_INTERVAL 250
+
 #define MSG(_msg) "[newcamd %s] " _msg, mod->config.name
 
 #define CSA_KEY_SIZE 8
@@ -59,11 +64,13 @@ struct module_data_t
         uint8_t key[KEY_SIZE];
 
         bool disable_emm;
+        int pipeline;
     } config;
 
     int status;
     asc_socket_t *sock;
     asc_timer_t *timeout;
+    asc_timer_t *req_timer;
 
     uint8_t *prov_buffer;
 
@@ -74,13 +81,37 @@ struct module_data_t
         DES_key_schedule ks2;
     } triple_des;
 
-    uint16_t msg_id;        // curren message id
-    em_packet_t *packet;    // current packet
+    uint16_t msg_id;        // last message id
     csa_key_t last_key[2];  // NDS
 
+    /* requests sent to the server, oldest first */
+    struct
+    {
+        em_packet_t *packet;
+        uint16_t msg_id;
+        uint64_t time;
+    } inflight[NEWCAMD_PIPELINE_MAX];
+    size_t inflight_cnt;
+    uint64_t last_rx;
+
+    struct
+    {
+        uint64_t requests;
+        uint64_t responses;
+        uint64_t timeouts;
+        uint64_t total_time; // queued to answered
+        uint64_t max_time;
+        uint64_t rtt_time;   // sent to answered
+        size_t max_inflight;
+    } stats;
+
     uint8_t buffer[NEWCAMD_MSG_SIZE];
-    size_t payload_size;    // to send
-    size_t buffer_skip;     // to recv
+    size_t payload_size;    // to recv
+    size_t buffer_skip;
+
+    uint8_t tx_buffer[NEWCAMD_MSG_SIZE];
+    size_t tx_size;         // control message waiting to be sent
+    bool tx_pending;
 };
 
 typedef enum {
@@ -96,6 +127,7 @@ typedef enum {
 
 static void newcamd_connect(module_data_t *mod);
 static void newcamd_reconnect(module_data_t *mod, bool timeout);
+static void newcamd_pump(module_data_t *mod);
 
 /*
  * ooooooooooo ooooooooo  ooooooooooo      o
@@ -181,6 +213,59 @@ static void on_timeout(void *arg)
     newcamd_reconnect(mod, false);
 }
 
+static void on_request_timer(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+
+    const uint64_t now = asc_utime();
+    const uint64_t timeout = mod->config.timeout * 1000ULL;
+    bool is_stalled = false;
+
+    /* requests are kept in order they were sent */
+    size_t expired = 0;
+    while(expired < mod->inflight_cnt && now - mod->inflight[expired].time >= timeout)
+    {
+        const em_packet_t *packet = mod->inflight[expired].packet;
+        asc_log_warning(  MSG("response timeout (pnr:%d type:0x%02X msg:%d)")
+                        , packet->decrypt->cas_pnr, packet->buffer[0]
+                        , mod->inflight[expired].msg_id);
+
+        /* nothing received since this request was sent */
+        if(mod->last_rx < mod->inflight[expired].time)
+            is_stalled = true;
+
+        ++mod->stats.timeouts;
+        ++expired;
+    }
+
+    if(expired == 0)
+        return;
+
+    if(is_stalled)
+    {
+        asc_log_error(MSG("server is not responding"));
+        newcamd_reconnect(mod, false);
+        return;
+    }
+
+    em_packet_t *packets[NEWCAMD_PIPELINE_MAX];
+    for(size_t i = 0; i < expired; ++i)
+        packets[i] = mod->inflight[i].packet;
+
+    mod->inflight_cnt -= expired;
+    memmove(  &mod->inflight[0], &mod->inflight[expired]
+            , mod->inflight_cnt * sizeof(mod->inflight[0]));
+
+    /* waiters may resend right away; inflight list must be consistent */
+    for(size_t i = 0; i < expired; ++i)
+    {
+        module_cam_timeout(&mod->__cam, packets[i]);
+        free(packets[i]);
+    }
+
+    newcamd_pump(mod);
+}
+
 static void on_newcamd_close(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
@@ -192,6 +277,7 @@ static void on_newcamd_close(void *arg)
     mod->sock = NULL;
 
     ASC_FREE(mod->timeout, asc_timer_destroy);
+    ASC_FREE(mod->req_timer, asc_timer_destroy);
 
     module_cam_reset(&mod->__cam);
 
@@ -201,11 +287,10 @@ static void on_newcamd_close(void *arg)
         mod->prov_buffer = NULL;
     }
 
-    if(mod->packet)
-    {
-        free(mod->packet);
-        mod->packet = NULL;
-    }
+    for(size_t i = 0; i < mod->inflight_cnt; ++i)
+        free(mod->inflight[i].packet);
+    mod->inflight_cnt = 0;
+    mod->tx_pending = false;
 
     if(mod->status == 0)
         asc_log_error(MSG("connection failed"));
@@ -230,46 +315,30 @@ static void on_newcamd_close(void *arg)
  *
  */
 
-static void on_newcamd_ready(void *arg)
+/* encrypt and send the message prepared in tx_buffer */
+static bool newcamd_send(module_data_t *mod, size_t payload_size)
 {
-    module_data_t *mod = (module_data_t *)arg;
+    uint8_t *const msg = mod->tx_buffer;
+    uint8_t *const buffer = &msg[NEWCAMD_HEADER_SIZE];
 
-    memset(mod->buffer, 0, NEWCAMD_HEADER_SIZE);
-
-    uint8_t *buffer = &mod->buffer[NEWCAMD_HEADER_SIZE];
-
-    if(mod->packet)
-    {
-        memcpy(buffer, mod->packet->buffer, mod->packet->buffer_size);
-        mod->payload_size = mod->packet->buffer_size - 3;
+    buffer[1] = (payload_size >> 8) & 0x0F;
+    buffer[2] = (payload_size     ) & 0xFF;
 
-        mod->msg_id = (mod->msg_id + 1) & 0xFFFF;
-        mod->buffer[2] = mod->msg_id >> 8;
-        mod->buffer[3] = mod->msg_id & 0xff;
-
-        const uint16_t pnr = mod->packet->decrypt->cas_pnr;
-        mod->buffer[4] = pnr >> 8;
-        mod->buffer[5] = pnr & 0xff;
-    }
-
-    buffer[1] = (mod->payload_size >> 8) & 0x0F;
-    buffer[2] = (mod->payload_size     ) & 0xFF;
-
-    size_t packet_size = NEWCAMD_HEADER_SIZE + 3 + mod->payload_size;
+    size_t packet_size = NEWCAMD_HEADER_SIZE + 3 + payload_size;
     const uint8_t no_pad_bytes = (8 - ((packet_size - 1) % 8)) % 8;
 
     if((packet_size + no_pad_bytes + 1) >= (NEWCAMD_MSG_SIZE - 8))
     {
         asc_log_error(MSG("failed to pad message"));
         newcamd_reconnect(mod, true);
-        return;
+        return false;
     }
 
     DES_cblock pad_bytes;
     DES_random_key((DES_cblock *)pad_bytes);
-    memcpy(&mod->buffer[packet_size], pad_bytes, no_pad_bytes);
+    memcpy(&msg[packet_size], pad_bytes, no_pad_bytes);
     packet_size += no_pad_bytes;
-    mod->buffer[packet_size] = xor_sum(&mod->buffer[2], packet_size - 2);
+    msg[packet_size] = xor_sum(&msg[2], packet_size - 2);
     ++packet_size;
 
     // encrypt
@@ -279,31 +348,134 @@ static void on_newcamd_ready(void *arg)
     {
         asc_log_error(MSG("failed to encrypt message"));
         newcamd_reconnect(mod, true);
-        return;
+        return false;
     }
-    memcpy(&mod->buffer[packet_size], ivec, sizeof(ivec));
-    DES_ede2_cbc_encrypt(  &mod->buffer[2], &mod->buffer[2], packet_size - 2
+    memcpy(&msg[packet_size], ivec, sizeof(ivec));
+    DES_ede2_cbc_encrypt(  &msg[2], &msg[2], packet_size - 2
                          , &mod->triple_des.ks1, &mod->triple_des.ks2
                          , (DES_cblock *)ivec, DES_ENCRYPT);
     packet_size += sizeof(ivec);
 
-    mod->buffer[0] = ((packet_size - 2) >> 8) & 0xFF;
-    mod->buffer[1] = ((packet_size - 2)     ) & 0xFF;
+    msg[0] = ((packet_size - 2) >> 8) & 0xFF;
+    msg[1] = ((packet_size - 2)     ) & 0xFF;
 
-    if(asc_socket_send(mod->sock, mod->buffer, packet_size) != (ssize_t)packet_size)
+    if(asc_socket_send(mod->sock, msg, packet_size) != (ssize_t)packet_size)
     {
         asc_log_error(MSG("failed to send message"));
         newcamd_reconnect(mod, true);
-        return;
+        return false;
+    }
+
+    return true;
+}
+
+static bool newcamd_send_packet(module_data_t *mod, em_packet_t *packet)
+{
+    uint8_t *const msg = mod->tx_buffer;
+
+    memset(msg, 0, NEWCAMD_HEADER_SIZE);
+    memcpy(&msg[NEWCAMD_HEADER_SIZE], packet->buffer, packet->buffer_size);
+
+    mod->msg_id = (mod->msg_id + 1) & 0xFFFF;
+    msg[2] = mod->msg_id >> 8;
+    msg[3] = mod->msg_id & 0xff;
+
+    const uint16_t pnr = packet->decrypt->cas_pnr;
+    msg[4] = pnr >> 8;
+    msg[5] = pnr & 0xff;
+
+    if(!newcamd_send(mod, packet->buffer_size - 3))
+    {
+        free(packet);
+        return false;
+    }
+
+    const size_t i = mod->inflight_cnt++;
+    mod->inflight[i].packet = packet;
+    mod->inflight[i].msg_id = mod->msg_id;
+    mod->inflight[i].time = asc_utime();
+
+    ++mod->stats.requests;
+    if(mod->inflight_cnt > mod->stats.max_inflight)
+        mod->stats.max_inflight = mod->inflight_cnt;
+
+    return true;
+}
+
+static void on_newcamd_ready(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+
+    if(mod->tx_pending)
+    {
+        mod->tx_pending = false;
+
+        memset(mod->tx_buffer, 0, NEWCAMD_HEADER_SIZE);
+        if(!newcamd_send(mod, mod->tx_size))
+            return;
+
+        if(mod->status != 3 && !mod->timeout)
+            mod->timeout = asc_timer_init(mod->config.timeout, on_timeout, mod);
+    }
+
+    /* keep up to 'pipeline' requests in flight */
+    while(mod->status == 3 && mod->inflight_cnt < (size_t)mod->config.pipeline)
+    {
+        em_packet_t *const packet = module_cam_queue_pop(&mod->__cam);
+        if(!packet)
+            break;
+
+        if(!newcamd_send_packet(mod, packet))
+            return;
     }
 
     asc_socket_set_on_ready(mod->sock, NULL);
+}
 
-    mod->buffer_skip = 0;
-    mod->payload_size = 0;
+static void newcamd_pump(module_data_t *mod)
+{
+    const bool has_slot = (mod->inflight_cnt < (size_t)mod->config.pipeline);
 
-    if(!mod->timeout)
-        mod->timeout = asc_timer_init(mod->config.timeout, on_timeout, mod);
+    if(   mod->tx_pending
+       || (has_slot && asc_list_count(mod->__cam.packet_queue) > 0))
+    {
+        asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
+    }
+}
+
+static em_packet_t *newcamd_inflight_take(module_data_t *mod, uint16_t msg_id)
+{
+    size_t i = 0;
+    for(; i < mod->inflight_cnt; ++i)
+    {
+        if(mod->inflight[i].msg_id == msg_id)
+            break;
+    }
+
+    if(i == mod->inflight_cnt)
+    {
+        /* some servers don't echo message id; fine without pipelining */
+        if(mod->config.pipeline == 1 && mod->inflight_cnt == 1)
+            i = 0;
+        else
+            return NULL;
+    }
+
+    em_packet_t *const packet = mod->inflight[i].packet;
+
+    const uint64_t now = asc_utime();
+    const uint64_t elapsed = now - packet->time;
+    ++mod->stats.responses;
+    mod->stats.rtt_time += now - mod->inflight[i].time;
+    mod->stats.total_time += elapsed;
+    if(elapsed > mod->stats.max_time)
+        mod->stats.max_time = elapsed;
+
+    --mod->inflight_cnt;
+    memmove(  &mod->inflight[i], &mod->inflight[i + 1]
+            , (mod->inflight_cnt - i) * sizeof(mod->inflight[0]));
+
+    return packet;
 }
 
 /*
@@ -381,6 +553,8 @@ static void on_newcamd_read_packet(void *arg)
         return;
     }
 
+    mod->last_rx = asc_utime();
+
     const uint8_t msg_type = mod->buffer[NEWCAMD_HEADER_SIZE];
 
     uint8_t *buffer = &mod->buffer[NEWCAMD_HEADER_SIZE];
@@ -388,40 +562,49 @@ static void on_newcamd_read_packet(void *arg)
 
     if(mod->status == 3)
     {
-        if(!mod->packet && msg_type == NEWCAMD_MSG_KEEPALIVE)
+        if(msg_type == NEWCAMD_MSG_KEEPALIVE)
         {
-            buffer[0] = NEWCAMD_MSG_KEEPALIVE;
-            buffer[1] = 0;
-            buffer[2] = 0;
-            mod->payload_size = 0;
+            uint8_t *const reply = &mod->tx_buffer[NEWCAMD_HEADER_SIZE];
+            reply[0] = NEWCAMD_MSG_KEEPALIVE;
+            mod->tx_size = 0;
+            mod->tx_pending = true;
 
-            asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
+            newcamd_pump(mod);
             return;
         }
 
-        if(!mod->packet || msg_type < 0x80 || msg_type > 0x8F)
+        if(msg_type < 0x80 || msg_type > 0x8F)
         {
             asc_log_warning(MSG("unknown packet type [0x%02X]"), msg_type);
             return;
         }
 
-        ASC_FREE(mod->timeout, asc_timer_destroy);
+        const uint16_t msg_id = (mod->buffer[2] << 8) | mod->buffer[3];
+        em_packet_t *const packet = newcamd_inflight_take(mod, msg_id);
+        if(!packet)
+        {
+            /* response to a request that has already timed out */
+            asc_log_warning(  MSG("unexpected response (type:0x%02X msg:%d)")
+                            , msg_type, msg_id);
+            return;
+        }
 
         asc_list_for(mod->__cam.decrypt_list)
         {
-            if(asc_list_data(mod->__cam.decrypt_list) == mod->packet->decrypt)
+            if(asc_list_data(mod->__cam.decrypt_list) == packet->decrypt)
                 break;
         }
         if(asc_list_eol(mod->__cam.decrypt_list))
         {
             /* the decrypt module was detached */
-            free(mod->packet);
-            mod->packet = module_cam_queue_pop(&mod->__cam);
-            if(mod->packet)
-                asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
+            module_cam_drop(&mod->__cam, packet);
+            free(packet);
+            newcamd_pump(mod);
             return;
         }
 
+        uint8_t response[ECM_HEADER_SIZE + ECM_PAYLOAD_SIZE] = { 0 };
+
         if(mod->payload_size == ECM_PAYLOAD_SIZE)
         {
             // NDS
@@ -439,27 +622,23 @@ static void on_newcamd_read_packet(void *arg)
                 mod->last_key[0].l = key_0.l;
             }
 
-            memcpy(mod->packet->buffer, buffer, ECM_HEADER_SIZE + ECM_PAYLOAD_SIZE);
-            mod->packet->buffer_size = ECM_HEADER_SIZE + ECM_PAYLOAD_SIZE;
+            memcpy(response, buffer, ECM_HEADER_SIZE + ECM_PAYLOAD_SIZE);
         }
         else if(mod->payload_size == 0)
         {
-            memcpy(mod->packet->buffer, buffer, ECM_HEADER_SIZE);
-            mod->packet->buffer_size = ECM_HEADER_SIZE;
+            memcpy(response, buffer, ECM_HEADER_SIZE);
         }
         else
         {
-            mod->packet->buffer[2] = 0x00;
-            mod->packet->buffer[3] = 0x00;
-            mod->packet->buffer_size = ECM_HEADER_SIZE;
+            response[0] = packet->buffer[0];
+            response[1] = packet->buffer[1];
         }
 
-        on_cam_response(mod->packet->decrypt->self, mod->packet->arg, mod->packet->buffer);
-        free(mod->packet);
+        /* packet still holds the original ECM for cache lookup */
+        module_cam_response(&mod->__cam, packet, response);
+        free(packet);
 
-        mod->packet = module_cam_queue_pop(&mod->__cam);
-        if(mod->packet)
-            asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
+        newcamd_pump(mod);
     }
     else if(mod->status == 1)
     {
@@ -475,10 +654,10 @@ static void on_newcamd_read_packet(void *arg)
         const size_t p_len = 35; /* strlen(mod->config.pass) */
         triple_des_set_key(mod, (uint8_t *)mod->config.pass, p_len - 1);
 
-        buffer[0] = NEWCAMD_MSG_CARD_DATA_REQ;
-        buffer[1] = 0;
-        buffer[2] = 0;
-        mod->payload_size = 0;
+        uint8_t *const request = &mod->tx_buffer[NEWCAMD_HEADER_SIZE];
+        request[0] = NEWCAMD_MSG_CARD_DATA_REQ;
+        mod->tx_size = 0;
+        mod->tx_pending = true;
 
         asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
     }
@@ -522,6 +701,7 @@ static void on_newcamd_read_packet(void *arg)
         }
 
         ASC_FREE(mod->timeout, asc_timer_destroy);
+        mod->req_timer = asc_timer_init(NEWCAMD_TIMER_INTERVAL, on_request_timer, mod);
 
         module_cam_ready(&mod->__cam);
     }
@@ -546,7 +726,7 @@ static void on_newcamd_read_init(void *arg)
 
     triple_des_set_key(mod, mod->buffer, KEY_SIZE);
 
-    uint8_t *buffer = &mod->buffer[NEWCAMD_HEADER_SIZE];
+    uint8_t *buffer = &mod->tx_buffer[NEWCAMD_HEADER_SIZE];
 
     buffer[0] = NEWCAMD_MSG_CLIENT_2_SERVER_LOGIN;
     const size_t u_len = strlen(mod->config.user) + 1;
@@ -554,7 +734,9 @@ static void on_newcamd_read_init(void *arg)
     const size_t p_len = 35; /* strlen(mod->config.pass) */
     memcpy(&buffer[3 + u_len], mod->config.pass, p_len);
 
-    mod->payload_size = u_len + p_len;
+    mod->tx_size = u_len + p_len;
+    mod->tx_pending = true;
+    mod->buffer_skip = 0;
 
     asc_socket_set_on_read(mod->sock, on_newcamd_read_packet);
     asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
@@ -638,7 +820,9 @@ static void newcamd_send_em(  module_data_t *mod
     packet->buffer_size = size;
     packet->decrypt = decrypt;
     packet->arg = arg;
+    packet->time = asc_utime();
 
+    em_packet_t *old_packet = NULL;
     if(packet->buffer[0] == 0x80 || packet->buffer[0] == 0x81)
     {
         asc_list_for(mod->__cam.packet_queue)
@@ -651,21 +835,22 @@ static void newcamd_send_em(  module_data_t *mod
                 asc_log_warning(  MSG("drop old packet (pnr:%d drop:0x%02X set:0x%02X)")
                                 , decrypt->pnr, queue_item->buffer[0], packet->buffer[0]);
                 asc_list_remove_current(mod->__cam.packet_queue);
-                free(queue_item);
+                old_packet = queue_item;
                 break;
             }
         }
     }
 
-    if(mod->packet)
+    asc_list_insert_tail(mod->__cam.packet_queue, packet);
+
+    if(old_packet != NULL)
     {
-        // newcamd is busy
-        asc_list_insert_tail(mod->__cam.packet_queue, packet);
-        return;
+        /* other decrypts may be waiting for the dropped ECM */
+        module_cam_drop(&mod->__cam, old_packet);
+        free(old_packet);
     }
 
-    mod->packet = packet;
-    asc_socket_set_on_ready(mod->sock, on_newcamd_ready);
+    newcamd_pump(mod);
 }
 
 static void module_init(lua_State *L, module_data_t *mod)
@@ -701,12 +886,24 @@ static void module_init(lua_State *L, module_data_t *mod)
 
     module_option_boolean(L, "disable_emm", &mod->config.disable_emm);
 
+    int ecm_cache = ECM_CACHE_TTL / 1000;
+    module_option_integer(L, "ecm_cache", &ecm_cache);
+    if(ecm_cache < 0)
+        luaL_error(L, MSG("option 'ecm_cache' must not be negative"));
+
+    mod->config.pipeline = 1;
+    module_option_integer(L, "pipeline", &mod->config.pipeline);
+    if(mod->config.pipeline < 1 || mod->config.pipeline > NEWCAMD_PIPELINE_MAX)
+        luaL_error(L, MSG("option 'pipeline' must be between 1 and %d")
+                   , NEWCAMD_PIPELINE_MAX);
+
     module_option_integer(L, "timeout", &mod->config.timeout);
     if(!mod->config.timeout)
         mod->config.timeout = 8;
     mod->config.timeout *= 1000;
 
     module_cam_init(mod, newcamd_connect, newcamd_disconnect, newcamd_send_em);
+    mod->__cam.ecm_cache_ttl = ecm_cache * 1000;
 }
 
 static void module_destroy(module_data_t *mod)
@@ -719,9 +916,43 @@ static void module_destroy(module_data_t *mod)
 
 MODULE_CAM_METHODS()
 
+static int method_stats(lua_State *L, module_data_t *mod)
+{
+    lua_newtable(L);
+
+    lua_pushnumber(L, mod->stats.requests);
+    lua_setfield(L, -2, "requests");
+    lua_pushnumber(L, mod->stats.responses);
+    lua_setfield(L, -2, "responses");
+    lua_pushnumber(L, mod->stats.timeouts);
+    lua_setfield(L, -2, "timeouts");
+    lua_pushinteger(L, mod->inflight_cnt);
+    lua_setfield(L, -2, "inflight");
+    lua_pushinteger(L, mod->stats.max_inflight);
+    lua_setfield(L, -2, "max_inflight");
+
+    /* response time including queueing, and server round trip; ms */
+    double avg = 0.0, rtt = 0.0;
+    if(mod->stats.responses > 0)
+    {
+        avg = (double)mod->stats.total_time / mod->stats.responses / 1000.0;
+        rtt = (double)mod->stats.rtt_time / mod->stats.responses / 1000.0;
+    }
+
+    lua_pushnumber(L, avg);
+    lua_setfield(L, -2, "avg");
+    lua_pushnumber(L, rtt);
+    lua_setfield(L, -2, "rtt");
+    lua_pushnumber(L, mod->stats.max_time / 1000.0);
+    lua_setfield(L, -2, "max");
+
+    return 1;
+}
+
 static const module_method_t module_methods[] =
 {
     MODULE_CAM_METHODS_REF(),
+    { "stats", method_stats },
     { NULL, NULL },
 };
 
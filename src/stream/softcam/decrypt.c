@@ -32,10 +32,47 @@
  *      cam         - object, cam instance returned by cam_module_instance:cam()
  *      cas_data    - string, additional paramters for CAS
  *      cas_pnr     - number, original PNR
+ *      latency     - number, maximum time in ms a packet is held for
+ *                    batching before partial batches are flushed
+ *                    (default: 100, 0 to disable the deadline and
+ *                    latency statistics)
+ *
+ * Module Methods:
+ *      latency()   - return table with packet latency statistics:
+ *                    bounds (histogram bucket upper bounds in ms),
+ *                    histogram (packet counts, one more than bounds),
+ *                    avg and max (ms) and flushes (deadline flushes)
+ *
+ * When the worker pool is enabled (see astra.workers()), filled CSA
+ * batches are descrambled on a pool thread instead of the main loop.
+ * Each decrypt instance is bound to one worker, so its batches complete
+ * in the order they were queued; instances are spread across workers.
  */
 
 #include "module_cam.h"
-#include <dvbcsa/dvbcsa.h>
+#include <astra/core/worker.h>
+#include <astra/core/timer.h>
+#include <astra/core/mutex.h>
+#include <astra/core/cond.h>
+#include <astra/utils/csa.h>
+
+/* storage size, in batches; larger when descrambling off-thread */
+#define STORAGE_BATCHES 4
+#define STORAGE_BATCHES_ASYNC 8
+
+/* maximum number of batch sets queued to a worker */
+#define DSC_JOBS 8
+
+/* default batching deadline, ms */
+#define LATENCY_DEFAULT 100
+
+/* latency histogram bucket upper bounds, ms */
+static const unsigned int latency_bounds[] =
+{
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000,
+};
+
+#define LATENCY_BUCKETS (ASC_ARRAY_SIZE(latency_bounds) + 1)
 
 typedef struct
 {
@@ -45,9 +82,9 @@ typedef struct
     bool is_keys;
     unsigned int parity;
 
-    struct dvbcsa_bs_key_s *even_key;
-    struct dvbcsa_bs_key_s *odd_key;
-    struct dvbcsa_bs_batch_s *batch;
+    csa_key_t *even_key;
+    csa_key_t *odd_key;
+    csa_batch_t *batch;
 
     size_t batch_skip;
 
@@ -64,6 +101,34 @@ typedef struct
     ca_stream_t *ca_stream;
 } el_stream_t;
 
+/* one ca_stream's share of a worker job */
+typedef struct
+{
+    ca_stream_t *ca_stream;
+    unsigned int parity;
+
+    csa_batch_t *batch;
+    size_t batch_skip;
+
+    int new_key_id;
+    uint8_t new_key[16];
+} dsc_slice_t;
+
+typedef struct
+{
+    module_data_t *mod;
+
+    dsc_slice_t *slices;
+    size_t slice_cnt;
+    size_t slice_max;
+
+    /* storage bytes released to output once this job completes */
+    size_t bytes;
+
+    /* set by worker */
+    int done;
+} dsc_job_t;
+
 struct module_data_t
 {
     STREAM_MODULE_DATA();
@@ -75,10 +140,11 @@ struct module_data_t
     bool disable_emm;
     int ecm_pid;
 
-    /* dvbcsa */
+    /* CSA */
     asc_list_t *el_list;
     asc_list_t *ca_list;
 
+    const csa_engine_t *csa;
     size_t batch_size;
 
     struct
@@ -89,6 +155,9 @@ struct module_data_t
         size_t dsc_count;
         size_t read;
         size_t write;
+
+        /* arrival time of each packet */
+        uint64_t *stamp;
     } storage;
 
     struct
@@ -100,6 +169,29 @@ struct module_data_t
         size_t write;
     } shift;
 
+    /* off-thread descrambling */
+    asc_worker_t *worker;
+    asc_mutex_t dsc_mutex;
+    asc_cond_t dsc_cond;
+
+    dsc_job_t jobs[DSC_JOBS];
+    size_t job_head;
+    size_t job_cnt;
+    size_t queued;
+
+    /* batching deadline */
+    uint64_t latency;
+    asc_timer_t *deadline;
+
+    struct
+    {
+        uint64_t histogram[LATENCY_BUCKETS];
+        uint64_t total;
+        uint64_t count;
+        uint64_t max;
+        uint64_t flushes;
+    } stats;
+
     /* Base */
     ts_psi_t *stream[TS_MAX_PIDS];
     ts_psi_t *pmt;
@@ -126,10 +218,10 @@ static ca_stream_t * ca_stream_init(module_data_t *mod, uint16_t ecm_pid)
     ca_stream = ASC_ALLOC(1, ca_stream_t);
 
     ca_stream->ecm_pid = ecm_pid;
+    ca_stream->even_key = au_csa_key_init();
+    ca_stream->odd_key = au_csa_key_init();
 
-    ca_stream->even_key = dvbcsa_bs_key_alloc();
-    ca_stream->odd_key = dvbcsa_bs_key_alloc();
-    ca_stream->batch = ASC_ALLOC(mod->batch_size + 1, struct dvbcsa_bs_batch_s);
+    ca_stream->batch = ASC_ALLOC(mod->batch_size + 1, csa_batch_t);
 
     asc_list_insert_tail(mod->ca_list, ca_stream);
 
@@ -138,19 +230,20 @@ static ca_stream_t * ca_stream_init(module_data_t *mod, uint16_t ecm_pid)
 
 static void ca_stream_destroy(ca_stream_t *ca_stream)
 {
-    dvbcsa_bs_key_free(ca_stream->even_key);
-    dvbcsa_bs_key_free(ca_stream->odd_key);
     free(ca_stream->batch);
 
+    au_csa_key_destroy(ca_stream->even_key);
+    au_csa_key_destroy(ca_stream->odd_key);
+
     free(ca_stream);
 }
 
 static void ca_stream_set_keys(ca_stream_t *ca_stream, const uint8_t *even, const uint8_t *odd)
 {
     if(even)
-        dvbcsa_bs_key_set(even, ca_stream->even_key);
+        au_csa_key_set(ca_stream->even_key, even);
     if(odd)
-        dvbcsa_bs_key_set(odd, ca_stream->odd_key);
+        au_csa_key_set(ca_stream->odd_key, odd);
 }
 
 static void module_decrypt_cas_init(module_data_t *mod)
@@ -164,8 +257,12 @@ static void module_decrypt_cas_init(module_data_t *mod)
     ASC_ASSERT(mod->__decrypt.cas != NULL, MSG("CAS with CAID:0x%04X not found"), mod->caid);
 }
 
+static void dsc_flush(module_data_t *mod);
+
 static void module_decrypt_cas_destroy(module_data_t *mod)
 {
+    dsc_flush(mod);
+
     if(mod->__decrypt.cas)
     {
         free(mod->__decrypt.cas->self);
@@ -616,9 +713,9 @@ static void on_em(void *arg, ts_psi_t *psi)
         return;
     }
 
-    mod->__decrypt.cam->send_em(  mod->__decrypt.cam->self
-                                , &mod->__decrypt, ca_stream
-                                , psi->buffer, psi->buffer_size);
+    module_cam_send_em(  mod->__decrypt.cam
+                       , &mod->__decrypt, ca_stream
+                       , psi->buffer, psi->buffer_size);
 }
 
 /*
@@ -630,49 +727,298 @@ static void on_em(void *arg, ts_psi_t *psi)
  *
  */
 
-static void decrypt(module_data_t *mod)
+static void ca_stream_decrypt(const csa_engine_t *csa, ca_stream_t *ca_stream
+                              , unsigned int parity, csa_batch_t *batch
+                              , size_t batch_skip)
+{
+    if(batch_skip == 0)
+        return;
+
+    batch[batch_skip].data = NULL;
+
+    if(parity == TS_SC_EVEN)
+        csa->decrypt(ca_stream->even_key, batch, TS_BODY_SIZE);
+    else if(parity == TS_SC_ODD)
+        csa->decrypt(ca_stream->odd_key, batch, TS_BODY_SIZE);
+}
+
+static void ca_stream_update_keys(ca_stream_t *ca_stream, int new_key_id
+                                  , const uint8_t *new_key)
+{
+    switch(new_key_id)
+    {
+        case 0:
+            break;
+        case 1:
+            ca_stream_set_keys(ca_stream, &new_key[0], NULL);
+            break;
+        case 2:
+            ca_stream_set_keys(ca_stream, NULL, &new_key[8]);
+            break;
+        case 3:
+            ca_stream_set_keys(ca_stream, &new_key[0], &new_key[8]);
+            break;
+    }
+}
+
+/*
+ * Worker jobs. Batches are handed over by swapping batch arrays with
+ * the job's slices, key updates are carried along so that the worker
+ * applies them after the batch that was filled with the old key. Jobs
+ * are retired strictly in queue order; their storage bytes become
+ * available for output only after every job before them is done.
+ */
+
+/* runs on a worker thread */
+static void on_dsc_job(void *arg)
+{
+    dsc_job_t *const job = (dsc_job_t *)arg;
+    module_data_t *const mod = job->mod;
+
+    for(size_t i = 0; i < job->slice_cnt; ++i)
+    {
+        dsc_slice_t *const slice = &job->slices[i];
+
+        ca_stream_decrypt(mod->csa, slice->ca_stream, slice->parity
+                          , slice->batch, slice->batch_skip);
+        ca_stream_update_keys(slice->ca_stream, slice->new_key_id
+                              , slice->new_key);
+    }
+
+    asc_mutex_lock(&mod->dsc_mutex);
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    asc_cond_signal(&mod->dsc_cond);
+    asc_mutex_unlock(&mod->dsc_mutex);
+}
+
+/* release storage covered by completed jobs */
+static void dsc_retire(module_data_t *mod)
+{
+    while(mod->job_cnt > 0)
+    {
+        dsc_job_t *const job = &mod->jobs[mod->job_head];
+        if(!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE))
+            break;
+
+        mod->storage.dsc_count += job->bytes;
+        mod->queued -= job->bytes;
+
+        mod->job_head = (mod->job_head + 1) % DSC_JOBS;
+        --mod->job_cnt;
+    }
+}
+
+/* block until the oldest job is done */
+static void dsc_wait(module_data_t *mod)
+{
+    if(mod->job_cnt == 0)
+        return;
+
+    dsc_job_t *const job = &mod->jobs[mod->job_head];
+
+    asc_mutex_lock(&mod->dsc_mutex);
+    while(!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE))
+        asc_cond_wait(&mod->dsc_cond, &mod->dsc_mutex);
+    asc_mutex_unlock(&mod->dsc_mutex);
+
+    dsc_retire(mod);
+}
+
+/*
+ * drop queued jobs, waiting for one that is already running. Bytes they
+ * covered are not marked as descrambled; with `queued' reset, the next
+ * job covers them again unless the caller resets the storage.
+ */
+static void dsc_flush(module_data_t *mod)
 {
+    if(mod->worker == NULL)
+        return;
+
+    asc_worker_prune(mod->worker, mod);
+
+    mod->job_head = 0;
+    mod->job_cnt = 0;
+    mod->queued = 0;
+}
+
+static dsc_slice_t *dsc_slice_get(module_data_t *mod, dsc_job_t *job)
+{
+    if(job->slice_cnt == job->slice_max)
+    {
+        const size_t max = job->slice_max + 4;
+
+        job->slices = (dsc_slice_t *)realloc(job->slices, max * sizeof(dsc_slice_t));
+        ASC_ASSERT(job->slices != NULL, MSG("realloc() failed"));
+
+        for(size_t i = job->slice_max; i < max; ++i)
+        {
+            job->slices[i].batch = ASC_ALLOC(mod->batch_size + 1
+                                             , csa_batch_t);
+        }
+
+        job->slice_max = max;
+    }
+
+    return &job->slices[job->slice_cnt++];
+}
+
+static void dsc_queue(module_data_t *mod)
+{
+    const size_t bytes = mod->storage.count - mod->storage.dsc_count
+                         - mod->queued;
+
+    if(mod->job_cnt == DSC_JOBS)
+        dsc_wait(mod);
+
+    dsc_job_t *const job = &mod->jobs[(mod->job_head + mod->job_cnt) % DSC_JOBS];
+    job->mod = mod;
+    job->slice_cnt = 0;
+
     asc_list_for(mod->ca_list)
     {
         ca_stream_t *ca_stream = (ca_stream_t *)asc_list_data(mod->ca_list);
 
-        if(ca_stream->batch_skip > 0)
-        {
-            ca_stream->batch[ca_stream->batch_skip].data = NULL;
+        if(ca_stream->batch_skip == 0 && ca_stream->new_key_id == 0)
+            continue;
 
-            if(ca_stream->parity == TS_SC_EVEN)
-                dvbcsa_bs_decrypt(ca_stream->even_key, ca_stream->batch, TS_BODY_SIZE);
-            else if(ca_stream->parity == TS_SC_ODD)
-                dvbcsa_bs_decrypt(ca_stream->odd_key, ca_stream->batch, TS_BODY_SIZE);
+        dsc_slice_t *const slice = dsc_slice_get(mod, job);
+        slice->ca_stream = ca_stream;
+        slice->parity = ca_stream->parity;
 
-            ca_stream->batch_skip = 0;
-        }
+        csa_batch_t *const batch = slice->batch;
+        slice->batch = ca_stream->batch;
+        slice->batch_skip = ca_stream->batch_skip;
+        ca_stream->batch = batch;
+        ca_stream->batch_skip = 0;
 
-        // check new key
-        switch(ca_stream->new_key_id)
+        slice->new_key_id = ca_stream->new_key_id;
+        memcpy(slice->new_key, ca_stream->new_key, sizeof(slice->new_key));
+        ca_stream->new_key_id = 0;
+    }
+
+    if(job->slice_cnt == 0)
+    {
+        /* nothing to descramble; release after preceding jobs */
+        if(mod->job_cnt > 0)
         {
-            case 0:
-                break;
-            case 1:
-                ca_stream_set_keys(ca_stream, &ca_stream->new_key[0], NULL);
-                ca_stream->new_key_id = 0;
-                break;
-            case 2:
-                ca_stream_set_keys(ca_stream, NULL, &ca_stream->new_key[8]);
-                ca_stream->new_key_id = 0;
-                break;
-            case 3:
-                ca_stream_set_keys(  ca_stream
-                                   , &ca_stream->new_key[0]
-                                   , &ca_stream->new_key[8]);
-                ca_stream->new_key_id = 0;
-                break;
+            const size_t tail = (mod->job_head + mod->job_cnt - 1) % DSC_JOBS;
+            mod->jobs[tail].bytes += bytes;
+            mod->queued += bytes;
+        }
+        else
+        {
+            mod->storage.dsc_count += bytes;
         }
+
+        return;
+    }
+
+    job->bytes = bytes;
+    job->done = 0;
+    mod->queued += bytes;
+    ++mod->job_cnt;
+
+    if(!asc_worker_queue(mod->worker, mod, on_dsc_job, job))
+    {
+        /* worker is overloaded; finish preceding jobs and run it here */
+        while(mod->job_cnt > 1)
+            dsc_wait(mod);
+
+        on_dsc_job(job);
+        dsc_retire(mod);
+    }
+}
+
+static void decrypt(module_data_t *mod)
+{
+    if(mod->worker != NULL)
+    {
+        dsc_queue(mod);
+        return;
+    }
+
+    asc_list_for(mod->ca_list)
+    {
+        ca_stream_t *ca_stream = (ca_stream_t *)asc_list_data(mod->ca_list);
+
+        ca_stream_decrypt(mod->csa, ca_stream, ca_stream->parity
+                          , ca_stream->batch, ca_stream->batch_skip);
+        ca_stream->batch_skip = 0;
+
+        // check new key
+        ca_stream_update_keys(ca_stream, ca_stream->new_key_id
+                              , ca_stream->new_key);
+        ca_stream->new_key_id = 0;
     }
 
     mod->storage.dsc_count = mod->storage.count;
 }
 
+/* account for the time a packet spent in storage */
+static void storage_stats(module_data_t *mod, uint64_t now)
+{
+    const uint64_t stamp = mod->storage.stamp[mod->storage.read / TS_PACKET_SIZE];
+    const uint64_t latency = (now > stamp) ? (now - stamp) : 0;
+
+    size_t bucket = 0;
+    while(bucket < ASC_ARRAY_SIZE(latency_bounds)
+          && latency >= latency_bounds[bucket] * 1000ULL)
+    {
+        ++bucket;
+    }
+
+    ++mod->stats.histogram[bucket];
+    mod->stats.total += latency;
+    ++mod->stats.count;
+    if(latency > mod->stats.max)
+        mod->stats.max = latency;
+}
+
+/* send oldest descrambled packet; now is only used with a deadline set */
+static void storage_send(module_data_t *mod, uint64_t now)
+{
+    if(mod->latency > 0)
+        storage_stats(mod, now);
+
+    module_stream_send(mod, &mod->storage.buffer[mod->storage.read]);
+    mod->storage.read += TS_PACKET_SIZE;
+    if(mod->storage.read == mod->storage.size)
+        mod->storage.read = 0;
+    mod->storage.dsc_count -= TS_PACKET_SIZE;
+    mod->storage.count -= TS_PACKET_SIZE;
+}
+
+/*
+ * Low bitrate services may take a long time to fill a batch. Once the
+ * oldest packet in storage is past the deadline, descramble whatever
+ * partial batches there are and send out everything that's ready.
+ */
+static void on_deadline(void *arg)
+{
+    module_data_t *const mod = (module_data_t *)arg;
+
+    if(mod->job_cnt > 0)
+        dsc_retire(mod);
+
+    if(mod->storage.count == 0)
+        return;
+
+    const uint64_t now = asc_utime();
+    const uint64_t stamp = mod->storage.stamp[mod->storage.read / TS_PACKET_SIZE];
+
+    if(now - stamp < mod->latency)
+        return;
+
+    if(mod->storage.count > mod->storage.dsc_count + mod->queued)
+    {
+        decrypt(mod);
+        ++mod->stats.flushes;
+    }
+
+    while(mod->storage.dsc_count > 0)
+        storage_send(mod, now);
+}
+
 static void on_ts(module_data_t *mod, const uint8_t *ts)
 {
     const uint16_t pid = TS_GET_PID(ts);
@@ -732,6 +1078,14 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         mod->shift.count -= TS_PACKET_SIZE;
     }
 
+    /* skip the clock read unless there's a deadline to keep */
+    uint64_t now = 0;
+    if(mod->latency > 0)
+    {
+        now = asc_utime();
+        mod->storage.stamp[mod->storage.write / TS_PACKET_SIZE] = now;
+    }
+
     uint8_t *dst = &mod->storage.buffer[mod->storage.write];
     memcpy(dst, ts, TS_PACKET_SIZE);
 
@@ -783,17 +1137,20 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     }
 
     if(mod->storage.count >= mod->storage.size)
+    {
         decrypt(mod);
 
-    if(mod->storage.dsc_count > 0)
+        /* storage is full; wait for descrambled packets */
+        while(mod->storage.dsc_count == 0 && mod->job_cnt > 0)
+            dsc_wait(mod);
+    }
+    else if(mod->job_cnt > 0)
     {
-        module_stream_send(mod, &mod->storage.buffer[mod->storage.read]);
-        mod->storage.read += TS_PACKET_SIZE;
-        if(mod->storage.read == mod->storage.size)
-            mod->storage.read = 0;
-        mod->storage.dsc_count -= TS_PACKET_SIZE;
-        mod->storage.count -= TS_PACKET_SIZE;
+        dsc_retire(mod);
     }
+
+    if(mod->storage.dsc_count > 0)
+        storage_send(mod, now);
 }
 
 /*
@@ -911,6 +1268,40 @@ void on_cam_response(module_data_t *mod, void *arg, const uint8_t *data)
  *
  */
 
+static int method_latency(lua_State *L, module_data_t *mod)
+{
+    lua_newtable(L);
+
+    lua_newtable(L);
+    for(size_t i = 0; i < ASC_ARRAY_SIZE(latency_bounds); ++i)
+    {
+        lua_pushinteger(L, latency_bounds[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "bounds");
+
+    lua_newtable(L);
+    for(size_t i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        lua_pushnumber(L, mod->stats.histogram[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "histogram");
+
+    const double avg = (mod->stats.count > 0)
+                       ? ((double)mod->stats.total / mod->stats.count)
+                       : 0.0;
+
+    lua_pushnumber(L, avg / 1000.0);
+    lua_setfield(L, -2, "avg");
+    lua_pushnumber(L, mod->stats.max / 1000.0);
+    lua_setfield(L, -2, "max");
+    lua_pushnumber(L, mod->stats.flushes);
+    lua_setfield(L, -2, "flushes");
+
+    return 1;
+}
+
 static void module_init(lua_State *L, module_data_t *mod)
 {
     module_stream_init(L, mod, on_ts);
@@ -928,11 +1319,40 @@ static void module_init(lua_State *L, module_data_t *mod)
     mod->ca_list = asc_list_init();
     mod->el_list = asc_list_init();
 
-    mod->batch_size = dvbcsa_bs_batch_size();
+    mod->csa = au_csa_engine();
+    mod->batch_size = mod->csa->batch_size;
+    asc_log_debug(MSG("CSA engine: %s, %zu packet batches")
+                  , mod->csa->name, mod->batch_size);
+
+    size_t storage_batches = STORAGE_BATCHES;
+    mod->worker = asc_worker_acquire();
+    if(mod->worker != NULL)
+    {
+        asc_mutex_init(&mod->dsc_mutex);
+        asc_cond_init(&mod->dsc_cond);
+        storage_batches = STORAGE_BATCHES_ASYNC;
+
+        asc_log_debug(MSG("descrambling on worker %u")
+                      , asc_worker_id(mod->worker));
+    }
 
-    mod->storage.size = mod->batch_size * 4 * TS_PACKET_SIZE;
+    mod->storage.size = mod->batch_size * storage_batches * TS_PACKET_SIZE;
     mod->storage.buffer = ASC_ALLOC(mod->storage.size, uint8_t);
 
+    int latency = LATENCY_DEFAULT;
+    module_option_integer(L, "latency", &latency);
+    if(latency < 0)
+        luaL_error(L, MSG("latency must not be negative"));
+
+    if(latency > 0)
+    {
+        /* check at a quarter of the deadline */
+        mod->latency = latency * 1000ULL;
+        mod->deadline = asc_timer_init((latency + 3) / 4, on_deadline, mod);
+        mod->storage.stamp = ASC_ALLOC(mod->storage.size / TS_PACKET_SIZE
+                                       , uint64_t);
+    }
+
     const char *biss_key = NULL;
     size_t biss_length = 0;
     module_option_string(L, "biss", &biss_key, &biss_length);
@@ -995,6 +1415,26 @@ static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
 
+    ASC_FREE(mod->deadline, asc_timer_destroy);
+
+    if(mod->worker != NULL)
+    {
+        dsc_flush(mod);
+        ASC_FREE(mod->worker, asc_worker_release);
+
+        for(size_t i = 0; i < DSC_JOBS; ++i)
+        {
+            dsc_job_t *const job = &mod->jobs[i];
+            for(size_t j = 0; j < job->slice_max; ++j)
+                free(job->slices[j].batch);
+
+            ASC_FREE(job->slices, free);
+        }
+
+        asc_cond_destroy(&mod->dsc_cond);
+        asc_mutex_destroy(&mod->dsc_mutex);
+    }
+
     if(mod->__decrypt.cam)
     {
         module_cam_detach_decrypt(mod->__decrypt.cam, &mod->__decrypt);
@@ -1018,6 +1458,7 @@ static void module_destroy(module_data_t *mod)
     ASC_FREE(mod->el_list, asc_list_destroy);
 
     ASC_FREE(mod->storage.buffer, free);
+    ASC_FREE(mod->storage.stamp, free);
     ASC_FREE(mod->shift.buffer, free);
 
     for(int i = 0; i < TS_MAX_PIDS; ++i)
@@ -1026,8 +1467,15 @@ static void module_destroy(module_data_t *mod)
     ASC_FREE(mod->pmt, ts_psi_destroy);
 }
 
+static const module_method_t module_methods[] =
+{
+    { "latency", method_latency },
+    { NULL, NULL },
+};
+
 STREAM_MODULE_REGISTER(decrypt)
 {
     .init = module_init,
     .destroy = module_destroy,
+    .methods = module_methods,
 };
@@ -52,6 +52,8 @@ struct em_packet_t
 
     module_decrypt_t *decrypt;
     void *arg;
+
+    uint64_t time; // queued at
 };
 
 /*
@@ -63,6 +65,9 @@ struct em_packet_t
  *
  */
 
+/* default ECM response lifetime, ms */
+#define ECM_CACHE_TTL 10000
+
 struct module_cam_t
 {
     module_data_t *self;
@@ -77,6 +82,17 @@ struct module_cam_t
     asc_list_t *decrypt_list;
     asc_list_t *packet_queue;
 
+    /* ECM responses shared between decrypt instances */
+    asc_list_t *ecm_cache;
+    unsigned int ecm_cache_ttl;
+
+    struct
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t coalesced;
+    } ecm_stats;
+
     void (*connect)(module_data_t *mod);
     void (*disconnect)(module_data_t *mod);
     void (*send_em)(  module_data_t *mod
@@ -96,12 +112,23 @@ void module_cam_reset(module_cam_t *cam);
 em_packet_t * module_cam_queue_pop(module_cam_t *cam) __asc_result;
 void module_cam_queue_flush(module_cam_t *cam, module_decrypt_t *decrypt);
 
+void module_cam_send_em(  module_cam_t *cam
+                        , module_decrypt_t *decrypt, void *arg
+                        , const uint8_t *buffer, uint16_t size);
+void module_cam_response(  module_cam_t *cam
+                         , const em_packet_t *packet, const uint8_t *data);
+void module_cam_timeout(module_cam_t *cam, const em_packet_t *packet);
+void module_cam_drop(module_cam_t *cam, const em_packet_t *packet);
+void module_cam_cache_clear(module_cam_t *cam);
+
 #define module_cam_init(_mod, _connect, _disconnect, _send_em) \
     do { \
         _mod->__cam.self = _mod; \
         _mod->__cam.decrypt_list = asc_list_init(); \
         _mod->__cam.prov_list = asc_list_init(); \
         _mod->__cam.packet_queue = asc_list_init(); \
+        _mod->__cam.ecm_cache = asc_list_init(); \
+        _mod->__cam.ecm_cache_ttl = ECM_CACHE_TTL; \
         _mod->__cam.connect = _connect; \
         _mod->__cam.disconnect = _disconnect; \
         _mod->__cam.send_em = _send_em; \
@@ -115,6 +142,7 @@ void module_cam_queue_flush(module_cam_t *cam, module_decrypt_t *decrypt);
             asc_list_destroy(_mod->__cam.decrypt_list); \
             asc_list_destroy(_mod->__cam.prov_list); \
             asc_list_destroy(_mod->__cam.packet_queue); \
+            asc_list_destroy(_mod->__cam.ecm_cache); \
         } \
     } while (0)
 
@@ -123,10 +151,24 @@ void module_cam_queue_flush(module_cam_t *cam, module_decrypt_t *decrypt);
     { \
         lua_pushlightuserdata(L, &mod->__cam); \
         return 1; \
+    } \
+    static int method_ecm_cache(lua_State *L, module_data_t *mod) \
+    { \
+        lua_newtable(L); \
+        lua_pushnumber(L, mod->__cam.ecm_stats.hits); \
+        lua_setfield(L, -2, "hits"); \
+        lua_pushnumber(L, mod->__cam.ecm_stats.misses); \
+        lua_setfield(L, -2, "misses"); \
+        lua_pushnumber(L, mod->__cam.ecm_stats.coalesced); \
+        lua_setfield(L, -2, "coalesced"); \
+        lua_pushinteger(L, asc_list_count(mod->__cam.ecm_cache)); \
+        lua_setfield(L, -2, "entries"); \
+        return 1; \
     }
 
 #define MODULE_CAM_METHODS_REF() \
-    { "cam", method_cam }
+    { "cam", method_cam }, \
+    { "ecm_cache", method_ecm_cache }
 
 /*
  *   oooooooo8     o       oooooooo8
@@ -30,12 +30,26 @@
  *      pnr         - number, program containing T2-MI payload
  *      pid         - number, force decapsulator to process this pid
  *      plp         - number, PLP ID (defaults to first one available)
+ *
+ * Module Methods:
+ *      plp(id)     - return stream instance carrying a single PLP; all
+ *                    requested PLP's are extracted in one pass, the
+ *                    module's own output keeps carrying the 'plp' one
+ *      status()    - return table, per-PLP statistics indexed by PLP ID
  */
 
 #include <astra/astra.h>
 #include <astra/luaapi/stream.h>
 #include <astra/mpegts/t2mi.h>
 
+#define MSG(_msg) "[t2mi %s] " _msg, mod->name
+
+/* per-PLP output stream */
+typedef struct
+{
+    STREAM_MODULE_DATA();
+} plp_output_t;
+
 struct module_data_t
 {
     STREAM_MODULE_DATA();
@@ -48,6 +62,8 @@ struct module_data_t
 
     /* decapsulator context */
     ts_t2mi_t *decap;
+
+    plp_output_t *outputs[T2MI_PLP_COUNT];
 };
 
 static void on_ts(module_data_t *mod, const uint8_t *ts)
@@ -55,6 +71,65 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     ts_t2mi_decap(mod->decap, ts);
 }
 
+static int method_plp(lua_State *L, module_data_t *mod)
+{
+    const lua_Integer plp_id = luaL_checkinteger(L, 2);
+    if (plp_id < 0 || plp_id >= T2MI_PLP_COUNT)
+        luaL_error(L, MSG("PLP ID must be between 0 and %d")
+                   , T2MI_PLP_COUNT - 1);
+
+    plp_output_t *out = mod->outputs[plp_id];
+    if (out == NULL)
+    {
+        out = mod->outputs[plp_id] = ASC_ALLOC(1, plp_output_t);
+
+        module_data_t *const omod = (module_data_t *)out;
+        module_stream_init(NULL, omod, NULL);
+        module_demux_set(omod, NULL, NULL);
+
+        ts_t2mi_set_plp_callback(mod->decap, plp_id
+                                 , module_stream_send, omod);
+    }
+
+    lua_pushlightuserdata(L, out);
+    return 1;
+}
+
+static int method_status(lua_State *L, module_data_t *mod)
+{
+    lua_newtable(L);
+
+    for (unsigned int i = 0; i < T2MI_PLP_COUNT; i++)
+    {
+        ts_t2mi_plp_stats_t st;
+        if (!ts_t2mi_get_plp_stats(mod->decap, i, &st) || !st.present)
+            continue;
+
+        lua_newtable(L);
+
+        lua_pushboolean(L, st.active);
+        lua_setfield(L, -2, "active");
+        lua_pushinteger(L, st.type);
+        lua_setfield(L, -2, "type");
+        lua_pushinteger(L, st.group_id);
+        lua_setfield(L, -2, "group");
+        lua_pushnumber(L, st.bbframes);
+        lua_setfield(L, -2, "bbframes");
+        lua_pushnumber(L, st.packets);
+        lua_setfield(L, -2, "packets");
+        lua_pushnumber(L, st.nulls);
+        lua_setfield(L, -2, "nulls");
+        lua_pushnumber(L, st.errors);
+        lua_setfield(L, -2, "errors");
+        lua_pushnumber(L, st.dropped);
+        lua_setfield(L, -2, "dropped");
+
+        lua_rawseti(L, -2, i);
+    }
+
+    return 1;
+}
+
 static void module_init(lua_State *L, module_data_t *mod)
 {
     module_stream_init(L, mod, on_ts);
@@ -87,11 +162,30 @@ static void module_init(lua_State *L, module_data_t *mod)
 static void module_destroy(module_data_t *mod)
 {
     ASC_FREE(mod->decap, ts_t2mi_destroy);
+
+    for (unsigned int i = 0; i < T2MI_PLP_COUNT; i++)
+    {
+        plp_output_t *const out = mod->outputs[i];
+        if (out == NULL)
+            continue;
+
+        module_stream_destroy((module_data_t *)out);
+        ASC_FREE(mod->outputs[i], free);
+    }
+
     module_stream_destroy(mod);
 }
 
+static const module_method_t module_methods[] =
+{
+    { "plp", method_plp },
+    { "status", method_status },
+    { NULL, NULL },
+};
+
 STREAM_MODULE_REGISTER(t2mi_decap)
 {
     .init = module_init,
     .destroy = module_destroy,
+    .methods = module_methods,
 };
@@ -44,10 +44,24 @@ void on_ts(module_data_t *mod, const uint8_t *ts)
     module_stream_send(mod, ts);
 }
 
+static
+void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t cnt)
+{
+    module_stream_send_batch(mod, ts, cnt);
+}
+
+static
+void on_ts_block(module_data_t *mod, asc_block_t *block)
+{
+    module_stream_send_block(mod, block);
+}
+
 static
 void module_init(lua_State *L, module_data_t *mod)
 {
     module_stream_init(L, mod, on_ts);
+    module_stream_set_batch(mod, on_ts_batch);
+    module_stream_set_block(mod, on_ts_block);
 }
 
 static
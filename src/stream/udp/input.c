@@ -32,12 +32,16 @@
  *      socket_size - number, socket buffer size
  *      renew       - number, renewing multicast subscription interval in seconds
  *      rtp         - boolean, use RTP instead of RAW UDP
+ *      batch       - number, datagrams per recvmmsg() call; values above 1
+ *                    also drain the socket on each wakeup
  *
  * Module Methods:
  *      port()      - return number, random port number
+ *      status()    - return table, datagram counters
  */
 
 #include <astra/astra.h>
+#include <astra/core/block.h>
 #include <astra/core/socket.h>
 #include <astra/core/timer.h>
 #include <astra/luaapi/stream.h>
@@ -45,6 +49,12 @@
 #define UDP_BUFFER_SIZE 1460
 #define RTP_HEADER_SIZE 12
 
+/* limit reads per wakeup so other events get a chance to run */
+#define UDP_DRAIN_ROUNDS 16
+
+/* idle blocks kept per recvmmsg() slot */
+#define UDP_POOL_IDLE 4
+
 #define RTP_IS_EXT(_data) ((_data[0] & 0x10))
 #define RTP_EXT_SIZE(_data) \
     (((_data[RTP_HEADER_SIZE + 2] << 8) | _data[RTP_HEADER_SIZE + 3]) * 4 + 4)
@@ -61,6 +71,7 @@ struct module_data_t
         int port;
         const char *localaddr;
         bool rtp;
+        int batch;
     } config;
 
     bool is_error_message;
@@ -68,7 +79,18 @@ struct module_data_t
     asc_socket_t *sock;
     asc_timer_t *timer_renew;
 
-    uint8_t buffer[UDP_BUFFER_SIZE];
+    struct
+    {
+        uint64_t wakeups;
+        uint64_t datagrams;
+        size_t max_datagrams;
+    } stats;
+
+    /* each datagram is received into its own block */
+    asc_block_pool_t *pool;
+    asc_block_t *blocks[ASC_SOCKET_BATCH_MAX];
+    void *buffers[ASC_SOCKET_BATCH_MAX];
+    size_t lens[ASC_SOCKET_BATCH_MAX];
 };
 
 static void on_close(void *arg)
@@ -85,40 +107,31 @@ static void on_close(void *arg)
     ASC_FREE(mod->timer_renew, asc_timer_destroy);
 }
 
-static void on_read(void *arg)
+static void on_datagram(module_data_t *mod, asc_block_t *block, size_t len)
 {
-    module_data_t *const mod = (module_data_t *)arg;
-
-    /* TODO: read until it fails with EAGAIN */
-    const ssize_t ret = asc_socket_recv(mod->sock, mod->buffer, UDP_BUFFER_SIZE);
-    if(ret <= 0)
-    {
-        if(ret == 0 || asc_socket_would_block())
-            return;
-
-        asc_log_error(MSG("recv(): %s"), asc_error_msg());
-        on_close(mod);
-
-        return;
-    }
-
-    const size_t len = ret;
+    const uint8_t *const buffer = block->buffer;
     size_t i = 0;
 
     if(mod->config.rtp)
     {
+        if(len < RTP_HEADER_SIZE)
+            return;
+
         i = RTP_HEADER_SIZE;
-        if(RTP_IS_EXT(mod->buffer))
+        if(RTP_IS_EXT(buffer))
         {
             if(len < RTP_HEADER_SIZE + 4)
                 return;
 
-            i += RTP_EXT_SIZE(mod->buffer);
+            i += RTP_EXT_SIZE(buffer);
         }
     }
 
-    for(; i + TS_PACKET_SIZE <= len; i += TS_PACKET_SIZE)
-        module_stream_send(mod, &mod->buffer[i]);
+    const size_t cnt = (len > i) ? (len - i) / TS_PACKET_SIZE : 0;
+    block->data = &block->buffer[i];
+    block->cnt = cnt;
+    module_stream_send_block(mod, block);
+    i += cnt * TS_PACKET_SIZE;
 
     if(i != len && !mod->is_error_message)
     {
@@ -127,6 +140,63 @@ static void on_read(void *arg)
     }
 }
 
+static void on_read(void *arg)
+{
+    module_data_t *const mod = (module_data_t *)arg;
+    const size_t batch = mod->config.batch;
+
+    size_t total = 0;
+    for(unsigned int round = 0; round < UDP_DRAIN_ROUNDS; round++)
+    {
+        /* replace blocks retained by downstream modules */
+        for(size_t i = 0; i < batch; i++)
+        {
+            if(!mod->blocks[i])
+            {
+                mod->blocks[i] = asc_block_alloc(mod->pool);
+                mod->buffers[i] = mod->blocks[i]->buffer;
+            }
+        }
+
+        const ssize_t ret = asc_socket_recv_batch(mod->sock, mod->buffers
+                                                  , UDP_BUFFER_SIZE
+                                                  , mod->lens, batch);
+        if(ret <= 0)
+        {
+            if(ret == 0 || asc_socket_would_block())
+                break;
+
+            asc_log_error(MSG("recv(): %s"), asc_error_msg());
+            on_close(mod);
+
+            return;
+        }
+
+        for(ssize_t i = 0; i < ret; i++)
+        {
+            asc_block_t *const block = mod->blocks[i];
+            on_datagram(mod, block, mod->lens[i]);
+
+            if(block->refcnt > 1)
+            {
+                asc_block_release(block);
+                mod->blocks[i] = NULL;
+            }
+        }
+
+        total += ret;
+
+        /* single datagram mode or socket is drained */
+        if(batch == 1 || (size_t)ret < batch)
+            break;
+    }
+
+    mod->stats.wakeups++;
+    mod->stats.datagrams += total;
+    if(total > mod->stats.max_datagrams)
+        mod->stats.max_datagrams = total;
+}
+
 static void timer_renew_callback(void *arg)
 {
     module_data_t *const mod = (module_data_t *)arg;
@@ -141,6 +211,20 @@ static int method_port(lua_State *L, module_data_t *mod)
     return 1;
 }
 
+static int method_status(lua_State *L, module_data_t *mod)
+{
+    lua_newtable(L);
+
+    lua_pushnumber(L, mod->stats.wakeups);
+    lua_setfield(L, -2, "wakeups");
+    lua_pushnumber(L, mod->stats.datagrams);
+    lua_setfield(L, -2, "datagrams");
+    lua_pushnumber(L, mod->stats.max_datagrams);
+    lua_setfield(L, -2, "max_datagrams");
+
+    return 1;
+}
+
 static void module_init(lua_State *L, module_data_t *mod)
 {
     module_stream_init(L, mod, NULL);
@@ -152,6 +236,17 @@ static void module_init(lua_State *L, module_data_t *mod)
 
     module_option_integer(L, "port", &mod->config.port);
 
+    mod->config.batch = 1;
+    module_option_integer(L, "batch", &mod->config.batch);
+    if(mod->config.batch < 1 || mod->config.batch > ASC_SOCKET_BATCH_MAX)
+    {
+        luaL_error(L, MSG("option 'batch' must be between 1 and %d")
+                   , ASC_SOCKET_BATCH_MAX);
+    }
+
+    mod->pool = asc_block_pool_init(UDP_BUFFER_SIZE
+                                    , mod->config.batch * UDP_POOL_IDLE);
+
     mod->sock = asc_socket_open_udp4(mod);
     asc_socket_set_reuseaddr(mod->sock, 1);
 
@@ -181,11 +276,17 @@ static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
     on_close(mod);
+
+    for(size_t i = 0; i < ASC_SOCKET_BATCH_MAX; i++)
+        ASC_FREE(mod->blocks[i], asc_block_release);
+
+    ASC_FREE(mod->pool, asc_block_pool_destroy);
 }
 
 static const module_method_t module_methods[] =
 {
     { "port", method_port },
+    { "status", method_status },
     { NULL, NULL },
 };
 
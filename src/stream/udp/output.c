@@ -35,6 +35,19 @@
  *      rtp         - boolean, use RTP instead of RAW UDP
  *      sync        - boolean, use MPEG-TS syncing
  *      sync_opts   - string, sync buffer options
+ *      sync_pacing - number, release synced packets from a dedicated
+ *                    thread, waking up at most every N microseconds
+ *                    (50-5000, default 0: shared scheduler)
+ *      packets     - number, TS packets per datagram (1-7, default 7)
+ *      batch       - number, datagrams to queue before flushing them with
+ *                    a single sendmmsg() call (default 1, no queueing)
+ *      batch_time  - number, flush queued datagrams after this many ms
+ *      gso         - boolean, use UDP segmentation offload if available
+ *
+ * Module Methods:
+ *      status()    - return table, datagram and drop counters; with
+ *                    sync pacing also wakeups, jitter_avg and jitter_max
+ *                    (pacing thread lateness, microseconds)
  */
 
 #include <astra/astra.h>
@@ -46,8 +59,12 @@
 #define MSG(_msg) "[udp_output %s:%d] " _msg, mod->addr, mod->port
 
 #define UDP_BUFFER_SIZE 1460
+#define RTP_HEADER_SIZE 12
 #define RTP_PT_MP2T 33 /* RFC2250 */
 
+#define UDP_MAX_PACKETS ((UDP_BUFFER_SIZE - RTP_HEADER_SIZE) / TS_PACKET_SIZE)
+#define UDP_BATCH_TIME 2
+
 struct module_data_t
 {
     STREAM_MODULE_DATA();
@@ -57,6 +74,7 @@ struct module_data_t
 
     bool is_rtp;
     uint16_t rtpseq;
+    uint32_t rtpssrc;
 
     asc_socket_t *sock;
     bool can_send;
@@ -64,12 +82,24 @@ struct module_data_t
 
     struct
     {
+        uint64_t datagrams;
+        uint64_t syscalls;
+        uint64_t dropped;
+    } stats;
+
+    struct
+    {
+        size_t size;
+        size_t batch;
+        size_t count;
         uint32_t skip;
-        uint8_t buffer[UDP_BUFFER_SIZE];
+        uint8_t *buffer;
     } packet;
 
+    asc_timer_t *batch_timer;
+
     ts_sync_t *sync;
-    asc_timer_t *sync_loop;
+    bool is_paced;
 };
 
 static void on_ready(void *arg)
@@ -86,9 +116,9 @@ static void on_ready(void *arg)
     asc_socket_set_on_ready(mod->sock, NULL);
 }
 
-static void on_sync_ts(module_data_t *mod, const uint8_t *ts)
+static void on_sync_ts_batch(module_data_t *mod, const uint8_t *ts, size_t cnt)
 {
-    const bool ret = ts_sync_push(mod->sync, ts, 1);
+    const bool ret = ts_sync_push(mod->sync, ts, cnt);
 
     if (!ret)
     {
@@ -97,55 +127,183 @@ static void on_sync_ts(module_data_t *mod, const uint8_t *ts)
     }
 }
 
-static void on_output_ts(module_data_t *mod, const uint8_t *ts)
+static void on_sync_ts(module_data_t *mod, const uint8_t *ts)
 {
-    if(!mod->can_send)
-    {
-        mod->dropped++;
+    on_sync_ts_batch(mod, ts, 1);
+}
+
+static void flush_datagrams(module_data_t *mod)
+{
+    const size_t count = mod->packet.count;
+    if(count == 0)
         return;
+
+    const size_t len = count * mod->packet.size;
+    ssize_t ret;
+
+    if(count == 1)
+    {
+        ret = asc_socket_sendto(mod->sock, mod->packet.buffer, len);
+        if(ret != -1)
+            ret = 1;
+    }
+    else
+    {
+        ret = asc_socket_sendto_batch(mod->sock, mod->packet.buffer
+                                      , len, mod->packet.size);
     }
 
-    if(mod->is_rtp && mod->packet.skip == 0)
+    mod->stats.syscalls++;
+
+    const size_t sent = (ret > 0) ? (size_t)ret : 0;
+    mod->stats.datagrams += sent;
+
+    if(sent < count)
     {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        const uint64_t msec = ((tv.tv_sec % 1000000) * 1000) + (tv.tv_usec / 1000);
+        if(ret != -1 || asc_socket_would_block())
+        {
+            mod->can_send = false;
+            asc_socket_set_on_ready(mod->sock, on_ready);
+        }
+        else
+            asc_log_warning(MSG("sendto(): %s"), asc_error_msg());
+
+        const size_t lost = (count - sent) * ((mod->packet.size
+                                               - (mod->is_rtp ? RTP_HEADER_SIZE : 0))
+                                              / TS_PACKET_SIZE);
+        mod->dropped += lost;
+        mod->stats.dropped += lost;
+    }
 
-        mod->packet.buffer[2] = (mod->rtpseq >> 8) & 0xFF;
-        mod->packet.buffer[3] = (mod->rtpseq     ) & 0xFF;
+    /* move incomplete datagram to the front of the queue */
+    if(mod->packet.skip > 0)
+        memmove(mod->packet.buffer, &mod->packet.buffer[len], mod->packet.skip);
 
-        mod->packet.buffer[4] = (msec >> 24) & 0xFF;
-        mod->packet.buffer[5] = (msec >> 16) & 0xFF;
-        mod->packet.buffer[6] = (msec >>  8) & 0xFF;
-        mod->packet.buffer[7] = (msec      ) & 0xFF;
+    mod->packet.count = 0;
+}
 
-        ++mod->rtpseq;
+static void on_batch_timer(void *arg)
+{
+    module_data_t *const mod = (module_data_t *)arg;
 
-        mod->packet.skip += 12;
+    if(mod->can_send)
+        flush_datagrams(mod);
+}
+
+static void put_rtp_header(module_data_t *mod, uint8_t *dgram)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    const uint64_t msec = ((tv.tv_sec % 1000000) * 1000) + (tv.tv_usec / 1000);
+
+    dgram[0 ] = 0x80; // RTP version
+    dgram[1 ] = RTP_PT_MP2T;
+
+    dgram[2 ] = (mod->rtpseq >> 8) & 0xFF;
+    dgram[3 ] = (mod->rtpseq     ) & 0xFF;
+
+    dgram[4 ] = (msec >> 24) & 0xFF;
+    dgram[5 ] = (msec >> 16) & 0xFF;
+    dgram[6 ] = (msec >>  8) & 0xFF;
+    dgram[7 ] = (msec      ) & 0xFF;
+
+    dgram[8 ] = (mod->rtpssrc >> 24) & 0xFF;
+    dgram[9 ] = (mod->rtpssrc >> 16) & 0xFF;
+    dgram[10] = (mod->rtpssrc >>  8) & 0xFF;
+    dgram[11] = (mod->rtpssrc      ) & 0xFF;
+
+    ++mod->rtpseq;
+}
+
+/* called on the sync pacing thread; sends each datagram once it's full */
+static void on_paced_ts(module_data_t *mod, const uint8_t *ts)
+{
+    uint8_t *const dgram = mod->packet.buffer;
+
+    if(mod->is_rtp && mod->packet.skip == 0)
+    {
+        put_rtp_header(mod, dgram);
+        mod->packet.skip += RTP_HEADER_SIZE;
     }
 
-    memcpy(&mod->packet.buffer[mod->packet.skip], ts, TS_PACKET_SIZE);
+    memcpy(&dgram[mod->packet.skip], ts, TS_PACKET_SIZE);
     mod->packet.skip += TS_PACKET_SIZE;
 
-    if(mod->packet.skip > UDP_BUFFER_SIZE - TS_PACKET_SIZE)
+    if(mod->packet.skip < mod->packet.size)
+        return;
+
+    mod->packet.skip = 0;
+    __atomic_add_fetch(&mod->stats.syscalls, 1, __ATOMIC_RELAXED);
+
+    if(asc_socket_sendto(mod->sock, dgram, mod->packet.size) != -1)
     {
-        const ssize_t ret = asc_socket_sendto(mod->sock
-                                              , mod->packet.buffer
-                                              , mod->packet.skip);
+        __atomic_add_fetch(&mod->stats.datagrams, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        const size_t lost = (mod->packet.size
+                             - (mod->is_rtp ? RTP_HEADER_SIZE : 0)) / TS_PACKET_SIZE;
 
-        if(ret == -1)
-        {
-            if(asc_socket_would_block())
-            {
-                mod->can_send = false;
-                asc_socket_set_on_ready(mod->sock, on_ready);
-            }
-            else
-                asc_log_warning(MSG("sendto(): %s"), asc_error_msg());
-        }
+        __atomic_add_fetch(&mod->stats.dropped, lost, __ATOMIC_RELAXED);
+    }
+}
+
+static void on_output_ts(module_data_t *mod, const uint8_t *ts)
+{
+    if(!mod->can_send)
+    {
+        mod->dropped++;
+        mod->stats.dropped++;
+        return;
+    }
+
+    uint8_t *const dgram = &mod->packet.buffer[mod->packet.count
+                                               * mod->packet.size];
+
+    if(mod->is_rtp && mod->packet.skip == 0)
+    {
+        put_rtp_header(mod, dgram);
+        mod->packet.skip += RTP_HEADER_SIZE;
+    }
+
+    memcpy(&dgram[mod->packet.skip], ts, TS_PACKET_SIZE);
+    mod->packet.skip += TS_PACKET_SIZE;
 
+    if(mod->packet.skip >= mod->packet.size)
+    {
         mod->packet.skip = 0;
+        mod->packet.count++;
+
+        if(mod->packet.count >= mod->packet.batch)
+            flush_datagrams(mod);
+    }
+}
+
+static int method_status(lua_State *L, module_data_t *mod)
+{
+    lua_newtable(L);
+
+    lua_pushnumber(L, __atomic_load_n(&mod->stats.datagrams, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "datagrams");
+    lua_pushnumber(L, __atomic_load_n(&mod->stats.syscalls, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "syscalls");
+    lua_pushnumber(L, __atomic_load_n(&mod->stats.dropped, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "dropped");
+
+    if(mod->is_paced)
+    {
+        ts_sync_stat_t st;
+        ts_sync_query(mod->sync, &st);
+
+        lua_pushnumber(L, st.wakeups);
+        lua_setfield(L, -2, "wakeups");
+        lua_pushinteger(L, st.jitter_avg);
+        lua_setfield(L, -2, "jitter_avg");
+        lua_pushinteger(L, st.jitter_max);
+        lua_setfield(L, -2, "jitter_max");
     }
+
+    return 1;
 }
 
 static void module_init(lua_State *L, module_data_t *mod)
@@ -159,17 +317,31 @@ static void module_init(lua_State *L, module_data_t *mod)
 
     module_option_boolean(L, "rtp", &mod->is_rtp);
     if(mod->is_rtp)
+        mod->rtpssrc = (uint32_t)rand();
+
+    int packets = UDP_MAX_PACKETS;
+    module_option_integer(L, "packets", &packets);
+    if(packets < 1 || packets > UDP_MAX_PACKETS)
     {
-        const uint32_t rtpssrc = (uint32_t)rand();
+        luaL_error(L, MSG("option 'packets' must be between 1 and %d")
+                   , UDP_MAX_PACKETS);
+    }
 
-        mod->packet.buffer[0 ] = 0x80; // RTP version
-        mod->packet.buffer[1 ] = RTP_PT_MP2T;
-        mod->packet.buffer[8 ] = (rtpssrc >> 24) & 0xFF;
-        mod->packet.buffer[9 ] = (rtpssrc >> 16) & 0xFF;
-        mod->packet.buffer[10] = (rtpssrc >>  8) & 0xFF;
-        mod->packet.buffer[11] = (rtpssrc      ) & 0xFF;
+    int batch = 1;
+    module_option_integer(L, "batch", &batch);
+    if(batch < 1 || batch > ASC_SOCKET_BATCH_MAX)
+    {
+        luaL_error(L, MSG("option 'batch' must be between 1 and %d")
+                   , ASC_SOCKET_BATCH_MAX);
     }
 
+    mod->packet.size = packets * TS_PACKET_SIZE;
+    if(mod->is_rtp)
+        mod->packet.size += RTP_HEADER_SIZE;
+
+    mod->packet.batch = batch;
+    mod->packet.buffer = ASC_ALLOC(batch * mod->packet.size, uint8_t);
+
     mod->sock = asc_socket_open_udp4(mod);
     asc_socket_set_reuseaddr(mod->sock, 1);
     if(!asc_socket_bind(mod->sock, NULL, 0))
@@ -191,6 +363,32 @@ static void module_init(lua_State *L, module_data_t *mod)
     asc_socket_multicast_join(mod->sock, mod->addr, NULL);
     asc_socket_set_sockaddr(mod->sock, mod->addr, mod->port);
 
+    bool gso = false;
+    module_option_boolean(L, "gso", &gso);
+
+    int batch_time = UDP_BATCH_TIME;
+    const bool has_batch_time =
+        module_option_integer(L, "batch_time", &batch_time);
+
+    if(batch > 1)
+    {
+        if(gso && !asc_socket_set_gso(mod->sock, mod->packet.size))
+            asc_log_warning(MSG("UDP GSO is not available"));
+
+        if(batch_time < 1)
+            luaL_error(L, MSG("option 'batch_time' must be positive"));
+
+        mod->batch_timer = asc_timer_init(batch_time, on_batch_timer, mod);
+    }
+    else if(gso)
+    {
+        luaL_error(L, MSG("option 'gso' requires 'batch'"));
+    }
+    else if(has_batch_time)
+    {
+        luaL_error(L, MSG("option 'batch_time' requires 'batch'"));
+    }
+
     mod->can_send = false;
     asc_socket_set_on_ready(mod->sock, on_ready);
 
@@ -198,6 +396,27 @@ static void module_init(lua_State *L, module_data_t *mod)
     bool sync_on = false;
     module_option_boolean(L, "sync", &sync_on);
 
+    int pacing = 0;
+    module_option_integer(L, "sync_pacing", &pacing);
+    if(pacing != 0)
+    {
+        if(!sync_on)
+            luaL_error(L, MSG("option 'sync_pacing' requires 'sync'"));
+
+        if(pacing < SYNC_PACING_MIN_USEC || pacing > SYNC_PACING_MAX_USEC)
+        {
+            luaL_error(L, MSG("option 'sync_pacing' must be between %d and %d")
+                       , SYNC_PACING_MIN_USEC, SYNC_PACING_MAX_USEC);
+        }
+
+        /* datagrams are sent straight from the pacing thread */
+        if(batch > 1)
+            luaL_error(L, MSG("option 'batch' can't be used with 'sync_pacing'"));
+
+        on_ts = on_paced_ts;
+        mod->is_paced = true;
+    }
+
     if(sync_on)
     {
         mod->sync = ts_sync_init((ts_callback_t)on_ts, mod);
@@ -209,27 +428,45 @@ static void module_init(lua_State *L, module_data_t *mod)
         if (optstr != NULL && !ts_sync_set_opts(mod->sync, optstr))
             luaL_error(L, MSG("invalid value for option 'sync_opts'"));
 
-        mod->sync_loop = asc_timer_init(SYNC_INTERVAL_MSEC, ts_sync_loop
-                                        , mod->sync);
+        if(mod->is_paced)
+        {
+            if(!ts_sync_set_pacing(mod->sync, pacing))
+                luaL_error(L, MSG("failed to start sync pacing"));
+        }
+        else
+        {
+            ts_sync_schedule(mod->sync);
+        }
 
         on_ts = on_sync_ts;
     }
 
     module_stream_init(L, mod, on_ts);
     module_demux_set(mod, NULL, NULL);
+
+    if(sync_on)
+        module_stream_set_batch(mod, on_sync_ts_batch);
 }
 
 static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
 
-    ASC_FREE(mod->sync_loop, asc_timer_destroy);
     ASC_FREE(mod->sync, ts_sync_destroy);
+    ASC_FREE(mod->batch_timer, asc_timer_destroy);
     ASC_FREE(mod->sock, asc_socket_close);
+    ASC_FREE(mod->packet.buffer, free);
 }
 
+static const module_method_t module_methods[] =
+{
+    { "status", method_status },
+    { NULL, NULL },
+};
+
 STREAM_MODULE_REGISTER(udp_output)
 {
     .init = module_init,
     .destroy = module_destroy,
+    .methods = module_methods,
 };
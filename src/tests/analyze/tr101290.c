@@ -0,0 +1,266 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/mpegts/pcr.h>
+#include <astra/mpegts/psi.h>
+#include <stream/analyze/tr101290.h>
+
+#define PMT_PID 0x20
+#define ES_PID 0x100
+
+static tr101290_t *tr = NULL;
+static uint64_t now = 0;
+
+static
+void setup(void)
+{
+    tr = tr101290_init();
+    ck_assert(tr != NULL);
+
+    now = 1000;
+}
+
+static
+void teardown(void)
+{
+    ASC_FREE(tr, tr101290_destroy);
+}
+
+/* return and reset one error counter */
+static
+uint32_t errors(tr101290_error_t err)
+{
+    uint32_t out[TR_ERROR_COUNT];
+    tr101290_query(tr, out);
+
+    return out[err];
+}
+
+static
+void on_pat_ts(void *arg, const uint8_t *ts)
+{
+    ASC_UNUSED(arg);
+    tr101290_packet(tr, ts, now);
+}
+
+static
+void send_pat(void)
+{
+    ts_psi_t *const psi = ts_psi_init(TS_TYPE_PAT, 0x00);
+
+    PAT_INIT(psi, 1, 0);
+    PAT_ITEMS_APPEND(psi, 1, PMT_PID);
+    PSI_SET_CRC32(psi);
+    ts_psi_demux(psi, on_pat_ts, NULL);
+
+    ts_psi_destroy(psi);
+}
+
+static
+void send_es(unsigned int cc)
+{
+    uint8_t ts[TS_PACKET_SIZE];
+    memset(ts, 0xff, sizeof(ts));
+
+    TS_INIT(ts);
+    TS_SET_PID(ts, ES_PID);
+    TS_SET_PAYLOAD(ts, true);
+    TS_SET_CC(ts, cc);
+
+    tr101290_packet(tr, ts, now);
+}
+
+static
+void send_pmt(unsigned int cc)
+{
+    uint8_t ts[TS_PACKET_SIZE];
+    memset(ts, 0xff, sizeof(ts));
+
+    TS_INIT(ts);
+    TS_SET_PID(ts, PMT_PID);
+    TS_SET_PUSI(ts, true);
+    TS_SET_PAYLOAD(ts, true);
+    TS_SET_CC(ts, cc);
+
+    /* pointer field and table_id; the engine doesn't parse the rest */
+    ts[4] = 0x00;
+    ts[5] = 0x02;
+
+    tr101290_packet(tr, ts, now);
+}
+
+/* PCR only packet, stamped `ms' milliseconds into the stream */
+static
+void send_pcr(uint64_t ms)
+{
+    uint8_t ts[TS_PACKET_SIZE];
+
+    TS_INIT(ts);
+    TS_SET_PID(ts, ES_PID);
+    TS_SET_AF(ts, TS_BODY_SIZE - 1);
+    TS_SET_PCR(ts, ms * (TS_PCR_FREQ / 1000));
+
+    tr101290_packet(tr, ts, now);
+}
+
+/* 1.4: continuity counter */
+START_TEST(cc_errors)
+{
+    for (unsigned int i = 0; i < 20; i++)
+        send_es(i);
+
+    ck_assert(errors(TR_CC) == 0);
+
+    /* one packet lost */
+    send_es(21);
+    ck_assert(errors(TR_CC) == 1);
+
+    /* single duplicate is allowed, a second one is not */
+    send_es(21);
+    ck_assert(errors(TR_CC) == 0);
+    send_es(21);
+    ck_assert(errors(TR_CC) == 1);
+
+    /* counter resumes from the last value */
+    send_es(22);
+    send_es(23);
+    ck_assert(errors(TR_CC) == 0);
+}
+END_TEST
+
+/* 1.3: PAT repetition */
+START_TEST(pat_timeout)
+{
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        send_pat();
+        tr101290_check(tr, now);
+        now += 400;
+    }
+
+    ck_assert(errors(TR_PAT) == 0);
+
+    /* 800 ms since the last PAT */
+    now += 400;
+    tr101290_check(tr, now);
+    ck_assert(errors(TR_PAT) == 1);
+
+    /* late arrival isn't counted again */
+    send_pat();
+    ck_assert(errors(TR_PAT) == 0);
+
+    /* gap noticed only on arrival */
+    now += 600;
+    send_pat();
+    ck_assert(errors(TR_PAT) == 1);
+}
+END_TEST
+
+/* 1.5: PMT repetition */
+START_TEST(pmt_timeout)
+{
+    send_pat();
+    tr101290_ref_pid(tr, PMT_PID, TR_REF_PMT);
+
+    unsigned int cc = 0;
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        send_pmt(cc++);
+        now += 400;
+        tr101290_check(tr, now);
+    }
+
+    ck_assert(errors(TR_PMT) == 0);
+
+    now += 200;
+    tr101290_check(tr, now);
+    ck_assert(errors(TR_PMT) == 1);
+
+    /* late arrival isn't counted again */
+    send_pmt(cc++);
+    ck_assert(errors(TR_PMT) == 0);
+
+    /* unreferenced PMT PID is not checked */
+    tr101290_unref(tr);
+    now += 2000;
+    tr101290_check(tr, now);
+    ck_assert(errors(TR_PMT) == 0);
+}
+END_TEST
+
+/* 2.3: PCR repetition, 40 ms limit */
+START_TEST(pcr_gaps)
+{
+    tr101290_ref_pid(tr, ES_PID, TR_REF_ES | TR_REF_PCR);
+
+    uint64_t ms = 0;
+    for (unsigned int i = 0; i < 20; i++)
+    {
+        send_pcr(ms);
+        tr101290_check(tr, now);
+
+        ms += 40;
+        now += 40;
+    }
+
+    ck_assert(errors(TR_PCR_REPETITION) == 0);
+
+    /* 60 ms gap, seen only in PCR values */
+    ms += 20;
+    now += 20;
+    send_pcr(ms);
+    ck_assert(errors(TR_PCR_REPETITION) == 1);
+
+    /* 60 ms gap, noticed by the periodic check first */
+    ms += 50;
+    now += 50;
+    tr101290_check(tr, now);
+    ck_assert(errors(TR_PCR_REPETITION) == 1);
+
+    ms += 10;
+    now += 10;
+    send_pcr(ms);
+    ck_assert(errors(TR_PCR_REPETITION) == 0);
+
+    /* long outage: one error no matter how often it's checked */
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        now += 50;
+        tr101290_check(tr, now);
+    }
+
+    ck_assert(errors(TR_PCR_REPETITION) == 1);
+    ck_assert(errors(TR_PCR_DISCONTINUITY) == 0);
+}
+END_TEST
+
+Suite *analyze_tr101290(void)
+{
+    Suite *const s = suite_create("analyze/tr101290");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, cc_errors);
+    tcase_add_test(tc, pat_timeout);
+    tcase_add_test(tc, pmt_timeout);
+    tcase_add_test(tc, pcr_gaps);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
@@ -0,0 +1,520 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/core/mainloop.h>
+#include <astra/core/timer.h>
+#include <astra/mpegts/pcr.h>
+#include <astra/mpegts/psi.h>
+#include <stream/cbr/mux.h>
+
+#define MUX_BITRATE 5000000
+#define MUX_DELAY 20
+#define MUX_BUFFER 500
+#define MUX_PCR_INTERVAL 20
+
+/* input PIDs, same for both programs */
+#define IN_PMT_PID 0x30
+#define IN_ES_PID 0x31
+
+/* output PIDs as assigned by the muxer */
+#define OUT_PMT_PID(_idx) (0x100 + (_idx) * 0x20)
+#define OUT_ES_PID(_idx) (OUT_PMT_PID(_idx) + 1)
+
+/* input: 10 packets every 10ms, PCR and tables every 100ms */
+#define FEED_MSEC 10
+#define FEED_PACKETS 10
+#define FEED_PCR_TICKS 10
+
+#define RUN_MSEC 1000
+
+/* PCR accuracy limit, +/-500ns */
+#define PCR_ACCURACY (TS_PCR_FREQ / 2000000)
+
+#define PROG_CNT 2
+
+struct module_data_t
+{
+    STREAM_MODULE_DATA();
+
+    unsigned int idx;
+    unsigned int cc;
+    ts_psi_t *pat;
+    ts_psi_t *pmt;
+};
+
+static module_data_t src[PROG_CNT];
+static cbr_mux_t *mux = NULL;
+static asc_timer_t *feed_timer = NULL;
+static unsigned int feed_tick = 0;
+static uint64_t feed_start = 0;
+
+/* output state */
+static struct
+{
+    uint64_t packets;
+    uint64_t first_time;
+    uint64_t last_time;
+
+    unsigned int pid_cnt[TS_MAX_PIDS];
+    int cc[TS_MAX_PIDS];
+    unsigned int cc_errors;
+
+    struct
+    {
+        uint64_t idx;
+        uint64_t pcr;
+        unsigned int cnt;
+        uint64_t gap_max;
+        uint64_t jitter_max;
+        unsigned int backwards;
+    } pcr[PROG_CNT];
+
+    ts_psi_t *pat;
+    ts_psi_t *pmt[PROG_CNT];
+    unsigned int pat_ok;
+    unsigned int pmt_ok[PROG_CNT];
+    unsigned int psi_errors;
+} out;
+
+/*
+ * input
+ */
+
+static
+void on_src_psi(void *arg, const uint8_t *ts)
+{
+    module_stream_send(arg, ts);
+}
+
+static
+void send_es(module_data_t *mod, bool is_pcr)
+{
+    uint8_t ts[TS_PACKET_SIZE];
+
+    TS_INIT(ts);
+    TS_SET_PID(ts, IN_ES_PID);
+    TS_SET_PAYLOAD(ts, true);
+    TS_SET_CC(ts, mod->cc);
+    mod->cc = (mod->cc + 1) & 0xF;
+
+    size_t skip = TS_HEADER_SIZE;
+    if (is_pcr)
+    {
+        /* arbitrary time base for each program */
+        const uint64_t pcr = (asc_utime() - feed_start) * (TS_PCR_FREQ / 1000000)
+                             + mod->idx * TS_PCR_FREQ;
+
+        TS_SET_AF(ts, 7);
+        TS_SET_PCR(ts, pcr);
+        skip += 1 + 7;
+    }
+
+    /* payload tells programs apart */
+    memset(&ts[skip], 0xA0 + mod->idx, TS_PACKET_SIZE - skip);
+
+    module_stream_send(mod, ts);
+}
+
+static
+void on_feed(void *arg)
+{
+    ASC_UNUSED(arg);
+
+    const bool is_pcr = (feed_tick++ % FEED_PCR_TICKS) == 0;
+
+    for (size_t i = 0; i < PROG_CNT; i++)
+    {
+        module_data_t *const mod = &src[i];
+
+        if (is_pcr)
+        {
+            ts_psi_demux(mod->pat, on_src_psi, mod);
+            ts_psi_demux(mod->pmt, on_src_psi, mod);
+        }
+
+        for (size_t j = 0; j < FEED_PACKETS; j++)
+            send_es(mod, is_pcr && j == 0);
+    }
+}
+
+static
+void on_stop(void *arg)
+{
+    ASC_UNUSED(arg);
+    asc_main_loop_shutdown();
+}
+
+/*
+ * output
+ */
+
+static
+void on_out_pat(void *arg, ts_psi_t *psi)
+{
+    ASC_UNUSED(arg);
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if (crc32 != PSI_CALC_CRC32(psi))
+    {
+        out.psi_errors++;
+        return;
+    }
+
+    unsigned int cnt = 0;
+    const uint8_t *ptr = NULL;
+
+    PAT_ITEMS_FOREACH(psi, ptr)
+    {
+        const unsigned int pnr = PAT_ITEM_GET_PNR(psi, ptr);
+        const unsigned int pid = PAT_ITEM_GET_PID(psi, ptr);
+
+        if (pnr != 101 + cnt || pid != OUT_PMT_PID(cnt))
+        {
+            out.psi_errors++;
+            return;
+        }
+
+        cnt++;
+    }
+
+    if (cnt == PROG_CNT)
+        out.pat_ok++;
+    else
+        out.psi_errors++;
+}
+
+static
+void on_out_pmt(void *arg, ts_psi_t *psi)
+{
+    const unsigned int idx = (uintptr_t)arg;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if (crc32 != PSI_CALC_CRC32(psi)
+        || (unsigned int)PMT_GET_PNR(psi) != 101 + idx
+        || PMT_GET_PCR(psi) != OUT_ES_PID(idx))
+    {
+        out.psi_errors++;
+        return;
+    }
+
+    unsigned int cnt = 0;
+    const uint8_t *ptr = NULL;
+
+    PMT_ITEMS_FOREACH(psi, ptr)
+    {
+        if (PMT_ITEM_GET_PID(psi, ptr) != OUT_ES_PID(idx)
+            || PMT_ITEM_GET_TYPE(psi, ptr) != 0x1B)
+        {
+            out.psi_errors++;
+            return;
+        }
+
+        cnt++;
+    }
+
+    if (cnt == 1)
+        out.pmt_ok[idx]++;
+    else
+        out.psi_errors++;
+}
+
+static
+void check_cc(const uint8_t *ts, unsigned int pid)
+{
+    const int cc = TS_GET_CC(ts);
+    const int last = out.cc[pid];
+    out.cc[pid] = cc;
+
+    if (last == -1 || TS_IS_DISCONT(ts))
+        return;
+
+    /* counter only moves on packets with payload */
+    const int expect = TS_IS_PAYLOAD(ts) ? (last + 1) & 0xF : last;
+    if (cc != expect)
+        out.cc_errors++;
+}
+
+static
+void check_pcr(const uint8_t *ts, unsigned int idx)
+{
+    const uint64_t pcr = TS_GET_PCR(ts);
+    const uint64_t now_idx = out.packets;
+
+    if (out.pcr[idx].cnt++ > 0 && !TS_IS_DISCONT(ts))
+    {
+        if (pcr <= out.pcr[idx].pcr)
+        {
+            out.pcr[idx].backwards++;
+            return;
+        }
+
+        const uint64_t gap = pcr - out.pcr[idx].pcr;
+        if (gap > out.pcr[idx].gap_max)
+            out.pcr[idx].gap_max = gap;
+
+        /* position in the output must match the PCR value */
+        const uint64_t expect = (now_idx - out.pcr[idx].idx)
+                                * TS_PACKET_BITS * TS_PCR_FREQ / MUX_BITRATE;
+
+        const uint64_t jitter = (gap > expect) ? gap - expect : expect - gap;
+        if (jitter > out.pcr[idx].jitter_max)
+            out.pcr[idx].jitter_max = jitter;
+    }
+
+    out.pcr[idx].pcr = pcr;
+    out.pcr[idx].idx = now_idx;
+}
+
+static
+void on_out_ts(void *arg, const uint8_t *ts)
+{
+    ASC_UNUSED(arg);
+
+    const uint64_t now = asc_utime();
+    if (out.packets == 0)
+        out.first_time = now;
+
+    out.last_time = now;
+
+    ck_assert(TS_IS_SYNC(ts));
+    const unsigned int pid = TS_GET_PID(ts);
+    out.pid_cnt[pid]++;
+
+    if (pid != TS_NULL_PID)
+        check_cc(ts, pid);
+
+    if (pid == 0x00)
+        ts_psi_mux(out.pat, ts, on_out_pat, NULL);
+
+    for (size_t i = 0; i < PROG_CNT; i++)
+    {
+        if (pid == OUT_PMT_PID(i))
+        {
+            ts_psi_mux(out.pmt[i], ts, on_out_pmt, (void *)(uintptr_t)i);
+        }
+        else if (pid == OUT_ES_PID(i))
+        {
+            if (TS_IS_PAYLOAD(ts))
+            {
+                const uint8_t *const payload = TS_GET_PAYLOAD(ts);
+                ck_assert(payload != NULL && *payload == 0xA0 + i);
+            }
+
+            if (TS_IS_PCR(ts))
+                check_pcr(ts, i);
+        }
+    }
+
+    out.packets++;
+}
+
+static
+void setup(void)
+{
+    lib_setup();
+
+    memset(&out, 0, sizeof(out));
+    for (size_t i = 0; i < TS_MAX_PIDS; i++)
+        out.cc[i] = -1;
+
+    out.pat = ts_psi_init(TS_TYPE_PAT, 0x00);
+    for (size_t i = 0; i < PROG_CNT; i++)
+        out.pmt[i] = ts_psi_init(TS_TYPE_PMT, OUT_PMT_PID(i));
+
+    const cbr_mux_config_t cfg = {
+        .name = "test",
+        .bitrate = MUX_BITRATE,
+        .delay = MUX_DELAY,
+        .buffer = MUX_BUFFER,
+        .pcr_interval = MUX_PCR_INTERVAL,
+        .tsid = 1,
+        .onid = 1,
+    };
+
+    mux = cbr_mux_init(&cfg, on_out_ts, NULL);
+    ck_assert(mux != NULL);
+
+    for (size_t i = 0; i < PROG_CNT; i++)
+    {
+        module_data_t *const mod = &src[i];
+
+        memset(mod, 0, sizeof(*mod));
+        module_stream_init(NULL, mod, NULL);
+        mod->idx = i;
+
+        mod->pat = ts_psi_init(TS_TYPE_PAT, 0x00);
+        PAT_INIT(mod->pat, 1 + i, 0);
+        PAT_ITEMS_APPEND(mod->pat, 1 + i, IN_PMT_PID);
+        PSI_SET_CRC32(mod->pat);
+
+        mod->pmt = ts_psi_init(TS_TYPE_PMT, IN_PMT_PID);
+        PMT_INIT(mod->pmt, 1 + i, 0, IN_ES_PID, NULL, 0);
+        PMT_ITEMS_APPEND(mod->pmt, 0x1B, IN_ES_PID, NULL, 0);
+        PSI_SET_CRC32(mod->pmt);
+
+        const cbr_mux_prog_config_t prog = {
+            .upstream = mod,
+            .pnr = 101 + i,
+            .service = "test",
+        };
+
+        cbr_mux_add(mux, &prog);
+    }
+
+    feed_tick = 0;
+    feed_start = asc_utime();
+    feed_timer = asc_timer_init(FEED_MSEC, on_feed, NULL);
+}
+
+static
+void teardown(void)
+{
+    ASC_FREE(feed_timer, asc_timer_destroy);
+    ASC_FREE(mux, cbr_mux_destroy);
+
+    for (size_t i = 0; i < PROG_CNT; i++)
+    {
+        module_stream_destroy(&src[i]);
+        ASC_FREE(src[i].pat, ts_psi_destroy);
+        ASC_FREE(src[i].pmt, ts_psi_destroy);
+        ASC_FREE(out.pmt[i], ts_psi_destroy);
+    }
+
+    ASC_FREE(out.pat, ts_psi_destroy);
+
+    lib_teardown();
+}
+
+static
+void run(void)
+{
+    asc_timer_t *const stop = asc_timer_one_shot(RUN_MSEC, on_stop, NULL);
+    ck_assert(stop != NULL);
+
+    const bool again = asc_main_loop_run();
+    ck_assert(again == false);
+}
+
+/* packets go out at the configured rate */
+START_TEST(constant_rate)
+{
+    run();
+
+    cbr_mux_stat_t stat;
+    cbr_mux_query(mux, &stat);
+    ck_assert(stat.programs == PROG_CNT);
+    ck_assert(stat.packets == out.packets);
+
+    /* both programs fit, leaving room for padding */
+    ck_assert(out.pid_cnt[TS_NULL_PID] > 0);
+    ck_assert(stat.nulls == out.pid_cnt[TS_NULL_PID]);
+
+    const uint64_t elapsed = out.last_time - out.first_time;
+    ck_assert(elapsed > 0);
+
+    const uint64_t rate = (out.packets - 1) * TS_PACKET_BITS
+                          * 1000000ULL / elapsed;
+
+    ck_assert_msg(rate > MUX_BITRATE * 95 / 100
+                  && rate < MUX_BITRATE * 105 / 100
+                  , "output rate %" PRIu64 " bps", rate);
+}
+END_TEST
+
+/* PCRs are monotonic, within the interval and match output position */
+START_TEST(pcr_timing)
+{
+    run();
+
+    cbr_mux_stat_t stat;
+    cbr_mux_query(mux, &stat);
+    ck_assert(stat.pcr_inserts > 0);
+
+    const uint64_t interval = MUX_PCR_INTERVAL * (TS_PCR_FREQ / 1000);
+
+    for (size_t i = 0; i < PROG_CNT; i++)
+    {
+        ck_assert(out.pcr[i].cnt >= RUN_MSEC / MUX_PCR_INTERVAL / 2);
+        ck_assert(out.pcr[i].backwards == 0);
+
+        ck_assert_msg(out.pcr[i].gap_max <= interval + PCR_ACCURACY
+                      , "program %zu: PCR gap %" PRIu64 " ticks"
+                      , i, out.pcr[i].gap_max);
+
+        /* one tick for rounding of slot times */
+        ck_assert_msg(out.pcr[i].jitter_max <= PCR_ACCURACY + 1
+                      , "program %zu: PCR jitter %" PRIu64 " ticks"
+                      , i, out.pcr[i].jitter_max);
+    }
+}
+END_TEST
+
+/* PIDs are moved into their ranges, tables are rebuilt accordingly */
+START_TEST(remap_tables)
+{
+    run();
+
+    ck_assert(out.psi_errors == 0);
+    ck_assert(out.pat_ok > 0);
+
+    ck_assert(out.pid_cnt[IN_PMT_PID] == 0);
+    ck_assert(out.pid_cnt[IN_ES_PID] == 0);
+
+    for (size_t i = 0; i < PROG_CNT; i++)
+    {
+        ck_assert(out.pmt_ok[i] > 0);
+        ck_assert(out.pid_cnt[OUT_ES_PID(i)] > 0);
+
+        cbr_mux_prog_stat_t stat;
+        ck_assert(cbr_mux_query_prog(mux, i, &stat));
+        ck_assert(stat.ready && stat.pnr == 101 + i);
+        ck_assert(stat.dropped == 0);
+    }
+
+    ck_assert(!cbr_mux_query_prog(mux, PROG_CNT, NULL));
+}
+END_TEST
+
+/* inserted PCR-only packets don't break continuity */
+START_TEST(cc_continuity)
+{
+    run();
+
+    cbr_mux_stat_t stat;
+    cbr_mux_query(mux, &stat);
+    ck_assert(stat.pcr_inserts > 0);
+
+    ck_assert(out.cc_errors == 0);
+}
+END_TEST
+
+Suite *cbr_mux(void)
+{
+    Suite *const s = suite_create("cbr/mux");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, constant_rate);
+    tcase_add_test(tc, pcr_timing);
+    tcase_add_test(tc, remap_tables);
+    tcase_add_test(tc, cc_continuity);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
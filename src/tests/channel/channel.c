@@ -0,0 +1,305 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/core/clock.h>
+#include <astra/luaapi/module.h>
+#include <astra/luaapi/state.h>
+#include <astra/luaapi/stream.h>
+#include <astra/mpegts/psi.h>
+
+#define L lua
+
+#define TSID 0x10
+#define ONID 0x20
+#define PNR 1
+#define SET_PNR 5
+#define PMT_PID 0x30
+
+/* channel option, milliseconds */
+#define EIT_INTERVAL 100
+
+MODULE_MANIFEST_DECL(channel);
+
+struct module_data_t
+{
+    STREAM_MODULE_DATA();
+};
+
+static module_data_t upstream;
+static module_data_t sink;
+
+/* EIT sections received from the channel */
+static ts_psi_t *out_eit = NULL;
+static unsigned int out_cnt = 0;
+static uint8_t out_last[PSI_MAX_SIZE];
+static size_t out_size = 0;
+
+static
+void on_out_eit(void *arg, ts_psi_t *psi)
+{
+    ASC_UNUSED(arg);
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    ck_assert(crc32 == PSI_CALC_CRC32(psi));
+    ck_assert(EIT_GET_PNR(psi) == SET_PNR);
+
+    memcpy(out_last, psi->buffer, psi->buffer_size);
+    out_size = psi->buffer_size;
+    out_cnt++;
+}
+
+static
+void on_sink_ts(module_data_t *mod, const uint8_t *ts)
+{
+    ASC_UNUSED(mod);
+
+    if (TS_GET_PID(ts) == 0x12)
+        ts_psi_mux(out_eit, ts, on_out_eit, NULL);
+}
+
+static
+void setup(void)
+{
+    lib_setup();
+
+    memset(&upstream, 0, sizeof(upstream));
+    module_stream_init(NULL, &upstream, NULL);
+
+    memset(&sink, 0, sizeof(sink));
+    module_stream_init(NULL, &sink, on_sink_ts);
+
+    out_eit = ts_psi_init(TS_TYPE_EIT, 0x12);
+    out_cnt = 0;
+    out_size = 0;
+
+    module_register(L, &MODULE_MANIFEST_SYMBOL(channel));
+    lua_pushlightuserdata(L, &upstream);
+    lua_setglobal(L, "test_upstream");
+
+    char script[256];
+    snprintf(script, sizeof(script)
+             , "test_channel = channel({ name = 'test'"
+               ", upstream = test_upstream, pnr = %d, set_pnr = %d"
+               ", eit_interval = %d })\n"
+               "return test_channel:stream()"
+             , PNR, SET_PNR, EIT_INTERVAL);
+
+    ck_assert_msg(luaL_dostring(L, script) == 0, lua_tostring(L, -1));
+    ck_assert(lua_islightuserdata(L, -1));
+
+    module_data_t *const channel = (module_data_t *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    module_stream_attach(channel, &sink);
+}
+
+static
+void teardown(void)
+{
+    module_stream_destroy(&sink);
+    module_stream_destroy(&upstream);
+    ASC_FREE(out_eit, ts_psi_destroy);
+
+    lib_teardown();
+}
+
+static
+void send_pat(unsigned int version)
+{
+    ts_psi_t *const psi = ts_psi_init(TS_TYPE_PAT, 0x00);
+
+    PAT_INIT(psi, TSID, version);
+    PAT_ITEMS_APPEND(psi, PNR, PMT_PID);
+    PSI_SET_CRC32(psi);
+    ts_psi_demux(psi, module_stream_send, &upstream);
+
+    ts_psi_destroy(psi);
+}
+
+/* EIT actual present/following with a single event */
+static
+ts_psi_t *make_eit(unsigned int version, unsigned int eid)
+{
+    ts_psi_t *const psi = ts_psi_init(TS_TYPE_EIT, 0x12);
+    uint8_t *const buf = psi->buffer;
+
+    buf[0] = 0x4E;
+    buf[1] = 0x80 | 0x70;
+    EIT_SET_PNR(psi, PNR);
+    buf[5] = 0x01;
+    PAT_SET_VERSION(psi, version);
+    buf[6] = 0x00;
+    buf[7] = 0x01;
+    buf[8] = TSID >> 8;
+    buf[9] = TSID & 0xFF;
+    buf[10] = ONID >> 8;
+    buf[11] = ONID & 0xFF;
+    buf[12] = 0x01;
+    buf[13] = 0x4E;
+
+    uint8_t *const item = &buf[14];
+    memset(item, 0, 12);
+    item[0] = eid >> 8;
+    item[1] = eid & 0xFF;
+    item[10] = 0x80; /* running, no descriptors */
+
+    psi->buffer_size = 14 + 12 + CRC32_SIZE;
+    PSI_SET_SIZE(psi);
+    PSI_SET_CRC32(psi);
+
+    return psi;
+}
+
+static
+void send_eit(ts_psi_t *psi)
+{
+    ts_psi_demux(psi, module_stream_send, &upstream);
+}
+
+static
+unsigned int out_eid(void)
+{
+    ck_assert(out_size >= 14 + 12 + CRC32_SIZE);
+    return (out_last[14] << 8) | out_last[15];
+}
+
+/* repeat with a known CRC is sent as stored, body isn't looked at */
+START_TEST(repeat_stored)
+{
+    send_pat(0);
+
+    ts_psi_t *const psi = make_eit(0, 0x100);
+    send_eit(psi);
+    ck_assert(out_cnt == 1);
+    ck_assert(out_eid() == 0x100);
+
+    uint8_t first[PSI_MAX_SIZE];
+    const size_t first_size = out_size;
+    memcpy(first, out_last, first_size);
+
+    asc_usleep((EIT_INTERVAL + 50) * 1000);
+
+    /* same CRC field, different event id */
+    ts_psi_t *const fake = make_eit(0, 0x200);
+    memcpy(&fake->buffer[fake->buffer_size - CRC32_SIZE]
+           , &psi->buffer[psi->buffer_size - CRC32_SIZE], CRC32_SIZE);
+    send_eit(fake);
+
+    ck_assert(out_cnt == 2);
+    ck_assert(out_size == first_size);
+    ck_assert(!memcmp(out_last, first, first_size));
+
+    ts_psi_destroy(fake);
+    ts_psi_destroy(psi);
+}
+END_TEST
+
+/* new version goes out right away and replaces the cached one */
+START_TEST(new_version)
+{
+    send_pat(0);
+
+    ts_psi_t *const v0 = make_eit(0, 0x100);
+    ts_psi_t *const v1 = make_eit(1, 0x101);
+
+    send_eit(v0);
+    ck_assert(out_cnt == 1);
+    ck_assert(out_eid() == 0x100);
+
+    send_eit(v1);
+    ck_assert(out_cnt == 2);
+    ck_assert(out_eid() == 0x101);
+
+    /* cached entry is now v1 */
+    send_eit(v1);
+    ck_assert(out_cnt == 2);
+
+    asc_usleep((EIT_INTERVAL + 50) * 1000);
+
+    send_eit(v1);
+    ck_assert(out_cnt == 3);
+    ck_assert(out_eid() == 0x101);
+
+    ts_psi_destroy(v1);
+    ts_psi_destroy(v0);
+}
+END_TEST
+
+/* repeats are dropped until eit_interval elapses */
+START_TEST(repeat_interval)
+{
+    send_pat(0);
+
+    ts_psi_t *const psi = make_eit(0, 0x100);
+
+    send_eit(psi);
+    ck_assert(out_cnt == 1);
+
+    for (unsigned int i = 0; i < 10; i++)
+        send_eit(psi);
+
+    ck_assert(out_cnt == 1);
+
+    asc_usleep((EIT_INTERVAL + 50) * 1000);
+
+    send_eit(psi);
+    send_eit(psi);
+    ck_assert(out_cnt == 2);
+
+    ts_psi_destroy(psi);
+}
+END_TEST
+
+/* PAT change reloads the stream and empties the cache */
+START_TEST(reload_flush)
+{
+    send_pat(0);
+
+    ts_psi_t *const psi = make_eit(0, 0x100);
+
+    send_eit(psi);
+    send_eit(psi);
+    ck_assert(out_cnt == 1);
+
+    send_pat(1);
+
+    send_eit(psi);
+    ck_assert(out_cnt == 2);
+
+    send_eit(psi);
+    ck_assert(out_cnt == 2);
+
+    ts_psi_destroy(psi);
+}
+END_TEST
+
+Suite *channel_channel(void)
+{
+    Suite *const s = suite_create("channel/channel");
+
+    TCase *const tc = tcase_create("eit_cache");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, repeat_stored);
+    tcase_add_test(tc, new_version);
+    tcase_add_test(tc, repeat_interval);
+    tcase_add_test(tc, reload_flush);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
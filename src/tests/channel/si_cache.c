@@ -0,0 +1,325 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <stream/channel/si_cache.h>
+
+#define TSID 0x10
+#define ONID 0x20
+
+struct module_data_t
+{
+    STREAM_MODULE_DATA();
+
+    /* pid membership requested by the cache */
+    unsigned int joins[TS_MAX_PIDS];
+    unsigned int leaves[TS_MAX_PIDS];
+};
+
+static module_data_t upstream;
+
+typedef struct
+{
+    unsigned int pnr;
+
+    unsigned int sdt_cnt;
+    unsigned int sdt_items;
+    unsigned int sdt_sid;
+
+    unsigned int eit_cnt;
+    unsigned int eit_pnr;
+    unsigned int eit_other;
+} test_sub_t;
+
+static
+void on_join(module_data_t *mod, uint16_t pid)
+{
+    mod->joins[pid]++;
+}
+
+static
+void on_leave(module_data_t *mod, uint16_t pid)
+{
+    mod->leaves[pid]++;
+}
+
+static
+void upstream_init(void)
+{
+    memset(&upstream, 0, sizeof(upstream));
+    module_stream_init(NULL, &upstream, NULL);
+    module_demux_set(&upstream, on_join, on_leave);
+}
+
+static
+void setup(void)
+{
+    lib_setup();
+    upstream_init();
+}
+
+static
+void teardown(void)
+{
+    module_stream_destroy(&upstream);
+    lib_teardown();
+}
+
+static
+void on_sdt(void *arg, ts_psi_t *psi)
+{
+    test_sub_t *const t = (test_sub_t *)arg;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    ck_assert(crc32 == PSI_CALC_CRC32(psi));
+    ck_assert(SDT_GET_TSID(psi) == TSID);
+    ck_assert(SDT_GET_SECTION_NUMBER(psi) == 0);
+    ck_assert(SDT_GET_LAST_SECTION_NUMBER(psi) == 0);
+
+    t->sdt_cnt++;
+    t->sdt_items = 0;
+
+    const uint8_t *ptr = NULL;
+    SDT_ITEMS_FOREACH(psi, ptr)
+    {
+        t->sdt_sid = SDT_ITEM_GET_SID(psi, ptr);
+        t->sdt_items++;
+    }
+}
+
+static
+void on_eit(void *arg, ts_psi_t *psi)
+{
+    test_sub_t *const t = (test_sub_t *)arg;
+
+    t->eit_cnt++;
+    t->eit_pnr = EIT_GET_PNR(psi);
+
+    if (t->eit_pnr != t->pnr)
+        t->eit_other++;
+}
+
+static
+si_cache_sub_t *subscribe(test_sub_t *t, unsigned int pnr)
+{
+    memset(t, 0, sizeof(*t));
+    t->pnr = pnr;
+
+    si_cache_sub_t *const sub =
+        si_cache_subscribe(&upstream, pnr, on_sdt, on_eit, t);
+    ck_assert(sub != NULL);
+
+    return sub;
+}
+
+/* SDT actual with one section listing given services */
+static
+void send_sdt(const unsigned int *sids, size_t cnt, unsigned int version)
+{
+    ts_psi_t *const psi = ts_psi_init(TS_TYPE_SDT, 0x11);
+    uint8_t *const buf = psi->buffer;
+
+    buf[0] = 0x42;
+    buf[1] = 0x80 | 0x70;
+    SDT_SET_TSID(psi, TSID);
+    buf[5] = 0x01;
+    PAT_SET_VERSION(psi, version);
+    buf[6] = 0x00;
+    buf[7] = 0x00;
+    buf[8] = ONID >> 8;
+    buf[9] = ONID & 0xFF;
+    buf[10] = 0xFF;
+
+    size_t skip = 11;
+    for (size_t i = 0; i < cnt; i++)
+    {
+        uint8_t *const item = &buf[skip];
+
+        item[0] = sids[i] >> 8;
+        item[1] = sids[i] & 0xFF;
+        item[2] = 0xFC;
+        item[3] = 0x80; /* running, no descriptors */
+        item[4] = 0x00;
+        skip += 5;
+    }
+
+    psi->buffer_size = skip + CRC32_SIZE;
+    PSI_SET_SIZE(psi);
+    PSI_SET_CRC32(psi);
+
+    ts_psi_demux(psi, module_stream_send, &upstream);
+    ts_psi_destroy(psi);
+}
+
+/* EIT actual present/following, no events */
+static
+void send_eit(unsigned int pnr)
+{
+    ts_psi_t *const psi = ts_psi_init(TS_TYPE_EIT, 0x12);
+    uint8_t *const buf = psi->buffer;
+
+    buf[0] = 0x4E;
+    buf[1] = 0x80 | 0x70;
+    EIT_SET_PNR(psi, pnr);
+    buf[5] = 0x01;
+    buf[6] = 0x00;
+    buf[7] = 0x01;
+    buf[8] = TSID >> 8;
+    buf[9] = TSID & 0xFF;
+    buf[10] = ONID >> 8;
+    buf[11] = ONID & 0xFF;
+    buf[12] = 0x01;
+    buf[13] = 0x4E;
+
+    psi->buffer_size = 14 + CRC32_SIZE;
+    PSI_SET_SIZE(psi);
+    PSI_SET_CRC32(psi);
+
+    ts_psi_demux(psi, module_stream_send, &upstream);
+    ts_psi_destroy(psi);
+}
+
+/* each subscriber gets its own service only */
+START_TEST(split_services)
+{
+    test_sub_t a, b;
+    si_cache_sub_t *const sub_a = subscribe(&a, 1);
+    si_cache_sub_t *const sub_b = subscribe(&b, 2);
+
+    /* one cache, one membership */
+    ck_assert(si_cache_upstream(sub_a) == &upstream);
+    ck_assert(si_cache_upstream(sub_b) == &upstream);
+    ck_assert(upstream.joins[0x11] == 1);
+    ck_assert(upstream.joins[0x12] == 1);
+
+    static const unsigned int sids[] = { 3, 2, 1 };
+    send_sdt(sids, ASC_ARRAY_SIZE(sids), 0);
+
+    ck_assert(a.sdt_cnt == 1 && a.sdt_items == 1 && a.sdt_sid == 1);
+    ck_assert(b.sdt_cnt == 1 && b.sdt_items == 1 && b.sdt_sid == 2);
+
+    for (unsigned int pnr = 1; pnr <= 3; pnr++)
+        send_eit(pnr);
+
+    ck_assert(a.eit_cnt == 1 && a.eit_pnr == 1);
+    ck_assert(b.eit_cnt == 1 && b.eit_pnr == 2);
+    ck_assert(a.eit_other == 0 && b.eit_other == 0);
+
+    /* service that went away from SDT isn't delivered */
+    static const unsigned int sids_b[] = { 2 };
+    send_sdt(sids_b, ASC_ARRAY_SIZE(sids_b), 1);
+
+    ck_assert(a.sdt_cnt == 1);
+    ck_assert(b.sdt_cnt == 2 && b.sdt_items == 1 && b.sdt_sid == 2);
+
+    si_cache_unsubscribe(sub_a);
+    si_cache_unsubscribe(sub_b);
+}
+END_TEST
+
+/* last subscriber leaving destroys the cache */
+START_TEST(teardown_cache)
+{
+    test_sub_t a, b;
+    si_cache_sub_t *const sub_a = subscribe(&a, 1);
+    si_cache_sub_t *const sub_b = subscribe(&b, 1);
+
+    si_cache_unsubscribe(sub_a);
+    ck_assert(upstream.leaves[0x11] == 0);
+    ck_assert(upstream.leaves[0x12] == 0);
+
+    /* remaining subscriber still gets sections */
+    static const unsigned int sids[] = { 1 };
+    send_sdt(sids, ASC_ARRAY_SIZE(sids), 0);
+    send_eit(1);
+
+    ck_assert(a.sdt_cnt == 0 && a.eit_cnt == 0);
+    ck_assert(b.sdt_cnt == 1 && b.eit_cnt == 1);
+
+    si_cache_unsubscribe(sub_b);
+    ck_assert(upstream.leaves[0x11] == 1);
+    ck_assert(upstream.leaves[0x12] == 1);
+
+    /* nothing is attached to the upstream anymore */
+    send_sdt(sids, ASC_ARRAY_SIZE(sids), 1);
+    send_eit(1);
+    ck_assert(b.sdt_cnt == 1 && b.eit_cnt == 1);
+
+    /* next subscription starts over */
+    si_cache_sub_t *const sub_c = subscribe(&a, 1);
+    ck_assert(upstream.joins[0x11] == 2);
+    ck_assert(upstream.joins[0x12] == 2);
+
+    send_sdt(sids, ASC_ARRAY_SIZE(sids), 1);
+    ck_assert(a.sdt_cnt == 1);
+
+    si_cache_unsubscribe(sub_c);
+}
+END_TEST
+
+/* orphaned cache isn't reused for a new upstream */
+START_TEST(upstream_destroyed)
+{
+    test_sub_t a, b;
+    si_cache_sub_t *const sub_a = subscribe(&a, 1);
+
+    module_stream_destroy(&upstream);
+    ck_assert(si_cache_upstream(sub_a) == NULL);
+
+    /* new module at the same address */
+    upstream_init();
+
+    si_cache_sub_t *const sub_b = subscribe(&b, 1);
+    ck_assert(si_cache_upstream(sub_b) == &upstream);
+    ck_assert(si_cache_upstream(sub_a) == NULL);
+    ck_assert(upstream.joins[0x11] == 1);
+    ck_assert(upstream.joins[0x12] == 1);
+
+    static const unsigned int sids[] = { 1 };
+    send_sdt(sids, ASC_ARRAY_SIZE(sids), 0);
+    send_eit(1);
+
+    ck_assert(a.sdt_cnt == 0 && a.eit_cnt == 0);
+    ck_assert(b.sdt_cnt == 1 && b.eit_cnt == 1);
+
+    /* dropping the orphan leaves the new cache alone */
+    si_cache_unsubscribe(sub_a);
+    ck_assert(upstream.leaves[0x11] == 0);
+
+    send_eit(1);
+    ck_assert(b.eit_cnt == 2);
+
+    si_cache_unsubscribe(sub_b);
+    ck_assert(upstream.leaves[0x11] == 1);
+    ck_assert(upstream.leaves[0x12] == 1);
+}
+END_TEST
+
+Suite *channel_si_cache(void)
+{
+    Suite *const s = suite_create("channel/si_cache");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, split_services);
+    tcase_add_test(tc, teardown_cache);
+    tcase_add_test(tc, upstream_destroyed);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
@@ -0,0 +1,180 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/core/block.h>
+
+#define BLOCK_PACKETS 7
+#define BLOCK_SIZE (BLOCK_PACKETS * TS_PACKET_SIZE)
+
+static void fill_block(asc_block_t *block, size_t cnt, uint8_t seed)
+{
+    block->cnt = cnt;
+    for (size_t i = 0; i < cnt; i++)
+    {
+        uint8_t *const ts = &block->data[i * TS_PACKET_SIZE];
+
+        memset(ts, seed + i, TS_PACKET_SIZE);
+        ts[0] = 0x47;
+    }
+}
+
+/* idle blocks are reused instead of being freed */
+START_TEST(reuse)
+{
+    asc_block_pool_t *const pool = asc_block_pool_init(BLOCK_SIZE, 2);
+    asc_block_stats_t st;
+
+    asc_block_t *const a = asc_block_alloc(pool);
+    asc_block_t *const b = asc_block_alloc(pool);
+    asc_block_t *const c = asc_block_alloc(pool);
+
+    ck_assert(a->refcnt == 1 && a->cnt == 0);
+    ck_assert(a->data == a->buffer && a->size == BLOCK_SIZE);
+    ck_assert(asc_block_space(a) == BLOCK_SIZE);
+
+    fill_block(a, 3, 0);
+    ck_assert(asc_block_space(a) == BLOCK_SIZE - 3 * TS_PACKET_SIZE);
+
+    asc_block_pool_stats(pool, &st);
+    ck_assert(st.allocs == 3 && st.reuses == 0 && st.active == 3);
+
+    /* only two of the three fit into the idle list */
+    asc_block_release(a);
+    asc_block_release(b);
+    asc_block_release(c);
+
+    asc_block_pool_stats(pool, &st);
+    ck_assert(st.active == 0);
+
+    asc_block_t *const d = asc_block_alloc(pool);
+    ck_assert(d == b);
+    ck_assert(d->cnt == 0 && d->data == d->buffer && d->refcnt == 1);
+
+    asc_block_t *const e = asc_block_alloc(pool);
+    ck_assert(e == a);
+
+    asc_block_t *const f = asc_block_alloc(pool);
+
+    asc_block_pool_stats(pool, &st);
+    ck_assert(st.allocs == 4 && st.reuses == 2 && st.active == 3);
+
+    asc_block_release(d);
+    asc_block_release(e);
+    asc_block_release(f);
+    asc_block_pool_destroy(pool);
+}
+END_TEST
+
+/* copy on write only happens for shared blocks */
+START_TEST(cow)
+{
+    asc_block_pool_t *const pool = asc_block_pool_init(BLOCK_SIZE, 4);
+    asc_block_stats_t st;
+
+    asc_block_t *a = asc_block_alloc(pool);
+    a->data = &a->buffer[12]; /* e.g. RTP header */
+    fill_block(a, 2, 0x10);
+
+    /* sole owner gets the same block back */
+    ck_assert(asc_block_writable(a) == a);
+
+    /* shared: writer gets a private copy */
+    asc_block_t *const ref = asc_block_retain(a);
+    ck_assert(a->refcnt == 2);
+
+    asc_block_t *const copy = asc_block_writable(a);
+    ck_assert(copy != ref);
+    ck_assert(ref->refcnt == 1 && copy->refcnt == 1);
+    ck_assert(copy->cnt == 2);
+    ck_assert(copy->data == &copy->buffer[12]);
+    ck_assert(!memcmp(copy->data, ref->data, 2 * TS_PACKET_SIZE));
+
+    copy->data[1] = 0xff;
+    ck_assert(ref->data[1] == 0x10);
+
+    asc_block_pool_stats(pool, &st);
+    ck_assert(st.copies == 1 && st.active == 2);
+
+    asc_block_release(copy);
+    asc_block_release(ref);
+    asc_block_pool_destroy(pool);
+}
+END_TEST
+
+/* blocks outlive their pool */
+START_TEST(late_release)
+{
+    asc_block_pool_t *const pool = asc_block_pool_init(BLOCK_SIZE, 4);
+
+    asc_block_t *const idle = asc_block_alloc(pool);
+    asc_block_t *const a = asc_block_alloc(pool);
+    fill_block(a, BLOCK_PACKETS, 0);
+    asc_block_release(idle);
+
+    asc_block_t *const b = asc_block_retain(a);
+    asc_block_pool_destroy(pool);
+
+    /* shared block can still be made writable */
+    asc_block_t *const c = asc_block_writable(b);
+    ck_assert(c != a);
+    ck_assert(c->cnt == BLOCK_PACKETS);
+
+    asc_block_release(a);
+    asc_block_release(c);
+}
+END_TEST
+
+/* release more than once */
+START_TEST(double_release)
+{
+    asc_block_pool_t *const pool = asc_block_pool_init(BLOCK_SIZE, 4);
+
+    asc_block_t *const a = asc_block_alloc(pool);
+    asc_block_retain(a);
+    asc_block_release(a);
+    asc_block_release(a);
+    asc_block_release(a); /* will abort */
+}
+END_TEST
+
+Suite *core_block(void)
+{
+    Suite *const s = suite_create("core/block");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, lib_setup, lib_teardown);
+
+    tcase_add_test(tc, reuse);
+    tcase_add_test(tc, cow);
+    tcase_add_test(tc, late_release);
+
+    suite_add_tcase(s, tc);
+
+    if (can_fork != CK_NOFORK)
+    {
+        TCase *const tc_f = tcase_create("fail");
+        tcase_add_checked_fixture(tc_f, lib_setup, lib_teardown);
+        tcase_add_exit_test(tc_f, double_release, ASC_EXIT_ABORT);
+        suite_add_tcase(s, tc_f);
+    }
+
+    return s;
+}
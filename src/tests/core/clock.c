@@ -59,6 +59,21 @@ START_TEST(u_sleep)
 }
 END_TEST
 
+/* cached event loop time */
+START_TEST(loop_time)
+{
+    const uint64_t first = asc_loop_time_update();
+    ck_assert(first != 0);
+
+    asc_usleep(2000);
+    ck_assert(asc_loop_time() == first);
+
+    const uint64_t second = asc_loop_time_update();
+    ck_assert(second > first);
+    ck_assert(asc_loop_time() == second);
+}
+END_TEST
+
 #ifndef _WIN32
 START_TEST(rtc_time)
 {
@@ -89,6 +104,7 @@ Suite *core_clock(void)
     TCase *const tc = tcase_create("default");
     tcase_add_test(tc, u_time);
     tcase_add_test(tc, u_sleep);
+    tcase_add_test(tc, loop_time);
 #ifndef _WIN32
     tcase_add_test(tc, rtc_time);
 #endif
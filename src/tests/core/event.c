@@ -1432,6 +1432,172 @@ START_TEST(series_of_tubes)
 }
 END_TEST
 
+/* close another ready event from within a callback */
+#define SIBLING_COUNT 8
+
+typedef struct
+{
+    int fd;
+    int tx;
+    asc_event_t *ev;
+} sibling_t;
+
+static sibling_t siblings[SIBLING_COUNT];
+static unsigned int sibling_calls;
+
+static void sibling_on_read(void *arg)
+{
+    sibling_t *const s = (sibling_t *)arg;
+    sibling_calls++;
+
+    /* close everyone including ourselves */
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(siblings); i++)
+        ASC_FREE(siblings[i].ev, asc_event_close);
+
+    ck_assert(s->ev == NULL);
+    asc_main_loop_shutdown();
+}
+
+START_TEST(close_sibling)
+{
+    /* make all sockets readable at once */
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(siblings); i++)
+    {
+        unsigned short port = 0;
+        siblings[i].fd = sock_open(SOCK_DGRAM, &port);
+        siblings[i].tx = sock_open(SOCK_DGRAM, NULL);
+        sock_connect(siblings[i].tx, port);
+
+        siblings[i].ev = asc_event_init(siblings[i].fd, &siblings[i]);
+        asc_event_set_on_read(siblings[i].ev, sibling_on_read);
+        asc_event_set_on_error(siblings[i].ev, on_fail_event);
+
+        ck_assert(send(siblings[i].tx, "x", 1, 0) == 1);
+    }
+
+    sibling_calls = 0;
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(sibling_calls == 1);
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(siblings); i++)
+    {
+        sock_close(siblings[i].fd);
+        sock_close(siblings[i].tx);
+    }
+}
+END_TEST
+
+/* open and close many events while others are waiting for dispatch */
+#define CHURN_READY 8
+#define CHURN_EVENTS 256
+
+static sibling_t churn[CHURN_READY];
+static unsigned int churn_calls;
+
+static void churn_on_read(void *arg)
+{
+    sibling_t *const s = (sibling_t *)arg;
+    churn_calls++;
+
+    char buf[16];
+    ck_assert(recv(s->fd, buf, sizeof(buf), 0) == 1);
+
+    /* grow the backend's lists, then shrink them again */
+    int fds[CHURN_EVENTS];
+    asc_event_t *evs[CHURN_EVENTS];
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(evs); i++)
+    {
+        fds[i] = sock_open(SOCK_DGRAM, NULL);
+        evs[i] = asc_event_init(fds[i], NULL);
+        asc_event_set_on_error(evs[i], on_fail_event);
+    }
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(evs); i++)
+    {
+        asc_event_close(evs[i]);
+        sock_close(fds[i]);
+    }
+
+    if (churn_calls == ASC_ARRAY_SIZE(churn))
+        asc_main_loop_shutdown();
+}
+
+START_TEST(churn_in_callback)
+{
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(churn); i++)
+    {
+        unsigned short port = 0;
+        churn[i].fd = sock_open(SOCK_DGRAM, &port);
+        churn[i].tx = sock_open(SOCK_DGRAM, NULL);
+        sock_connect(churn[i].tx, port);
+
+        churn[i].ev = asc_event_init(churn[i].fd, &churn[i]);
+        asc_event_set_on_read(churn[i].ev, churn_on_read);
+        asc_event_set_on_error(churn[i].ev, on_fail_event);
+
+        ck_assert(send(churn[i].tx, "x", 1, 0) == 1);
+    }
+
+    churn_calls = 0;
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(churn_calls == ASC_ARRAY_SIZE(churn));
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(churn); i++)
+    {
+        asc_event_close(churn[i].ev);
+        sock_close(churn[i].fd);
+        sock_close(churn[i].tx);
+    }
+}
+END_TEST
+
+/* edge-triggered event with a callback draining the socket */
+#define EDGE_DATAGRAMS 100
+
+static int edge_fd;
+static asc_event_t *edge_ev;
+static unsigned int edge_rx;
+
+static void edge_on_read(void *arg)
+{
+    ASC_UNUSED(arg);
+
+    char buf[16];
+    while (recv(edge_fd, buf, sizeof(buf), 0) > 0)
+        edge_rx++;
+
+    ck_assert(sock_blocked(sock_err()));
+
+    if (edge_rx >= EDGE_DATAGRAMS)
+        asc_main_loop_shutdown();
+}
+
+START_TEST(edge_triggered)
+{
+    unsigned short port = 0;
+    edge_fd = sock_open(SOCK_DGRAM, &port);
+    const int tx = sock_open(SOCK_DGRAM, NULL);
+    sock_connect(tx, port);
+
+    edge_rx = 0;
+    edge_ev = asc_event_init(edge_fd, NULL);
+    asc_event_set_on_read(edge_ev, edge_on_read);
+    asc_event_set_on_error(edge_ev, on_fail_event);
+    asc_event_set_edge(edge_ev, true);
+
+    for (size_t i = 0; i < EDGE_DATAGRAMS; i++)
+        ck_assert(send(tx, "x", 1, 0) == 1);
+
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(edge_rx == EDGE_DATAGRAMS);
+
+    ASC_FREE(edge_ev, asc_event_close);
+    sock_close(edge_fd);
+    sock_close(tx);
+}
+END_TEST
+
 /* on_error handler that doesn't close the event */
 static void nce_on_error(void *arg)
 {
@@ -1462,6 +1628,9 @@ Suite *core_event(void)
     tcase_add_test(tc, tcp_oob);
     tcase_add_test(tc, udp_sockets);
     tcase_add_test(tc, series_of_tubes);
+    tcase_add_test(tc, close_sibling);
+    tcase_add_test(tc, churn_in_callback);
+    tcase_add_test(tc, edge_triggered);
 
     if (can_fork != CK_NOFORK)
     {
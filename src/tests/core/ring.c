@@ -0,0 +1,382 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/core/mainloop.h>
+#include <astra/core/thread.h>
+#include <astra/core/ring.h>
+
+static void make_packet(uint8_t *ts, uint32_t seq)
+{
+    memset(ts, 0xff, TS_PACKET_SIZE);
+
+    ts[0] = 0x47;
+    ts[4] = (seq >> 24) & 0xff;
+    ts[5] = (seq >> 16) & 0xff;
+    ts[6] = (seq >> 8) & 0xff;
+    ts[7] = seq & 0xff;
+}
+
+static uint32_t packet_seq(const uint8_t *ts)
+{
+    ck_assert(ts[0] == 0x47);
+    return (ts[4] << 24) | (ts[5] << 16) | (ts[6] << 8) | ts[7];
+}
+
+static void on_data_nop(void *arg)
+{
+    ASC_UNUSED(arg);
+}
+
+/* size rounding, push and peek with wrap around */
+START_TEST(push_peek)
+{
+    asc_ring_t *const ring = asc_ring_init(100, on_data_nop, NULL);
+    ck_assert(ring != NULL);
+    ck_assert(asc_ring_size(ring) == 128);
+
+    uint8_t ts[TS_PACKET_SIZE];
+    const uint8_t *ptr = NULL;
+    uint32_t seq = 0, expect = 0;
+
+    ck_assert(asc_ring_peek(ring, &ptr) == 0);
+
+    /* move read position close to the end */
+    for (size_t i = 0; i < 120; i++)
+    {
+        make_packet(ts, seq++);
+        ck_assert(asc_ring_push(ring, ts) == true);
+    }
+
+    size_t cnt = asc_ring_peek(ring, &ptr);
+    ck_assert(cnt == 120);
+    for (size_t i = 0; i < cnt; i++)
+        ck_assert(packet_seq(&ptr[i * TS_PACKET_SIZE]) == expect++);
+
+    asc_ring_skip(ring, cnt);
+
+    /* wrap around; should be returned in two parts */
+    for (size_t i = 0; i < 20; i++)
+    {
+        make_packet(ts, seq++);
+        ck_assert(asc_ring_push(ring, ts) == true);
+    }
+
+    cnt = asc_ring_peek(ring, &ptr);
+    ck_assert(cnt == 8);
+    for (size_t i = 0; i < cnt; i++)
+        ck_assert(packet_seq(&ptr[i * TS_PACKET_SIZE]) == expect++);
+
+    asc_ring_skip(ring, cnt);
+
+    cnt = asc_ring_peek(ring, &ptr);
+    ck_assert(cnt == 12);
+    for (size_t i = 0; i < cnt; i++)
+        ck_assert(packet_seq(&ptr[i * TS_PACKET_SIZE]) == expect++);
+
+    asc_ring_skip(ring, cnt);
+    ck_assert(asc_ring_peek(ring, &ptr) == 0);
+
+    asc_ring_stats_t st;
+    asc_ring_stats(ring, &st);
+    ck_assert(st.pushed == 140);
+    ck_assert(st.overruns == 0);
+
+    asc_ring_destroy(ring);
+}
+END_TEST
+
+/* count packets that didn't fit */
+START_TEST(overrun)
+{
+    asc_ring_t *const ring = asc_ring_init(64, on_data_nop, NULL);
+    ck_assert(ring != NULL);
+
+    uint8_t ts[TS_PACKET_SIZE];
+    for (size_t i = 0; i < 100; i++)
+    {
+        make_packet(ts, i);
+        ck_assert(asc_ring_push(ring, ts) == (i < 64));
+    }
+
+    asc_ring_stats_t st;
+    asc_ring_stats(ring, &st);
+    ck_assert(st.pushed == 64);
+    ck_assert(st.overruns == 36);
+
+    /* oldest packets are kept */
+    const uint8_t *ptr = NULL;
+    ck_assert(asc_ring_peek(ring, &ptr) == 64);
+    ck_assert(packet_seq(ptr) == 0);
+
+    asc_ring_flush(ring);
+    ck_assert(asc_ring_peek(ring, &ptr) == 0);
+    ck_assert(asc_ring_push(ring, ts) == true);
+
+    asc_ring_destroy(ring);
+}
+END_TEST
+
+/* multiple notifications result in a single callback */
+static asc_ring_t *coalesce_ring;
+static unsigned int coalesce_calls;
+
+static void coalesce_on_data(void *arg)
+{
+    ASC_UNUSED(arg);
+
+    const uint8_t *ptr;
+    size_t cnt;
+
+    coalesce_calls++;
+    while ((cnt = asc_ring_peek(coalesce_ring, &ptr)) > 0)
+        asc_ring_skip(coalesce_ring, cnt);
+}
+
+static void coalesce_stop(void *arg)
+{
+    ASC_UNUSED(arg);
+    asc_main_loop_shutdown();
+}
+
+START_TEST(coalesce)
+{
+    coalesce_ring = asc_ring_init(1024, coalesce_on_data, NULL);
+    coalesce_calls = 0;
+
+    uint8_t ts[TS_PACKET_SIZE];
+    make_packet(ts, 0);
+
+    /* no wake up without data */
+    asc_ring_notify(coalesce_ring);
+
+    ck_assert(asc_ring_push(coalesce_ring, ts) == true);
+    asc_ring_notify(coalesce_ring);
+    asc_ring_notify(coalesce_ring);
+    ck_assert(asc_ring_push(coalesce_ring, ts) == true);
+    asc_ring_notify(coalesce_ring);
+
+    asc_job_queue(NULL, coalesce_stop, NULL);
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(coalesce_calls == 1);
+
+    /* callback re-arms notification */
+    ck_assert(asc_ring_push(coalesce_ring, ts) == true);
+    asc_ring_notify(coalesce_ring);
+
+    asc_job_queue(NULL, coalesce_stop, NULL);
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(coalesce_calls == 2);
+
+    /* automatic notification when ring fills up */
+    for (size_t i = 0; i < 1024 / 4; i++)
+        ck_assert(asc_ring_push(coalesce_ring, ts) == true);
+
+    asc_job_queue(NULL, coalesce_stop, NULL);
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(coalesce_calls == 3);
+
+    asc_ring_stats_t st;
+    asc_ring_stats(coalesce_ring, &st);
+    ck_assert(st.wakeups == 3);
+
+    ASC_FREE(coalesce_ring, asc_ring_destroy);
+}
+END_TEST
+
+/* threaded producer, main loop consumer */
+#define SPSC_PACKETS (1000 * 1000)
+#define SPSC_RING_SIZE 4096
+
+typedef struct
+{
+    asc_ring_t *ring;
+    asc_thread_t *thread;
+
+    uint32_t rx_seq;
+    unsigned int calls;
+} spsc_test_t;
+
+static void spsc_on_data(void *arg)
+{
+    spsc_test_t *const t = (spsc_test_t *)arg;
+    const uint8_t *ptr;
+    size_t cnt;
+
+    t->calls++;
+    while ((cnt = asc_ring_peek(t->ring, &ptr)) > 0)
+    {
+        for (size_t i = 0; i < cnt; i++)
+            ck_assert(packet_seq(&ptr[i * TS_PACKET_SIZE]) == t->rx_seq++);
+
+        asc_ring_skip(t->ring, cnt);
+    }
+
+    if (t->rx_seq == SPSC_PACKETS)
+        asc_main_loop_shutdown();
+}
+
+static void spsc_proc(void *arg)
+{
+    spsc_test_t *const t = (spsc_test_t *)arg;
+    uint8_t ts[TS_PACKET_SIZE];
+
+    for (uint32_t seq = 0; seq < SPSC_PACKETS; seq++)
+    {
+        make_packet(ts, seq);
+        while (!asc_ring_push(t->ring, ts))
+        {
+            asc_ring_notify(t->ring);
+            asc_usleep(100);
+        }
+
+        if ((seq % 64) == 0)
+            asc_ring_notify(t->ring);
+    }
+
+    asc_ring_notify(t->ring);
+}
+
+static void spsc_close(void *arg)
+{
+    spsc_test_t *const t = (spsc_test_t *)arg;
+    ASC_FREE(t->thread, asc_thread_join);
+}
+
+START_TEST(spsc)
+{
+    spsc_test_t t;
+    memset(&t, 0, sizeof(t));
+
+    asc_wake_open();
+    t.ring = asc_ring_init(SPSC_RING_SIZE, spsc_on_data, &t);
+
+    const uint64_t start = asc_utime();
+    t.thread = asc_thread_init(&t, spsc_proc, spsc_close);
+    ck_assert(asc_main_loop_run() == false);
+    const uint64_t bench = asc_utime() - start;
+
+    ASC_FREE(t.thread, asc_thread_join);
+    ck_assert(t.rx_seq == SPSC_PACKETS);
+
+    asc_ring_stats_t st;
+    asc_ring_stats(t.ring, &st);
+    ck_assert(st.pushed == SPSC_PACKETS);
+    ck_assert(st.wakeups == t.calls);
+    ck_assert(st.wakeups < SPSC_PACKETS / 64);
+
+    asc_log_info("ring: %u packets in %" PRIu64 "us, %u wake ups, "
+                 "%" PRIu64 " overruns, %.1f Mbit/s"
+                 , SPSC_PACKETS, bench, t.calls, st.overruns
+                 , (SPSC_PACKETS * TS_PACKET_SIZE * 8.0) / bench);
+
+    asc_ring_destroy(t.ring);
+    asc_wake_close();
+}
+END_TEST
+
+/* slow producer notifying on its own schedule */
+#define PACED_PACKETS 2000
+#define PACED_RING_SIZE 1024
+#define PACED_NOTIFY 5000 /* 5ms */
+
+static void paced_proc(void *arg)
+{
+    spsc_test_t *const t = (spsc_test_t *)arg;
+    uint8_t ts[TS_PACKET_SIZE];
+    uint64_t last = asc_utime();
+
+    for (uint32_t seq = 0; seq < PACED_PACKETS; seq++)
+    {
+        make_packet(ts, seq);
+        ck_assert(asc_ring_push(t->ring, ts) == true);
+        asc_usleep(100);
+
+        const uint64_t now = asc_utime();
+        if (now - last >= PACED_NOTIFY)
+        {
+            last = now;
+            asc_ring_notify(t->ring);
+        }
+    }
+
+    asc_ring_notify(t->ring);
+}
+
+static void paced_on_data(void *arg)
+{
+    spsc_test_t *const t = (spsc_test_t *)arg;
+    const uint8_t *ptr;
+    size_t cnt;
+
+    t->calls++;
+    while ((cnt = asc_ring_peek(t->ring, &ptr)) > 0)
+    {
+        t->rx_seq += cnt;
+        asc_ring_skip(t->ring, cnt);
+    }
+
+    if (t->rx_seq == PACED_PACKETS)
+        asc_main_loop_shutdown();
+}
+
+START_TEST(paced)
+{
+    spsc_test_t t;
+    memset(&t, 0, sizeof(t));
+
+    asc_wake_open();
+    t.ring = asc_ring_init(PACED_RING_SIZE, paced_on_data, &t);
+
+    t.thread = asc_thread_init(&t, paced_proc, spsc_close);
+    ck_assert(asc_main_loop_run() == false);
+
+    ASC_FREE(t.thread, asc_thread_join);
+    ck_assert(t.rx_seq == PACED_PACKETS);
+
+    /* ring never gets 1/4 full; only the producer's notifies count */
+    asc_ring_stats_t st;
+    asc_ring_stats(t.ring, &st);
+    ck_assert(st.wakeups == t.calls);
+    ck_assert_msg(st.wakeups < PACED_PACKETS / 16
+                  , "too many wake ups: %" PRIu64, st.wakeups);
+
+    asc_ring_destroy(t.ring);
+    asc_wake_close();
+}
+END_TEST
+
+Suite *core_ring(void)
+{
+    Suite *const s = suite_create("core/ring");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, lib_setup, lib_teardown);
+
+    tcase_add_test(tc, push_peek);
+    tcase_add_test(tc, overrun);
+    tcase_add_test(tc, coalesce);
+    tcase_add_test(tc, spsc);
+    tcase_add_test(tc, paced);
+
+    suite_add_tcase(s, tc);
+
+    return s;
+}
@@ -219,6 +219,132 @@ START_TEST(blocked_thread)
 }
 END_TEST
 
+/* timer destroying itself and another due timer */
+static asc_timer_t *self_timers[2];
+static unsigned int self_triggered;
+
+static void on_destroy_self(void *arg)
+{
+    ASC_UNUSED(arg);
+    self_triggered++;
+
+    ASC_FREE(self_timers[0], asc_timer_destroy);
+    ASC_FREE(self_timers[1], asc_timer_destroy);
+}
+
+START_TEST(destroy_self)
+{
+    self_triggered = 0;
+    self_timers[0] = asc_timer_init(20, on_destroy_self, NULL);
+    self_timers[1] = asc_timer_init(20, on_destroy_self, NULL);
+
+    run_loop(200);
+    ck_assert(timed_out == true);
+    ck_assert(self_triggered == 1);
+}
+END_TEST
+
+/* cancel random timers */
+#define CANCEL_COUNT 1000
+
+static void on_cancel_random(void *arg)
+{
+    bool *const fired = (bool *)arg;
+
+    ck_assert(*fired == false);
+    *fired = true;
+}
+
+START_TEST(cancel_random)
+{
+    asc_timer_t **const timers = ASC_ALLOC(CANCEL_COUNT, asc_timer_t *);
+    bool *const fired = ASC_ALLOC(CANCEL_COUNT, bool);
+    bool *const cancelled = ASC_ALLOC(CANCEL_COUNT, bool);
+
+    for (size_t i = 0; i < CANCEL_COUNT; i++)
+    {
+        const unsigned int ms = 10 + (rand() % 100);
+        timers[i] = asc_timer_one_shot(ms, on_cancel_random, &fired[i]);
+    }
+
+    for (size_t i = 0; i < CANCEL_COUNT / 2; i++)
+    {
+        const size_t idx = rand() % CANCEL_COUNT;
+        if (!cancelled[idx])
+        {
+            asc_timer_destroy(timers[idx]);
+            cancelled[idx] = true;
+        }
+    }
+
+    run_loop(200);
+    ck_assert(timed_out == true);
+
+    for (size_t i = 0; i < CANCEL_COUNT; i++)
+        ck_assert(fired[i] != cancelled[i]);
+
+    free(cancelled);
+    free(fired);
+    free(timers);
+}
+END_TEST
+
+/* lots of periodic timers, one in 20 being a short sync timer */
+#define BENCH_TIMERS 10000
+#define BENCH_MS_SHORT 5
+#define BENCH_MS_LONG 250
+
+static void on_bench_timer(void *arg)
+{
+    timer_test_t *const timer = (timer_test_t *)arg;
+    timer->triggered++;
+}
+
+START_TEST(ten_thousand)
+{
+    timer_test_t *const data = ASC_ALLOC(BENCH_TIMERS, timer_test_t);
+
+    uint64_t start = asc_utime();
+    for (size_t i = 0; i < BENCH_TIMERS; i++)
+    {
+        data[i].interval = (i % 20) ? BENCH_MS_LONG : BENCH_MS_SHORT;
+        data[i].timer = asc_timer_init(data[i].interval, on_bench_timer
+                                       , &data[i]);
+    }
+    const uint64_t init_time = asc_utime() - start;
+
+    const unsigned duration = 1000;
+    const clock_t cpu_start = clock();
+    run_loop(duration);
+    const unsigned int cpu_ms = (clock() - cpu_start) * 1000 / CLOCKS_PER_SEC;
+    ck_assert(timed_out == true);
+
+    unsigned int total = 0;
+    for (size_t i = 0; i < BENCH_TIMERS; i++)
+    {
+        const unsigned int expect = duration / data[i].interval;
+        fail_unless(data[i].triggered > expect / 3
+                    && data[i].triggered <= expect
+                    , "missed event count (wanted up to %u, got %u)"
+                    , expect, data[i].triggered);
+
+        total += data[i].triggered;
+    }
+
+    start = asc_utime();
+    for (size_t i = 0; i < BENCH_TIMERS; i++)
+        asc_timer_destroy(data[i].timer);
+    const uint64_t destroy_time = asc_utime() - start;
+
+    asc_log_info("%u timers: init %" PRIu64 "us, destroy %" PRIu64 "us"
+                 ", %u events in %ums using %ums of CPU time"
+                 , BENCH_TIMERS, init_time, destroy_time, total, duration
+                 , cpu_ms);
+
+    free(data);
+}
+END_TEST
+
 Suite *core_timer(void)
 {
     Suite *const s = suite_create("core/timer");
@@ -235,6 +361,9 @@ Suite *core_timer(void)
     tcase_add_test(tc, single_one_shot);
     tcase_add_test(tc, cancel_one_shot);
     tcase_add_test(tc, blocked_thread);
+    tcase_add_test(tc, destroy_self);
+    tcase_add_test(tc, cancel_random);
+    tcase_add_test(tc, ten_thousand);
 
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,242 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/core/mainloop.h>
+#include <astra/core/worker.h>
+
+/* pool is disabled by default */
+START_TEST(disabled)
+{
+    ck_assert(asc_worker_get_count() == 0);
+    ck_assert(asc_worker_acquire() == NULL);
+
+    ck_assert(asc_worker_set_count(ASC_WORKER_MAX + 1) == false);
+    ck_assert(asc_worker_get_count() == 0);
+}
+END_TEST
+
+/* spread users evenly across workers */
+#define BIND_WORKERS 4
+#define BIND_USERS (BIND_WORKERS * 3)
+
+START_TEST(affinity)
+{
+    asc_worker_t *users[BIND_USERS];
+    unsigned int counts[BIND_WORKERS] = { 0 };
+
+    ck_assert(asc_worker_set_count(BIND_WORKERS) == true);
+    ck_assert(asc_worker_get_count() == BIND_WORKERS);
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(users); i++)
+    {
+        users[i] = asc_worker_acquire();
+        ck_assert(users[i] != NULL);
+
+        const unsigned int id = asc_worker_id(users[i]);
+        ck_assert(id < BIND_WORKERS);
+        counts[id]++;
+    }
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(counts); i++)
+        ck_assert(counts[i] == BIND_USERS / BIND_WORKERS);
+
+    /* can't resize while in use */
+    ck_assert(asc_worker_set_count(1) == false);
+    ck_assert(asc_worker_get_count() == BIND_WORKERS);
+
+    /* setting the same size is a no-op, even with users bound */
+    ck_assert(asc_worker_set_count(BIND_WORKERS) == true);
+    ck_assert(asc_worker_get_count() == BIND_WORKERS);
+    ck_assert(asc_worker_acquire() == users[0]);
+    asc_worker_release(users[0]);
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(users); i++)
+        asc_worker_release(users[i]);
+
+    ck_assert(asc_worker_set_count(1) == true);
+    ck_assert(asc_worker_get_count() == 1);
+}
+END_TEST
+
+/* run jobs in order, report back to main thread */
+#define ORDER_USERS 8
+#define ORDER_JOBS 100
+
+typedef struct
+{
+    asc_worker_t *worker;
+    unsigned int id;
+    unsigned int next;
+    unsigned int done;
+} order_test_t;
+
+static unsigned int order_running;
+
+static void order_done(void *arg)
+{
+    order_test_t *const ot = (order_test_t *)arg;
+
+    ck_assert(ot->next == ORDER_JOBS);
+    ot->done++;
+
+    if (--order_running == 0)
+        asc_main_loop_shutdown();
+}
+
+static void order_proc(void *arg)
+{
+    order_test_t *const ot = (order_test_t *)arg;
+
+    if (++ot->next == ORDER_JOBS)
+    {
+        asc_job_queue(NULL, order_done, ot);
+        asc_wake();
+    }
+}
+
+START_TEST(job_order)
+{
+    order_test_t ot[ORDER_USERS];
+    memset(ot, 0, sizeof(ot));
+
+    asc_wake_open();
+    ck_assert(asc_worker_set_count(3) == true);
+
+    order_running = ORDER_USERS;
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(ot); i++)
+    {
+        ot[i].id = i;
+        ot[i].worker = asc_worker_acquire();
+        ck_assert(ot[i].worker != NULL);
+    }
+
+    for (size_t j = 0; j < ORDER_JOBS; j++)
+    {
+        for (size_t i = 0; i < ASC_ARRAY_SIZE(ot); i++)
+        {
+            const bool ret = asc_worker_queue(ot[i].worker, &ot[i]
+                                              , order_proc, &ot[i]);
+            ck_assert(ret == true);
+        }
+    }
+
+    ck_assert(asc_main_loop_run() == false);
+    ck_assert(order_running == 0);
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(ot); i++)
+    {
+        ck_assert(ot[i].next == ORDER_JOBS);
+        ck_assert(ot[i].done == 1);
+        asc_worker_release(ot[i].worker);
+    }
+
+    asc_wake_close();
+}
+END_TEST
+
+/* remove pending jobs and wait for the running one */
+#define PRUNE_JOBS 100
+
+static volatile unsigned int prune_count;
+static volatile bool prune_inside;
+
+static void prune_proc(void *arg)
+{
+    ASC_UNUSED(arg);
+
+    prune_inside = true;
+    asc_usleep(10 * 1000); /* 10ms */
+    prune_count++;
+    prune_inside = false;
+}
+
+START_TEST(prune)
+{
+    ck_assert(asc_worker_set_count(1) == true);
+
+    asc_worker_t *const worker = asc_worker_acquire();
+    ck_assert(worker != NULL);
+
+    prune_count = 0;
+    prune_inside = false;
+
+    int owner;
+    for (size_t i = 0; i < PRUNE_JOBS; i++)
+        ck_assert(asc_worker_queue(worker, &owner, prune_proc, NULL));
+
+    asc_usleep(50 * 1000); /* 50ms */
+    asc_worker_prune(worker, &owner);
+
+    ck_assert(prune_inside == false);
+    const unsigned int count = prune_count;
+    ck_assert(count > 0 && count < PRUNE_JOBS);
+
+    asc_usleep(50 * 1000); /* 50ms */
+    ck_assert(prune_count == count);
+
+    asc_worker_release(worker);
+}
+END_TEST
+
+/* queue overflow */
+static void block_proc(void *arg)
+{
+    asc_usleep(*(unsigned int *)arg);
+}
+
+START_TEST(queue_overflow)
+{
+    ck_assert(asc_worker_set_count(1) == true);
+
+    asc_worker_t *const worker = asc_worker_acquire();
+    ck_assert(worker != NULL);
+
+    static unsigned int delay = 200 * 1000; /* 200ms */
+    static unsigned int nodelay = 0;
+    ck_assert(asc_worker_queue(worker, NULL, block_proc, &delay));
+
+    bool overflow = false;
+    for (size_t i = 0; i < 10000 && !overflow; i++)
+        overflow = !asc_worker_queue(worker, NULL, block_proc, &nodelay);
+
+    ck_assert(overflow == true);
+
+    asc_worker_release(worker);
+}
+END_TEST
+
+Suite *core_worker(void)
+{
+    Suite *const s = suite_create("core/worker");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, lib_setup, lib_teardown);
+
+    tcase_add_test(tc, disabled);
+    tcase_add_test(tc, affinity);
+    tcase_add_test(tc, job_order);
+    tcase_add_test(tc, prune);
+    tcase_add_test(tc, queue_overflow);
+
+    suite_add_tcase(s, tc);
+
+    return s;
+}
@@ -0,0 +1,116 @@
+/*
+ * CRC-32 throughput test
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <astra/astra.h>
+#include <astra/core/clock.h>
+#include <astra/utils/crc32b.h>
+
+#define fatal(__fmt, ...) \
+    { \
+        fprintf(stderr, "error: " __fmt "\n", __VA_ARGS__); \
+        exit(1); \
+    }
+
+/* bytes processed per measurement */
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+typedef uint32_t (*crc32b_func_t)(const void *, size_t);
+
+typedef struct
+{
+    const char *name;
+    crc32b_func_t func;
+} crc32b_impl_t;
+
+/* typical section sizes: PAT/PMT, SDT, full size EIT/NIT, and long data */
+static
+const size_t test_sizes[] = { 32, 188, 1024, 4096, 65536 };
+
+/* keeps the compiler from optimizing away unused results */
+static volatile uint32_t sink;
+
+static
+double bench(crc32b_func_t func, const uint8_t *buf, size_t size)
+{
+    const size_t rounds = BENCH_BYTES / size;
+
+    const uint64_t start = asc_utime();
+    for (size_t i = 0; i < rounds; i++)
+        sink = func(buf, size);
+
+    const uint64_t bench = asc_utime() - start;
+    if (bench == 0)
+        return 0.0;
+
+    /* MB/s */
+    return ((double)rounds * size) / bench;
+}
+
+int main(void)
+{
+    crc32b_impl_t impl[3];
+    size_t impl_cnt = 0;
+
+    impl[impl_cnt++] = (crc32b_impl_t){ "slice8", au_crc32b_sb8 };
+#ifdef HAVE_PCLMUL
+    if (au_crc32b_clmul_supported())
+        impl[impl_cnt++] = (crc32b_impl_t){ "pclmul", au_crc32b_clmul };
+#endif /* HAVE_PCLMUL */
+    impl[impl_cnt++] = (crc32b_impl_t){ "default", au_crc32b };
+
+    const size_t max_size = test_sizes[ASC_ARRAY_SIZE(test_sizes) - 1];
+    uint8_t *const buf = ASC_ALLOC(max_size, uint8_t);
+
+    for (size_t i = 0; i < max_size; i++)
+        buf[i] = (uint8_t)(rand() & 0xff);
+
+    /* sanity check */
+    const uint32_t expect = au_crc32b_sb8(buf, max_size);
+    for (size_t i = 0; i < impl_cnt; i++)
+    {
+        const uint32_t crc = impl[i].func(buf, max_size);
+        if (crc != expect)
+        {
+            fatal("%s: checksum mismatch: expected 0x%08x, got 0x%08x"
+                  , impl[i].name, expect, crc);
+        }
+    }
+
+    /* throughput */
+    printf("%8s", "size");
+    for (size_t i = 0; i < impl_cnt; i++)
+        printf(" %10s", impl[i].name);
+    printf("\n");
+
+    for (size_t j = 0; j < ASC_ARRAY_SIZE(test_sizes); j++)
+    {
+        printf("%8zu", test_sizes[j]);
+        for (size_t i = 0; i < impl_cnt; i++)
+        {
+            const double mbps = bench(impl[i].func, buf, test_sizes[j]);
+            printf(" %10.1f", mbps);
+        }
+        printf("\n");
+    }
+
+    printf("(MB/s)\n");
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * CSA throughput test
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <astra/astra.h>
+#include <astra/utils/csa.h>
+
+#ifdef HAVE_DVBCSA
+#   include <dvbcsa/dvbcsa.h>
+#endif /* HAVE_DVBCSA */
+
+#define fatal(__fmt, ...) \
+    { \
+        fprintf(stderr, "error: " __fmt "\n", __VA_ARGS__); \
+        exit(1); \
+    }
+
+/* packets per measurement */
+#define BENCH_PACKETS 200000
+
+static
+const uint8_t test_cw[CSA_CW_SIZE] =
+{
+    0x11, 0x22, 0x33, 0x66, 0x44, 0x55, 0x66, 0xff
+};
+
+typedef void (*bench_func_t)(const void *key, void *batch);
+
+/* Mbit/s of TS, header included */
+static
+double bench(bench_func_t func, const void *key, void *batch
+             , size_t batch_size)
+{
+    const size_t rounds = BENCH_PACKETS / batch_size + 1;
+
+    const uint64_t start = asc_utime();
+    for (size_t i = 0; i < rounds; i++)
+        func(key, batch);
+
+    const uint64_t bench = asc_utime() - start;
+    if (bench == 0)
+        return 0.0;
+
+    return (rounds * batch_size * TS_PACKET_SIZE * 8.0) / bench;
+}
+
+static
+uint8_t *alloc_payload(size_t cnt)
+{
+    uint8_t *const buf = ASC_ALLOC(cnt * TS_BODY_SIZE, uint8_t);
+
+    for (size_t i = 0; i < cnt * TS_BODY_SIZE; i++)
+        buf[i] = (uint8_t)(rand() & 0xff);
+
+    return buf;
+}
+
+/*
+ * in-tree engines
+ */
+
+static const csa_engine_t *cur_engine = NULL;
+
+static
+void engine_encrypt(const void *key, void *batch)
+{
+    cur_engine->encrypt((const csa_key_t *)key, (csa_batch_t *)batch
+                        , TS_BODY_SIZE);
+}
+
+static
+void engine_decrypt(const void *key, void *batch)
+{
+    cur_engine->decrypt((const csa_key_t *)key, (csa_batch_t *)batch
+                        , TS_BODY_SIZE);
+}
+
+static
+void test_engine(const csa_key_t *key, const csa_engine_t *engine)
+{
+    const size_t cnt = engine->batch_size;
+    uint8_t *const buf = alloc_payload(cnt);
+    uint8_t *const ref = ASC_ALLOC(cnt * TS_BODY_SIZE, uint8_t);
+    memcpy(ref, buf, cnt * TS_BODY_SIZE);
+
+    csa_batch_t *const batch = ASC_ALLOC(cnt + 1, csa_batch_t);
+    for (size_t i = 0; i < cnt; i++)
+    {
+        batch[i].data = &buf[i * TS_BODY_SIZE];
+        batch[i].len = TS_BODY_SIZE;
+    }
+
+    /* check against reference code */
+    engine->encrypt(key, batch, TS_BODY_SIZE);
+    for (size_t i = 0; i < cnt; i++)
+        au_csa_encrypt(key, &ref[i * TS_BODY_SIZE], TS_BODY_SIZE);
+
+    if (memcmp(buf, ref, cnt * TS_BODY_SIZE))
+        fatal("%s: encrypted payload doesn't match reference", engine->name);
+
+    engine->decrypt(key, batch, TS_BODY_SIZE);
+    for (size_t i = 0; i < cnt; i++)
+        au_csa_decrypt(key, &ref[i * TS_BODY_SIZE], TS_BODY_SIZE);
+
+    if (memcmp(buf, ref, cnt * TS_BODY_SIZE))
+        fatal("%s: decrypted payload doesn't match reference", engine->name);
+
+    /* throughput */
+    cur_engine = engine;
+
+    const double enc = bench(engine_encrypt, key, batch, cnt);
+    const double dec = bench(engine_decrypt, key, batch, cnt);
+    printf("%-10s %4zu  %8.1f  %8.1f\n", engine->name, cnt, enc, dec);
+
+    free(batch);
+    free(ref);
+    free(buf);
+}
+
+/*
+ * libdvbcsa, for comparison
+ */
+
+#ifdef HAVE_DVBCSA
+static
+void lib_encrypt(const void *key, void *batch)
+{
+    dvbcsa_bs_encrypt((const struct dvbcsa_bs_key_s *)key
+                      , (struct dvbcsa_bs_batch_s *)batch, TS_BODY_SIZE);
+}
+
+static
+void lib_decrypt(const void *key, void *batch)
+{
+    dvbcsa_bs_decrypt((const struct dvbcsa_bs_key_s *)key
+                      , (struct dvbcsa_bs_batch_s *)batch, TS_BODY_SIZE);
+}
+
+static
+void test_dvbcsa(const csa_key_t *ref_key)
+{
+    const size_t cnt = dvbcsa_bs_batch_size();
+    if (cnt == 0)
+        fatal("invalid libdvbcsa batch size: %zu", cnt);
+
+    struct dvbcsa_bs_key_s *const key = dvbcsa_bs_key_alloc();
+    dvbcsa_bs_key_set(test_cw, key);
+
+    uint8_t *const buf = alloc_payload(cnt);
+    uint8_t *const ref = ASC_ALLOC(cnt * TS_BODY_SIZE, uint8_t);
+    memcpy(ref, buf, cnt * TS_BODY_SIZE);
+
+    struct dvbcsa_bs_batch_s *const batch =
+        ASC_ALLOC(cnt + 1, struct dvbcsa_bs_batch_s);
+
+    for (size_t i = 0; i < cnt; i++)
+    {
+        batch[i].data = &buf[i * TS_BODY_SIZE];
+        batch[i].len = TS_BODY_SIZE;
+    }
+
+    /* both implementations must agree */
+    dvbcsa_bs_encrypt(key, batch, TS_BODY_SIZE);
+    for (size_t i = 0; i < cnt; i++)
+        au_csa_encrypt(ref_key, &ref[i * TS_BODY_SIZE], TS_BODY_SIZE);
+
+    if (memcmp(buf, ref, cnt * TS_BODY_SIZE))
+        fatal("%s: encrypted payload doesn't match reference", "libdvbcsa");
+
+    dvbcsa_bs_decrypt(key, batch, TS_BODY_SIZE);
+    for (size_t i = 0; i < cnt; i++)
+        au_csa_decrypt(ref_key, &ref[i * TS_BODY_SIZE], TS_BODY_SIZE);
+
+    if (memcmp(buf, ref, cnt * TS_BODY_SIZE))
+        fatal("%s: decrypted payload doesn't match reference", "libdvbcsa");
+
+    const double enc = bench(lib_encrypt, key, batch, cnt);
+    const double dec = bench(lib_decrypt, key, batch, cnt);
+    printf("%-10s %4zu  %8.1f  %8.1f\n", "libdvbcsa", cnt, enc, dec);
+
+    free(batch);
+    free(ref);
+    free(buf);
+    dvbcsa_bs_key_free(key);
+}
+#endif /* HAVE_DVBCSA */
+
+int main(void)
+{
+    csa_key_t *const key = au_csa_key_init();
+    au_csa_key_set(key, test_cw);
+
+    printf("%-10s %4s  %8s  %8s  (Mbit/s)\n"
+           , "engine", "pkts", "encrypt", "decrypt");
+
+    size_t cnt = 0;
+    const csa_engine_t *const list = au_csa_engine_list(&cnt);
+    for (size_t i = 0; i < cnt; i++)
+        test_engine(key, &list[i]);
+
+#ifdef HAVE_DVBCSA
+    test_dvbcsa(key);
+#endif /* HAVE_DVBCSA */
+
+    printf("selected: %s\n", au_csa_engine()->name);
+    au_csa_key_destroy(key);
+
+    return 0;
+}
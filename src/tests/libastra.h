@@ -32,19 +32,32 @@ bool is_fd_inherited(int fd);
 void lib_setup(void);
 void lib_teardown(void);
 
+/* analyze */
+Suite *analyze_tr101290(void);
+
+/* cbr */
+Suite *cbr_mux(void);
+
+/* channel */
+Suite *channel_channel(void);
+Suite *channel_si_cache(void);
+
 /* core */
 Suite *core_alloc(void);
 Suite *core_assert(void);
+Suite *core_block(void);
 Suite *core_clock(void);
 Suite *core_compat(void);
 Suite *core_event(void);
 Suite *core_list(void);
 Suite *core_log(void);
 Suite *core_mainloop(void);
+Suite *core_ring(void);
 Suite *core_spawn(void);
 Suite *core_child(void);
 Suite *core_thread(void);
 Suite *core_timer(void);
+Suite *core_worker(void);
 
 /* luaapi */
 Suite *luaapi_luaapi(void);
@@ -68,10 +81,14 @@ Suite *mpegts_mpegts(void);
 Suite *mpegts_pcr(void);
 Suite *mpegts_sync(void);
 
+/* softcam */
+Suite *softcam_cam(void);
+
 /* utils */
 Suite *utils_base64(void);
 Suite *utils_crc32b(void);
 Suite *utils_crc8(void);
+Suite *utils_csa(void);
 Suite *utils_json(void);
 Suite *utils_md5(void);
 Suite *utils_rc4(void);
@@ -82,19 +99,32 @@ Suite *utils_strhex(void);
 typedef Suite (*(*const suite_func_t)(void));
 
 static suite_func_t suite_list[] = {
+    /* analyze */
+    analyze_tr101290,
+
+    /* cbr */
+    cbr_mux,
+
+    /* channel */
+    channel_channel,
+    channel_si_cache,
+
     /* core */
     core_alloc,
     core_assert,
+    core_block,
     core_clock,
     core_compat,
     core_event,
     core_list,
     core_log,
     core_mainloop,
+    core_ring,
     core_spawn,
     core_child,
     core_thread,
     core_timer,
+    core_worker,
 
     /* luaapi */
     luaapi_luaapi,
@@ -118,10 +148,14 @@ static suite_func_t suite_list[] = {
     mpegts_pcr,
     mpegts_sync,
 
+    /* softcam */
+    softcam_cam,
+
     /* utils */
     utils_base64,
     utils_crc32b,
     utils_crc8,
+    utils_csa,
     utils_json,
     utils_md5,
     utils_rc4,
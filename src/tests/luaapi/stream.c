@@ -145,8 +145,12 @@ START_TEST(input_select)
     for (size_t i = 0; i < ASC_ARRAY_SIZE(select_cnt); i++)
         ck_assert(select_cnt[i] == 0);
 
+    ck_assert(module_stream_parent(mod_selector) == NULL);
+    ck_assert(module_stream_parent(mod_foobar) == mod_selector);
+
     /* round 2: attach to source_a */
     module_stream_attach(mod_source_a, mod_selector);
+    ck_assert(module_stream_parent(mod_selector) == mod_source_a);
 
     bulk_send(mod_source_a, 500, 1234); /* x4 */
     bulk_send(mod_source_b, 501, 4321);
@@ -157,6 +161,7 @@ START_TEST(input_select)
     /* round 3: attach to source_b */
     memset(&select_cnt, 0, sizeof(select_cnt));
     module_stream_attach(mod_source_b, mod_selector);
+    ck_assert(module_stream_parent(mod_selector) == mod_source_b);
 
     bulk_send(mod_source_b, 1000, 9999); /* x4 */
     bulk_send(mod_source_a, 1100, 5120);
@@ -167,6 +172,7 @@ START_TEST(input_select)
     /* round 4: detach */
     memset(&select_cnt, 0, sizeof(select_cnt));
     module_stream_attach(NULL, mod_selector);
+    ck_assert(module_stream_parent(mod_selector) == NULL);
 
     for (size_t i = 0; i < ASC_ARRAY_SIZE(select_cnt); i++)
     {
@@ -398,6 +404,154 @@ START_TEST(demux_flood)
 }
 END_TEST
 
+/* only deliver joined pids to routed children */
+#define ROUTE_COMMON_PID 0x10
+#define ROUTE_PID_A 0x100
+#define ROUTE_PID_B 0x200
+#define ROUTE_PID_OTHER 0x300
+
+static unsigned int route_sink_cnt[2][TS_MAX_PIDS];
+
+static void route_on_sink_ts(module_data_t *mod, const uint8_t *ts)
+{
+    const unsigned int idx = (mod == mod_sink_a ? 0 : 1);
+    const uint16_t pid = TS_GET_PID(ts);
+
+    route_sink_cnt[idx][pid]++;
+}
+
+static void route_on_reload_ts(module_data_t *mod, const uint8_t *ts)
+{
+    /* rejoin pid from inside the callback */
+    const uint16_t pid = TS_GET_PID(ts);
+    module_demux_leave(mod, pid);
+    module_demux_join(mod, pid);
+
+    route_on_sink_ts(mod, ts);
+}
+
+static void route_on_kick_ts(module_data_t *mod, const uint8_t *ts)
+{
+    /* make sibling leave pid from inside the callback */
+    module_data_t *const sibling = (mod == mod_sink_a ? mod_sink_b : mod_sink_a);
+    const uint16_t pid = TS_GET_PID(ts);
+    if (module_demux_check(sibling, pid))
+        module_demux_leave(sibling, pid);
+
+    route_on_sink_ts(mod, ts);
+}
+
+static void route_send(void)
+{
+    static const uint16_t pids[] =
+        { ROUTE_COMMON_PID, ROUTE_PID_A, ROUTE_PID_B, ROUTE_PID_OTHER };
+
+    uint8_t ts[ASC_ARRAY_SIZE(pids) * TS_PACKET_SIZE];
+    memset(ts, 0, sizeof(ts));
+
+    for (unsigned int i = 0; i < ASC_ARRAY_SIZE(pids); i++)
+    {
+        ts[i * TS_PACKET_SIZE] = 0x47;
+        TS_SET_PID(&ts[i * TS_PACKET_SIZE], pids[i]);
+        module_stream_send(mod_foobar, &ts[i * TS_PACKET_SIZE]);
+    }
+
+    module_stream_send_batch(mod_foobar, ts, ASC_ARRAY_SIZE(pids));
+}
+
+START_TEST(demux_route)
+{
+    memset(route_sink_cnt, 0, sizeof(route_sink_cnt));
+    st_sink_a.on_ts = route_on_sink_ts;
+    st_sink_b.on_ts = route_on_sink_ts;
+
+    /* sink_a joins before routing is enabled, sink_b after */
+    module_demux_join(mod_sink_a, ROUTE_COMMON_PID);
+    module_demux_join(mod_sink_a, ROUTE_PID_A);
+    module_demux_route(mod_sink_a, true);
+    module_demux_route(mod_sink_a, true); /* no-op */
+    module_demux_route(mod_sink_b, true);
+    module_demux_join(mod_sink_b, ROUTE_COMMON_PID);
+    module_demux_join(mod_sink_b, ROUTE_PID_B);
+
+    ck_assert(module_demux_check(mod_foobar, ROUTE_COMMON_PID));
+    ck_assert(module_demux_check(mod_foobar, ROUTE_PID_A));
+    ck_assert(module_demux_check(mod_foobar, ROUTE_PID_B));
+
+    for (unsigned int i = 0; i < 100; i++)
+        route_send();
+
+    ck_assert(route_sink_cnt[0][ROUTE_COMMON_PID] == 200);
+    ck_assert(route_sink_cnt[0][ROUTE_PID_A] == 200);
+    ck_assert(route_sink_cnt[0][ROUTE_PID_B] == 0);
+    ck_assert(route_sink_cnt[0][ROUTE_PID_OTHER] == 0);
+    ck_assert(route_sink_cnt[1][ROUTE_COMMON_PID] == 200);
+    ck_assert(route_sink_cnt[1][ROUTE_PID_A] == 0);
+    ck_assert(route_sink_cnt[1][ROUTE_PID_B] == 200);
+    ck_assert(route_sink_cnt[1][ROUTE_PID_OTHER] == 0);
+
+    /* leaving a pid stops delivery */
+    memset(route_sink_cnt, 0, sizeof(route_sink_cnt));
+    module_demux_leave(mod_sink_a, ROUTE_COMMON_PID);
+    route_send();
+
+    ck_assert(route_sink_cnt[0][ROUTE_COMMON_PID] == 0);
+    ck_assert(route_sink_cnt[0][ROUTE_PID_A] == 2);
+    ck_assert(route_sink_cnt[1][ROUTE_COMMON_PID] == 2);
+
+    /* rejoining from inside on_ts doesn't skip or repeat packets */
+    memset(route_sink_cnt, 0, sizeof(route_sink_cnt));
+    module_demux_join(mod_sink_a, ROUTE_COMMON_PID);
+    st_sink_a.on_ts = route_on_reload_ts;
+    st_sink_b.on_ts = route_on_reload_ts;
+
+    for (unsigned int i = 0; i < 100; i++)
+        route_send();
+
+    ck_assert(route_sink_cnt[0][ROUTE_COMMON_PID] == 200);
+    ck_assert(route_sink_cnt[1][ROUTE_COMMON_PID] == 200);
+    st_sink_a.on_ts = route_on_sink_ts;
+    st_sink_b.on_ts = route_on_sink_ts;
+
+    /* removing a sibling from inside on_ts doesn't repeat packets */
+    memset(route_sink_cnt, 0, sizeof(route_sink_cnt));
+    st_sink_a.on_ts = route_on_kick_ts;
+    st_sink_b.on_ts = route_on_kick_ts;
+    route_send();
+
+    ck_assert(route_sink_cnt[0][ROUTE_COMMON_PID]
+              + route_sink_cnt[1][ROUTE_COMMON_PID] == 2);
+    ck_assert(module_demux_check(mod_sink_a, ROUTE_COMMON_PID)
+              != module_demux_check(mod_sink_b, ROUTE_COMMON_PID));
+    st_sink_a.on_ts = route_on_sink_ts;
+    st_sink_b.on_ts = route_on_sink_ts;
+
+    if (!module_demux_check(mod_sink_a, ROUTE_COMMON_PID))
+        module_demux_join(mod_sink_a, ROUTE_COMMON_PID);
+    if (!module_demux_check(mod_sink_b, ROUTE_COMMON_PID))
+        module_demux_join(mod_sink_b, ROUTE_COMMON_PID);
+
+    /* routing follows the child to its new parent */
+    memset(route_sink_cnt, 0, sizeof(route_sink_cnt));
+    module_stream_attach(mod_selector, mod_sink_b);
+    route_send();
+
+    ck_assert(route_sink_cnt[1][ROUTE_COMMON_PID] == 0);
+    ck_assert(route_sink_cnt[1][ROUTE_PID_B] == 0);
+    ck_assert(!module_demux_check(mod_foobar, ROUTE_PID_B));
+    ck_assert(module_demux_check(mod_selector, ROUTE_PID_B));
+
+    /* disable routing: sink_a gets everything again */
+    memset(route_sink_cnt, 0, sizeof(route_sink_cnt));
+    module_demux_route(mod_sink_a, false);
+    route_send();
+
+    ck_assert(route_sink_cnt[0][ROUTE_PID_B] == 2);
+    ck_assert(route_sink_cnt[0][ROUTE_PID_OTHER] == 2);
+    ck_assert(module_demux_check(mod_foobar, ROUTE_PID_A));
+}
+END_TEST
+
 /* stacking pid memberships */
 #define STACK_PID 0x1500
 
@@ -549,6 +703,172 @@ START_TEST(double_leave)
 }
 END_TEST
 
+/* batched delivery with per-packet fallback */
+#define BATCH_SIZE 42
+#define BATCH_ROUNDS 100
+
+static unsigned int batch_calls;
+static unsigned int batch_sink_cnt[2][BATCH_SIZE];
+static uint16_t batch_next_pid[2];
+
+static void batch_on_ts_batch(module_data_t *mod, const uint8_t *ts
+                              , size_t cnt)
+{
+    ck_assert(cnt == BATCH_SIZE);
+    batch_calls++;
+
+    module_stream_send_batch(mod, ts, cnt);
+}
+
+static void batch_on_ts(module_data_t *mod, const uint8_t *ts)
+{
+    module_stream_send(mod, ts);
+}
+
+static void batch_on_sink_ts(module_data_t *mod, const uint8_t *ts)
+{
+    const unsigned int idx = (mod == mod_sink_a ? 0 : 1);
+    const uint16_t pid = TS_GET_PID(ts);
+
+    /* packets must arrive in their original order */
+    ck_assert(pid == batch_next_pid[idx]);
+    batch_next_pid[idx] = (pid + 1) % BATCH_SIZE;
+
+    batch_sink_cnt[idx][pid]++;
+}
+
+START_TEST(batch_send)
+{
+    batch_calls = 0;
+    memset(batch_sink_cnt, 0, sizeof(batch_sink_cnt));
+    memset(batch_next_pid, 0, sizeof(batch_next_pid));
+
+    /* foobar accepts batches, sinks only take single packets */
+    st_foobar.on_ts = batch_on_ts;
+    module_stream_set_batch(mod_foobar, batch_on_ts_batch);
+    st_sink_a.on_ts = batch_on_sink_ts;
+    st_sink_b.on_ts = batch_on_sink_ts;
+    module_stream_attach(mod_source_a, mod_foobar);
+
+    uint8_t ts[BATCH_SIZE * TS_PACKET_SIZE];
+    memset(ts, 0, sizeof(ts));
+    for (unsigned int i = 0; i < BATCH_SIZE; i++)
+    {
+        ts[i * TS_PACKET_SIZE] = 0x47;
+        TS_SET_PID(&ts[i * TS_PACKET_SIZE], i);
+    }
+
+    for (unsigned int i = 0; i < BATCH_ROUNDS; i++)
+    {
+        module_stream_send_batch(mod_source_a, ts, BATCH_SIZE);
+        module_stream_send_batch(mod_source_a, ts, 0); /* no-op */
+    }
+
+    ck_assert(batch_calls == BATCH_ROUNDS);
+    for (unsigned int i = 0; i < BATCH_SIZE; i++)
+    {
+        ck_assert(batch_sink_cnt[0][i] == BATCH_ROUNDS);
+        ck_assert(batch_sink_cnt[1][i] == BATCH_ROUNDS);
+    }
+
+    /* single packets still go through on_ts */
+    module_stream_send(mod_source_a, ts);
+    ck_assert(batch_calls == BATCH_ROUNDS);
+    ck_assert(batch_sink_cnt[0][0] == BATCH_ROUNDS + 1);
+    ck_assert(batch_sink_cnt[1][0] == BATCH_ROUNDS + 1);
+}
+END_TEST
+
+/* block delivery with batch and per-packet fallback */
+#define BLOCK_PACKETS 7
+
+static asc_block_t *block_held;
+static unsigned int block_calls;
+static unsigned int block_sink_cnt;
+
+static void block_on_ts_block(module_data_t *mod, asc_block_t *block)
+{
+    ck_assert(mod == mod_sink_a);
+    ck_assert(block->cnt == BLOCK_PACKETS);
+    block_calls++;
+
+    /* keep last block instead of copying its contents */
+    if (block_held != NULL)
+        asc_block_release(block_held);
+
+    block_held = asc_block_retain(block);
+}
+
+static void block_on_ts_batch(module_data_t *mod, const uint8_t *ts
+                              , size_t cnt)
+{
+    ck_assert(cnt == BLOCK_PACKETS);
+    module_stream_send_batch(mod, ts, cnt);
+}
+
+static void block_on_ts_forward(module_data_t *mod, asc_block_t *block)
+{
+    module_stream_send_block(mod, block);
+}
+
+static void block_on_sink_ts(module_data_t *mod, const uint8_t *ts)
+{
+    ck_assert(mod == mod_sink_b);
+    ck_assert(ts[0] == 0x47);
+    block_sink_cnt++;
+}
+
+START_TEST(block_send)
+{
+    block_held = NULL;
+    block_calls = 0;
+    block_sink_cnt = 0;
+
+    /* foobar takes blocks, forwards them; sink_b has no block callback */
+    st_foobar.on_ts = batch_on_ts;
+    module_stream_set_batch(mod_foobar, block_on_ts_batch);
+    module_stream_set_block(mod_foobar, block_on_ts_forward);
+    st_sink_a.on_ts = block_on_sink_ts;
+    module_stream_set_block(mod_sink_a, block_on_ts_block);
+    st_sink_b.on_ts = block_on_sink_ts;
+    module_stream_attach(mod_source_a, mod_foobar);
+
+    asc_block_pool_t *const pool =
+        asc_block_pool_init(BLOCK_PACKETS * TS_PACKET_SIZE, 4);
+
+    for (unsigned int i = 0; i < BATCH_ROUNDS; i++)
+    {
+        asc_block_t *const block = asc_block_alloc(pool);
+        for (size_t j = 0; j < BLOCK_PACKETS; j++)
+            block->data[j * TS_PACKET_SIZE] = 0x47;
+
+        block->cnt = BLOCK_PACKETS;
+        module_stream_send_block(mod_source_a, block);
+
+        /* sink_a holds a reference until the next block arrives */
+        ck_assert(block_held == block);
+        ck_assert(block->refcnt == 2);
+        asc_block_release(block);
+    }
+
+    ck_assert(block_calls == BATCH_ROUNDS);
+    ck_assert(block_sink_cnt == BATCH_ROUNDS * BLOCK_PACKETS);
+
+    /* empty blocks are not delivered */
+    asc_block_t *const empty = asc_block_alloc(pool);
+    module_stream_send_block(mod_source_a, empty);
+    ck_assert(block_calls == BATCH_ROUNDS);
+    asc_block_release(empty);
+
+    asc_block_stats_t st;
+    asc_block_pool_stats(pool, &st);
+    ck_assert(st.copies == 0 && st.active == 1);
+
+    ASC_FREE(block_held, asc_block_release);
+    asc_block_pool_destroy(pool);
+}
+END_TEST
+
 /* trying to initialize twice */
 START_TEST(double_init)
 {
@@ -607,6 +927,20 @@ START_TEST(no_on_ts)
 }
 END_TEST
 
+/* batch callback on a module that can't receive TS */
+START_TEST(batch_no_on_ts)
+{
+    module_stream_set_batch(mod_source_a, batch_on_ts_batch);
+}
+END_TEST
+
+/* block callback on a module that can't receive TS */
+START_TEST(block_no_on_ts)
+{
+    module_stream_set_block(mod_source_a, block_on_ts_block);
+}
+END_TEST
+
 /* demux calls with invalid pids */
 START_TEST(range_join)
 {
@@ -640,9 +974,12 @@ Suite *luaapi_stream(void)
     tcase_add_test(tc, demux_move);
     tcase_add_test(tc, demux_discard);
     tcase_add_test(tc, demux_flood);
+    tcase_add_test(tc, demux_route);
     tcase_add_test(tc, demux_stack);
     tcase_add_test(tc, demux_destroy);
     tcase_add_test(tc, double_leave);
+    tcase_add_test(tc, batch_send);
+    tcase_add_test(tc, block_send);
     suite_add_tcase(s, tc);
 
     if (can_fork != CK_NOFORK)
@@ -653,6 +990,8 @@ Suite *luaapi_stream(void)
         tcase_add_exit_test(tc_f, bad_attach, ASC_EXIT_ABORT);
         tcase_add_exit_test(tc_f, ouroboros, ASC_EXIT_ABORT);
         tcase_add_exit_test(tc_f, no_on_ts, ASC_EXIT_ABORT);
+        tcase_add_exit_test(tc_f, batch_no_on_ts, ASC_EXIT_ABORT);
+        tcase_add_exit_test(tc_f, block_no_on_ts, ASC_EXIT_ABORT);
         tcase_add_exit_test(tc_f, range_join, ASC_EXIT_ABORT);
         tcase_add_exit_test(tc_f, range_leave, ASC_EXIT_ABORT);
         tcase_add_exit_test(tc_f, range_check, ASC_EXIT_ABORT);
@@ -21,6 +21,7 @@
 #include "../libastra.h"
 #include <astra/core/mainloop.h>
 #include <astra/luaapi/state.h>
+#include <astra/mpegts/sync.h>
 
 #define L lua
 
@@ -69,6 +70,54 @@ START_TEST(astra_loopctl)
 }
 END_TEST
 
+/* worker pool size */
+START_TEST(astra_workers)
+{
+    static const char *const script =
+        "assert(astra.workers() == 0)\n"
+        "assert(astra.workers(2) == 2)\n"
+        "assert(astra.workers() == 2)\n"
+        "assert(pcall(astra.workers, -1) == false)\n"
+        "assert(astra.workers(0) == 0)\n";
+
+    ck_assert_msg(luaL_dostring(L, script) == 0, lua_tostring(L, -1));
+}
+END_TEST
+
+/* shared sync scheduler stats */
+static
+void sync_on_ts(void *arg, const uint8_t *ts)
+{
+    ASC_UNUSED(arg);
+    ASC_UNUSED(ts);
+}
+
+START_TEST(astra_sync_stats)
+{
+    static const char *const empty =
+        "local s = astra.sync_stats()\n"
+        "assert(s.buffers == 0 and #s.list == 0)\n";
+
+    ck_assert_msg(luaL_dostring(L, empty) == 0, lua_tostring(L, -1));
+
+    ts_sync_t *sx = ts_sync_init(sync_on_ts, NULL);
+    ts_sync_set_fname(sx, "test/sync");
+    ts_sync_schedule(sx);
+
+    static const char *const script =
+        "local s = astra.sync_stats()\n"
+        "assert(s.buffers == 1 and #s.list == 1)\n"
+        "assert(s.list[1].name == 'test/sync')\n"
+        "assert(s.list[1].fill == 0 and s.list[1].filled == 0)\n"
+        "assert(s.list[1].size > 0 and s.list[1].underruns == 0)\n";
+
+    ck_assert_msg(luaL_dostring(L, script) == 0, lua_tostring(L, -1));
+
+    ASC_FREE(sx, ts_sync_destroy);
+    ck_assert_msg(luaL_dostring(L, empty) == 0, lua_tostring(L, -1));
+}
+END_TEST
+
 /* test abort */
 START_TEST(astra_abort)
 {
@@ -100,6 +149,8 @@ Suite *lualib_astra(void)
     tcase_add_checked_fixture(tc, lib_setup, lib_teardown);
     tcase_add_test(tc, version_data);
     tcase_add_test(tc, astra_loopctl);
+    tcase_add_test(tc, astra_workers);
+    tcase_add_test(tc, astra_sync_stats);
 
     if (can_fork != CK_NOFORK)
     {
@@ -1742,6 +1742,239 @@ START_TEST(ts_bench)
 }
 END_TEST
 
+/* output spread evenly by the pacing thread */
+#define PACED_TS_RATE 2000000 /* 2 Mbit */
+#define PACED_PCR_INTERVAL 20 /* 20 ms */
+#define PACED_DURATION 1500 /* 1.5 seconds of TS */
+#define PACED_INTERVAL 100 /* 100 us */
+#define PACED_MAX_PACKETS 4096
+
+typedef struct
+{
+    uint64_t rx_time[PACED_MAX_PACKETS];
+    size_t rx_cnt;
+} paced_test_t;
+
+static
+void paced_on_ts(void *arg, const uint8_t *ts)
+{
+    paced_test_t *const t = (paced_test_t *)arg;
+
+    /* NOTE: called on pacing thread; checks are done afterwards */
+    if (t->rx_cnt < PACED_MAX_PACKETS && TS_IS_SYNC(ts))
+        t->rx_time[t->rx_cnt++] = asc_utime();
+}
+
+START_TEST(paced)
+{
+    paced_test_t *const t = ASC_ALLOC(1, paced_test_t);
+    ts_generator_t gen;
+    memset(&gen, 0, sizeof(gen));
+
+    ts_sync_t *sx = ts_sync_init(paced_on_ts, t);
+    ck_assert(ts_sync_set_blocks(sx, 2, 2) == true);
+
+    ck_assert(ts_sync_set_pacing(sx, 10) == false);
+    ck_assert(ts_sync_set_pacing(sx, PACED_INTERVAL) == true);
+    ck_assert(ts_sync_set_pacing(sx, PACED_INTERVAL) == false);
+
+    size_t pushed = 0;
+    for (unsigned int ms = 0; ms < PACED_DURATION; )
+    {
+        uint8_t ts[TS_PACKET_SIZE];
+
+        if (ts_generator(&gen, ts))
+        {
+            ck_assert(ts_sync_push(sx, ts, 1) == true);
+            pushed++;
+        }
+        else
+        {
+            gen.bitrate = PACED_TS_RATE;
+            gen.duration = PACED_PCR_INTERVAL;
+            ms += PACED_PCR_INTERVAL;
+        }
+    }
+
+    ck_assert(pushed < PACED_MAX_PACKETS);
+    asc_usleep((PACED_DURATION / 2) * 1000);
+
+    ts_sync_stat_t st;
+    ts_sync_query(sx, &st);
+    ck_assert(st.bitrate > PACED_TS_RATE * 0.99
+              && st.bitrate < PACED_TS_RATE * 1.01);
+    ck_assert(st.wakeups > 0);
+    ck_assert(st.jitter_avg <= st.jitter_max);
+
+    ASC_FREE(sx, ts_sync_destroy);
+    ck_assert(t->rx_cnt > 0);
+
+    /*
+     * At 2 Mbit/s packets are due every 752us. With a 5ms timer they
+     * would go out in bursts of 6 or 7; paced output should mostly have
+     * them one by one.
+     */
+    size_t spaced = 0;
+    for (size_t i = 1; i < t->rx_cnt; i++)
+    {
+        if (t->rx_time[i] - t->rx_time[i - 1] >= 300)
+            spaced++;
+    }
+
+    asc_log_info("paced: %zu packets, %zu spaced out, jitter avg %uus "
+                 "max %uus", t->rx_cnt, spaced, st.jitter_avg
+                 , st.jitter_max);
+
+    ck_assert(spaced > t->rx_cnt / 2);
+
+    free(t);
+}
+END_TEST
+
+/* many buffers driven by the shared scheduler */
+#define SCHED_DURATION 1000 /* 1 second of TS per buffer */
+#define SCHED_RUN_TIME 600 /* 600 ms */
+
+typedef struct
+{
+    ts_sync_t *sx;
+    ts_generator_t gen;
+    uint32_t bitrate;
+    unsigned int pcr_ms;
+
+    size_t rx_cnt;
+    unsigned int cc;
+} sched_test_t;
+
+static
+void sched_on_ts(void *arg, const uint8_t *ts)
+{
+    sched_test_t *const t = (sched_test_t *)arg;
+
+    ck_assert(TS_IS_SYNC(ts));
+    if (TS_GET_PID(ts) == GEN_DATA_PID)
+    {
+        ck_assert(TS_GET_CC(ts) == t->cc);
+        t->cc = (t->cc + 1) & 0xf;
+    }
+
+    t->rx_cnt++;
+}
+
+static
+void sched_on_stop(void *arg)
+{
+    ASC_UNUSED(arg);
+    asc_main_loop_shutdown();
+}
+
+static
+void sched_on_buffer(void *arg, const char *name, const ts_sync_stat_t *st)
+{
+    unsigned int *const cnt = (unsigned int *)arg;
+
+    ck_assert(name != NULL && st->size > 0);
+    (*cnt)++;
+}
+
+START_TEST(scheduled)
+{
+    static const struct
+    {
+        uint32_t bitrate;
+        unsigned int pcr_ms;
+    } cfg[] =
+    {
+        { 100000, 80 },
+        { 200000, 40 },
+        { 1000000, 20 },
+        { 2000000, 20 },
+        { 5000000, 20 },
+        { 10000000, 20 },
+        { 20000000, 10 },
+        { 40000000, 10 },
+    };
+
+    sched_test_t t[ASC_ARRAY_SIZE(cfg)];
+    memset(t, 0, sizeof(t));
+
+    ts_sync_sched_stat_t sst;
+    ts_sync_sched_query(&sst);
+    ck_assert(sst.buffers == 0);
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(cfg); i++)
+    {
+        t[i].bitrate = cfg[i].bitrate;
+        t[i].sx = ts_sync_init(sched_on_ts, &t[i]);
+        ts_sync_set_fname(t[i].sx, "sched/%zu", i);
+        ck_assert(ts_sync_set_blocks(t[i].sx, 2, 2) == true);
+
+        for (unsigned int ms = 0; ms < SCHED_DURATION; )
+        {
+            uint8_t ts[TS_PACKET_SIZE];
+
+            if (ts_generator(&t[i].gen, ts))
+            {
+                ck_assert(ts_sync_push(t[i].sx, ts, 1) == true);
+            }
+            else
+            {
+                t[i].gen.bitrate = cfg[i].bitrate;
+                t[i].gen.duration = cfg[i].pcr_ms;
+                ms += cfg[i].pcr_ms;
+            }
+        }
+
+        ts_sync_schedule(t[i].sx);
+        ts_sync_schedule(t[i].sx); /* no-op */
+    }
+
+    ts_sync_sched_query(&sst);
+    ck_assert(sst.buffers == ASC_ARRAY_SIZE(cfg));
+
+    asc_timer_t *const stop =
+        asc_timer_one_shot(SCHED_RUN_TIME, sched_on_stop, NULL);
+    ck_assert(stop != NULL);
+
+    const bool again = asc_main_loop_run();
+    ck_assert(again == false);
+
+    ts_sync_sched_query(&sst);
+    ck_assert(sst.ticks > 0);
+    ck_assert(sst.steps > 0);
+
+    /* low bitrate buffers skip ticks with nothing due */
+    asc_log_info("scheduled: %" PRIu64 " ticks, %" PRIu64 " steps"
+                 , sst.ticks, sst.steps);
+    ck_assert(sst.steps < sst.ticks * ASC_ARRAY_SIZE(cfg));
+
+    unsigned int listed = 0;
+    ts_sync_sched_foreach(sched_on_buffer, &listed);
+    ck_assert(listed == ASC_ARRAY_SIZE(cfg));
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(cfg); i++)
+    {
+        ts_sync_stat_t st;
+        ts_sync_query(t[i].sx, &st);
+
+        ck_assert(t[i].rx_cnt > 0);
+        ck_assert(st.bitrate > t[i].bitrate * 0.99
+                  && st.bitrate < t[i].bitrate * 1.01);
+        ck_assert(st.underruns == 0);
+    }
+
+    /* remove from the middle of the heap first */
+    static const size_t order[] = { 3, 0, 7, 5, 1, 6, 2, 4 };
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(order); i++)
+    {
+        ASC_FREE(t[order[i]].sx, ts_sync_destroy);
+
+        ts_sync_sched_query(&sst);
+        ck_assert(sst.buffers == ASC_ARRAY_SIZE(cfg) - i - 1);
+    }
+}
+END_TEST
+
 Suite *mpegts_sync(void)
 {
     Suite *const s = suite_create("mpegts/sync");
@@ -1762,6 +1995,8 @@ Suite *mpegts_sync(void)
     tcase_add_test(tc, time_travel);
     tcase_add_test(tc, ts_pull);
     tcase_add_test(tc, ts_bench);
+    tcase_add_test(tc, paced);
+    tcase_add_test(tc, scheduled);
 
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,398 @@
+/*
+ * Newcamd server stub
+ *
+ * Copyright (C) 2017, Artem Kharitonov <artem@3phase.pw>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Accepts a single client at a time and answers every ECM with a control
+ * word derived from its contents. Responses are delayed by a random time
+ * up to the given number of milliseconds, so requests in flight come back
+ * out of order. Any user name and password are accepted.
+ *
+ * Usage: newcamd_stub <port> [max_delay_ms] [caid]
+ */
+
+#include <astra/astra.h>
+
+#include <openssl/des.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+#define fatal(__fmt, ...) \
+    { \
+        fprintf(stderr, "error: " __fmt "\n", __VA_ARGS__); \
+        exit(1); \
+    }
+
+#define HEADER_SIZE 12
+#define MSG_SIZE (HEADER_SIZE + 1024)
+#define KEY_SIZE 14
+#define PASS_SIZE 34
+
+#define MAX_PENDING 256
+
+enum
+{
+    MSG_LOGIN = 0xE0,
+    MSG_LOGIN_ACK = 0xE1,
+    MSG_CARD_DATA_REQ = 0xE3,
+    MSG_CARD_DATA = 0xE4,
+    MSG_KEEPALIVE = 0xFD,
+};
+
+static
+const uint8_t config_key[KEY_SIZE] =
+{
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x14,
+};
+
+typedef struct
+{
+    uint64_t due;
+    uint8_t msg_id[2];
+    uint8_t sid[2];
+    uint8_t table_id;
+    uint8_t cw[16];
+} pending_t;
+
+static DES_key_schedule ks1;
+static DES_key_schedule ks2;
+
+static pending_t pending[MAX_PENDING];
+static size_t pending_cnt;
+
+/* same key spreading as the client does */
+static
+void set_key(const uint8_t *key, size_t key_size)
+{
+    uint8_t k[KEY_SIZE];
+    memcpy(k, config_key, sizeof(k));
+
+    for (size_t i = 0; i < key_size; i++)
+        k[i % sizeof(k)] ^= key[i];
+
+    uint8_t des[16];
+    for (size_t half = 0; half < 2; half++)
+    {
+        const uint8_t *const s = &k[half * 7];
+        uint8_t *const d = &des[half * 8];
+
+        d[0] = s[0] & 0xfe;
+        for (size_t i = 1; i < 7; i++)
+            d[i] = ((s[i - 1] << (8 - i)) | (s[i] >> i)) & 0xfe;
+
+        d[7] = s[6] << 1;
+    }
+
+    DES_set_odd_parity((DES_cblock *)&des[0]);
+    DES_set_odd_parity((DES_cblock *)&des[8]);
+    DES_key_sched((DES_cblock *)&des[0], &ks1);
+    DES_key_sched((DES_cblock *)&des[8], &ks2);
+}
+
+static
+uint8_t xor_sum(const uint8_t *mem, size_t len)
+{
+    uint8_t cs = 0;
+    while (len-- > 0)
+        cs ^= *mem++;
+
+    return cs;
+}
+
+static
+bool read_full(int fd, uint8_t *buf, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t ret = recv(fd, buf, size, 0);
+        if (ret <= 0)
+            return false;
+
+        buf += ret;
+        size -= ret;
+    }
+
+    return true;
+}
+
+/* receive and decrypt a message; returns payload size or -1 */
+static
+ssize_t msg_recv(int fd, uint8_t *msg)
+{
+    if (!read_full(fd, msg, 2))
+        return -1;
+
+    const size_t size = (msg[0] << 8) | msg[1];
+    if (size < HEADER_SIZE + 8 || size + 2 > MSG_SIZE || size % 8 != 0)
+        return -1;
+
+    if (!read_full(fd, &msg[2], size))
+        return -1;
+
+    DES_cblock ivec;
+    const size_t len = size - sizeof(ivec);
+    memcpy(ivec, &msg[2 + len], sizeof(ivec));
+    DES_ede2_cbc_encrypt(&msg[2], &msg[2], len, &ks1, &ks2
+                         , (DES_cblock *)ivec, DES_DECRYPT);
+
+    if (xor_sum(&msg[2], len) != 0)
+        return -1;
+
+    return ((msg[HEADER_SIZE + 1] & 0x0f) << 8) | msg[HEADER_SIZE + 2];
+}
+
+static
+bool msg_send(int fd, uint8_t *msg, size_t payload_size)
+{
+    msg[HEADER_SIZE + 1] = (payload_size >> 8) & 0x0f;
+    msg[HEADER_SIZE + 2] = payload_size & 0xff;
+
+    size_t size = HEADER_SIZE + 3 + payload_size;
+    const size_t pad = (8 - ((size - 1) % 8)) % 8;
+    memset(&msg[size], 0, pad);
+    size += pad;
+    msg[size] = xor_sum(&msg[2], size - 2);
+    size++;
+
+    DES_cblock ivec;
+    for (size_t i = 0; i < sizeof(ivec); i++)
+        ivec[i] = rand() & 0xff;
+
+    memcpy(&msg[size], ivec, sizeof(ivec));
+    DES_ede2_cbc_encrypt(&msg[2], &msg[2], size - 2, &ks1, &ks2
+                         , (DES_cblock *)ivec, DES_ENCRYPT);
+    size += sizeof(ivec);
+
+    msg[0] = ((size - 2) >> 8) & 0xff;
+    msg[1] = (size - 2) & 0xff;
+
+    return send(fd, msg, size, 0) == (ssize_t)size;
+}
+
+static
+bool send_due(int fd, uint64_t now)
+{
+    uint8_t msg[MSG_SIZE];
+
+    for (size_t i = 0; i < pending_cnt; )
+    {
+        const pending_t *const p = &pending[i];
+        if (p->due > now)
+        {
+            i++;
+            continue;
+        }
+
+        memset(msg, 0, HEADER_SIZE);
+        memcpy(&msg[2], p->msg_id, 2);
+        memcpy(&msg[4], p->sid, 2);
+        msg[HEADER_SIZE] = p->table_id;
+        memcpy(&msg[HEADER_SIZE + 3], p->cw, sizeof(p->cw));
+
+        if (!msg_send(fd, msg, sizeof(p->cw)))
+            return false;
+
+        pending[i] = pending[--pending_cnt];
+    }
+
+    return true;
+}
+
+static
+void on_ecm(const uint8_t *msg, size_t size, unsigned int max_delay)
+{
+    if (pending_cnt >= MAX_PENDING)
+    {
+        fprintf(stderr, "too many pending requests, dropping ECM\n");
+        return;
+    }
+
+    pending_t *const p = &pending[pending_cnt++];
+    memcpy(p->msg_id, &msg[2], 2);
+    memcpy(p->sid, &msg[4], 2);
+    p->table_id = msg[HEADER_SIZE];
+
+    /* control words depend on ECM body only */
+    const uint8_t *const body = &msg[HEADER_SIZE + 3];
+    for (size_t i = 0; i < sizeof(p->cw); i++)
+    {
+        uint8_t cw = i * 0x11;
+        for (size_t j = i; j < size; j += sizeof(p->cw))
+            cw ^= body[j];
+
+        p->cw[i] = cw;
+    }
+
+    /* CSA checksum bytes */
+    for (size_t i = 0; i < sizeof(p->cw); i += 4)
+        p->cw[i + 3] = p->cw[i] + p->cw[i + 1] + p->cw[i + 2];
+
+    p->due = asc_utime();
+    if (max_delay > 0)
+        p->due += (rand() % (max_delay * 1000));
+}
+
+static
+void serve(int fd, unsigned int max_delay, uint16_t caid)
+{
+    uint8_t msg[MSG_SIZE];
+
+    /* login key */
+    uint8_t rnd[KEY_SIZE];
+    for (size_t i = 0; i < sizeof(rnd); i++)
+        rnd[i] = rand() & 0xff;
+
+    if (send(fd, rnd, sizeof(rnd), 0) != sizeof(rnd))
+        return;
+
+    set_key(rnd, sizeof(rnd));
+
+    /* login: user\0 crypted_pass\0 */
+    ssize_t size = msg_recv(fd, msg);
+    if (size <= 0 || msg[HEADER_SIZE] != MSG_LOGIN)
+        return;
+
+    const char *const user = (char *)&msg[HEADER_SIZE + 3];
+    const size_t u_len = strnlen(user, size) + 1;
+    if (u_len + PASS_SIZE > (size_t)size)
+        return;
+
+    uint8_t pass[PASS_SIZE];
+    memcpy(pass, &msg[HEADER_SIZE + 3 + u_len], sizeof(pass));
+    printf("login: %s\n", user);
+
+    memset(msg, 0, HEADER_SIZE);
+    msg[HEADER_SIZE] = MSG_LOGIN_ACK;
+    if (!msg_send(fd, msg, 0))
+        return;
+
+    set_key(pass, sizeof(pass));
+
+    size = msg_recv(fd, msg);
+    if (size < 0 || msg[HEADER_SIZE] != MSG_CARD_DATA_REQ)
+        return;
+
+    /* card data: AU, CAID, UA, no providers */
+    memset(msg, 0, MSG_SIZE);
+    uint8_t *const card = &msg[HEADER_SIZE];
+    card[0] = MSG_CARD_DATA;
+    card[3] = 0;
+    card[4] = caid >> 8;
+    card[5] = caid & 0xff;
+    card[14] = 0;
+    if (!msg_send(fd, msg, 12))
+        return;
+
+    pending_cnt = 0;
+    uint64_t requests = 0;
+
+    while (true)
+    {
+        int timeout = -1;
+        const uint64_t now = asc_utime();
+        for (size_t i = 0; i < pending_cnt; i++)
+        {
+            const int ms = (pending[i].due > now)
+                           ? (int)((pending[i].due - now + 999) / 1000) : 0;
+
+            if (timeout < 0 || ms < timeout)
+                timeout = ms;
+        }
+
+        struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+        const int ret = poll(&pfd, 1, timeout);
+        if (ret < 0)
+            break;
+
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            size = msg_recv(fd, msg);
+            if (size < 0)
+                break;
+
+            const uint8_t cmd = msg[HEADER_SIZE];
+            if (cmd == 0x80 || cmd == 0x81)
+            {
+                on_ecm(msg, size, max_delay);
+                requests++;
+            }
+            else if (cmd == MSG_KEEPALIVE)
+            {
+                memset(msg, 0, HEADER_SIZE);
+                if (!msg_send(fd, msg, 0))
+                    break;
+            }
+        }
+
+        if (!send_due(fd, asc_utime()))
+            break;
+    }
+
+    printf("disconnected after %" PRIu64 " requests\n", requests);
+}
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <port> [max_delay_ms] [caid]\n", argv[0]);
+        return 1;
+    }
+
+    const int port = atoi(argv[1]);
+    const unsigned int max_delay = (argc > 2) ? atoi(argv[2]) : 0;
+    const uint16_t caid = (argc > 3) ? strtoul(argv[3], NULL, 16) : 0x0500;
+
+    srand(time(NULL));
+
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == -1)
+        fatal("socket(): %s", strerror(errno));
+
+    const int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)) != 0)
+        fatal("bind(): %s", strerror(errno));
+
+    if (listen(sock, 1) != 0)
+        fatal("listen(): %s", strerror(errno));
+
+    printf("listening on 127.0.0.1:%d\n", port);
+    fflush(stdout);
+
+    while (true)
+    {
+        const int fd = accept(sock, NULL, NULL);
+        if (fd == -1)
+            fatal("accept(): %s", strerror(errno));
+
+        serve(fd, max_delay, caid);
+        fflush(stdout);
+        close(fd);
+    }
+
+    return 0;
+}
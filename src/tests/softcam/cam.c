@@ -0,0 +1,332 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <stream/softcam/module_cam.h>
+
+#define ECM_SIZE 32
+#define RESPONSE_SIZE (3 + 16)
+
+/*
+ * Serves as both the fake CAM and the fake decrypt instances; the cam
+ * code only ever passes `self' pointers around.
+ */
+struct module_data_t
+{
+    module_cam_t __cam;
+    module_decrypt_t __decrypt;
+
+    /* decrypt side */
+    unsigned int responses;
+    void *last_arg;
+    uint8_t last_response[RESPONSE_SIZE];
+
+    /* CAM side */
+    unsigned int requests;
+};
+
+static module_data_t cam_mod;
+static module_data_t dec_mod[3];
+static module_data_t *cam = &cam_mod;
+
+static
+void fake_connect(module_data_t *mod)
+{
+    ASC_UNUSED(mod);
+}
+
+static
+void fake_disconnect(module_data_t *mod)
+{
+    ASC_UNUSED(mod);
+}
+
+/* queue requests, replacing stale ECMs the way newcamd does */
+static
+void fake_send_em(module_data_t *mod, module_decrypt_t *decrypt, void *arg
+                  , const uint8_t *buffer, uint16_t size)
+{
+    mod->requests++;
+
+    em_packet_t *const packet = ASC_ALLOC(1, em_packet_t);
+    memcpy(packet->buffer, buffer, size);
+    packet->buffer_size = size;
+    packet->decrypt = decrypt;
+    packet->arg = arg;
+
+    em_packet_t *old_packet = NULL;
+    asc_list_for(mod->__cam.packet_queue)
+    {
+        em_packet_t *const item =
+            (em_packet_t *)asc_list_data(mod->__cam.packet_queue);
+
+        if (item->decrypt == decrypt && item->arg == arg)
+        {
+            asc_list_remove_current(mod->__cam.packet_queue);
+            old_packet = item;
+            break;
+        }
+    }
+
+    asc_list_insert_tail(mod->__cam.packet_queue, packet);
+
+    if (old_packet != NULL)
+    {
+        module_cam_drop(&mod->__cam, old_packet);
+        free(old_packet);
+    }
+}
+
+/* decrypt callbacks, normally provided by decrypt.c */
+void on_cam_ready(module_data_t *mod)
+{
+    ASC_UNUSED(mod);
+}
+
+void on_cam_error(module_data_t *mod)
+{
+    ASC_UNUSED(mod);
+}
+
+void on_cam_response(module_data_t *mod, void *arg, const uint8_t *data)
+{
+    mod->responses++;
+    mod->last_arg = arg;
+
+    memset(mod->last_response, 0, sizeof(mod->last_response));
+    memcpy(mod->last_response, data, 3 + data[2]);
+}
+
+static
+void setup(void)
+{
+    lib_setup();
+
+    memset(&cam_mod, 0, sizeof(cam_mod));
+    memset(dec_mod, 0, sizeof(dec_mod));
+
+    module_cam_init(cam, fake_connect, fake_disconnect, fake_send_em);
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(dec_mod); i++)
+    {
+        dec_mod[i].__decrypt.self = &dec_mod[i];
+        dec_mod[i].__decrypt.pnr = i + 1;
+        module_cam_attach_decrypt(&cam->__cam, &dec_mod[i].__decrypt);
+    }
+
+    module_cam_ready(&cam->__cam);
+}
+
+static
+void teardown(void)
+{
+    module_cam_destroy(cam);
+    lib_teardown();
+}
+
+static
+void send_ecm(module_data_t *dec, uint8_t id)
+{
+    uint8_t ecm[ECM_SIZE];
+    memset(ecm, id, sizeof(ecm));
+    ecm[0] = 0x80 | (id & 1);
+
+    module_cam_send_em(&cam->__cam, &dec->__decrypt, dec, ecm, sizeof(ecm));
+}
+
+/* answer oldest request; keys are derived from the ECM */
+static
+bool answer(bool is_keys)
+{
+    em_packet_t *const packet = module_cam_queue_pop(&cam->__cam);
+    if (packet == NULL)
+        return false;
+
+    uint8_t response[RESPONSE_SIZE] = { 0 };
+    response[0] = packet->buffer[0];
+    if (is_keys)
+    {
+        response[2] = 16;
+        memset(&response[3], packet->buffer[1], 16);
+    }
+
+    module_cam_response(&cam->__cam, packet, response);
+    free(packet);
+
+    return true;
+}
+
+/* requests queued for the CAM */
+static
+size_t queued(void)
+{
+    return asc_list_count(cam->__cam.packet_queue);
+}
+
+/* keys received by the decrypt, as set by answer() */
+static
+uint8_t keys_of(const module_data_t *dec)
+{
+    ck_assert(dec->last_response[2] == 16);
+    return dec->last_response[3];
+}
+
+/* same ECM from two decrypts: one request, both get the keys */
+START_TEST(shared_ecm)
+{
+    module_data_t *const a = &dec_mod[0];
+    module_data_t *const b = &dec_mod[1];
+
+    send_ecm(a, 0x10);
+    send_ecm(b, 0x10);
+    ck_assert(cam->requests == 1);
+    ck_assert(cam->__cam.ecm_stats.misses == 1);
+    ck_assert(cam->__cam.ecm_stats.coalesced == 1);
+
+    ck_assert(answer(true));
+    ck_assert(a->responses == 1 && a->last_arg == a);
+    ck_assert(keys_of(a) == 0x10);
+    ck_assert(b->responses == 1 && b->last_arg == b);
+    ck_assert(keys_of(b) == 0x10);
+
+    /* answered from the cache */
+    send_ecm(&dec_mod[2], 0x10);
+    ck_assert(cam->requests == 1);
+    ck_assert(cam->__cam.ecm_stats.hits == 1);
+    ck_assert(dec_mod[2].responses == 1);
+    ck_assert(keys_of(&dec_mod[2]) == 0x10);
+}
+END_TEST
+
+/* failure is passed to every waiter but isn't cached */
+START_TEST(failure_not_cached)
+{
+    module_data_t *const a = &dec_mod[0];
+    module_data_t *const b = &dec_mod[1];
+
+    send_ecm(a, 0x10);
+    send_ecm(b, 0x10);
+    ck_assert(answer(false));
+
+    ck_assert(a->responses == 1 && a->last_response[2] == 0);
+    ck_assert(b->responses == 1 && b->last_response[2] == 0);
+    ck_assert(asc_list_count(cam->__cam.ecm_cache) == 0);
+
+    /* next copy goes to the CAM again */
+    send_ecm(b, 0x10);
+    ck_assert(cam->requests == 2);
+    ck_assert(cam->__cam.ecm_stats.hits == 0);
+
+    ck_assert(answer(true));
+    ck_assert(b->responses == 2);
+    ck_assert(keys_of(b) == 0x10);
+    ck_assert(a->responses == 1);
+}
+END_TEST
+
+/* detaching the decrypt a request was sent for */
+START_TEST(detach_sender)
+{
+    module_data_t *const a = &dec_mod[0];
+    module_data_t *const b = &dec_mod[1];
+    module_data_t *const c = &dec_mod[2];
+
+    send_ecm(a, 0x10);
+    send_ecm(b, 0x10);
+    send_ecm(c, 0x10);
+    ck_assert(cam->requests == 1);
+
+    /* CAM discards requests of a detached decrypt; resent for `b' */
+    module_cam_detach_decrypt(&cam->__cam, &a->__decrypt);
+    ck_assert(cam->requests == 2);
+    ck_assert(queued() == 1);
+
+    /* detaching a waiter that didn't send the request changes nothing */
+    module_cam_detach_decrypt(&cam->__cam, &c->__decrypt);
+    ck_assert(cam->requests == 2);
+
+    ck_assert(answer(true));
+    ck_assert(a->responses == 0);
+    ck_assert(c->responses == 0);
+    ck_assert(b->responses == 1);
+    ck_assert(keys_of(b) == 0x10);
+
+    /* last waiter gone: pending entry is dropped */
+    send_ecm(b, 0x20);
+    module_cam_detach_decrypt(&cam->__cam, &b->__decrypt);
+    ck_assert(queued() == 0);
+    ck_assert(asc_list_count(cam->__cam.ecm_cache) == 1);
+}
+END_TEST
+
+/* a queued ECM replaced by a newer one from the same stream */
+START_TEST(superseded_ecm)
+{
+    module_data_t *const a = &dec_mod[0];
+    module_data_t *const b = &dec_mod[1];
+
+    send_ecm(a, 0x10);
+    send_ecm(b, 0x10);
+    ck_assert(cam->requests == 1);
+
+    /* request for 0x10 is resent on behalf of the other waiter */
+    send_ecm(a, 0x11);
+    ck_assert(cam->requests == 3);
+    ck_assert(queued() == 2);
+
+    while (answer(true))
+        ;
+
+    ck_assert(a->responses == 1);
+    ck_assert(keys_of(a) == 0x11);
+    ck_assert(b->responses == 1);
+    ck_assert(keys_of(b) == 0x10);
+
+    /* nobody else waiting: entry is dropped, not left pending */
+    send_ecm(a, 0x20);
+    send_ecm(a, 0x21);
+    ck_assert(cam->requests == 5);
+    ck_assert(queued() == 1);
+
+    send_ecm(b, 0x20);
+    ck_assert(cam->requests == 6);
+
+    while (answer(true))
+        ;
+
+    ck_assert(a->responses == 2);
+    ck_assert(keys_of(a) == 0x21);
+    ck_assert(b->responses == 2);
+    ck_assert(keys_of(b) == 0x20);
+}
+END_TEST
+
+Suite *softcam_cam(void)
+{
+    Suite *const s = suite_create("softcam/cam");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, shared_ecm);
+    tcase_add_test(tc, failure_not_cached);
+    tcase_add_test(tc, detach_sender);
+    tcase_add_test(tc, superseded_ecm);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
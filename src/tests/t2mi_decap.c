@@ -35,6 +35,35 @@ static void on_ts(void *arg, const uint8_t *ts)
         fatal("fwrite: %s", strerror(errno));
 }
 
+/* multi-PLP mode: one output file per PLP, opened on first packet */
+typedef struct
+{
+    unsigned id;
+    const char *prefix;
+    FILE *f;
+} plp_file_t;
+
+static plp_file_t plp_files[T2MI_PLP_COUNT];
+
+static void on_plp_ts(void *arg, const uint8_t *ts)
+{
+    plp_file_t *const pf = (plp_file_t *)arg;
+
+    if (pf->f == NULL)
+    {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.%u", pf->prefix, pf->id);
+
+        pf->f = fopen(path, "wb");
+        if (!pf->f)
+            fatal("fopen: %s: %s", path, strerror(errno));
+
+        asc_log_info(MSG("writing PLP %u to %s"), pf->id, path);
+    }
+
+    on_ts(pf->f, ts);
+}
+
 static void join_pid(module_data_t *arg, uint16_t pid)
 {
     ASC_UNUSED(arg);
@@ -58,14 +87,21 @@ int main(int argc, char *argv[])
     unsigned plp_id = 0x100;
     unsigned outer_pid = 0;
     unsigned outer_pnr = 0;
+    bool all_plps = false;
 
     bool show_usage = false;
 
     int c;
-    while ((c = getopt(argc, argv, "i:o:p:P:s:")) != -1)
+    while ((c = getopt(argc, argv, "ai:o:p:P:s:")) != -1)
     {
         switch (c)
         {
+            case 'a':
+                /* all plps */
+                all_plps = true;
+                asc_log_info(MSG("option: extract all PLP's"));
+                break;
+
             case 'i':
                 /* in file */
                 infile = optarg;
@@ -111,6 +147,7 @@ int main(int argc, char *argv[])
         fatal(
             "usage: %s OPTIONS -i <infile> -o <outfile>\n"
             "options:\n"
+            "\t-a (write each PLP to <outfile>.<plp_id>)\n"
             "\t-p <plp_id>\n"
             "\t-P <payload_pid>\n"
             "\t-s <payload_pnr>"
@@ -125,9 +162,13 @@ int main(int argc, char *argv[])
     if (!f_in)
         fatal("fopen: %s: %s", infile, strerror(errno));
 
-    FILE *f_out = fopen(outfile, "wb");
-    if (!f_out)
-        fatal("fopen: %s: %s", outfile, strerror(errno));
+    FILE *f_out = NULL;
+    if (!all_plps)
+    {
+        f_out = fopen(outfile, "wb");
+        if (!f_out)
+            fatal("fopen: %s: %s", outfile, strerror(errno));
+    }
 
     /* feed TS to decapsulator */
     ts_t2mi_t *const mi = ts_t2mi_init();
@@ -137,18 +178,51 @@ int main(int argc, char *argv[])
     ts_t2mi_set_payload(mi, outer_pnr, outer_pid);
     ts_t2mi_set_plp(mi, plp_id);
 
-    ts_t2mi_set_callback(mi, on_ts, f_out);
+    if (all_plps)
+    {
+        for (unsigned i = 0; i < T2MI_PLP_COUNT; i++)
+        {
+            plp_files[i].id = i;
+            plp_files[i].prefix = outfile;
+            ts_t2mi_set_plp_callback(mi, i, on_plp_ts, &plp_files[i]);
+        }
+    }
+    else
+    {
+        ts_t2mi_set_callback(mi, on_ts, f_out);
+    }
 
     uint8_t ts[TS_PACKET_SIZE];
     while (fread(ts, sizeof(ts), 1, f_in) == 1)
         ts_t2mi_decap(mi, ts);
 
+    /* print statistics */
+    for (unsigned i = 0; i < T2MI_PLP_COUNT; i++)
+    {
+        ts_t2mi_plp_stats_t st;
+        if (!ts_t2mi_get_plp_stats(mi, i, &st) || st.bbframes == 0)
+            continue;
+
+        asc_log_info(MSG("PLP %u: %" PRIu64 " BBframes, %" PRIu64 " packets, "
+                         "%" PRIu64 " nulls, %" PRIu64 " errors, "
+                         "%" PRIu64 " dropped fragments")
+                     , i, st.bbframes, st.packets, st.nulls
+                     , st.errors, st.dropped);
+    }
+
     /* clean up */
     asc_log_info(MSG("cleaning up"));
     ts_t2mi_destroy(mi);
 
     fclose(f_in);
-    fclose(f_out);
+    if (f_out != NULL)
+        fclose(f_out);
+
+    for (unsigned i = 0; i < T2MI_PLP_COUNT; i++)
+    {
+        if (plp_files[i].f != NULL)
+            fclose(plp_files[i].f);
+    }
 
     asc_log_core_destroy();
 
@@ -21,6 +21,30 @@
 #include "../libastra.h"
 #include <astra/utils/crc32b.h>
 
+typedef uint32_t (*crc32b_func_t)(const void *, size_t);
+
+/* implementations to test; au_crc32b() picks the fastest one */
+static
+const crc32b_func_t crc32b_funcs[] =
+{
+    au_crc32b,
+    au_crc32b_sb8,
+#ifdef HAVE_PCLMUL
+    au_crc32b_clmul,
+#endif /* HAVE_PCLMUL */
+};
+
+static
+size_t crc32b_func_count(void)
+{
+#ifdef HAVE_PCLMUL
+    if (!au_crc32b_clmul_supported())
+        return ASC_ARRAY_SIZE(crc32b_funcs) - 1;
+#endif /* HAVE_PCLMUL */
+
+    return ASC_ARRAY_SIZE(crc32b_funcs);
+}
+
 /* PSI tables */
 static
 const uint8_t test_tables[][96] =
@@ -122,15 +146,20 @@ const uint8_t test_tables[][96] =
 
 START_TEST(psi_tables)
 {
-    for (size_t i = 0; i < ASC_ARRAY_SIZE(test_tables); i++)
+    for (size_t f = 0; f < crc32b_func_count(); f++)
     {
-        const uint8_t *const buf = test_tables[i];
-        const size_t buf_size = buf[2] + 3;
-        ck_assert(buf_size > CRC32_SIZE);
+        for (size_t i = 0; i < ASC_ARRAY_SIZE(test_tables); i++)
+        {
+            const uint8_t *const buf = test_tables[i];
+            const size_t buf_size = buf[2] + 3;
+            ck_assert(buf_size > CRC32_SIZE);
 
-        const uint32_t expect = asc_get_be32(&buf[buf_size - CRC32_SIZE]);
-        const uint32_t crc = au_crc32b(buf, buf_size - CRC32_SIZE);
-        ck_assert(crc == expect);
+            const uint32_t expect =
+                asc_get_be32(&buf[buf_size - CRC32_SIZE]);
+            const uint32_t crc =
+                crc32b_funcs[f](buf, buf_size - CRC32_SIZE);
+            ck_assert(crc == expect);
+        }
     }
 }
 END_TEST
@@ -221,10 +250,14 @@ START_TEST(repeating_strings)
             for (size_t i = 0; i < len; i++)
                 buf[i] = t->alphabet[i % alphachrs];
 
-            const uint32_t crc = au_crc32b(buf, len);
-            ck_assert_msg(crc == t->crc[r]
-                          , "rep: %zu/%zu/% 8zu: expected 0x%08x, got 0x%08x\n"
-                          , j, r, len, t->crc[r], crc);
+            for (size_t f = 0; f < crc32b_func_count(); f++)
+            {
+                const uint32_t crc = crc32b_funcs[f](buf, len);
+                ck_assert_msg(crc == t->crc[r]
+                              , "rep: %zu/%zu/%zu/% 8zu: expected 0x%08x, "
+                                "got 0x%08x\n"
+                              , f, j, r, len, t->crc[r], crc);
+            }
 
             free(buf);
         }
@@ -232,12 +265,59 @@ START_TEST(repeating_strings)
 }
 END_TEST
 
+/* compare against bit-at-a-time calculation at all lengths and offsets */
+static
+uint32_t crc32b_bitwise(const uint8_t *buf, size_t len)
+{
+    if (len == 0)
+        return 0;
+
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint32_t)buf[i] << 24;
+        for (unsigned int b = 0; b < 8; b++)
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+
+    return crc;
+}
+
+START_TEST(random_data)
+{
+    static uint8_t buf[1024 + 16];
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = rand();
+
+    for (size_t off = 0; off < 16; off++)
+    {
+        for (size_t len = 0; len <= 1024; len++)
+        {
+            const uint32_t expect = crc32b_bitwise(&buf[off], len);
+
+            for (size_t f = 0; f < crc32b_func_count(); f++)
+            {
+                const uint32_t crc = crc32b_funcs[f](&buf[off], len);
+                ck_assert_msg(crc == expect
+                              , "rand: %zu/%zu/%zu: expected 0x%08x, "
+                                "got 0x%08x\n"
+                              , f, off, len, expect, crc);
+            }
+        }
+    }
+}
+END_TEST
+
 /* zero length input */
 START_TEST(zero_length)
 {
     char empty[1] = { 0 };
-    ck_assert(au_crc32b(NULL, 0) == 0);
-    ck_assert(au_crc32b(empty, 0) == 0);
+
+    for (size_t f = 0; f < crc32b_func_count(); f++)
+    {
+        ck_assert(crc32b_funcs[f](NULL, 0) == 0);
+        ck_assert(crc32b_funcs[f](empty, 0) == 0);
+    }
 }
 END_TEST
 
@@ -248,6 +328,7 @@ Suite *utils_crc32b(void)
     TCase *const tc = tcase_create("default");
     tcase_add_test(tc, psi_tables);
     tcase_add_test(tc, repeating_strings);
+    tcase_add_test(tc, random_data);
     tcase_add_test(tc, zero_length);
     suite_add_tcase(s, tc);
 
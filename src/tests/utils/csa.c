@@ -0,0 +1,745 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../libastra.h"
+#include <astra/utils/csa.h>
+
+#ifdef HAVE_DVBCSA
+#   include <dvbcsa/dvbcsa.h>
+#endif /* HAVE_DVBCSA */
+
+typedef struct
+{
+    uint8_t cw[CSA_CW_SIZE];
+    unsigned int len;
+    uint8_t data[TS_BODY_SIZE];
+} csa_test_t;
+
+#include "csa_vectors.h"
+
+/*
+ * Second implementation, written separately from astra/utils/csa.c in
+ * the classic FreeDec/VLC form: one nibble per shift register cell,
+ * stream cipher S-boxes as 32-entry lookup tables, block cipher byte
+ * registers R1..R8 and a per-bit key permutation.
+ */
+
+static
+const uint8_t cl_key_perm[64] =
+{
+    0x12, 0x24, 0x09, 0x07, 0x2a, 0x31, 0x1d, 0x15,
+    0x1c, 0x36, 0x3e, 0x32, 0x13, 0x21, 0x3b, 0x40,
+    0x18, 0x14, 0x25, 0x27, 0x02, 0x35, 0x1b, 0x01,
+    0x22, 0x04, 0x0d, 0x0e, 0x39, 0x28, 0x1a, 0x29,
+    0x33, 0x23, 0x34, 0x0c, 0x16, 0x30, 0x1e, 0x3a,
+    0x2d, 0x1f, 0x08, 0x19, 0x17, 0x2f, 0x3d, 0x11,
+    0x3c, 0x05, 0x38, 0x2b, 0x0b, 0x06, 0x0a, 0x2c,
+    0x20, 0x3f, 0x2e, 0x0f, 0x03, 0x26, 0x10, 0x37,
+};
+
+static
+const uint8_t cl_sbox[7][32] =
+{
+    { 2, 0, 1, 1, 2, 3, 3, 0, 3, 2, 2, 0, 1, 1, 0, 3
+    , 0, 3, 3, 0, 2, 2, 1, 1, 2, 2, 0, 3, 1, 1, 3, 0 },
+    { 3, 1, 0, 2, 2, 3, 3, 0, 1, 3, 2, 1, 0, 0, 1, 2
+    , 3, 1, 0, 3, 3, 2, 0, 2, 0, 0, 1, 2, 2, 1, 3, 1 },
+    { 2, 0, 1, 2, 2, 3, 3, 1, 1, 1, 0, 3, 3, 0, 2, 0
+    , 1, 3, 0, 1, 3, 0, 2, 2, 2, 0, 1, 2, 0, 3, 3, 1 },
+    { 3, 1, 2, 3, 0, 2, 1, 2, 1, 2, 0, 1, 3, 0, 0, 3
+    , 1, 0, 3, 1, 2, 3, 0, 3, 0, 3, 2, 0, 1, 2, 2, 1 },
+    { 2, 0, 0, 1, 3, 2, 3, 2, 0, 1, 3, 3, 1, 0, 2, 1
+    , 2, 3, 2, 0, 0, 3, 1, 1, 1, 0, 3, 2, 3, 1, 0, 2 },
+    { 0, 1, 2, 3, 1, 2, 2, 0, 0, 1, 3, 0, 2, 3, 1, 3
+    , 2, 3, 0, 2, 3, 0, 1, 1, 2, 1, 1, 2, 0, 3, 3, 0 },
+    { 0, 3, 2, 2, 3, 0, 0, 1, 3, 0, 1, 3, 1, 2, 2, 1
+    , 1, 0, 3, 3, 0, 1, 1, 2, 2, 3, 1, 0, 2, 3, 0, 2 },
+};
+
+static
+const uint8_t cl_block_sbox[256] =
+{
+    0x3a, 0xea, 0x68, 0xfe, 0x33, 0xe9, 0x88, 0x1a, 0x83, 0xcf, 0xe1, 0x7f,
+    0xba, 0xe2, 0x38, 0x12, 0xe8, 0x27, 0x61, 0x95, 0x0c, 0x36, 0xe5, 0x70,
+    0xa2, 0x06, 0x82, 0x7c, 0x17, 0xa3, 0x26, 0x49, 0xbe, 0x7a, 0x6d, 0x47,
+    0xc1, 0x51, 0x8f, 0xf3, 0xcc, 0x5b, 0x67, 0xbd, 0xcd, 0x18, 0x08, 0xc9,
+    0xff, 0x69, 0xef, 0x03, 0x4e, 0x48, 0x4a, 0x84, 0x3f, 0xb4, 0x10, 0x04,
+    0xdc, 0xf5, 0x5c, 0xc6, 0x16, 0xab, 0xac, 0x4c, 0xf1, 0x6a, 0x2f, 0x3c,
+    0x3b, 0xd4, 0xd5, 0x94, 0xd0, 0xc4, 0x63, 0x62, 0x71, 0xa1, 0xf9, 0x4f,
+    0x2e, 0xaa, 0xc5, 0x56, 0xe3, 0x39, 0x93, 0xce, 0x65, 0x64, 0xe4, 0x58,
+    0x6c, 0x19, 0x42, 0x79, 0xdd, 0xee, 0x96, 0xf6, 0x8a, 0xec, 0x1e, 0x85,
+    0x53, 0x45, 0xde, 0xbb, 0x7e, 0x0a, 0x9a, 0x13, 0x2a, 0x9d, 0xc2, 0x5e,
+    0x5a, 0x1f, 0x32, 0x35, 0x9c, 0xa8, 0x73, 0x30, 0x29, 0x3d, 0xe7, 0x92,
+    0x87, 0x1b, 0x2b, 0x4b, 0xa5, 0x57, 0x97, 0x40, 0x15, 0xe6, 0xbc, 0x0e,
+    0xeb, 0xc3, 0x34, 0x2d, 0xb8, 0x44, 0x25, 0xa4, 0x1c, 0xc7, 0x23, 0xed,
+    0x90, 0x6e, 0x50, 0x00, 0x99, 0x9e, 0x4d, 0xd9, 0xda, 0x8d, 0x6f, 0x5f,
+    0x3e, 0xd7, 0x21, 0x74, 0x86, 0xdf, 0x6b, 0x05, 0x8e, 0x5d, 0x37, 0x11,
+    0xd2, 0x28, 0x75, 0xd6, 0xa7, 0x77, 0x24, 0xbf, 0xf0, 0xb0, 0x02, 0xb7,
+    0xf8, 0xfc, 0x81, 0x09, 0xb1, 0x01, 0x76, 0x91, 0x7d, 0x0f, 0xc8, 0xa0,
+    0xf2, 0xcb, 0x78, 0x60, 0xd1, 0xf7, 0xe0, 0xb5, 0x98, 0x22, 0xb3, 0x20,
+    0x1d, 0xa6, 0xdb, 0x7b, 0x59, 0x9f, 0xae, 0x31, 0xfb, 0xd3, 0xb6, 0xca,
+    0x43, 0x72, 0x07, 0xf4, 0xd8, 0x41, 0x14, 0x55, 0x0d, 0x54, 0x8b, 0xb9,
+    0xad, 0x46, 0x0b, 0xaf, 0x80, 0x52, 0x2c, 0xfa, 0x8c, 0x89, 0x66, 0xfd,
+    0xb2, 0xa9, 0x9b, 0xc0,
+};
+
+/* block cipher output bit permutation: bit i moves to cl_perm_to[i] */
+static
+const unsigned int cl_perm_to[8] = { 1, 7, 5, 4, 2, 6, 0, 3 };
+
+typedef struct
+{
+    int a[11]; /* A1..A10 */
+    int b[11]; /* B1..B10 */
+    int x, y, z, d, e, f, p, q, r;
+} cl_stream_t;
+
+#define CL_BIT(_v, _n, _to) ((((_v) >> (_n)) & 1) << (_to))
+
+static
+void cl_key_schedule(uint8_t kk[57], const uint8_t *cw)
+{
+    int kb[8][9];
+
+    for (unsigned int i = 0; i < 8; i++)
+        kb[7][i + 1] = cw[i];
+
+    for (unsigned int i = 0; i < 7; i++)
+    {
+        int bit[64];
+
+        for (unsigned int j = 0; j < 64; j++)
+            bit[cl_key_perm[j] - 1] = (kb[7 - i][1 + j / 8] >> (7 - j % 8)) & 1;
+
+        for (unsigned int j = 0; j < 8; j++)
+        {
+            kb[6 - i][1 + j] = 0;
+            for (unsigned int k = 0; k < 8; k++)
+                kb[6 - i][1 + j] |= bit[j * 8 + k] << (7 - k);
+        }
+    }
+
+    for (unsigned int i = 0; i < 7; i++)
+    {
+        for (unsigned int j = 0; j < 8; j++)
+            kk[1 + i * 8 + j] = kb[1 + i][1 + j] ^ i;
+    }
+}
+
+static
+void cl_stream(cl_stream_t *c, bool init, const uint8_t *cw
+               , const uint8_t *in, uint8_t *out)
+{
+    if (init)
+    {
+        memset(c, 0, sizeof(*c));
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            c->a[1 + 2 * i] = cw[i] >> 4;
+            c->a[2 + 2 * i] = cw[i] & 0x0f;
+            c->b[1 + 2 * i] = cw[4 + i] >> 4;
+            c->b[2 + 2 * i] = cw[4 + i] & 0x0f;
+        }
+    }
+
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        const int in1 = init ? in[i] >> 4 : 0;
+        const int in2 = init ? in[i] & 0x0f : 0;
+        int op = 0;
+
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            int *const a = c->a;
+            int *const b = c->b;
+
+            const int s1 = cl_sbox[0][CL_BIT(a[4], 0, 4) | CL_BIT(a[1], 2, 3)
+                | CL_BIT(a[6], 1, 2) | CL_BIT(a[7], 3, 1) | CL_BIT(a[9], 0, 0)];
+            const int s2 = cl_sbox[1][CL_BIT(a[2], 1, 4) | CL_BIT(a[3], 2, 3)
+                | CL_BIT(a[6], 3, 2) | CL_BIT(a[7], 0, 1) | CL_BIT(a[9], 1, 0)];
+            const int s3 = cl_sbox[2][CL_BIT(a[1], 3, 4) | CL_BIT(a[2], 0, 3)
+                | CL_BIT(a[5], 1, 2) | CL_BIT(a[5], 3, 1) | CL_BIT(a[6], 2, 0)];
+            const int s4 = cl_sbox[3][CL_BIT(a[3], 3, 4) | CL_BIT(a[1], 1, 3)
+                | CL_BIT(a[2], 3, 2) | CL_BIT(a[4], 2, 1) | CL_BIT(a[8], 0, 0)];
+            const int s5 = cl_sbox[4][CL_BIT(a[5], 2, 4) | CL_BIT(a[4], 3, 3)
+                | CL_BIT(a[6], 0, 2) | CL_BIT(a[8], 1, 1) | CL_BIT(a[9], 2, 0)];
+            const int s6 = cl_sbox[5][CL_BIT(a[3], 1, 4) | CL_BIT(a[4], 1, 3)
+                | CL_BIT(a[5], 0, 2) | CL_BIT(a[7], 2, 1) | CL_BIT(a[9], 3, 0)];
+            const int s7 = cl_sbox[6][CL_BIT(a[2], 2, 4) | CL_BIT(a[3], 0, 3)
+                | CL_BIT(a[7], 1, 2) | CL_BIT(a[8], 2, 1) | CL_BIT(a[8], 3, 0)];
+
+            const int extra_b =
+                (CL_BIT(b[3], 0, 3) ^ CL_BIT(b[6], 1, 3)
+                 ^ CL_BIT(b[7], 2, 3) ^ CL_BIT(b[9], 3, 3))
+                | (CL_BIT(b[6], 0, 2) ^ CL_BIT(b[8], 1, 2)
+                   ^ CL_BIT(b[3], 3, 2) ^ CL_BIT(b[4], 2, 2))
+                | (CL_BIT(b[5], 3, 1) ^ CL_BIT(b[8], 2, 1)
+                   ^ CL_BIT(b[4], 0, 1) ^ CL_BIT(b[5], 1, 1))
+                | (CL_BIT(b[9], 2, 0) ^ CL_BIT(b[6], 3, 0)
+                   ^ CL_BIT(b[3], 1, 0) ^ CL_BIT(b[8], 0, 0));
+
+            int next_a1 = a[10] ^ c->x;
+            int next_b1 = b[7] ^ b[10] ^ c->y;
+            if (init)
+            {
+                next_a1 ^= c->d ^ ((j % 2) ? in2 : in1);
+                next_b1 ^= (j % 2) ? in1 : in2;
+            }
+
+            if (c->p)
+                next_b1 = ((next_b1 << 1) | (next_b1 >> 3)) & 0x0f;
+
+            c->d = c->e ^ c->z ^ extra_b;
+
+            const int next_e = c->f;
+            if (c->q)
+            {
+                c->f = c->z + c->e + c->r;
+                c->r = (c->f >> 4) & 1;
+                c->f &= 0x0f;
+            }
+            else
+            {
+                c->f = c->e;
+            }
+            c->e = next_e;
+
+            for (unsigned int k = 10; k > 1; k--)
+            {
+                a[k] = a[k - 1];
+                b[k] = b[k - 1];
+            }
+            a[1] = next_a1;
+            b[1] = next_b1;
+
+            c->x = CL_BIT(s4, 0, 3) | CL_BIT(s3, 0, 2)
+                 | CL_BIT(s2, 1, 1) | CL_BIT(s1, 1, 0);
+            c->y = CL_BIT(s6, 0, 3) | CL_BIT(s5, 0, 2)
+                 | CL_BIT(s4, 1, 1) | CL_BIT(s3, 1, 0);
+            c->z = CL_BIT(s2, 0, 3) | CL_BIT(s1, 0, 2)
+                 | CL_BIT(s7, 1, 1) | CL_BIT(s6, 1, 0);
+            c->p = (s7 >> 1) & 1;
+            c->q = s7 & 1;
+
+            const int dd = c->d ^ (c->d >> 1);
+            op = (op << 2) ^ (((dd >> 1) & 2) | (dd & 1));
+        }
+
+        if (!init)
+            out[i] = op;
+    }
+}
+
+static
+int cl_perm(int x)
+{
+    int out = 0;
+
+    for (unsigned int i = 0; i < 8; i++)
+        out |= CL_BIT(x, i, cl_perm_to[i]);
+
+    return out;
+}
+
+static
+void cl_block_decrypt(const uint8_t kk[57], const uint8_t *in, uint8_t *out)
+{
+    int r[9];
+
+    for (unsigned int i = 0; i < 8; i++)
+        r[i + 1] = in[i];
+
+    for (unsigned int i = 56; i > 0; i--)
+    {
+        const int so = cl_block_sbox[kk[i] ^ r[7]];
+        const int next_r8 = r[7];
+
+        r[7] = r[6] ^ cl_perm(so);
+        r[6] = r[5];
+        r[5] = r[4] ^ r[8] ^ so;
+        r[4] = r[3] ^ r[8] ^ so;
+        r[3] = r[2] ^ r[8] ^ so;
+        r[2] = r[1];
+        r[1] = r[8] ^ so;
+        r[8] = next_r8;
+    }
+
+    for (unsigned int i = 0; i < 8; i++)
+        out[i] = r[i + 1];
+}
+
+static
+void cl_block_encrypt(const uint8_t kk[57], const uint8_t *in, uint8_t *out)
+{
+    int r[9];
+
+    for (unsigned int i = 0; i < 8; i++)
+        r[i + 1] = in[i];
+
+    for (unsigned int i = 1; i <= 56; i++)
+    {
+        const int so = cl_block_sbox[kk[i] ^ r[8]];
+        const int next_r1 = r[2];
+
+        r[2] = r[3] ^ r[1];
+        r[3] = r[4] ^ r[1];
+        r[4] = r[5] ^ r[1];
+        r[5] = r[6];
+        r[6] = r[7] ^ cl_perm(so);
+        r[7] = r[8];
+        r[8] = r[1] ^ so;
+        r[1] = next_r1;
+    }
+
+    for (unsigned int i = 0; i < 8; i++)
+        out[i] = r[i + 1];
+}
+
+static
+void cl_decrypt(const uint8_t *cw, uint8_t *data, unsigned int len)
+{
+    const unsigned int n = len / 8;
+    const unsigned int residue = len % 8;
+    if (n == 0)
+        return;
+
+    uint8_t kk[57];
+    cl_key_schedule(kk, cw);
+
+    cl_stream_t c;
+    uint8_t ib[8], block[8], st[8];
+
+    memcpy(ib, data, sizeof(ib));
+    cl_stream(&c, true, cw, ib, NULL);
+
+    for (unsigned int i = 1; i <= n; i++)
+    {
+        cl_block_decrypt(kk, ib, block);
+
+        if (i < n)
+        {
+            cl_stream(&c, false, cw, NULL, st);
+            for (unsigned int j = 0; j < 8; j++)
+                ib[j] = data[8 * i + j] ^ st[j];
+        }
+        else
+        {
+            memset(ib, 0, sizeof(ib));
+        }
+
+        for (unsigned int j = 0; j < 8; j++)
+            data[8 * (i - 1) + j] = ib[j] ^ block[j];
+    }
+
+    if (residue > 0)
+    {
+        cl_stream(&c, false, cw, NULL, st);
+        for (unsigned int j = 0; j < residue; j++)
+            data[len - residue + j] ^= st[j];
+    }
+}
+
+static
+void cl_encrypt(const uint8_t *cw, uint8_t *data, unsigned int len)
+{
+    const unsigned int n = len / 8;
+    const unsigned int residue = len % 8;
+    if (n == 0)
+        return;
+
+    uint8_t kk[57];
+    cl_key_schedule(kk, cw);
+
+    /* ib[n + 1] is the all-zero block chained into the last one */
+    uint8_t ib[TS_BODY_SIZE / 8 + 2][8];
+    uint8_t block[8], st[8];
+
+    memset(ib[n + 1], 0, sizeof(ib[0]));
+    for (unsigned int i = n; i > 0; i--)
+    {
+        for (unsigned int j = 0; j < 8; j++)
+            block[j] = data[8 * (i - 1) + j] ^ ib[i + 1][j];
+
+        cl_block_encrypt(kk, block, ib[i]);
+    }
+
+    cl_stream_t c;
+    cl_stream(&c, true, cw, ib[1], NULL);
+    memcpy(data, ib[1], sizeof(ib[1]));
+
+    for (unsigned int i = 2; i <= n; i++)
+    {
+        cl_stream(&c, false, cw, NULL, st);
+        for (unsigned int j = 0; j < 8; j++)
+            data[8 * (i - 1) + j] = ib[i][j] ^ st[j];
+    }
+
+    if (residue > 0)
+    {
+        cl_stream(&c, false, cw, NULL, st);
+        for (unsigned int j = 0; j < residue; j++)
+            data[len - residue + j] ^= st[j];
+    }
+}
+
+static
+void fill_plain(uint8_t *buf, size_t idx, unsigned int len)
+{
+    for (unsigned int i = 0; i < len; i++)
+        buf[i] = (uint8_t)(i * 13 + idx * 7);
+}
+
+/* reference code against fixed vectors */
+START_TEST(test_vectors)
+{
+    csa_key_t *const key = au_csa_key_init();
+
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(test_data); i++)
+    {
+        const csa_test_t *const test = &test_data[i];
+        uint8_t plain[TS_BODY_SIZE];
+        uint8_t buf[TS_BODY_SIZE];
+
+        au_csa_key_set(key, test->cw);
+
+        fill_plain(plain, i, test->len);
+        memcpy(buf, plain, test->len);
+
+        au_csa_encrypt(key, buf, test->len);
+        ck_assert(!memcmp(buf, test->data, test->len));
+
+        au_csa_decrypt(key, buf, test->len);
+        ck_assert(!memcmp(buf, plain, test->len));
+    }
+
+    au_csa_key_destroy(key);
+}
+END_TEST
+
+/* second implementation against the same vectors */
+START_TEST(classic_vectors)
+{
+    for (size_t i = 0; i < ASC_ARRAY_SIZE(test_data); i++)
+    {
+        const csa_test_t *const test = &test_data[i];
+        uint8_t plain[TS_BODY_SIZE];
+        uint8_t buf[TS_BODY_SIZE];
+
+        fill_plain(plain, i, test->len);
+        memcpy(buf, plain, test->len);
+
+        cl_encrypt(test->cw, buf, test->len);
+        ck_assert(!memcmp(buf, test->data, test->len));
+
+        cl_decrypt(test->cw, buf, test->len);
+        ck_assert(!memcmp(buf, plain, test->len));
+    }
+}
+END_TEST
+
+/* reference code against the second implementation */
+#define ITERATIONS 50
+#define CLASSIC_ITERATIONS 2000
+
+START_TEST(classic_random)
+{
+    asc_srand();
+
+    csa_key_t *const key = au_csa_key_init();
+
+    for (size_t i = 0; i < CLASSIC_ITERATIONS; i++)
+    {
+        uint8_t cw[CSA_CW_SIZE];
+        for (size_t j = 0; j < sizeof(cw); j++)
+            cw[j] = rand();
+
+        au_csa_key_set(key, cw);
+
+        uint8_t buf[TS_BODY_SIZE];
+        uint8_t ref[TS_BODY_SIZE];
+        const unsigned int len = rand() % (TS_BODY_SIZE + 1);
+
+        for (size_t j = 0; j < len; j++)
+            buf[j] = rand();
+
+        memcpy(ref, buf, len);
+
+        if (i % 2 == 0)
+        {
+            au_csa_encrypt(key, buf, len);
+            cl_encrypt(cw, ref, len);
+        }
+        else
+        {
+            au_csa_decrypt(key, buf, len);
+            cl_decrypt(cw, ref, len);
+        }
+
+        ck_assert(!memcmp(buf, ref, len));
+    }
+
+    au_csa_key_destroy(key);
+}
+END_TEST
+
+/* every engine against fixed vectors, in all batch slots */
+START_TEST(engine_vectors)
+{
+    size_t cnt = 0;
+    const csa_engine_t *const list = au_csa_engine_list(&cnt);
+    ck_assert(cnt > 0);
+
+    csa_key_t *const key = au_csa_key_init();
+
+    for (size_t e = 0; e < cnt; e++)
+    {
+        const csa_engine_t *const engine = &list[e];
+        const size_t size = engine->batch_size;
+
+        uint8_t *const buf = ASC_ALLOC(size * TS_BODY_SIZE, uint8_t);
+        csa_batch_t *const batch = ASC_ALLOC(size + 1, csa_batch_t);
+
+        for (size_t i = 0; i < ASC_ARRAY_SIZE(test_data); i++)
+        {
+            const csa_test_t *const test = &test_data[i];
+            au_csa_key_set(key, test->cw);
+
+            for (size_t j = 0; j < size; j++)
+            {
+                batch[j].data = &buf[j * TS_BODY_SIZE];
+                batch[j].len = test->len;
+                fill_plain(batch[j].data, i, test->len);
+            }
+
+            engine->encrypt(key, batch, TS_BODY_SIZE);
+            for (size_t j = 0; j < size; j++)
+                ck_assert(!memcmp(batch[j].data, test->data, test->len));
+
+            engine->decrypt(key, batch, TS_BODY_SIZE);
+            for (size_t j = 0; j < size; j++)
+            {
+                uint8_t plain[TS_BODY_SIZE];
+                fill_plain(plain, i, test->len);
+                ck_assert(!memcmp(batch[j].data, plain, test->len));
+            }
+        }
+
+        free(batch);
+        free(buf);
+    }
+
+    au_csa_key_destroy(key);
+}
+END_TEST
+
+/*
+ * Run one random partial batch through an engine and check it against
+ * a single packet implementation. Slots past the terminator must stay
+ * untouched.
+ */
+typedef void (*csa_single_func_t)(const uint8_t *cw, uint8_t *data
+                                  , unsigned int len, bool enc);
+
+static
+void random_batch(const csa_engine_t *engine, csa_single_func_t single
+                  , bool enc)
+{
+    const size_t size = engine->batch_size;
+
+    uint8_t *const buf = ASC_ALLOC(size * TS_BODY_SIZE, uint8_t);
+    uint8_t *const ref = ASC_ALLOC(size * TS_BODY_SIZE, uint8_t);
+    csa_batch_t *const batch = ASC_ALLOC(size + 1, csa_batch_t);
+    csa_key_t *const key = au_csa_key_init();
+
+    uint8_t cw[CSA_CW_SIZE];
+    for (size_t j = 0; j < sizeof(cw); j++)
+        cw[j] = rand();
+
+    au_csa_key_set(key, cw);
+
+    for (size_t j = 0; j < size * TS_BODY_SIZE; j++)
+        buf[j] = rand();
+
+    memcpy(ref, buf, size * TS_BODY_SIZE);
+
+    /* payloads shorter than a block are left as is */
+    const size_t used = 1 + (rand() % size);
+    for (size_t j = 0; j < used; j++)
+    {
+        batch[j].data = &buf[j * TS_BODY_SIZE];
+        batch[j].len = rand() % (TS_BODY_SIZE + 1);
+    }
+    batch[used].data = NULL;
+
+    if (enc)
+        engine->encrypt(key, batch, TS_BODY_SIZE);
+    else
+        engine->decrypt(key, batch, TS_BODY_SIZE);
+
+    for (size_t j = 0; j < used; j++)
+        single(cw, &ref[j * TS_BODY_SIZE], batch[j].len, enc);
+
+    ck_assert_msg(!memcmp(buf, ref, size * TS_BODY_SIZE)
+                  , "%s: %s output mismatch", engine->name
+                  , enc ? "encrypt" : "decrypt");
+
+    au_csa_key_destroy(key);
+    free(batch);
+    free(ref);
+    free(buf);
+}
+
+static
+void single_classic(const uint8_t *cw, uint8_t *data, unsigned int len
+                    , bool enc)
+{
+    if (enc)
+        cl_encrypt(cw, data, len);
+    else
+        cl_decrypt(cw, data, len);
+}
+
+/* partial batches of random length packets against the second code */
+START_TEST(engine_random)
+{
+    asc_srand();
+
+    size_t cnt = 0;
+    const csa_engine_t *const list = au_csa_engine_list(&cnt);
+
+    for (size_t e = 0; e < cnt; e++)
+    {
+        for (size_t i = 0; i < ITERATIONS; i++)
+            random_batch(&list[e], single_classic, (i % 2 == 0));
+    }
+}
+END_TEST
+
+#ifdef HAVE_DVBCSA
+static
+void single_dvbcsa(const uint8_t *cw, uint8_t *data, unsigned int len
+                   , bool enc)
+{
+    struct dvbcsa_key_s *const key = dvbcsa_key_alloc();
+    ck_assert(key != NULL);
+
+    dvbcsa_key_set(cw, key);
+    if (enc)
+        dvbcsa_encrypt(key, data, len);
+    else
+        dvbcsa_decrypt(key, data, len);
+
+    dvbcsa_key_free(key);
+}
+
+/* every engine, and the reference code, against libdvbcsa */
+START_TEST(engine_dvbcsa)
+{
+    asc_srand();
+
+    csa_key_t *const key = au_csa_key_init();
+
+    for (size_t i = 0; i < CLASSIC_ITERATIONS; i++)
+    {
+        uint8_t cw[CSA_CW_SIZE];
+        for (size_t j = 0; j < sizeof(cw); j++)
+            cw[j] = rand();
+
+        au_csa_key_set(key, cw);
+
+        uint8_t buf[TS_BODY_SIZE];
+        uint8_t ref[TS_BODY_SIZE];
+        const unsigned int len = rand() % (TS_BODY_SIZE + 1);
+
+        for (size_t j = 0; j < len; j++)
+            buf[j] = rand();
+
+        memcpy(ref, buf, len);
+
+        const bool enc = (i % 2 == 0);
+        if (enc)
+            au_csa_encrypt(key, buf, len);
+        else
+            au_csa_decrypt(key, buf, len);
+
+        single_dvbcsa(cw, ref, len, enc);
+        ck_assert_msg(!memcmp(buf, ref, len)
+                      , "reference: %s output mismatch"
+                      , enc ? "encrypt" : "decrypt");
+    }
+
+    au_csa_key_destroy(key);
+
+    size_t cnt = 0;
+    const csa_engine_t *const list = au_csa_engine_list(&cnt);
+
+    for (size_t e = 0; e < cnt; e++)
+    {
+        for (size_t i = 0; i < ITERATIONS; i++)
+            random_batch(&list[e], single_dvbcsa, (i % 2 == 0));
+    }
+
+    /* default engine is libdvbcsa's own batch code */
+    for (size_t i = 0; i < ITERATIONS; i++)
+        random_batch(au_csa_engine(), single_classic, (i % 2 == 0));
+}
+END_TEST
+#endif /* HAVE_DVBCSA */
+
+/* au_csa_engine() returns the default engine */
+START_TEST(engine_select)
+{
+    size_t cnt = 0;
+    const csa_engine_t *const list = au_csa_engine_list(&cnt);
+    const csa_engine_t *const engine = au_csa_engine();
+
+    ck_assert(cnt > 0);
+
+#ifdef HAVE_DVBCSA
+    ck_assert(!strcmp(engine->name, "libdvbcsa"));
+    ck_assert(engine->batch_size == dvbcsa_bs_batch_size());
+#else /* HAVE_DVBCSA */
+    /* widest built-in engine */
+    ck_assert(engine == &list[0]);
+#endif /* !HAVE_DVBCSA */
+
+    for (size_t i = 1; i < cnt; i++)
+        ck_assert(list[i].batch_size < list[i - 1].batch_size);
+
+    ck_assert(!strcmp(list[cnt - 1].name, "generic"));
+}
+END_TEST
+
+Suite *utils_csa(void)
+{
+    Suite *const s = suite_create("utils/csa");
+
+    TCase *const tc = tcase_create("default");
+    tcase_add_test(tc, test_vectors);
+    tcase_add_test(tc, classic_vectors);
+    tcase_add_test(tc, classic_random);
+    tcase_add_test(tc, engine_vectors);
+    tcase_add_test(tc, engine_random);
+#ifdef HAVE_DVBCSA
+    tcase_add_test(tc, engine_dvbcsa);
+#endif /* HAVE_DVBCSA */
+    tcase_add_test(tc, engine_select);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
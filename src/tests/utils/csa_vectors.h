@@ -0,0 +1,121 @@
+/*
+ * Astra Unit Tests
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _CSA_VECTORS_H_
+#define _CSA_VECTORS_H_ 1
+
+/*
+ * Payload byte n of vector i is (n * 13 + i * 7) before encryption.
+ * Ciphertext was produced by the scalar reference code; the separate
+ * classic implementation in csa.c produces the same output.
+ */
+static const csa_test_t test_data[] =
+{
+    {
+        .cw = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        .len = 184,
+        .data =
+        {
+            0x5e, 0x06, 0x2e, 0x41, 0x03, 0x79, 0x80, 0x9e,
+            0xcb, 0x88, 0x1d, 0xdc, 0x75, 0x60, 0x7a, 0x3d,
+            0x54, 0xc7, 0xca, 0xa9, 0x1f, 0x39, 0x40, 0xa6,
+            0x58, 0xa4, 0xcb, 0x64, 0x93, 0x51, 0x6e, 0x83,
+            0x67, 0x9b, 0x31, 0x44, 0xeb, 0xe3, 0x04, 0xfd,
+            0xb0, 0x07, 0xbd, 0x38, 0x9d, 0x04, 0xd0, 0x24,
+            0x3f, 0x3d, 0x12, 0xb5, 0x10, 0xd7, 0xe4, 0x66,
+            0x1e, 0x9d, 0xa6, 0x3f, 0x74, 0x28, 0x4d, 0x1d,
+            0xdf, 0xc5, 0x04, 0x6a, 0x8d, 0x70, 0xda, 0xf6,
+            0x66, 0x2d, 0x35, 0x57, 0x0c, 0xf7, 0xa7, 0xd1,
+            0x23, 0x62, 0x84, 0x13, 0x81, 0x1f, 0x4e, 0xc2,
+            0xb0, 0x8a, 0x9d, 0x71, 0x48, 0x67, 0xaa, 0x75,
+            0x59, 0xfa, 0xa2, 0xfd, 0xb3, 0x2a, 0xf4, 0x11,
+            0x3b, 0x03, 0x6c, 0x0f, 0x30, 0xa7, 0x85, 0x5a,
+            0xc7, 0x07, 0xfb, 0xdf, 0xcb, 0x31, 0x4c, 0x11,
+            0xf8, 0xa8, 0x68, 0x90, 0xf1, 0xed, 0xf3, 0x5b,
+            0x81, 0x59, 0x7f, 0x7a, 0x23, 0x49, 0x03, 0x7c,
+            0xf4, 0x56, 0x68, 0x78, 0xa0, 0x55, 0x9a, 0xa4,
+            0x2e, 0xda, 0xde, 0x77, 0x55, 0xc7, 0xbe, 0x6e,
+            0x70, 0x9d, 0xee, 0x77, 0xe5, 0xfb, 0xf6, 0x8e,
+            0x44, 0xa1, 0x7d, 0xcf, 0x81, 0xa1, 0x1c, 0x39,
+            0xf2, 0x42, 0x27, 0xac, 0x1d, 0xc4, 0x84, 0xe7,
+            0xc9, 0x40, 0x09, 0xab, 0xc1, 0xe8, 0xea, 0x71,
+        },
+    },
+    {
+        .cw = { 0x11, 0x22, 0x33, 0x66, 0x44, 0x55, 0x66, 0xff },
+        .len = 184,
+        .data =
+        {
+            0xca, 0xe9, 0x03, 0xb0, 0xd0, 0x22, 0x3b, 0xad,
+            0x7d, 0xe1, 0xae, 0xcd, 0x4b, 0xa2, 0xfe, 0x72,
+            0xeb, 0xe7, 0x50, 0x7a, 0x6c, 0xe3, 0xa7, 0x89,
+            0x7b, 0x7a, 0x0e, 0x5c, 0x52, 0x81, 0xc0, 0xb9,
+            0xd5, 0xc7, 0xb2, 0xbe, 0xce, 0xa3, 0x49, 0x06,
+            0xaf, 0xfd, 0xda, 0x43, 0x4d, 0x6d, 0xd0, 0xca,
+            0x79, 0xd9, 0xb1, 0x48, 0x76, 0xd4, 0xc2, 0x8b,
+            0x42, 0x1b, 0xa0, 0x77, 0x3b, 0xb4, 0xd2, 0x5c,
+            0x10, 0x19, 0x39, 0x53, 0xcf, 0x56, 0x9b, 0xe0,
+            0x72, 0x0f, 0xc5, 0xc3, 0x7a, 0x43, 0x0f, 0x5f,
+            0x1a, 0x63, 0x25, 0xfa, 0x50, 0x40, 0x37, 0x8a,
+            0x92, 0x73, 0x21, 0x37, 0x8c, 0xae, 0x6c, 0xeb,
+            0x05, 0xc9, 0x10, 0xbb, 0xbf, 0x48, 0xf9, 0x3a,
+            0xaf, 0xae, 0xd3, 0x81, 0x89, 0x43, 0xab, 0x01,
+            0x02, 0x21, 0x7a, 0x75, 0x41, 0x67, 0xce, 0x4d,
+            0x46, 0x46, 0x36, 0x34, 0xb6, 0x7d, 0x30, 0x06,
+            0x4c, 0x2d, 0xf9, 0xf5, 0x3a, 0xef, 0xed, 0x16,
+            0xac, 0xf4, 0x08, 0x2d, 0x43, 0xbe, 0xb2, 0x6f,
+            0xf4, 0x88, 0x2c, 0xea, 0x26, 0xe2, 0x3a, 0x60,
+            0x80, 0x9a, 0x41, 0x6d, 0x23, 0x24, 0x0a, 0x56,
+            0x86, 0x63, 0x75, 0x48, 0xd9, 0x12, 0xc6, 0x61,
+            0x54, 0xa6, 0x3f, 0x17, 0x13, 0x26, 0x50, 0xac,
+            0xb3, 0x2e, 0x3d, 0x0c, 0x3a, 0xdf, 0x9e, 0x29,
+        },
+    },
+    {
+        .cw = { 0x12, 0x34, 0x56, 0xbc, 0x78, 0x9a, 0xbc, 0xce },
+        .len = 101,
+        .data =
+        {
+            0xa8, 0xdb, 0xbc, 0xfc, 0x90, 0xea, 0x47, 0x80,
+            0x70, 0x7f, 0x37, 0x3a, 0x33, 0xa5, 0xae, 0x49,
+            0xef, 0xa7, 0xff, 0xc9, 0x8e, 0x20, 0xb4, 0xb8,
+            0xdc, 0x72, 0x6d, 0x43, 0x10, 0xd7, 0xe4, 0xb9,
+            0xa7, 0x9f, 0x98, 0x6d, 0xe8, 0xb3, 0xb1, 0x1a,
+            0xae, 0x32, 0xa2, 0x5d, 0x5e, 0x2b, 0x45, 0x9a,
+            0xc5, 0x3b, 0xe5, 0xde, 0x8a, 0xd5, 0x4d, 0xa9,
+            0xf2, 0x75, 0xff, 0xdc, 0x94, 0x34, 0xe5, 0xb8,
+            0x8d, 0xc5, 0x62, 0x7f, 0xfc, 0x12, 0xa7, 0x07,
+            0x1d, 0xff, 0x69, 0xee, 0xd1, 0x29, 0x12, 0x79,
+            0x33, 0x83, 0xd2, 0x41, 0x51, 0x18, 0x93, 0xfb,
+            0x57, 0xd8, 0xa5, 0xbe, 0xb8, 0xc6, 0x28, 0xd3,
+            0x58, 0x45, 0xa9, 0xa2, 0xa5,
+        },
+    },
+    {
+        .cw = { 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff, 0xff, 0xfd },
+        .len = 15,
+        .data =
+        {
+            0x63, 0x87, 0xa4, 0xbd, 0x26, 0x20, 0x36, 0x5c,
+            0xb3, 0xb4, 0xaf, 0xff, 0xeb, 0x75, 0xf7,
+        },
+    },
+};
+
+#endif /* _CSA_VECTORS_H_ */